@@ -62,6 +62,7 @@ class DrawTarget;
 class DrawEventRecorder;
 class FilterNode;
 class LogForwarder;
+class WorkerPool;
 
 struct NativeSurface {
   NativeSurfaceType mType;
@@ -637,6 +638,7 @@ protected:
 };
 
 class DrawTargetCapture;
+struct TileSet;
 
 /** This is the main class used for all the drawing. It is created through the
  * factory and accepts drawing commands. The results of drawing to a target
@@ -736,6 +738,32 @@ public:
                                      Float aSigma,
                                      CompositionOp aOperator) = 0;
 
+  /**
+   * Draw the blurred shadow of a rectangle, rounded by aCornerRadii if given,
+   * in aColor. The result matches blurring the whole shape with AlphaBoxBlur,
+   * within AlphaBoxBlur::kMaxDownscaledError for large sigmas, but only its
+   * corners and a slice of its edges are blurred and stretched along the box,
+   * so the cost depends on the blur and corner radii rather than on the size
+   * of the box. The blurred pieces are kept in the cache of
+   * Factory::SetShadowMaskCacheSize.
+   *
+   * aRect is rounded to whole units and the shadow is drawn in pieces aligned
+   * to them, so this is meant for transforms that map user space units to
+   * pixels, like DrawSurfaceWithShadow.
+   *
+   * @param aRect Rectangle casting the shadow
+   * @param aCornerRadii Null, or the radii of the top-left, top-right,
+   *                     bottom-right and bottom-left corners
+   * @param aColor Color of the shadow
+   * @param aSigma Sigma used for the gaussian filter kernel
+   * @param aOptions Options used for drawing the shadow
+   */
+  virtual void DrawBoxShadow(const Rect &aRect,
+                             const Size *aCornerRadii,
+                             const Color &aColor,
+                             Float aSigma,
+                             const DrawOptions &aOptions = DrawOptions());
+
   /**
    * Clear a rectangle on the draw target to transparent black. This will
    * respect the clipping region and transform.
@@ -1062,6 +1090,29 @@ protected:
 
 class DrawTargetCapture : public DrawTarget
 {
+public:
+  /**
+   * Discards all captured commands so the capture can be recorded again,
+   * for example for the next frame. The memory used to store the commands
+   * is kept and reused.
+   */
+  virtual void ClearCommands() = 0;
+
+  /**
+   * Removes commands that have no effect on the result: draws outside the
+   * clip or the target, draws that later opaque draws completely cover, and
+   * transform and clip changes that no draw depends on. Returns the number
+   * of commands that were removed.
+   */
+  virtual uint32_t OptimizeCommands() = 0;
+
+  /**
+   * Replays the commands onto a set of tiles. Every tile only gets the
+   * drawing commands whose device space bounds intersect it, along with all
+   * transform and clip changes. The tiles are drawn one after the other on
+   * the calling thread, and their transforms are left as they were.
+   */
+  virtual void ReplayToTiles(const TileSet &aTiles) = 0;
 };
 
 class DrawEventRecorder : public RefCounted<DrawEventRecorder>
@@ -1083,10 +1134,109 @@ struct TileSet
   size_t mTileCount;
 };
 
+/**
+ * Counters for the caches the Factory configures, see
+ * Factory::SetSoftwareFilterCacheSize, SetShadowMaskCacheSize,
+ * SetScaledSurfaceCacheSize and SetMipmapCacheSize. The mipmap cache has one
+ * entry for every surface that has levels.
+ */
+struct CacheStats
+{
+  uint64_t mHits;
+  uint64_t mMisses;
+  uint64_t mEvictions;
+  size_t mEntries;
+  size_t mBytes;
+};
+
+/**
+ * Per operation counters collected by DrawTargets created through
+ * Factory::CreateInstrumentedDrawTarget. Several DrawTargets may share one
+ * instance, as long as they're all used on the same thread.
+ */
+class GFX2D_API DrawTargetStats : public RefCounted<DrawTargetStats>
+{
+public:
+  MOZ_DECLARE_REFCOUNTED_TYPENAME(DrawTargetStats)
+
+  enum Operation {
+    FILL_RECT,
+    STROKE_RECT,
+    STROKE_LINE,
+    STROKE,
+    FILL,
+    FILL_GLYPHS,
+    MASK,
+    MASK_SURFACE,
+    DRAW_SURFACE,
+    DRAW_SURFACE_WITH_SHADOW,
+    DRAW_FILTER,
+    CLEAR_RECT,
+    COPY_SURFACE,
+    COPY_RECT,
+    PUSH_CLIP,
+    PUSH_CLIP_RECT,
+    POP_CLIP,
+    SNAPSHOT,
+    FLUSH,
+    CREATE_SOURCE_SURFACE_FROM_DATA,
+    OPTIMIZE_SOURCE_SURFACE,
+    CREATE_SIMILAR_DRAW_TARGET,
+    OPERATION_COUNT
+  };
+
+  /**
+   * mNanoseconds is the time spent inside the wrapped DrawTarget's method,
+   * backends that defer their work spend it elsewhere. mPixels is the area of
+   * the device space bounds of each operation within the bounds of the clip,
+   * or of the DrawTarget for CopySurface and CopyRect, which ignore the clip.
+   * That makes it an upper bound on the pixels touched. Mask counts the whole
+   * clip, since its patterns may extend indefinitely. It isn't known for
+   * FillGlyphs.
+   * mAllocatedBytes counts the pixel data of surfaces and DrawTargets created
+   * by the operation.
+   */
+  struct Counters {
+    uint64_t mCalls;
+    uint64_t mNanoseconds;
+    uint64_t mPixels;
+    uint64_t mAllocatedBytes;
+  };
+
+  DrawTargetStats() { Reset(); }
+
+  const Counters& Get(Operation aOperation) const { return mCounters[aOperation]; }
+
+  void Record(Operation aOperation, uint64_t aNanoseconds, uint64_t aPixels,
+              uint64_t aAllocatedBytes)
+  {
+    Counters& counters = mCounters[aOperation];
+    counters.mCalls++;
+    counters.mNanoseconds += aNanoseconds;
+    counters.mPixels += aPixels;
+    counters.mAllocatedBytes += aAllocatedBytes;
+  }
+
+  void Reset();
+
+  static const char* GetOperationName(Operation aOperation);
+
+  /**
+   * Returns the counters of all operations that were called at least once as
+   * a JSON object keyed by the name of the DrawTarget method, for example
+   * {"FillRect": {"calls": 2, "timeMs": 0.012, "pixels": 800, "allocatedBytes": 0}}.
+   */
+  std::string ToJSON() const;
+
+private:
+  Counters mCounters[OPERATION_COUNT];
+};
+
 class GFX2D_API Factory
 {
 public:
   static bool HasSSE2();
+  static bool HasAVX2();
 
   /** Make sure that the given dimensions don't overflow a 32-bit signed int
    * using 4 bytes per pixel; optionally, make sure that either dimension
@@ -1101,6 +1251,14 @@ public:
 
   static TemporaryRef<DrawTarget>
     CreateRecordingDrawTarget(DrawEventRecorder *aRecorder, DrawTarget *aDT);
+
+  /**
+   * Wraps aDT in a DrawTarget that counts and times every drawing operation
+   * before forwarding it, and adds the results to aStats. DrawTargets created
+   * through CreateSimilarDrawTarget on the result are instrumented as well.
+   */
+  static TemporaryRef<DrawTarget>
+    CreateInstrumentedDrawTarget(DrawTarget *aDT, DrawTargetStats *aStats);
      
   static TemporaryRef<DrawTarget>
     CreateDrawTargetForData(BackendType aBackend, unsigned char* aData, const IntSize &aSize, int32_t aStride, SurfaceFormat aFormat);
@@ -1157,8 +1315,24 @@ public:
     CreateWrappingDataSourceSurface(uint8_t *aData, int32_t aStride,
                                     const IntSize &aSize, SurfaceFormat aFormat);
 
+  /**
+   * This creates an event recorder that writes to aFilename. With aCompress
+   * the recording is compressed as it's written, which costs some CPU time
+   * but makes recordings with a lot of surface data much smaller.
+   */
   static TemporaryRef<DrawEventRecorder>
-    CreateEventRecorderForFile(const char *aFilename);
+    CreateEventRecorderForFile(const char *aFilename, bool aCompress = false);
+
+  /**
+   * This creates an event recorder that records into a ring buffer of
+   * aCapacity bytes. If aFilename is given the buffer is written to that file
+   * on a background thread, otherwise the recorder only retains the most
+   * recent events (see DrawEventRecorderMemory). aCompress applies to
+   * whatever is written to a file.
+   */
+  static TemporaryRef<DrawEventRecorder>
+    CreateEventRecorderForMemory(size_t aCapacity, const char *aFilename = nullptr,
+                                 bool aCompress = false);
 
   static void SetGlobalEventRecorder(DrawEventRecorder *aRecorder);
 
@@ -1167,8 +1341,107 @@ public:
 
   static LogForwarder* GetLogForwarder() { return mLogForwarder; }
 
+  /**
+   * When aTileSize is positive, software filters whose output is larger than
+   * aTileSize x aTileSize pixels are evaluated and drawn in tiles of that
+   * size. This bounds the size of the intermediate surfaces at the cost of
+   * not caching filter output between draws. With aParallel the tiles are
+   * evaluated concurrently on the shared worker pool. The default tile size
+   * of 0 evaluates the whole filter output at once.
+   */
+  static void SetSoftwareFilterTiling(int32_t aTileSize, bool aParallel);
+
+  static int32_t GetSoftwareFilterTileSize() { return mSoftwareFilterTileSize; }
+
+  /**
+   * The pool software filter tiles are evaluated on, or null if they're
+   * evaluated on the drawing thread.
+   */
+  static WorkerPool* GetSoftwareFilterWorkerPool();
+
+  /**
+   * Sets the budget, in bytes, of a cache that keeps the output of software
+   * filter nodes across draws. Entries are keyed by a hash of the filter's
+   * type, attributes and inputs, so a filter graph that returns to an earlier
+   * state, or an identical graph built elsewhere, reuses earlier output. Least
+   * recently used entries are evicted once the budget is exceeded. Input
+   * surfaces must not be modified after they've been set on a filter.
+   * The cache is only used on the thread that last called this, filter tiles
+   * evaluated on worker threads bypass it. The default of 0 disables it;
+   * changing the size empties the cache and resets its counters.
+   */
+  static void SetSoftwareFilterCacheSize(size_t aMaxBytes);
+
+  static CacheStats GetSoftwareFilterCacheStats();
+
+  /**
+   * Sets the budget, in bytes, of a cache of the blurred alpha masks the Cairo
+   * and Skia backends draw in DrawSurfaceWithShadow. Masks are keyed by the
+   * source surface, the standard deviation and the mask's extents, so a
+   * surface redrawn with the same shadow every frame is only blurred once.
+   * The templates of DrawTarget::DrawBoxShadow, keyed by corner radii and
+   * standard deviation, are kept here too.
+   * Least recently used masks are evicted once the budget is exceeded. The
+   * cache is only used on the thread that last called this. The default of 0
+   * disables it; changing the size empties the cache and resets its counters.
+   */
+  static void SetShadowMaskCacheSize(size_t aMaxBytes);
+
+  static CacheStats GetShadowMaskCacheStats();
+
+  /**
+   * Drops the cached shadow masks of aSurface. This must be called after
+   * changing the contents of a surface that has been drawn with a shadow,
+   * the cache can't tell otherwise.
+   */
+  static void InvalidateShadowMasks(SourceSurface* aSurface);
+
+  /**
+   * Sets the budget, in bytes, of a cache of the images ScaleSurface and
+   * ScaleSurfaceAsync return. Results are keyed by the source surface and the
+   * destination size, so an image drawn at the same reduced size every frame
+   * is only scaled once. Least recently used results are evicted once the
+   * budget is exceeded. The cache is only used on the thread that last called
+   * this. The default of 0 disables it; changing the size empties the cache
+   * and resets its counters.
+   */
+  static void SetScaledSurfaceCacheSize(size_t aMaxBytes);
+
+  static CacheStats GetScaledSurfaceCacheStats();
+
+  /**
+   * Drops the cached scaled copies of aSurface. This must be called after
+   * changing the contents of a surface that has been scaled.
+   */
+  static void InvalidateScaledSurfaces(SourceSurface* aSurface);
+
+  /**
+   * Sets the budget, in bytes, of the mipmap levels the Cairo and Skia
+   * backends build for surfaces that DrawSurface or a SurfacePattern draws
+   * minified by a factor of two or more. The levels are kept while the
+   * surface lives and reused every time it is drawn that small, so
+   * thumbnails of large images aren't downsampled again every frame. The
+   * levels of the least recently drawn surfaces are dropped once the budget
+   * is exceeded.
+   * The cache is only used on the thread that last called this. Surfaces
+   * that have levels may be released on any thread, their levels are dropped
+   * the next time the cache is used. The default of 0 disables it; changing
+   * the size empties the cache and resets its counters.
+   */
+  static void SetMipmapCacheSize(size_t aMaxBytes);
+
+  static CacheStats GetMipmapCacheStats();
+
+  /**
+   * Drops the mipmap levels of aSurface. This must be called after changing
+   * the contents of a surface that has been drawn minified.
+   */
+  static void InvalidateMipmaps(SourceSurface* aSurface);
+
 private:
   static LogForwarder* mLogForwarder;
+  static int32_t mSoftwareFilterTileSize;
+  static bool mSoftwareFilterTilesInParallel;
 public:
 
 #ifdef USE_SKIA_GPU
@@ -1192,8 +1465,14 @@ public:
    * drawing is distributed over number of tiles which may each hold an
    * individual offset. The tiles in the set must each have the same backend
    * and format.
+   *
+   * When aQueuePerTile is true, drawing commands are queued per tile and
+   * replayed one tile at a time on the calling thread when the DrawTarget is
+   * flushed or snapshotted. The contents of the individual tiles are only
+   * defined after one of those calls.
    */
-  static TemporaryRef<DrawTarget> CreateTiledDrawTarget(const TileSet& aTileSet);
+  static TemporaryRef<DrawTarget> CreateTiledDrawTarget(const TileSet& aTileSet,
+                                                        bool aQueuePerTile = false);
 
 #ifdef XP_MACOSX
   static TemporaryRef<DrawTarget> CreateDrawTargetForCairoCGContext(CGContextRef cg, const IntSize& aSize);
@@ -9,6 +9,7 @@
 #include <algorithm>
 #include <math.h>
 #include <string.h>
+#include <vector>
 
 #include "mozilla/CheckedInt.h"
 #include "mozilla/Constants.h"
@@ -17,6 +18,7 @@
 #include "2D.h"
 #include "DataSurfaceHelpers.h"
 #include "Tools.h"
+#include "WorkerPool.h"
 
 using namespace std;
 
@@ -32,8 +34,8 @@ namespace gfx {
  * @param aRightLobe The number of pixels to blend on the right.
  * @param aWidth The number of columns in the buffers.
  * @param aRows The number of rows in the buffers.
+ * @param aStride The stride of the buffers.
  * @param aSkipRect An area to skip blurring in.
- * XXX shouldn't we pass stride in separately here?
  */
 static void
 BoxBlurHorizontal(unsigned char* aInput,
@@ -42,6 +44,7 @@ BoxBlurHorizontal(unsigned char* aInput,
                   int32_t aRightLobe,
                   int32_t aWidth,
                   int32_t aRows,
+                  int32_t aStride,
                   const IntRect& aSkipRect)
 {
     MOZ_ASSERT(aWidth > 0);
@@ -50,7 +53,9 @@ BoxBlurHorizontal(unsigned char* aInput,
     bool skipRectCoversWholeRow = 0 >= aSkipRect.x &&
                                   aWidth <= aSkipRect.XMost();
     if (boxSize == 1) {
-        memcpy(aOutput, aInput, aWidth*aRows);
+        for (int32_t y = 0; y < aRows; y++) {
+            memcpy(aOutput + aStride * y, aInput + aStride * y, aWidth);
+        }
         return;
     }
     uint32_t reciprocal = uint32_t((uint64_t(1) << 32) / boxSize);
@@ -73,7 +78,7 @@ BoxBlurHorizontal(unsigned char* aInput,
             // valid position to clamp to.
             pos = max(pos, 0);
             pos = min(pos, aWidth - 1);
-            alphaSum += aInput[aWidth * y + pos];
+            alphaSum += aInput[aStride * y + pos];
         }
         for (int32_t x = 0; x < aWidth; x++) {
             // Check whether we are within the skip rect. If so, go
@@ -93,17 +98,17 @@ BoxBlurHorizontal(unsigned char* aInput,
                     // valid position to clamp to.
                     pos = max(pos, 0);
                     pos = min(pos, aWidth - 1);
-                    alphaSum += aInput[aWidth * y + pos];
+                    alphaSum += aInput[aStride * y + pos];
                 }
             }
             int32_t tmp = x - aLeftLobe;
             int32_t last = max(tmp, 0);
             int32_t next = min(tmp + boxSize, aWidth - 1);
 
-            aOutput[aWidth * y + x] = (uint64_t(alphaSum) * reciprocal) >> 32;
+            aOutput[aStride * y + x] = (uint64_t(alphaSum) * reciprocal) >> 32;
 
-            alphaSum += aInput[aWidth * y + next] -
-                        aInput[aWidth * y + last];
+            alphaSum += aInput[aStride * y + next] -
+                        aInput[aStride * y + last];
         }
     }
 }
@@ -111,7 +116,6 @@ BoxBlurHorizontal(unsigned char* aInput,
 /**
  * Identical to BoxBlurHorizontal, except it blurs top and bottom instead of
  * left and right.
- * XXX shouldn't we pass stride in separately here?
  */
 static void
 BoxBlurVertical(unsigned char* aInput,
@@ -120,6 +124,7 @@ BoxBlurVertical(unsigned char* aInput,
                 int32_t aBottomLobe,
                 int32_t aWidth,
                 int32_t aRows,
+                int32_t aStride,
                 const IntRect& aSkipRect)
 {
     MOZ_ASSERT(aRows > 0);
@@ -128,7 +133,9 @@ BoxBlurVertical(unsigned char* aInput,
     bool skipRectCoversWholeColumn = 0 >= aSkipRect.y &&
                                      aRows <= aSkipRect.YMost();
     if (boxSize == 1) {
-        memcpy(aOutput, aInput, aWidth*aRows);
+        for (int32_t y = 0; y < aRows; y++) {
+            memcpy(aOutput + aStride * y, aInput + aStride * y, aWidth);
+        }
         return;
     }
     uint32_t reciprocal = uint32_t((uint64_t(1) << 32) / boxSize);
@@ -148,7 +155,7 @@ BoxBlurVertical(unsigned char* aInput,
             // valid position to clamp to.
             pos = max(pos, 0);
             pos = min(pos, aRows - 1);
-            alphaSum += aInput[aWidth * pos + x];
+            alphaSum += aInput[aStride * pos + x];
         }
         for (int32_t y = 0; y < aRows; y++) {
             if (inSkipRectX && y >= aSkipRect.y &&
@@ -164,22 +171,23 @@ BoxBlurVertical(unsigned char* aInput,
                     // valid position to clamp to.
                     pos = max(pos, 0);
                     pos = min(pos, aRows - 1);
-                    alphaSum += aInput[aWidth * pos + x];
+                    alphaSum += aInput[aStride * pos + x];
                 }
             }
             int32_t tmp = y - aTopLobe;
             int32_t last = max(tmp, 0);
             int32_t next = min(tmp + boxSize, aRows - 1);
 
-            aOutput[aWidth * y + x] = (uint64_t(alphaSum) * reciprocal) >> 32;
+            aOutput[aStride * y + x] = (uint64_t(alphaSum) * reciprocal) >> 32;
 
-            alphaSum += aInput[aWidth * next + x] -
-                        aInput[aWidth * last + x];
+            alphaSum += aInput[aStride * next + x] -
+                        aInput[aStride * last + x];
         }
     }
 }
 
-static void ComputeLobes(int32_t aRadius, int32_t aLobes[3][2])
+void
+AlphaBoxBlur::ComputeLobes(int32_t aRadius, int32_t aLobes[3][2])
 {
     int32_t major, minor, final;
 
@@ -401,7 +409,8 @@ AlphaBoxBlur::AlphaBoxBlur(const Rect& aRect,
     mSpreadRadius(),
     mBlurRadius(CalculateBlurRadius(Point(aSigmaX, aSigmaY))),
     mStride(aStride),
-    mSurfaceAllocationSize(0)
+    mSurfaceAllocationSize(0),
+    mStdDeviation(aSigmaX, aSigmaY)
 {
   IntRect intRect;
   if (aRect.ToIntRect(&intRect)) {
@@ -452,8 +461,38 @@ AlphaBoxBlur::GetSurfaceAllocationSize() const
   return mSurfaceAllocationSize;
 }
 
+// Surfaces with fewer pixels than this are always blurred on the calling
+// thread, splitting them up would cost more than it saves.
+static const int32_t kMinParallelBlurPixels = 256 * 256;
+
+// The minimum number of rows or columns in a strip handed to a worker.
+static const int32_t kMinBlurStripLength = 32;
+
+/**
+ * Returns how many strips aLength rows or columns should be split into, at
+ * most one per pool thread and each at least aMinLength long.
+ */
+static int32_t
+BlurStripCount(WorkerPool* aPool, int32_t aLength, int32_t aMinLength)
+{
+  if (!aPool) {
+    return 1;
+  }
+  return max<int32_t>(1, min<int32_t>(aPool->GetThreadCount(), aLength / aMinLength));
+}
+
+/**
+ * Returns the first row or column of strip aIndex out of aCount strips
+ * covering aLength rows or columns.
+ */
+static int32_t
+BlurStripStart(int32_t aLength, int32_t aCount, int32_t aIndex)
+{
+  return int32_t(int64_t(aLength) * aIndex / aCount);
+}
+
 void
-AlphaBoxBlur::Blur(uint8_t* aData)
+AlphaBoxBlur::Blur(uint8_t* aData, WorkerPool* aPool)
 {
   if (!aData) {
     return;
@@ -465,6 +504,10 @@ AlphaBoxBlur::Blur(uint8_t* aData)
 
     IntSize size = GetSize();
 
+    if (size.width * size.height < kMinParallelBlurPixels) {
+      aPool = nullptr;
+    }
+
     if (mSpreadRadius.width > 0 || mSpreadRadius.height > 0) {
       // No need to use CheckedInt here - we have validated it in the constructor.
       size_t szB = stride * size.height;
@@ -509,18 +552,37 @@ AlphaBoxBlur::Blur(uint8_t* aData)
       uint8_t* a = aData;
       uint8_t* b = tmpData;
       if (mBlurRadius.width > 0) {
-        BoxBlurHorizontal(a, b, horizontalLobes[0][0], horizontalLobes[0][1], stride, GetSize().height, mSkipRect);
-        BoxBlurHorizontal(b, a, horizontalLobes[1][0], horizontalLobes[1][1], stride, GetSize().height, mSkipRect);
-        BoxBlurHorizontal(a, b, horizontalLobes[2][0], horizontalLobes[2][1], stride, GetSize().height, mSkipRect);
+        // Rows are blurred independently of each other, so a strip of rows
+        // can go through all three passes without waiting for the others.
+        int32_t strips = BlurStripCount(aPool, size.height, kMinBlurStripLength);
+        ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+          int32_t y = BlurStripStart(size.height, strips, aStrip);
+          int32_t rows = BlurStripStart(size.height, strips, aStrip + 1) - y;
+          IntRect skipRect = mSkipRect - IntPoint(0, y);
+          uint8_t* stripA = a + stride * y;
+          uint8_t* stripB = b + stride * y;
+          BoxBlurHorizontal(stripA, stripB, horizontalLobes[0][0], horizontalLobes[0][1], stride, rows, stride, skipRect);
+          BoxBlurHorizontal(stripB, stripA, horizontalLobes[1][0], horizontalLobes[1][1], stride, rows, stride, skipRect);
+          BoxBlurHorizontal(stripA, stripB, horizontalLobes[2][0], horizontalLobes[2][1], stride, rows, stride, skipRect);
+        });
       } else {
         a = tmpData;
         b = aData;
       }
       // The result is in 'b' here.
       if (mBlurRadius.height > 0) {
-        BoxBlurVertical(b, a, verticalLobes[0][0], verticalLobes[0][1], stride, GetSize().height, mSkipRect);
-        BoxBlurVertical(a, b, verticalLobes[1][0], verticalLobes[1][1], stride, GetSize().height, mSkipRect);
-        BoxBlurVertical(b, a, verticalLobes[2][0], verticalLobes[2][1], stride, GetSize().height, mSkipRect);
+        // The same goes for strips of columns in the vertical passes.
+        int32_t strips = BlurStripCount(aPool, stride, kMinBlurStripLength);
+        ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+          int32_t x = BlurStripStart(stride, strips, aStrip);
+          int32_t columns = BlurStripStart(stride, strips, aStrip + 1) - x;
+          IntRect skipRect = mSkipRect - IntPoint(x, 0);
+          uint8_t* stripA = a + x;
+          uint8_t* stripB = b + x;
+          BoxBlurVertical(stripB, stripA, verticalLobes[0][0], verticalLobes[0][1], columns, size.height, stride, skipRect);
+          BoxBlurVertical(stripA, stripB, verticalLobes[1][0], verticalLobes[1][1], columns, size.height, stride, skipRect);
+          BoxBlurVertical(stripB, stripA, verticalLobes[2][0], verticalLobes[2][1], columns, size.height, stride, skipRect);
+        });
       } else {
         a = b;
       }
@@ -529,42 +591,230 @@ AlphaBoxBlur::Blur(uint8_t* aData)
         memcpy(aData, tmpData, szB);
       }
       delete [] tmpData;
-    } else {
-      size_t integralImageStride = GetAlignedStride<16>(integralImageSize.width * 4);
+      return;
+    }
+
+    int32_t halo = mBlurRadius.height;
+    int32_t bands = BlurStripCount(aPool, size.height, max(kMinBlurStripLength, 2 * halo));
+    if (bands == 1) {
+      BoxBlurIntegral(aData, size, stride, mSkipRect, horizontalLobes, verticalLobes);
+      return;
+    }
 
-      // We need to leave room for an additional 12 bytes for a maximum overrun
-      // of 3 pixels in the blurring code.
-      size_t bufLen = BufferSizeFromStrideAndHeight(integralImageStride, integralImageSize.height, 12);
-      if (bufLen == 0) {
+    // Each pass over the integral image reads the result of the previous
+    // pass in the rows around it, so bands of rows can't simply be blurred in
+    // place. Instead every band is blurred in a buffer of its own together
+    // with the mBlurRadius.height rows above and below it. Those extra rows
+    // come out wrong near where the band was cut off, but the rows of the
+    // band itself end up exactly as if the whole surface had been blurred.
+    vector<uint8_t*> bandData(bands, nullptr);
+    ParallelFor(aPool, 0, bands, [&] (int32_t aBand) {
+      int32_t top = max(BlurStripStart(size.height, bands, aBand) - halo, 0);
+      int32_t bottom = min(BlurStripStart(size.height, bands, aBand + 1) + halo, size.height);
+      IntSize bandSize(size.width, bottom - top);
+
+      // Leave room for the same 3 byte overrun the surface has.
+      size_t bandBytes = size_t(stride) * bandSize.height;
+      uint8_t* data = new (std::nothrow) uint8_t[bandBytes + 3];
+      if (!data) {
         return;
       }
-      // bufLen is a byte count, but here we want a multiple of 32-bit ints, so
-      // we divide by 4.
-      AlignedArray<uint32_t> integralImage((bufLen / 4) + ((bufLen % 4) ? 1 : 0));
+      memcpy(data, aData + size_t(stride) * top, bandBytes);
+      memset(data + bandBytes, 0, 3);
 
-      if (!integralImage) {
+      if (!BoxBlurIntegral(data, bandSize, stride, mSkipRect - IntPoint(0, top),
+                           horizontalLobes, verticalLobes)) {
+        delete [] data;
         return;
       }
+      bandData[aBand] = data;
+    });
+
+    // Only write back once every band has read its rows from aData, and only
+    // if they all succeeded. A failed blur leaves the surface untouched.
+    bool succeeded = find(bandData.begin(), bandData.end(), nullptr) == bandData.end();
+    ParallelFor(succeeded ? aPool : nullptr, 0, bands, [&] (int32_t aBand) {
+      if (succeeded) {
+        int32_t y = BlurStripStart(size.height, bands, aBand);
+        int32_t rows = BlurStripStart(size.height, bands, aBand + 1) - y;
+        int32_t top = max(y - halo, 0);
+        memcpy(aData + size_t(stride) * y, bandData[aBand] + size_t(stride) * (y - top),
+               size_t(stride) * rows);
+      }
+      delete [] bandData[aBand];
+    });
+  }
+}
+
+/**
+ * Halves the aSize sized A8 image at aData in place, along the axes aHalveX
+ * and aHalveY select, by averaging pairs or 2x2 blocks of pixels. The sides
+ * that are halved must be even.
+ */
+static void
+HalveAlpha(uint8_t* aData, int32_t aStride, const IntSize& aSize, bool aHalveX, bool aHalveY)
+{
+  int32_t stepX = aHalveX ? 2 : 1;
+  int32_t stepY = aHalveY ? 2 : 1;
+  // Every pixel is only written after the pixels that are read into it, so
+  // this can be done in place.
+  for (int32_t y = 0; y < aSize.height / stepY; y++) {
+    const uint8_t* row0 = aData + size_t(aStride) * y * stepY;
+    const uint8_t* row1 = row0 + aStride * (stepY - 1);
+    uint8_t* dest = aData + size_t(aStride) * y;
+    for (int32_t x = 0; x < aSize.width / stepX; x++) {
+      // Along an axis that isn't halved both samples are the same pixel.
+      int32_t x0 = x * stepX;
+      int32_t x1 = x0 + stepX - 1;
+      dest[x] = uint8_t((row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2);
+    }
+  }
+}
+
+void
+AlphaBoxBlur::BlurDownscaled(uint8_t* aData, WorkerPool* aPool)
+{
+  IntSize size = GetSize();
+  IntSize factor(DownscaleFactor(mStdDeviation.x), DownscaleFactor(mStdDeviation.y));
+  if (!aData || factor == IntSize(1, 1) || mSpreadRadius != IntSize(0, 0) ||
+      size.width <= 0 || size.height <= 0) {
+    Blur(aData, aPool);
+    return;
+  }
+
+  // Pad the surface to a multiple of the factor by repeating its edges, which
+  // is what the blur does beyond them anyway.
+  IntSize reducedSize((size.width + factor.width - 1) / factor.width,
+                      (size.height + factor.height - 1) / factor.height);
+  IntSize paddedSize(reducedSize.width * factor.width, reducedSize.height * factor.height);
+  CheckedInt<int32_t> paddedStride = RoundUpToMultipleOf4(paddedSize.width);
+  if (!paddedStride.isValid()) {
+    return;
+  }
+  size_t paddedBytes = BufferSizeFromStrideAndHeight(paddedStride.value(), paddedSize.height, 3);
+  uint8_t* reduced = paddedBytes ? new (std::nothrow) uint8_t[paddedBytes] : nullptr;
+  if (!reduced) {
+    return;
+  }
+  memset(reduced, 0, paddedBytes);
+  for (int32_t y = 0; y < paddedSize.height; y++) {
+    const uint8_t* source = aData + size_t(mStride) * min(y, size.height - 1);
+    uint8_t* dest = reduced + size_t(paddedStride.value()) * y;
+    memcpy(dest, source, size.width);
+    memset(dest + size.width, source[size.width - 1], paddedSize.width - size.width);
+  }
+
+  IntSize currentSize = paddedSize;
+  while (currentSize != reducedSize) {
+    bool halveX = currentSize.width > reducedSize.width;
+    bool halveY = currentSize.height > reducedSize.height;
+    HalveAlpha(reduced, paddedStride.value(), currentSize, halveX, halveY);
+    currentSize = IntSize(halveX ? currentSize.width / 2 : currentSize.width,
+                          halveY ? currentSize.height / 2 : currentSize.height);
+  }
+
+  // Pack the rows of the reduced surface together, the blur expects no more
+  // than the usual padding at the end of them.
+  int32_t reducedStride = RoundUpToMultipleOf4(reducedSize.width).value();
+  for (int32_t y = 1; y < reducedSize.height; y++) {
+    memmove(reduced + size_t(reducedStride) * y,
+            reduced + size_t(paddedStride.value()) * y, reducedSize.width);
+  }
+
+  AlphaBoxBlur blur(Rect(0, 0, reducedSize.width, reducedSize.height), reducedStride,
+                    DownscaledStdDeviation(mStdDeviation.x, factor.width),
+                    DownscaledStdDeviation(mStdDeviation.y, factor.height));
+  blur.Blur(reduced, aPool);
+
+  // Scale back up bilinearly, in strips of rows.
+  vector<BilinearStep> columns, rows;
+  ComputeBilinearSteps(reducedSize.width, size.width, factor.width, columns);
+  ComputeBilinearSteps(reducedSize.height, size.height, factor.height, rows);
+  if (size.width * size.height < kMinParallelBlurPixels) {
+    aPool = nullptr;
+  }
+  int32_t strips = BlurStripCount(aPool, size.height, kMinBlurStripLength);
+  ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+    // Reduced rows scaled up horizontally, still multiplied by 256. Most
+    // output rows interpolate between the same two reduced rows as the one
+    // before, so the last two are kept around.
+    vector<uint16_t> expandedRows[2];
+    int32_t expandedIndices[2] = { -1, -1 };
+    auto expandRow = [&] (int32_t aIndex) -> const uint16_t* {
+      for (int32_t i = 0; i < 2; i++) {
+        if (expandedIndices[i] == aIndex) {
+          return &expandedRows[i].front();
+        }
+      }
+      int32_t slot = expandedIndices[0] < expandedIndices[1] ? 0 : 1;
+      vector<uint16_t>& expanded = expandedRows[slot];
+      expanded.resize(size.width);
+      expandedIndices[slot] = aIndex;
+      const uint8_t* source = reduced + size_t(reducedStride) * aIndex;
+      for (int32_t x = 0; x < size.width; x++) {
+        const BilinearStep& column = columns[x];
+        expanded[x] = uint16_t(source[column.mIndex0] * (256 - column.mWeight) +
+                               source[column.mIndex1] * column.mWeight);
+      }
+      return &expanded.front();
+    };
+
+    int32_t endY = BlurStripStart(size.height, strips, aStrip + 1);
+    for (int32_t y = BlurStripStart(size.height, strips, aStrip); y < endY; y++) {
+      const uint16_t* top = expandRow(rows[y].mIndex0);
+      const uint16_t* bottom = expandRow(rows[y].mIndex1);
+      uint32_t weight = rows[y].mWeight;
+      uint8_t* dest = aData + size_t(mStride) * y;
+      for (int32_t x = 0; x < size.width; x++) {
+        dest[x] = uint8_t((top[x] * (256 - weight) + bottom[x] * weight + (1 << 15)) >> 16);
+      }
+    }
+  });
+
+  delete [] reduced;
+}
+
+bool
+AlphaBoxBlur::BoxBlurIntegral(uint8_t* aData, const IntSize& aSize, int32_t aStride,
+                              const IntRect& aSkipRect, const int32_t aHorizontalLobes[3][2],
+                              const int32_t aVerticalLobes[3][2])
+{
+  // We want to allow for some extra space on the left for alignment reasons.
+  int32_t maxLeftLobe = RoundUpToMultipleOf4(aHorizontalLobes[0][0] + 1).value();
+
+  IntSize integralImageSize(aSize.width + maxLeftLobe + aHorizontalLobes[1][1],
+                            aSize.height + aVerticalLobes[0][0] + aVerticalLobes[1][1] + 1);
+
+  size_t integralImageStride = GetAlignedStride<16>(integralImageSize.width * 4);
+
+  // We need to leave room for an additional 12 bytes for a maximum overrun
+  // of 3 pixels in the blurring code.
+  size_t bufLen = BufferSizeFromStrideAndHeight(integralImageStride, integralImageSize.height, 12);
+  if (bufLen == 0) {
+    return false;
+  }
+  // bufLen is a byte count, but here we want a multiple of 32-bit ints, so
+  // we divide by 4.
+  AlignedArray<uint32_t> integralImage((bufLen / 4) + ((bufLen % 4) ? 1 : 0));
+
+  if (!integralImage) {
+    return false;
+  }
 #ifdef USE_SSE2
-      if (Factory::HasSSE2()) {
-        BoxBlur_SSE2(aData, horizontalLobes[0][0], horizontalLobes[0][1], verticalLobes[0][0],
-                     verticalLobes[0][1], integralImage, integralImageStride);
-        BoxBlur_SSE2(aData, horizontalLobes[1][0], horizontalLobes[1][1], verticalLobes[1][0],
-                     verticalLobes[1][1], integralImage, integralImageStride);
-        BoxBlur_SSE2(aData, horizontalLobes[2][0], horizontalLobes[2][1], verticalLobes[2][0],
-                     verticalLobes[2][1], integralImage, integralImageStride);
-      } else
+  if (Factory::HasSSE2()) {
+    for (int32_t i = 0; i < 3; i++) {
+      BoxBlur_SSE2(aData, aSize, aStride, aSkipRect, aHorizontalLobes[i][0], aHorizontalLobes[i][1],
+                   aVerticalLobes[i][0], aVerticalLobes[i][1], integralImage, integralImageStride);
+    }
+  } else
 #endif
-      {
-        BoxBlur_C(aData, horizontalLobes[0][0], horizontalLobes[0][1], verticalLobes[0][0],
-                  verticalLobes[0][1], integralImage, integralImageStride);
-        BoxBlur_C(aData, horizontalLobes[1][0], horizontalLobes[1][1], verticalLobes[1][0],
-                  verticalLobes[1][1], integralImage, integralImageStride);
-        BoxBlur_C(aData, horizontalLobes[2][0], horizontalLobes[2][1], verticalLobes[2][0],
-                  verticalLobes[2][1], integralImage, integralImageStride);
-      }
+  {
+    for (int32_t i = 0; i < 3; i++) {
+      BoxBlur_C(aData, aSize, aStride, aSkipRect, aHorizontalLobes[i][0], aHorizontalLobes[i][1],
+                aVerticalLobes[i][0], aVerticalLobes[i][1], integralImage, integralImageStride);
     }
   }
+  return true;
 }
 
 MOZ_ALWAYS_INLINE void
@@ -648,6 +898,9 @@ GenerateIntegralImage_C(int32_t aLeftInflation, int32_t aRightInflation,
  */
 void
 AlphaBoxBlur::BoxBlur_C(uint8_t* aData,
+                        const IntSize& aSize,
+                        int32_t aStride,
+                        const IntRect& aSkipRect,
                         int32_t aLeftLobe,
                         int32_t aRightLobe,
                         int32_t aTopLobe,
@@ -655,7 +908,7 @@ AlphaBoxBlur::BoxBlur_C(uint8_t* aData,
                         uint32_t *aIntegralImage,
                         size_t aIntegralImageStride)
 {
-  IntSize size = GetSize();
+  IntSize size = aSize;
 
   MOZ_ASSERT(size.width > 0);
 
@@ -678,7 +931,7 @@ AlphaBoxBlur::BoxBlur_C(uint8_t* aData,
 
   GenerateIntegralImage_C(leftInflation, aRightLobe, aTopLobe, aBottomLobe,
                           aIntegralImage, aIntegralImageStride, aData,
-                          mStride, size);
+                          aStride, size);
 
   uint32_t reciprocal = uint32_t((uint64_t(1) << 32) / boxSize);
 
@@ -686,9 +939,9 @@ AlphaBoxBlur::BoxBlur_C(uint8_t* aData,
 
   // Storing these locally makes this about 30% faster! Presumably the compiler
   // can't be sure we're not altering the member variables in this loop.
-  IntRect skipRect = mSkipRect;
+  IntRect skipRect = aSkipRect;
   uint8_t *data = aData;
-  int32_t stride = mStride;
+  int32_t stride = aStride;
   for (int32_t y = 0; y < size.height; y++) {
     bool inSkipRectY = y > skipRect.y && y < skipRect.YMost();
 
@@ -741,5 +994,25 @@ AlphaBoxBlur::CalculateBlurRadius(const Point& aStd)
     return size;
 }
 
+int32_t
+AlphaBoxBlur::DownscaleFactor(Float aStdDeviation)
+{
+  int32_t factor = 1;
+  while (aStdDeviation / (factor * 2) >= kMinDownscaledStdDeviation / 2.0f) {
+    factor *= 2;
+  }
+  return factor;
+}
+
+Float
+AlphaBoxBlur::DownscaledStdDeviation(Float aStdDeviation, int32_t aFactor)
+{
+  // Averaging blocks of aFactor pixels on the way down and interpolating
+  // linearly on the way up blur the image a little themselves, with variances
+  // of (aFactor^2 - 1) / 12 and (aFactor^2 - 1) / 6.
+  double variance = double(aStdDeviation) * aStdDeviation - (double(aFactor) * aFactor - 1) / 4;
+  return Float(sqrt(max(variance, 0.0)) / aFactor);
+}
+
 }
 }
@@ -18,6 +18,8 @@ namespace gfx {
 #pragma warning( disable : 4251 )
 #endif
 
+class WorkerPool;
+
 /**
  * Implementation of a triple box blur approximation of a Gaussian blur.
  *
@@ -105,8 +107,52 @@ public:
    * Perform the blur in-place on the surface backed by specified 8-bit
    * alpha surface data. The size must be at least that returned by
    * GetSurfaceAllocationSize() or bad things will happen.
+   *
+   * If aPool is non-null, large surfaces are split into strips which are
+   * blurred on the pool's threads. The result is identical to blurring on
+   * a single thread.
    */
-  void Blur(uint8_t* aData);
+  void Blur(uint8_t* aData, WorkerPool* aPool = nullptr);
+
+  /**
+   * Like Blur, except that directions with a standard deviation of at least
+   * kMinDownscaledStdDeviation are blurred at a reduced resolution: the
+   * surface is halved by averaging pairs of pixels, blurred there and scaled
+   * back up bilinearly. Pixels at least the blur radius away from the edges
+   * come out within kMaxDownscaledError of what Blur gives, at a cost that
+   * shrinks as the deviation grows.
+   *
+   * Only blurs constructed from standard deviations are downscaled, others
+   * are the same as Blur.
+   */
+  void BlurDownscaled(uint8_t* aData, WorkerPool* aPool = nullptr);
+
+  /**
+   * The smallest standard deviation BlurDownscaled blurs at reduced
+   * resolution. Below about half of this, the box sizes at the reduced
+   * resolution get too coarse to stay close to the full resolution blur.
+   */
+  static const int32_t kMinDownscaledStdDeviation = 24;
+
+  /**
+   * The largest difference between BlurDownscaled and Blur away from the
+   * edges, see BlurDownscaled.
+   */
+  static const int32_t kMaxDownscaledError = 6;
+
+  /**
+   * Returns the power of two BlurDownscaled scales a direction with the given
+   * standard deviation down by, which leaves a deviation of at least half of
+   * kMinDownscaledStdDeviation at the reduced resolution.
+   */
+  static int32_t DownscaleFactor(Float aStdDeviation);
+
+  /**
+   * Returns the standard deviation, in reduced pixels, that a blur at a
+   * resolution reduced by aFactor needs so that averaging on the way down,
+   * the blur and interpolating on the way up together blur by aStdDeviation.
+   */
+  static Float DownscaledStdDeviation(Float aStdDeviation, int32_t aFactor);
 
   /**
    * Calculates a blur radius that, when used with box blur, approximates a
@@ -116,14 +162,32 @@ public:
    */
   static IntSize CalculateBlurRadius(const Point& aStandardDeviation);
 
+  /**
+   * Splits a blur radius as returned by CalculateBlurRadius into the left and
+   * right (or top and bottom) lobes of the three box blurs that make up the
+   * blur in that direction.
+   */
+  static void ComputeLobes(int32_t aRadius, int32_t aLobes[3][2]);
+
 private:
 
-  void BoxBlur_C(uint8_t* aData,
-                 int32_t aLeftLobe, int32_t aRightLobe, int32_t aTopLobe,
-                 int32_t aBottomLobe, uint32_t *aIntegralImage, size_t aIntegralImageStride);
-  void BoxBlur_SSE2(uint8_t* aData,
-                    int32_t aLeftLobe, int32_t aRightLobe, int32_t aTopLobe,
-                    int32_t aBottomLobe, uint32_t *aIntegralImage, size_t aIntegralImageStride);
+  /**
+   * Runs the three box blur passes over the aSize sized area at aData using
+   * an integral image. Returns false if the integral image couldn't be
+   * allocated.
+   */
+  static bool BoxBlurIntegral(uint8_t* aData, const IntSize& aSize, int32_t aStride,
+                              const IntRect& aSkipRect, const int32_t aHorizontalLobes[3][2],
+                              const int32_t aVerticalLobes[3][2]);
+
+  static void BoxBlur_C(uint8_t* aData, const IntSize& aSize, int32_t aStride,
+                        const IntRect& aSkipRect,
+                        int32_t aLeftLobe, int32_t aRightLobe, int32_t aTopLobe,
+                        int32_t aBottomLobe, uint32_t *aIntegralImage, size_t aIntegralImageStride);
+  static void BoxBlur_SSE2(uint8_t* aData, const IntSize& aSize, int32_t aStride,
+                           const IntRect& aSkipRect,
+                           int32_t aLeftLobe, int32_t aRightLobe, int32_t aTopLobe,
+                           int32_t aBottomLobe, uint32_t *aIntegralImage, size_t aIntegralImageStride);
 
   static CheckedInt<int32_t> RoundUpToMultipleOf4(int32_t aVal);
 
@@ -168,6 +232,12 @@ private:
    * Whether mDirtyRect contains valid data.
    */
   bool mHasDirtyRect;
+
+  /**
+   * The standard deviation passed to the constructor, or 0 if it was given
+   * a blur radius instead.
+   */
+  Point mStdDeviation;
 };
 
 }
@@ -175,14 +175,17 @@ GenerateIntegralImage_SSE2(int32_t aLeftInflation, int32_t aRightInflation,
  */
 void
 AlphaBoxBlur::BoxBlur_SSE2(uint8_t* aData,
-			   int32_t aLeftLobe,
+                           const IntSize& aSize,
+                           int32_t aStride,
+                           const IntRect& aSkipRect,
+                           int32_t aLeftLobe,
                            int32_t aRightLobe,
                            int32_t aTopLobe,
                            int32_t aBottomLobe,
                            uint32_t *aIntegralImage,
                            size_t aIntegralImageStride)
 {
-  IntSize size = GetSize();
+  IntSize size = aSize;
 
   MOZ_ASSERT(size.height > 0);
 
@@ -206,7 +209,7 @@ AlphaBoxBlur::BoxBlur_SSE2(uint8_t* aData,
 
   GenerateIntegralImage_SSE2(leftInflation, aRightLobe, aTopLobe, aBottomLobe,
                              aIntegralImage, aIntegralImageStride, aData,
-                             mStride, size);
+                             aStride, size);
 
   __m128i divisor = _mm_set1_epi32(reciprocal);
   __m128i mask = _mm_setr_epi32(0x0, 0xffffffff, 0x0, 0xffffffff);
@@ -215,8 +218,8 @@ AlphaBoxBlur::BoxBlur_SSE2(uint8_t* aData,
   // the surface being blurred.
   uint32_t *innerIntegral = aIntegralImage + (aTopLobe * stride32bit) + leftInflation;
 
-  IntRect skipRect = mSkipRect;
-  int32_t stride = mStride;
+  IntRect skipRect = aSkipRect;
+  int32_t stride = aStride;
   uint8_t *data = aData;
   for (int32_t y = 0; y < size.height; y++) {
     bool inSkipRectY = y > skipRect.y && y < skipRect.YMost();
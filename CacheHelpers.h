@@ -0,0 +1,290 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_CACHEHELPERS_H_
+#define MOZILLA_GFX_CACHEHELPERS_H_
+
+#include "2D.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <thread>
+
+namespace mozilla {
+namespace gfx {
+
+/**
+ * Numbers that identify the contents of surfaces to a cache. A surface gets
+ * a serial, attached as user data, the first time Get is called for it, and
+ * a new one when Renew is called after its contents have changed. Serials
+ * are never reused, so entries for surfaces that have changed or gone away
+ * just stop matching. Every cache has its own instance, so renewing the
+ * serial of a surface in one cache doesn't affect the others.
+ *
+ * If aReleased is given it is called with the serial of every surface that
+ * goes away after having been given one, on the thread that releases it.
+ */
+class SurfaceSerials
+{
+public:
+  typedef void (*ReleasedFunction)(uint64_t aSerial);
+
+  explicit SurfaceSerials(ReleasedFunction aReleased = nullptr)
+    : mReleased(aReleased)
+    , mNextSerial(1)
+  {}
+
+  uint64_t Get(SourceSurface* aSurface)
+  {
+    Serial* serial = Find(aSurface);
+    if (!serial) {
+      serial = new Serial(this, mNextSerial++);
+      aSurface->AddUserData(&mKey, serial, DeleteSerial);
+    }
+    return serial->mValue;
+  }
+
+  /**
+   * Gives aSurface a new serial and returns its old one, or 0 if it didn't
+   * have one.
+   */
+  uint64_t Renew(SourceSurface* aSurface)
+  {
+    Serial* serial = Find(aSurface);
+    if (!serial) {
+      return 0;
+    }
+    uint64_t old = serial->mValue;
+    serial->mValue = mNextSerial++;
+    return old;
+  }
+
+private:
+  struct Serial
+  {
+    Serial(SurfaceSerials* aOwner, uint64_t aValue)
+      : mOwner(aOwner)
+      , mValue(aValue)
+    {}
+
+    SurfaceSerials* mOwner;
+    uint64_t mValue;
+  };
+
+  Serial* Find(SourceSurface* aSurface)
+  {
+    return static_cast<Serial*>(aSurface->GetUserData(&mKey));
+  }
+
+  static void DeleteSerial(void* aSerial)
+  {
+    Serial* serial = static_cast<Serial*>(aSerial);
+    if (serial->mOwner->mReleased) {
+      serial->mOwner->mReleased(serial->mValue);
+    }
+    delete serial;
+  }
+
+  UserDataKey mKey;
+  ReleasedFunction mReleased;
+  std::atomic<uint64_t> mNextSerial;
+};
+
+/**
+ * A cache that evicts its least recently used entries once they take up more
+ * than a budget of bytes. Several entries may share a key.
+ *
+ * The caches the Factory configures are shared across all DrawTargets, but
+ * our surfaces aren't reference counted atomically. So a cache is only used
+ * on the thread that last called SetMaxBytes, IsEnabled returns false on all
+ * other threads and callers bypass the cache there.
+ */
+template<typename Key, typename Value>
+class LRUCache
+{
+public:
+  LRUCache()
+    : mMaxBytes(0)
+    , mBytes(0)
+    , mHits(0)
+    , mMisses(0)
+    , mEvictions(0)
+  {}
+
+  bool IsEnabled() const
+  {
+    return mMaxBytes && std::this_thread::get_id() == mOwningThread;
+  }
+
+  /**
+   * Empties the cache, resets its counters and makes the calling thread the
+   * one the cache is used on. A budget of 0 disables the cache.
+   */
+  void SetMaxBytes(size_t aMaxBytes)
+  {
+    mEntries.clear();
+    mIndex.clear();
+    mMaxBytes = aMaxBytes;
+    mBytes = 0;
+    mHits = mMisses = mEvictions = 0;
+    mOwningThread = std::this_thread::get_id();
+  }
+
+  size_t GetMaxBytes() const { return mMaxBytes; }
+
+  /**
+   * Returns the first entry for aKey that aMatch accepts and makes it the
+   * most recently used one, or null if there is none. Counts a hit or a miss.
+   */
+  template<typename Match>
+  Value* Lookup(const Key& aKey, Match aMatch)
+  {
+    Value* value = Find(aKey, aMatch);
+    if (value) {
+      mHits++;
+    } else {
+      mMisses++;
+    }
+    return value;
+  }
+
+  Value* Lookup(const Key& aKey)
+  {
+    return Lookup(aKey, [](const Value&) { return true; });
+  }
+
+  /**
+   * Returns the first entry for aKey without counting a hit or making it the
+   * most recently used one, or null if there is none.
+   */
+  Value* Peek(const Key& aKey)
+  {
+    typename Index::iterator it = mIndex.find(aKey);
+    return it == mIndex.end() ? nullptr : &it->second->mValue;
+  }
+
+  /**
+   * Adds aValue, which takes up aBytes, as the most recently used entry for
+   * aKey, then evicts the least recently used entries until the cache is
+   * within its budget again. Values larger than the whole budget aren't
+   * added.
+   */
+  void Insert(const Key& aKey, const Value& aValue, size_t aBytes)
+  {
+    if (aBytes > mMaxBytes) {
+      return;
+    }
+
+    Entry entry = { aKey, aValue, aBytes };
+    mEntries.push_front(entry);
+    mIndex.insert(std::make_pair(aKey, mEntries.begin()));
+    mBytes += aBytes;
+
+    while (mBytes > mMaxBytes) {
+      typename EntryList::iterator last = mEntries.end();
+      --last;
+      std::pair<typename Index::iterator, typename Index::iterator> range =
+        mIndex.equal_range(last->mKey);
+      for (typename Index::iterator it = range.first; it != range.second; ++it) {
+        if (it->second == last) {
+          RemoveEntry(it);
+          break;
+        }
+      }
+      mEvictions++;
+    }
+  }
+
+  /**
+   * Removes the entries for aKey that aMatch accepts.
+   */
+  template<typename Match>
+  void Remove(const Key& aKey, Match aMatch)
+  {
+    std::pair<typename Index::iterator, typename Index::iterator> range =
+      mIndex.equal_range(aKey);
+    for (typename Index::iterator it = range.first; it != range.second;) {
+      typename Index::iterator next = it;
+      ++next;
+      if (aMatch(it->second->mValue)) {
+        RemoveEntry(it);
+      }
+      it = next;
+    }
+  }
+
+  void Remove(const Key& aKey)
+  {
+    Remove(aKey, [](const Value&) { return true; });
+  }
+
+  /**
+   * Removes the entries with keys from aFirst on, in key order, up to the
+   * first key that aInRange rejects.
+   */
+  template<typename InRange>
+  void RemoveRange(const Key& aFirst, InRange aInRange)
+  {
+    typename Index::iterator it = mIndex.lower_bound(aFirst);
+    while (it != mIndex.end() && aInRange(it->first)) {
+      typename Index::iterator next = it;
+      ++next;
+      RemoveEntry(it);
+      it = next;
+    }
+  }
+
+  CacheStats GetStats() const
+  {
+    CacheStats stats = { mHits, mMisses, mEvictions, mEntries.size(), mBytes };
+    return stats;
+  }
+
+private:
+  struct Entry {
+    Key mKey;
+    Value mValue;
+    size_t mBytes;
+  };
+  typedef std::list<Entry> EntryList;
+  typedef std::multimap<Key, typename EntryList::iterator> Index;
+
+  template<typename Match>
+  Value* Find(const Key& aKey, Match aMatch)
+  {
+    std::pair<typename Index::iterator, typename Index::iterator> range =
+      mIndex.equal_range(aKey);
+    for (typename Index::iterator it = range.first; it != range.second; ++it) {
+      if (aMatch(it->second->mValue)) {
+        mEntries.splice(mEntries.begin(), mEntries, it->second);
+        return &it->second->mValue;
+      }
+    }
+    return nullptr;
+  }
+
+  void RemoveEntry(typename Index::iterator aIndexEntry)
+  {
+    mBytes -= aIndexEntry->second->mBytes;
+    mEntries.erase(aIndexEntry->second);
+    mIndex.erase(aIndexEntry);
+  }
+
+  // Most recently used first.
+  EntryList mEntries;
+  Index mIndex;
+  size_t mMaxBytes;
+  size_t mBytes;
+  uint64_t mHits;
+  uint64_t mMisses;
+  uint64_t mEvictions;
+  std::thread::id mOwningThread;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_CACHEHELPERS_H_ */
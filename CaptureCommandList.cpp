@@ -0,0 +1,159 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "CaptureCommandList.h"
+#include "DrawCommand.h"
+
+#include <algorithm>
+
+namespace mozilla {
+namespace gfx {
+
+namespace {
+
+// Every command is preceded by a header, padded so the command itself stays
+// aligned.
+struct EntryHeader
+{
+  // The size of the command including the header.
+  uint32_t mSize;
+  bool mRemoved;
+};
+
+const size_t kHeaderSize = CaptureCommandList::kCommandAlignment;
+static_assert(sizeof(EntryHeader) <= kHeaderSize, "Header doesn't fit");
+
+EntryHeader*
+GetHeader(DrawingCommand *aCommand)
+{
+  return reinterpret_cast<EntryHeader*>(reinterpret_cast<uint8_t*>(aCommand) - kHeaderSize);
+}
+
+// Large enough for a few hundred typical commands.
+const size_t kChunkSize = 16 * 1024;
+
+size_t
+RoundUpToAlignment(size_t aSize)
+{
+  return (aSize + CaptureCommandList::kCommandAlignment - 1) &
+         ~(CaptureCommandList::kCommandAlignment - 1);
+}
+
+}
+
+CaptureCommandList::Chunk::Chunk(size_t aCapacity)
+  : mStorage(new uint8_t[aCapacity + kCommandAlignment - 1])
+  , mData(reinterpret_cast<uint8_t*>(RoundUpToAlignment(uintptr_t(mStorage))))
+  , mCapacity(aCapacity)
+  , mUsed(0)
+{
+}
+
+CaptureCommandList::~CaptureCommandList()
+{
+  Clear();
+  for (size_t i = 0; i < mChunks.size(); i++) {
+    delete mChunks[i];
+  }
+}
+
+void
+CaptureCommandList::Clear()
+{
+  for (Iterator iter(*this); !iter.Done(); iter.Next()) {
+    iter.Get()->~DrawingCommand();
+  }
+  for (size_t i = 0; i < mChunks.size(); i++) {
+    mChunks[i]->mUsed = 0;
+  }
+  mCurrentChunk = 0;
+}
+
+void*
+CaptureCommandList::Allocate(size_t aSize)
+{
+  size_t entrySize = kHeaderSize + RoundUpToAlignment(aSize);
+  MOZ_ASSERT(entrySize <= UINT32_MAX);
+
+  if (mChunks.empty()) {
+    mChunks.push_back(new Chunk(std::max(kChunkSize, entrySize)));
+  }
+
+  Chunk *chunk = mChunks[mCurrentChunk];
+  if (chunk->mCapacity - chunk->mUsed < entrySize) {
+    // Move on to the next chunk left over from before the last Clear(), or
+    // add one in its place if it can't hold this command. Either way every
+    // chunk before the current one keeps its commands in order.
+    mCurrentChunk++;
+    if (mCurrentChunk == mChunks.size() ||
+        mChunks[mCurrentChunk]->mCapacity < entrySize) {
+      mChunks.insert(mChunks.begin() + mCurrentChunk,
+                     new Chunk(std::max(kChunkSize, entrySize)));
+    }
+    chunk = mChunks[mCurrentChunk];
+  }
+
+  uint8_t *entry = chunk->mData + chunk->mUsed;
+  EntryHeader *header = reinterpret_cast<EntryHeader*>(entry);
+  header->mSize = entrySize;
+  header->mRemoved = false;
+  chunk->mUsed += entrySize;
+  return entry + kHeaderSize;
+}
+
+void
+CaptureCommandList::Remove(DrawingCommand *aCommand)
+{
+  MOZ_ASSERT(!GetHeader(aCommand)->mRemoved);
+  aCommand->~DrawingCommand();
+  GetHeader(aCommand)->mRemoved = true;
+}
+
+CaptureCommandList::Iterator::Iterator(const CaptureCommandList &aList)
+  : mList(aList)
+  , mChunk(0)
+  , mEndChunk(aList.mChunks.empty() ? 0 : aList.mCurrentChunk + 1)
+  , mOffset(0)
+{
+  SkipRemovedCommands();
+}
+
+DrawingCommand*
+CaptureCommandList::Iterator::Get() const
+{
+  MOZ_ASSERT(!Done());
+  return reinterpret_cast<DrawingCommand*>(mList.mChunks[mChunk]->mData + mOffset + kHeaderSize);
+}
+
+void
+CaptureCommandList::Iterator::Next()
+{
+  MOZ_ASSERT(!Done());
+  mOffset += reinterpret_cast<EntryHeader*>(mList.mChunks[mChunk]->mData + mOffset)->mSize;
+  SkipRemovedCommands();
+}
+
+void
+CaptureCommandList::Iterator::SkipRemovedCommands()
+{
+  // A chunk can also be left empty when the first command after a Clear()
+  // didn't fit into it.
+  while (mChunk < mEndChunk) {
+    Chunk *chunk = mList.mChunks[mChunk];
+    if (mOffset >= chunk->mUsed) {
+      mChunk++;
+      mOffset = 0;
+      continue;
+    }
+    EntryHeader *header = reinterpret_cast<EntryHeader*>(chunk->mData + mOffset);
+    if (!header->mRemoved) {
+      return;
+    }
+    mOffset += header->mSize;
+  }
+}
+
+}
+}
@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_CAPTURECOMMANDLIST_H_
+#define MOZILLA_GFX_CAPTURECOMMANDLIST_H_
+
+#include "Types.h"
+#include "mozilla/Alignment.h"
+#include "mozilla/Assertions.h"
+
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+class DrawingCommand;
+
+/**
+ * Storage for the DrawingCommands recorded by DrawTargetCaptureImpl.
+ *
+ * Commands are placement-constructed into large chunks of memory, each one
+ * aligned to kCommandAlignment. When a chunk is full a new one is added, the
+ * commands that were already stored are never moved. Clear() destroys the
+ * commands but keeps the chunks, so a capture that is recorded again every
+ * frame stops allocating once it has seen its largest frame.
+ */
+class CaptureCommandList
+{
+public:
+  static const size_t kCommandAlignment = 16;
+
+  CaptureCommandList()
+    : mCurrentChunk(0)
+  {}
+  ~CaptureCommandList();
+
+  /**
+   * Returns suitably aligned storage for a T, which the caller must construct
+   * a DrawingCommand in before the next call to Append.
+   */
+  template<typename T>
+  T* Append()
+  {
+    static_assert(MOZ_ALIGNOF(T) <= kCommandAlignment,
+                  "Command needs more alignment than the list provides");
+    return reinterpret_cast<T*>(Allocate(sizeof(T)));
+  }
+
+  /**
+   * Destroys all commands. The memory they used is kept for reuse.
+   */
+  void Clear();
+
+  /**
+   * Destroys a single command, iteration skips it from then on. Its memory is
+   * only reused after the next Clear().
+   */
+  void Remove(DrawingCommand *aCommand);
+
+  bool IsEmpty() const { return Iterator(*this).Done(); }
+
+  /**
+   * Iterates over the commands in the order they were appended.
+   */
+  class Iterator
+  {
+  public:
+    explicit Iterator(const CaptureCommandList &aList);
+
+    bool Done() const { return mChunk == mEndChunk; }
+    DrawingCommand* Get() const;
+    void Next();
+
+  private:
+    void SkipRemovedCommands();
+
+    const CaptureCommandList &mList;
+    size_t mChunk;
+    size_t mEndChunk;
+    size_t mOffset;
+  };
+
+private:
+  struct Chunk
+  {
+    explicit Chunk(size_t aCapacity);
+    ~Chunk() { delete [] mStorage; }
+
+    uint8_t *mStorage;
+    // mStorage rounded up to kCommandAlignment.
+    uint8_t *mData;
+    size_t mCapacity;
+    size_t mUsed;
+  };
+
+  void* Allocate(size_t aSize);
+
+  std::vector<Chunk*> mChunks;
+  // Chunks after this one are empty.
+  size_t mCurrentChunk;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_CAPTURECOMMANDLIST_H_ */
@@ -3,6 +3,7 @@
  * License, v. 2.0. If a copy of the MPL was not distributed with this
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
+#include <algorithm>
 #include <cstring>
 
 #include "2D.h"
@@ -196,5 +197,22 @@ BufferSizeFromStrideAndHeight(int32_t aStride,
   return requiredBytes.value();
 }
 
+void
+ComputeBilinearSteps(int32_t aSourceLength, int32_t aDestLength, int32_t aFactor,
+                     std::vector<BilinearStep>& aSteps)
+{
+  aSteps.resize(aDestLength);
+  for (int32_t i = 0; i < aDestLength; i++) {
+    // Every source pixel is the center of aFactor destination pixels, so this
+    // is the position of the center of pixel i in source pixels, minus half a
+    // pixel, in 1/256ths.
+    int32_t position = (2 * i + 1 - aFactor) * 256 / (2 * aFactor);
+    BilinearStep& step = aSteps[i];
+    step.mIndex0 = std::min(std::max(position, 0) / 256, aSourceLength - 1);
+    step.mIndex1 = std::min(step.mIndex0 + 1, aSourceLength - 1);
+    step.mWeight = position > 0 && step.mIndex0 < aSourceLength - 1 ? position % 256 : 0;
+  }
+}
+
 }
 }
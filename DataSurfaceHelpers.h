@@ -8,6 +8,8 @@
 
 #include "2D.h"
 
+#include <vector>
+
 namespace mozilla {
 namespace gfx {
 
@@ -70,6 +72,27 @@ BufferSizeFromStrideAndHeight(int32_t aStride,
                               int32_t aHeight,
                               int32_t aExtraBytes = 0);
 
+/**
+ * Where a row or column of an image that is scaled up bilinearly samples the
+ * original: between mIndex0 and mIndex1, mWeight / 256 of the way towards
+ * mIndex1.
+ */
+struct BilinearStep
+{
+  int32_t mIndex0;
+  int32_t mIndex1;
+  uint32_t mWeight;
+};
+
+/**
+ * Fills aSteps with a BilinearStep for each of the aDestLength rows or columns
+ * of an image aSourceLength long scaled up by aFactor, where every source
+ * pixel is the center of aFactor destination pixels.
+ */
+void
+ComputeBilinearSteps(int32_t aSourceLength, int32_t aDestLength, int32_t aFactor,
+                     std::vector<BilinearStep>& aSteps);
+
 }
 }
 
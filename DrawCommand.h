@@ -8,6 +8,8 @@
 
 #include "2D.h"
 #include "Filters.h"
+#include "Tools.h"
+#include <string.h>
 #include <vector>
 
 namespace mozilla {
@@ -41,6 +43,21 @@ public:
 
   virtual void ExecuteOnDT(DrawTarget* aDT, const Matrix& aTransform) = 0;
 
+  CommandType GetType() const { return mType; }
+
+  /**
+   * Sets aBounds to the user space bounds of the area the command draws to
+   * and returns true. Returns false if the bounds aren't known, or if the
+   * command can change the target outside of them.
+   */
+  virtual bool GetBounds(Rect& aBounds) const { return false; }
+
+  /**
+   * Returns true if the command replaces everything within its bounds,
+   * clipping aside, no matter what was drawn there before.
+   */
+  virtual bool IsOpaque() const { return false; }
+
 protected:
   explicit DrawingCommand(CommandType aType)
     : mType(aType)
@@ -104,6 +121,7 @@ private:
   StoredPattern operator=(const StoredPattern& aOther)
   {
     // Block this so that we notice if someone's doing excessive assigning.
+    return *this;
   }
 
   union {
@@ -111,9 +129,23 @@ private:
     char mLinear[sizeof(LinearGradientPattern)];
     char mRadial[sizeof(RadialGradientPattern)];
     char mSurface[sizeof(SurfacePattern)];
+    // The patterns hold pointers, this aligns the storage for them.
+    void* mAlignment;
   };
 };
 
+// How far a stroke can extend beyond the geometry it strokes.
+static inline Float
+GetStrokeInflation(const StrokeOptions& aStrokeOptions)
+{
+  Float scale = sqrtf(2.0f);
+  if (aStrokeOptions.mLineJoin == JoinStyle::MITER ||
+      aStrokeOptions.mLineJoin == JoinStyle::MITER_OR_BEVEL) {
+    scale = std::max(scale, aStrokeOptions.mMiterLimit);
+  }
+  return aStrokeOptions.mLineWidth * scale / 2;
+}
+
 class DrawSurfaceCommand : public DrawingCommand
 {
 public:
@@ -132,6 +164,12 @@ public:
     aDT->DrawSurface(mSurface, mDest, mSource, mSurfOptions, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mDest;
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   RefPtr<SourceSurface> mSurface;
   Rect mDest;
@@ -145,7 +183,7 @@ class DrawFilterCommand : public DrawingCommand
 public:
   DrawFilterCommand(FilterNode* aFilter, const Rect& aSourceRect,
                     const Point& aDestPoint, const DrawOptions& aOptions)
-    : DrawingCommand(CommandType::DRAWSURFACE)
+    : DrawingCommand(CommandType::DRAWFILTER)
     , mFilter(aFilter), mSourceRect(aSourceRect)
     , mDestPoint(aDestPoint), mOptions(aOptions)
   {
@@ -156,6 +194,12 @@ public:
     aDT->DrawFilter(mFilter, mSourceRect, mDestPoint, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = Rect(mDestPoint, mSourceRect.Size());
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   RefPtr<FilterNode> mFilter;
   Rect mSourceRect;
@@ -177,6 +221,14 @@ public:
     aDT->ClearRect(mRect);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mRect;
+    return true;
+  }
+
+  virtual bool IsOpaque() const { return true; }
+
 private:
   Rect mRect;
 };
@@ -202,6 +254,16 @@ public:
     aDT->CopySurface(mSurface, mSourceRect, IntPoint(uint32_t(dest.x), uint32_t(dest.y)));
   }
 
+  // CopySurface ignores the transform and the clip, this returns the device
+  // space rect that is replaced.
+  IntRect GetDestRect() const
+  {
+    IntRect sourceRect =
+      mSourceRect.Intersect(IntRect(IntPoint(), mSurface->GetSize()));
+    return IntRect(mDestination + (sourceRect.TopLeft() - mSourceRect.TopLeft()),
+                   sourceRect.Size());
+  }
+
 private:
   RefPtr<SourceSurface> mSurface;
   IntRect mSourceRect;
@@ -226,6 +288,21 @@ public:
     aDT->FillRect(mRect, mPattern, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mRect;
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
+  virtual bool IsOpaque() const
+  {
+    const Pattern& pattern = mPattern;
+    return mOptions.mCompositionOp == CompositionOp::OP_OVER &&
+           mOptions.mAlpha >= 1.0f &&
+           pattern.GetType() == PatternType::COLOR &&
+           static_cast<const ColorPattern&>(pattern).mColor.a >= 1.0f;
+  }
+
 private:
   Rect mRect;
   StoredPattern mPattern;
@@ -252,6 +329,13 @@ public:
     aDT->StrokeRect(mRect, mPattern, mStrokeOptions, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mRect;
+    aBounds.Inflate(GetStrokeInflation(mStrokeOptions));
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   Rect mRect;
   StoredPattern mPattern;
@@ -281,6 +365,13 @@ public:
     aDT->StrokeLine(mStart, mEnd, mPattern, mStrokeOptions, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = Rect(mStart, Size()).Union(Rect(mEnd, Size()));
+    aBounds.Inflate(GetStrokeInflation(mStrokeOptions));
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   Point mStart;
   Point mEnd;
@@ -307,6 +398,12 @@ public:
     aDT->Fill(mPath, mPattern, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mPath->GetBounds();
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   RefPtr<Path> mPath;
   StoredPattern mPattern;
@@ -333,6 +430,12 @@ public:
     aDT->Stroke(mPath, mPattern, mStrokeOptions, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    aBounds = mPath->GetStrokedBounds(mStrokeOptions);
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   RefPtr<Path> mPath;
   StoredPattern mPattern;
@@ -418,6 +521,13 @@ public:
     aDT->MaskSurface(mSource, mMask, mOffset, mOptions);
   }
 
+  virtual bool GetBounds(Rect& aBounds) const
+  {
+    IntSize size = mMask->GetSize();
+    aBounds = Rect(mOffset, Size(Float(size.width), Float(size.height)));
+    return IsOperatorBoundByMask(mOptions.mCompositionOp);
+  }
+
 private:
   StoredPattern mSource;
   RefPtr<SourceSurface> mMask;
@@ -439,6 +549,8 @@ public:
     aDT->PushClip(mPath);
   }
 
+  const Path* GetPath() const { return mPath; }
+
 private:
   RefPtr<Path> mPath;
 };
@@ -457,6 +569,8 @@ public:
     aDT->PushClipRect(mRect);
   }
 
+  const Rect& GetRect() const { return mRect; }
+
 private:
   Rect mRect;
 };
@@ -491,6 +605,8 @@ public:
     aDT->SetTransform(transform);
   }
 
+  const Matrix& GetTransform() const { return mTransform; }
+
 private:
   Matrix mTransform;
 };
@@ -5,16 +5,120 @@
 
 #include "DrawEventRecorder.h"
 #include "PathRecording.h"
+#include "RecordingCompression.h"
+#include "Tools.h"
+
+#include <algorithm>
+#include <chrono>
 
 namespace mozilla {
 namespace gfx {
 
 using namespace std;
 
-const uint32_t kMagicInt = 0xc001feed;
+// Amount of surface data a recording keeps stored in the player by default.
+static const size_t kDefaultStoredSurfaceDataLimit = 128 * 1024 * 1024;
+
+// 64-bit hash of the xxHash64 family, reasonably fast on large buffers since
+// it consumes 32 bytes per step in four independent lanes.
+static const uint64_t kPrime1 = 11400714785074694791ULL;
+static const uint64_t kPrime2 = 14029467366897019727ULL;
+static const uint64_t kPrime3 = 1609587929392839161ULL;
+static const uint64_t kPrime4 = 9650029242287828579ULL;
+static const uint64_t kPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t
+RotateLeft(uint64_t aValue, int aBits)
+{
+  return (aValue << aBits) | (aValue >> (64 - aBits));
+}
+
+template<typename T>
+static inline uint64_t
+Load(const uint8_t *aData)
+{
+  T value;
+  memcpy(&value, aData, sizeof(T));
+  return value;
+}
+
+static inline uint64_t
+HashRound(uint64_t aAccumulator, uint64_t aInput)
+{
+  return RotateLeft(aAccumulator + aInput * kPrime2, 31) * kPrime1;
+}
+
+static inline uint64_t
+HashMerge(uint64_t aAccumulator, uint64_t aLane)
+{
+  return (aAccumulator ^ HashRound(0, aLane)) * kPrime1 + kPrime4;
+}
+
+static uint64_t
+HashBytes(const uint8_t *aData, size_t aLength, uint64_t aSeed)
+{
+  const uint8_t *end = aData + aLength;
+  uint64_t hash;
+
+  if (aLength >= 32) {
+    uint64_t lanes[4] = { aSeed + kPrime1 + kPrime2, aSeed + kPrime2, aSeed, aSeed - kPrime1 };
+    do {
+      for (int i = 0; i < 4; i++) {
+        lanes[i] = HashRound(lanes[i], Load<uint64_t>(aData + i * 8));
+      }
+      aData += 32;
+    } while (aData + 32 <= end);
+
+    hash = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) +
+           RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+    for (int i = 0; i < 4; i++) {
+      hash = HashMerge(hash, lanes[i]);
+    }
+  } else {
+    hash = aSeed + kPrime5;
+  }
+
+  hash += aLength;
+
+  for (; aData + 8 <= end; aData += 8) {
+    hash = RotateLeft(hash ^ HashRound(0, Load<uint64_t>(aData)), 27) * kPrime1 + kPrime4;
+  }
+  if (aData + 4 <= end) {
+    hash = RotateLeft(hash ^ (Load<uint32_t>(aData) * kPrime1), 23) * kPrime2 + kPrime3;
+    aData += 4;
+  }
+  for (; aData < end; aData++) {
+    hash = RotateLeft(hash ^ (*aData * kPrime5), 11) * kPrime1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+// Hashes the visible part of every row, so padding in the stride doesn't
+// affect the result, along with the size and format.
+static uint64_t
+HashSurfaceData(const uint8_t *aData, int32_t aStride,
+                const IntSize &aSize, SurfaceFormat aFormat)
+{
+  size_t rowLength = size_t(aSize.width) * BytesPerPixel(aFormat);
+  uint64_t hash = HashBytes(reinterpret_cast<const uint8_t*>(&aSize), sizeof(aSize),
+                            uint64_t(aFormat));
+  for (int32_t y = 0; y < aSize.height; y++) {
+    hash = HashBytes(aData + y * aStride, rowLength, hash);
+  }
+  return hash;
+}
 
 DrawEventRecorderPrivate::DrawEventRecorderPrivate(std::ostream *aStream)
   : mOutputStream(aStream)
+  , mStoredSurfaceDataBytes(0)
+  , mStoredSurfaceDataLimit(kDefaultStoredSurfaceDataLimit)
+  , mCanStoreSurfaceData(true)
 {
 }
 
@@ -28,26 +132,344 @@ DrawEventRecorderPrivate::RecordEvent(const RecordedEvent &aEvent)
   Flush();
 }
 
-DrawEventRecorderFile::DrawEventRecorderFile(const char *aFilename)
-  : DrawEventRecorderPrivate(nullptr) 
-  , mOutputFile(aFilename, ofstream::binary)
+void
+DrawEventRecorderPrivate::RecordSourceSurfaceCreation(ReferencePtr aRefPtr, uint8_t *aData,
+                                                      int32_t aStride, const IntSize &aSize,
+                                                      SurfaceFormat aFormat)
 {
-  mOutputStream = &mOutputFile;
+  size_t bytes = size_t(aSize.width) * aSize.height * BytesPerPixel(aFormat);
+
+  if (!mCanStoreSurfaceData ||
+      bytes < kMinStoredSurfaceDataSize || bytes > mStoredSurfaceDataLimit) {
+    RecordEvent(RecordedSourceSurfaceCreation(aRefPtr, aData, aStride, aSize, aFormat));
+    return;
+  }
+
+  uint64_t dataId = HashSurfaceData(aData, aStride, aSize, aFormat);
+
+  map<uint64_t, StoredSurfaceDataList::iterator>::iterator iter =
+    mStoredSurfaceDataIndex.find(dataId);
+  if (iter != mStoredSurfaceDataIndex.end()) {
+    // The size and format are part of the hash, a mismatch means the hash
+    // collided. The stored data keeps its id, this surface is recorded in
+    // full.
+    if (iter->second->mSize != aSize || iter->second->mFormat != aFormat) {
+      RecordEvent(RecordedSourceSurfaceCreation(aRefPtr, aData, aStride, aSize, aFormat));
+      return;
+    }
+    mStoredSurfaceData.splice(mStoredSurfaceData.begin(), mStoredSurfaceData, iter->second);
+  } else {
+    ReleaseStoredSurfaceData(mStoredSurfaceDataLimit - bytes);
 
-  WriteElement(*mOutputStream, kMagicInt);
-  WriteElement(*mOutputStream, kMajorRevision);
-  WriteElement(*mOutputStream, kMinorRevision);
+    RecordEvent(RecordedSurfaceDataStore(dataId, aData, aStride, aSize, aFormat));
+
+    StoredSurfaceData data = { dataId, bytes, aSize, aFormat };
+    mStoredSurfaceData.push_front(data);
+    mStoredSurfaceDataIndex[dataId] = mStoredSurfaceData.begin();
+    mStoredSurfaceDataBytes += bytes;
+  }
+
+  RecordEvent(RecordedSourceSurfaceFromStoredData(aRefPtr, dataId));
 }
 
-DrawEventRecorderFile::~DrawEventRecorderFile()
+void
+DrawEventRecorderPrivate::SetSurfaceDataStoreLimit(size_t aBytes)
+{
+  mStoredSurfaceDataLimit = aBytes;
+  ReleaseStoredSurfaceData(aBytes);
+}
+
+void
+DrawEventRecorderPrivate::ReleaseStoredSurfaceData(size_t aLimit)
 {
+  while (mStoredSurfaceDataBytes > aLimit) {
+    const StoredSurfaceData &data = mStoredSurfaceData.back();
+    RecordEvent(RecordedSurfaceDataRelease(data.mDataId));
+    mStoredSurfaceDataBytes -= data.mBytes;
+    mStoredSurfaceDataIndex.erase(data.mDataId);
+    mStoredSurfaceData.pop_back();
+  }
+}
+
+RecordingFileWriter::RecordingFileWriter(const char *aFilename, bool aCompress)
+  : mOutputFile(aFilename, ofstream::binary)
+  , mChunkStream(&mChunkBuffer)
+  , mChunkEventCount(0)
+  , mCompress(aCompress)
+{
+  WriteElement(mOutputFile, kChunkedMagicInt);
+  WriteElement(mOutputFile, kMajorRevision);
+  WriteElement(mOutputFile, kMinorRevision);
+}
+
+RecordingFileWriter::~RecordingFileWriter()
+{
+  WriteChunk();
+
+  RecordingTrailer trailer;
+  trailer.mIndexOffset = uint64_t(mOutputFile.tellp());
+  trailer.mChunkCount = mChunkIndex.size();
+  trailer.mMagic = kTrailerMagic;
+
+  for (size_t i = 0; i < mChunkIndex.size(); i++) {
+    WriteElement(mOutputFile, mChunkIndex[i]);
+  }
+  WriteElement(mOutputFile, trailer);
+
   mOutputFile.close();
 }
 
 void
-DrawEventRecorderFile::Flush()
+RecordingFileWriter::EventWritten()
+{
+  mChunkEventCount++;
+  if (mChunkBuffer.Length() >= kChunkSize) {
+    WriteChunk();
+  }
+}
+
+void
+RecordingFileWriter::WriteChunk()
 {
+  if (!mChunkEventCount) {
+    return;
+  }
+
+  RecordingIndexEntry entry;
+  entry.mOffset = uint64_t(mOutputFile.tellp());
+  entry.mEventCount = mChunkEventCount;
+  entry.mReserved = 0;
+  mChunkIndex.push_back(entry);
+
+  RecordingChunkHeader header;
+  header.mMagic = kChunkMagic;
+  header.mEventCount = mChunkEventCount;
+  header.mLength = mChunkBuffer.Length();
+
+  size_t compressedLength = 0;
+  if (mCompress) {
+    mCompressedChunk.resize(RecordingCompression::MaxCompressedLength(mChunkBuffer.Length()));
+    compressedLength = RecordingCompression::Compress(mChunkBuffer.Data(), mChunkBuffer.Length(),
+                                                      &mCompressedChunk.front());
+  }
+
+  if (compressedLength && compressedLength + sizeof(uint64_t) < mChunkBuffer.Length()) {
+    header.mMagic = kCompressedChunkMagic;
+    header.mLength = compressedLength + sizeof(uint64_t);
+    WriteElement(mOutputFile, header);
+    WriteElement(mOutputFile, uint64_t(mChunkBuffer.Length()));
+    mOutputFile.write(&mCompressedChunk.front(), compressedLength);
+  } else {
+    WriteElement(mOutputFile, header);
+    mOutputFile.write(mChunkBuffer.Data(), mChunkBuffer.Length());
+  }
   mOutputFile.flush();
+
+  mChunkBuffer.Clear();
+  mChunkEventCount = 0;
+}
+
+DrawEventRecorderFile::DrawEventRecorderFile(const char *aFilename, bool aCompress)
+  : DrawEventRecorderPrivate(nullptr) 
+  , mWriter(aFilename, aCompress)
+{
+  mOutputStream = &mWriter.GetStream();
+}
+
+DrawEventRecorderFile::~DrawEventRecorderFile()
+{
+}
+
+void
+DrawEventRecorderFile::Flush()
+{
+  mWriter.EventWritten();
+}
+
+DrawEventRecorderMemory::DrawEventRecorderMemory(size_t aCapacity, const char *aFilename,
+                                                 bool aCompress)
+  : DrawEventRecorderPrivate(nullptr)
+  , mEventStream(&mEventBuffer)
+  , mRing(std::max<size_t>(aCapacity, 64))
+  , mHead(0)
+  , mTail(0)
+  , mWriter(nullptr)
+  , mShutdown(false)
+  , mDroppedEvents(0)
+  , mStalls(0)
+  , mCompress(aCompress)
+{
+  mOutputStream = &mEventStream;
+  // Overwritten records could take stored surface data with them.
+  mCanStoreSurfaceData = !!aFilename;
+
+  if (aFilename) {
+    mWriter = new RecordingFileWriter(aFilename, aCompress);
+    mDrainThread = std::thread(&DrawEventRecorderMemory::DrainLoop, this);
+  }
+}
+
+DrawEventRecorderMemory::~DrawEventRecorderMemory()
+{
+  if (mWriter) {
+    mShutdown = true;
+    mDrainThread.join();
+    delete mWriter;
+  }
+}
+
+void
+DrawEventRecorderMemory::WriteRecord(const char *aData, uint32_t aLength,
+                                     uint32_t aFlags, uint64_t aHead)
+{
+  uint32_t header = aLength | aFlags;
+  const char *parts[] = { reinterpret_cast<const char*>(&header), aData };
+  size_t lengths[] = { sizeof(uint32_t), aLength };
+
+  for (size_t i = 0; i < 2; i++) {
+    size_t offset = aHead % mRing.size();
+    size_t firstPart = std::min(lengths[i], mRing.size() - offset);
+    memcpy(&mRing[offset], parts[i], firstPart);
+    memcpy(&mRing[0], parts[i] + firstPart, lengths[i] - firstPart);
+    aHead += lengths[i];
+  }
+}
+
+uint32_t
+DrawEventRecorderMemory::ReadRecordHeader(uint64_t aPos) const
+{
+  uint32_t header;
+  char *dest = reinterpret_cast<char*>(&header);
+  for (size_t i = 0; i < sizeof(uint32_t); i++) {
+    dest[i] = mRing[(aPos + i) % mRing.size()];
+  }
+  return header;
+}
+
+void
+DrawEventRecorderMemory::CopyFromRing(uint64_t aPos, size_t aLength,
+                                      std::ostream &aStream) const
+{
+  size_t offset = aPos % mRing.size();
+  size_t firstPart = std::min(aLength, mRing.size() - offset);
+  aStream.write(&mRing[offset], firstPart);
+  aStream.write(&mRing[0], aLength - firstPart);
+}
+
+void
+DrawEventRecorderMemory::Flush()
+{
+  const char *data = mEventBuffer.Data();
+  size_t length = mEventBuffer.Length();
+  uint64_t head = mHead.load(std::memory_order_relaxed);
+
+  if (!mWriter) {
+    size_t recordLength = sizeof(uint32_t) + length;
+    if (recordLength > mRing.size()) {
+      mDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+      mEventBuffer.Clear();
+      return;
+    }
+
+    // Nobody else touches the ring in this mode, make room by discarding the
+    // oldest records.
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+    while (mRing.size() - (head - tail) < recordLength) {
+      tail += sizeof(uint32_t) + ReadRecordHeader(tail);
+    }
+    mTail.store(tail, std::memory_order_relaxed);
+
+    WriteRecord(data, length, 0, head);
+    mHead.store(head + recordLength, std::memory_order_relaxed);
+    mEventBuffer.Clear();
+    return;
+  }
+
+  // Fragments may take at most half the ring so the drain thread can always
+  // free up enough space for the next one.
+  size_t maxFragment = mRing.size() / 2 - sizeof(uint32_t);
+  do {
+    uint32_t fragment = uint32_t(std::min(length, maxFragment));
+    uint32_t flags = fragment < length ? kMoreFragmentsFlag : 0;
+    size_t recordLength = sizeof(uint32_t) + fragment;
+
+    if (mRing.size() - (head - mTail.load(std::memory_order_acquire)) < recordLength) {
+      mStalls.fetch_add(1, std::memory_order_relaxed);
+      do {
+        std::this_thread::yield();
+      } while (mRing.size() - (head - mTail.load(std::memory_order_acquire)) < recordLength);
+    }
+
+    WriteRecord(data, fragment, flags, head);
+    head += recordLength;
+    mHead.store(head, std::memory_order_release);
+
+    data += fragment;
+    length -= fragment;
+  } while (length);
+
+  mEventBuffer.Clear();
+}
+
+bool
+DrawEventRecorderMemory::Drain()
+{
+  uint64_t tail = mTail.load(std::memory_order_relaxed);
+  uint64_t head = mHead.load(std::memory_order_acquire);
+
+  if (tail == head) {
+    return false;
+  }
+
+  while (tail < head) {
+    uint32_t header = ReadRecordHeader(tail);
+    uint32_t length = header & ~kMoreFragmentsFlag;
+
+    CopyFromRing(tail + sizeof(uint32_t), length, mWriter->GetStream());
+    if (!(header & kMoreFragmentsFlag)) {
+      mWriter->EventWritten();
+    }
+
+    tail += sizeof(uint32_t) + length;
+    mTail.store(tail, std::memory_order_release);
+  }
+  return true;
+}
+
+void
+DrawEventRecorderMemory::DrainLoop()
+{
+  for (;;) {
+    // Read the flag first so everything recorded before shutdown was
+    // requested gets drained.
+    bool shutdown = mShutdown;
+    if (Drain()) {
+      continue;
+    }
+    if (shutdown) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+bool
+DrawEventRecorderMemory::DumpToFile(const char *aFilename)
+{
+  if (mWriter) {
+    return false;
+  }
+
+  RecordingFileWriter writer(aFilename, mCompress);
+
+  uint64_t head = mHead.load(std::memory_order_relaxed);
+  for (uint64_t pos = mTail.load(std::memory_order_relaxed); pos < head;) {
+    uint32_t length = ReadRecordHeader(pos);
+    CopyFromRing(pos + sizeof(uint32_t), length, writer.GetStream());
+    writer.EventWritten();
+    pos += sizeof(uint32_t) + length;
+  }
+  return true;
 }
 
 }
@@ -8,8 +8,12 @@
 
 #include "2D.h"
 #include "RecordedEvent.h"
+#include <atomic>
 #include <ostream>
 #include <fstream>
+#include <list>
+#include <map>
+#include <thread>
 
 #if defined(_MSC_VER)
 #include <hash_set>
@@ -47,11 +51,41 @@ public:
     return false;
   }
 
+  /* Records the creation of source surface aRefPtr with the given contents.
+   * The pixel data of larger surfaces is hashed and only written to the
+   * recording the first time those contents are seen, later surfaces with the
+   * same contents refer to the stored copy. Surfaces are only matched by a
+   * 64-bit hash along with their size and format, the pixels themselves
+   * aren't kept around to be compared.
+   */
+  void RecordSourceSurfaceCreation(ReferencePtr aRefPtr, uint8_t *aData, int32_t aStride,
+                                   const IntSize &aSize, SurfaceFormat aFormat);
+
+  /* Sets how many bytes of stored surface data the player is asked to keep
+   * around. The least recently used data is released once this is exceeded,
+   * 0 disables deduplication altogether. Recorders that may lose events never
+   * deduplicate.
+   */
+  void SetSurfaceDataStoreLimit(size_t aBytes);
+
 protected:
   std::ostream *mOutputStream;
 
   virtual void Flush() = 0;
 
+  // Surfaces smaller than this are always recorded in full.
+  static const size_t kMinStoredSurfaceDataSize = 4096;
+
+  struct StoredSurfaceData {
+    uint64_t mDataId;
+    size_t mBytes;
+    IntSize mSize;
+    SurfaceFormat mFormat;
+  };
+  typedef std::list<StoredSurfaceData> StoredSurfaceDataList;
+
+  void ReleaseStoredSurfaceData(size_t aLimit);
+
 #if defined(_MSC_VER)
   typedef stdext::hash_set<const void*> ObjectSet;
 #else
@@ -60,19 +94,128 @@ protected:
 
   ObjectSet mStoredPaths;
   ObjectSet mStoredScaledFonts;
+
+  // Most recently used first.
+  StoredSurfaceDataList mStoredSurfaceData;
+  std::map<uint64_t, StoredSurfaceDataList::iterator> mStoredSurfaceDataIndex;
+  size_t mStoredSurfaceDataBytes;
+  size_t mStoredSurfaceDataLimit;
+  // False for recorders whose events may not all end up in a recording,
+  // surfaces referring to stored data could otherwise outlive the data.
+  bool mCanStoreSurfaceData;
+};
+
+/* Writes events to a chunked recording file (see RecordingTypes.h). Events
+ * are collected in memory and written out a chunk at a time, the chunk index
+ * is written when the writer is destroyed. With aCompress chunks are
+ * compressed before they're written, unless that doesn't make them smaller.
+ */
+class RecordingFileWriter
+{
+public:
+  explicit RecordingFileWriter(const char *aFilename, bool aCompress = false);
+  ~RecordingFileWriter();
+
+  // Events are written to this stream, EventWritten() must be called after
+  // each complete event.
+  std::ostream &GetStream() { return mChunkStream; }
+  void EventWritten();
+
+private:
+  // Chunks are written once they grow beyond this size.
+  static const size_t kChunkSize = 1 << 20;
+
+  void WriteChunk();
+
+  std::ofstream mOutputFile;
+  VectorStreamBuffer mChunkBuffer;
+  std::ostream mChunkStream;
+  uint32_t mChunkEventCount;
+  std::vector<RecordingIndexEntry> mChunkIndex;
+  bool mCompress;
+  std::vector<char> mCompressedChunk;
 };
 
 class DrawEventRecorderFile : public DrawEventRecorderPrivate
 {
 public:
   MOZ_DECLARE_REFCOUNTED_VIRTUAL_TYPENAME(DrawEventRecorderFile)
-  explicit DrawEventRecorderFile(const char *aFilename);
+  explicit DrawEventRecorderFile(const char *aFilename, bool aCompress = false);
   ~DrawEventRecorderFile();
 
 private:
   virtual void Flush();
 
-  std::ofstream mOutputFile;
+  RecordingFileWriter mWriter;
+};
+
+/* Records into a fixed size ring buffer in memory, the recording thread never
+ * waits for I/O or takes a lock.
+ *
+ * When a filename is given a background thread continuously drains the ring
+ * buffer to that file. If the ring buffer fills up the recording thread
+ * waits for the drain thread to make room (see GetStallCount()), so no events
+ * are lost.
+ *
+ * Without a filename the recorder acts as a flight recorder: the oldest
+ * events are overwritten as new ones come in and DumpToFile() writes out the
+ * events that are currently retained. Such a dump usually lacks the creation
+ * events of objects referenced by the retained events, it's meant for
+ * inspecting what happened most recently rather than for full playback.
+ * Surface data isn't deduplicated in this mode, every surface creation is
+ * recorded with its pixels so it doesn't depend on data that may have been
+ * overwritten.
+ */
+class DrawEventRecorderMemory : public DrawEventRecorderPrivate
+{
+public:
+  MOZ_DECLARE_REFCOUNTED_VIRTUAL_TYPENAME(DrawEventRecorderMemory)
+  explicit DrawEventRecorderMemory(size_t aCapacity, const char *aFilename = nullptr,
+                                   bool aCompress = false);
+  ~DrawEventRecorderMemory();
+
+  /* Writes the retained events to a recording file. Only available in flight
+   * recorder mode, and must be called on the thread that is recording.
+   */
+  bool DumpToFile(const char *aFilename);
+
+  // Events that didn't fit in the ring buffer at all, flight recorder only.
+  // These counters may be read from any thread.
+  uint64_t GetDroppedEventCount() const { return mDroppedEvents.load(std::memory_order_relaxed); }
+  // Number of times the recording thread had to wait for the drain thread.
+  uint64_t GetStallCount() const { return mStalls.load(std::memory_order_relaxed); }
+
+private:
+  // Every record in the ring buffer starts with a uint32_t holding the record
+  // length. Events too large for the ring are split into several records,
+  // all but the last have this bit set.
+  static const uint32_t kMoreFragmentsFlag = 0x80000000;
+
+  virtual void Flush();
+
+  void WriteRecord(const char *aData, uint32_t aLength, uint32_t aFlags, uint64_t aHead);
+  uint32_t ReadRecordHeader(uint64_t aPos) const;
+  void CopyFromRing(uint64_t aPos, size_t aLength, std::ostream &aStream) const;
+
+  void DrainLoop();
+  bool Drain();
+
+  VectorStreamBuffer mEventBuffer;
+  std::ostream mEventStream;
+
+  std::vector<char> mRing;
+  // Positions are byte counts since the start of recording, the position in
+  // mRing is taken modulo its size.
+  std::atomic<uint64_t> mHead;
+  std::atomic<uint64_t> mTail;
+
+  RecordingFileWriter *mWriter;
+  std::thread mDrainThread;
+  std::atomic<bool> mShutdown;
+
+  std::atomic<uint64_t> mDroppedEvents;
+  std::atomic<uint64_t> mStalls;
+  bool mCompress;
 };
 
 }
@@ -7,6 +7,7 @@
 #include "Logging.h"
 
 #include "DrawTargetCapture.h"
+#include "ShadowMaskCache.h"
 
 namespace mozilla {
 namespace gfx {
@@ -35,5 +36,38 @@ DrawTarget::DrawCapturedDT(DrawTargetCapture *aCaptureDT,
   static_cast<DrawTargetCaptureImpl*>(aCaptureDT)->ReplayToDrawTarget(this, aTransform);
 }
 
+void
+DrawTarget::DrawBoxShadow(const Rect& aRect, const Size* aCornerRadii,
+                          const Color& aColor, Float aSigma,
+                          const DrawOptions& aOptions)
+{
+  IntRect box = RoundedToInt(aRect);
+  if (box.IsEmpty()) {
+    return;
+  }
+
+  std::vector<BoxShadowPatch> patches;
+  RefPtr<DataSourceSurface> shadowTemplate =
+    ShadowMaskCache::GetBoxShadow(box, aCornerRadii, aSigma, &patches);
+  if (!shadowTemplate) {
+    return;
+  }
+  // The template is a plain data surface, which DrawTargets that need their
+  // own surfaces, like recording ones, have to be given through here.
+  RefPtr<SourceSurface> mask = OptimizeSourceSurface(shadowTemplate);
+  if (!mask) {
+    return;
+  }
+
+  ColorPattern color(aColor);
+  for (size_t i = 0; i < patches.size(); i++) {
+    const BoxShadowPatch& patch = patches[i];
+    PushClipRect(Rect(patch.mDest));
+    Mask(color, SurfacePattern(mask, ExtendMode::CLAMP,
+                               patch.mTemplateTransform), aOptions);
+    PopClip();
+  }
+}
+
 }
 }
@@ -11,6 +11,8 @@
 #include "ScaledFontBase.h"
 #include "BorrowedContext.h"
 #include "FilterNodeSoftware.h"
+#include "MipmapCache.h"
+#include "ShadowMaskCache.h"
 #include "mozilla/Scoped.h"
 
 #include "cairo.h"
@@ -657,16 +659,29 @@ DrawTargetCairo::DrawSurface(SourceSurface *aSurface,
                              const DrawOptions &aOptions)
 {
   AutoPrepareForDrawing prep(this, mContext);
-  AutoClearDeviceOffset clear(aSurface);
 
-  float sx = aSource.Width() / aDest.Width();
-  float sy = aSource.Height() / aDest.Height();
+  // Draw minified surfaces from a smaller copy, which cairo can sample
+  // without skipping over pixels.
+  RefPtr<SourceSurface> surface = aSurface;
+  Rect source = aSource;
+  if (aSurfOptions.mFilter != Filter::POINT) {
+    RefPtr<DataSourceSurface> level =
+      MipmapCache::GetLevelForDrawSurface(aSurface, aDest, aSource, mTransform, &source);
+    if (level) {
+      surface = level;
+    }
+  }
+
+  AutoClearDeviceOffset clear(surface);
+
+  float sx = source.Width() / aDest.Width();
+  float sy = source.Height() / aDest.Height();
 
   cairo_matrix_t src_mat;
-  cairo_matrix_init_translate(&src_mat, aSource.X(), aSource.Y());
+  cairo_matrix_init_translate(&src_mat, source.X(), source.Y());
   cairo_matrix_scale(&src_mat, sx, sy);
 
-  cairo_surface_t* surf = GetCairoSurfaceForSourceSurface(aSurface);
+  cairo_surface_t* surf = GetCairoSurfaceForSourceSurface(surface);
   cairo_pattern_t* pat = cairo_pattern_create_for_surface(surf);
   cairo_surface_destroy(surf);
 
@@ -739,17 +754,40 @@ DrawTargetCairo::DrawSurfaceWithShadow(SourceSurface *aSurface,
   // We only use the A8 surface for blurred shadows. Unblurred shadows can just
   // use the RGBA surface directly.
   if (cairo_surface_get_type(sourcesurf) == CAIRO_SURFACE_TYPE_TEE) {
-    blursurf = cairo_tee_surface_index(sourcesurf, 0);
+    cairo_surface_t* alphasurf = cairo_tee_surface_index(sourcesurf, 0);
     surf = cairo_tee_surface_index(sourcesurf, 1);
 
-    MOZ_ASSERT(cairo_surface_get_type(blursurf) == CAIRO_SURFACE_TYPE_IMAGE);
-    Rect extents(0, 0, width, height);
-    AlphaBoxBlur blur(extents,
-                      cairo_image_surface_get_stride(blursurf),
-                      aSigma, aSigma);
-    blur.Blur(cairo_image_surface_get_data(blursurf));
+    MOZ_ASSERT(cairo_surface_get_type(alphasurf) == CAIRO_SURFACE_TYPE_IMAGE);
+    if (!ShadowMaskCache::IsEnabled()) {
+      Rect extents(0, 0, width, height);
+      AlphaBoxBlur blur(extents,
+                        cairo_image_surface_get_stride(alphasurf),
+                        aSigma, aSigma);
+      blur.BlurDownscaled(cairo_image_surface_get_data(alphasurf));
+      blursurf = cairo_surface_reference(alphasurf);
+    } else {
+      // The mask is blurred into a surface of its own rather than in place,
+      // so it can be kept for the next time this surface is drawn.
+      IntSize size = aSurface->GetSize();
+      IntPoint maskOffset;
+      RefPtr<DataSourceSurface> mask =
+        ShadowMaskCache::GetMask(aSurface, [alphasurf, size]() -> TemporaryRef<DataSourceSurface> {
+            cairo_surface_flush(alphasurf);
+            return Factory::CreateWrappingDataSourceSurface(cairo_image_surface_get_data(alphasurf),
+                                                            cairo_image_surface_get_stride(alphasurf),
+                                                            size, SurfaceFormat::A8);
+          }, aSigma, false, &maskOffset);
+      MOZ_ASSERT(maskOffset == IntPoint());
+      if (!mask) {
+        return;
+      }
+      blursurf = GetCairoSurfaceForSourceSurface(mask);
+      if (!blursurf) {
+        return;
+      }
+    }
   } else {
-    blursurf = sourcesurf;
+    blursurf = cairo_surface_reference(sourcesurf);
     surf = sourcesurf;
   }
 
@@ -785,6 +823,7 @@ DrawTargetCairo::DrawSurfaceWithShadow(SourceSurface *aSurface,
   }
 
   cairo_restore(mContext);
+  cairo_surface_destroy(blursurf);
 }
 
 void
@@ -798,9 +837,12 @@ DrawTargetCairo::DrawPattern(const Pattern& aPattern,
     return;
   }
 
-  AutoClearDeviceOffset clear(aPattern);
+  MipmappedPattern mipmapped(aPattern, mTransform);
+  const Pattern& pattern = mipmapped.Get();
 
-  cairo_pattern_t* pat = GfxPatternToCairoPattern(aPattern, aOptions.mAlpha);
+  AutoClearDeviceOffset clear(pattern);
+
+  cairo_pattern_t* pat = GfxPatternToCairoPattern(pattern, aOptions.mAlpha);
   if (!pat) {
     return;
   }
@@ -814,7 +856,7 @@ DrawTargetCairo::DrawPattern(const Pattern& aPattern,
 
   cairo_set_antialias(mContext, GfxAntialiasToCairoAntialias(aOptions.mAntialiasMode));
 
-  if (NeedIntermediateSurface(aPattern, aOptions) ||
+  if (NeedIntermediateSurface(pattern, aOptions) ||
       (!IsOperatorBoundByMask(aOptions.mCompositionOp) && !aPathBoundsClip)) {
     cairo_push_group_with_content(mContext, CAIRO_CONTENT_COLOR_ALPHA);
 
@@ -6,20 +6,14 @@
 #include "DrawTargetCapture.h"
 #include "DrawCommand.h"
 
+#include <vector>
+
 namespace mozilla {
 namespace gfx {
 
 
 DrawTargetCaptureImpl::~DrawTargetCaptureImpl()
 {
-  uint8_t* start = &mDrawCommandStorage.front();
-
-  uint8_t* current = start;
-
-  while (current < start + mDrawCommandStorage.size()) {
-    reinterpret_cast<DrawingCommand*>(current + sizeof(uint32_t))->~DrawingCommand();
-    current += *(uint32_t*)current;
-  }
 }
 
 bool
@@ -178,18 +172,352 @@ void
 DrawTargetCaptureImpl::SetTransform(const Matrix& aTransform)
 {
   AppendCommand(SetTransformCommand)(aTransform);
+  DrawTarget::SetTransform(aTransform);
+  mHasTransform = true;
 }
 
 void
 DrawTargetCaptureImpl::ReplayToDrawTarget(DrawTarget* aDT, const Matrix& aTransform)
 {
-  uint8_t* start = &mDrawCommandStorage.front();
+  for (CaptureCommandList::Iterator iter(mCommands); !iter.Done(); iter.Next()) {
+    iter.Get()->ExecuteOnDT(aDT, aTransform);
+  }
+}
+
+void
+DrawTargetCaptureImpl::ClearCommands()
+{
+  mCommands.Clear();
+
+  // Recording the current transform makes the new list independent of the
+  // target's state, which lets OptimizeCommands work from the start.
+  if (mHasTransform) {
+    AppendCommand(SetTransformCommand)(mTransform);
+  }
+}
+
+namespace {
+
+struct ClipState
+{
+  // Device space bounds of the clip, nothing outside of them is drawn.
+  Rect mBounds;
+  // Device space pixels that are known to be entirely inside the clip.
+  Rect mInterior;
+  DrawingCommand* mPushCommand;
+  bool mHasDraws;
+};
+
+/**
+ * Follows the transform and the clip stack through a command list, to find
+ * out where in device space each command draws.
+ *
+ * Until the first SetTransform the transform is whatever the target has when
+ * the commands are replayed, so nothing is known about where commands draw.
+ * Clips that were pushed before the first command are unknown too, but they
+ * can only make the drawn area smaller.
+ */
+class CommandBoundsTracker
+{
+public:
+  explicit CommandBoundsTracker(const IntSize& aSize)
+    : mTargetRect(0, 0, Float(aSize.width), Float(aSize.height))
+    , mHasTransform(false)
+  {
+    ClipState unclipped = { mTargetRect, mTargetRect, nullptr, true };
+    mUnclipped = unclipped;
+  }
+
+  bool HasTransform() const { return mHasTransform; }
+  const Matrix& GetTransform() const { return mTransform; }
+
+  ClipState& CurrentClip() { return mClips.empty() ? mUnclipped : mClips.back(); }
+
+  void SetTransform(const Matrix& aTransform)
+  {
+    mTransform = aTransform;
+    mHasTransform = true;
+  }
+
+  void PushClip(DrawingCommand* aCommand)
+  {
+    ClipState& clip = CurrentClip();
+    ClipState newClip = { clip.mBounds, Rect(), aCommand, false };
+    if (mHasTransform) {
+      Rect bounds;
+      if (aCommand->GetType() == CommandType::PUSHCLIPRECT) {
+        bounds = mTransform.TransformBounds(static_cast<PushClipRectCommand*>(aCommand)->GetRect());
+        if (bounds.IsFinite() && mTransform.PreservesAxisAlignedRectangles()) {
+          Rect interior = bounds;
+          interior.RoundIn();
+          newClip.mInterior = interior.Intersect(clip.mInterior);
+        }
+      } else {
+        bounds = static_cast<PushClipCommand*>(aCommand)->GetPath()->GetBounds(mTransform);
+      }
+      if (bounds.IsFinite()) {
+        bounds.RoundOut();
+        newClip.mBounds = bounds.Intersect(clip.mBounds);
+      }
+    }
+    mClips.push_back(newClip);
+  }
+
+  // Returns false if the clip was pushed before the first command.
+  bool PopClip(ClipState* aPopped)
+  {
+    if (mClips.empty()) {
+      return false;
+    }
+    *aPopped = mClips.back();
+    mClips.pop_back();
+    return true;
+  }
+
+  /**
+   * Sets aBounds to the device space bounds of what a drawing command draws,
+   * rounded out to whole pixels, and returns true. Returns false if those are
+   * unknown. If aOpaqueRect is given it's set to the pixels the command
+   * completely replaces.
+   */
+  bool GetDeviceBounds(DrawingCommand* aCommand, Rect* aBounds, Rect* aOpaqueRect = nullptr)
+  {
+    if (aOpaqueRect) {
+      *aOpaqueRect = Rect();
+    }
+
+    if (aCommand->GetType() == CommandType::COPYSURFACE) {
+      // CopySurface ignores the transform and the clip.
+      *aBounds = Rect(static_cast<CopySurfaceCommand*>(aCommand)->GetDestRect());
+      *aBounds = aBounds->Intersect(mTargetRect);
+      if (aOpaqueRect) {
+        *aOpaqueRect = *aBounds;
+      }
+      return true;
+    }
+
+    Rect bounds;
+    if (!mHasTransform || !aCommand->GetBounds(bounds)) {
+      return false;
+    }
+    bounds = mTransform.TransformBounds(bounds);
+    if (!bounds.IsFinite()) {
+      return false;
+    }
+
+    ClipState& clip = CurrentClip();
+    *aBounds = bounds;
+    aBounds->RoundOut();
+    *aBounds = aBounds->Intersect(clip.mBounds).Intersect(mTargetRect);
+
+    if (aOpaqueRect && aCommand->IsOpaque() &&
+        mTransform.PreservesAxisAlignedRectangles()) {
+      // Antialiased edges only partially cover their pixels.
+      bounds.RoundIn();
+      *aOpaqueRect = bounds.Intersect(clip.mInterior).Intersect(mTargetRect);
+    }
+    return true;
+  }
+
+private:
+  Rect mTargetRect;
+  ClipState mUnclipped;
+  std::vector<ClipState> mClips;
+  bool mHasTransform;
+  Matrix mTransform;
+};
+
+struct DrawState
+{
+  DrawingCommand* mCommand;
+  // Device space bounds of what the command draws, if mHasBounds is set.
+  Rect mBounds;
+  bool mHasBounds;
+  // Device space pixels the command completely replaces.
+  Rect mOpaqueRect;
+};
+
+// Limits the cost of the occlusion test, only the largest opaque areas are
+// kept.
+const size_t kMaxOccluders = 16;
+
+Float
+GetArea(const Rect& aRect)
+{
+  return aRect.width * aRect.height;
+}
+
+}
+
+uint32_t
+DrawTargetCaptureImpl::OptimizeCommands()
+{
+  uint32_t removed = 0;
+  CommandBoundsTracker tracker(mSize);
+  // The last SetTransform, as long as nothing has used it yet.
+  DrawingCommand* unusedTransform = nullptr;
+
+  std::vector<DrawState> draws;
+
+  for (CaptureCommandList::Iterator iter(mCommands); !iter.Done(); iter.Next()) {
+    DrawingCommand* command = iter.Get();
+
+    switch (command->GetType()) {
+    case CommandType::SETTRANSFORM:
+    {
+      const Matrix& transform = static_cast<SetTransformCommand*>(command)->GetTransform();
+      if (tracker.HasTransform() && transform == tracker.GetTransform()) {
+        mCommands.Remove(command);
+        removed++;
+        continue;
+      }
+      if (unusedTransform) {
+        mCommands.Remove(unusedTransform);
+        removed++;
+      }
+      unusedTransform = command;
+      tracker.SetTransform(transform);
+      continue;
+    }
+    case CommandType::PUSHCLIP:
+    case CommandType::PUSHCLIPRECT:
+      unusedTransform = nullptr;
+      tracker.PushClip(command);
+      continue;
+    case CommandType::POPCLIP:
+    {
+      ClipState popped;
+      if (!tracker.PopClip(&popped)) {
+        continue;
+      }
+      if (!popped.mHasDraws) {
+        mCommands.Remove(popped.mPushCommand);
+        mCommands.Remove(command);
+        removed += 2;
+      } else {
+        tracker.CurrentClip().mHasDraws = true;
+      }
+      continue;
+    }
+    default:
+      break;
+    }
+
+    if (command->GetType() != CommandType::COPYSURFACE) {
+      unusedTransform = nullptr;
+    }
+    DrawState draw = { command, Rect(), false, Rect() };
+    draw.mHasBounds = tracker.GetDeviceBounds(command, &draw.mBounds, &draw.mOpaqueRect);
+    if (draw.mHasBounds && draw.mBounds.IsEmpty()) {
+      mCommands.Remove(command);
+      removed++;
+      continue;
+    }
+    draws.push_back(draw);
+    tracker.CurrentClip().mHasDraws = true;
+  }
+
+  // Nothing reads back what was drawn, so anything a later opaque draw
+  // covers completely doesn't need to be drawn at all.
+  std::vector<Rect> occluders;
+  for (size_t i = draws.size(); i-- > 0;) {
+    const DrawState& draw = draws[i];
+    if (draw.mHasBounds) {
+      bool occluded = false;
+      for (size_t j = 0; j < occluders.size() && !occluded; j++) {
+        occluded = occluders[j].Contains(draw.mBounds);
+      }
+      if (occluded) {
+        mCommands.Remove(draw.mCommand);
+        removed++;
+        continue;
+      }
+    }
+
+    if (draw.mOpaqueRect.IsEmpty()) {
+      continue;
+    }
+    if (occluders.size() < kMaxOccluders) {
+      occluders.push_back(draw.mOpaqueRect);
+      continue;
+    }
+    size_t smallest = 0;
+    for (size_t j = 1; j < occluders.size(); j++) {
+      if (GetArea(occluders[j]) < GetArea(occluders[smallest])) {
+        smallest = j;
+      }
+    }
+    if (GetArea(occluders[smallest]) < GetArea(draw.mOpaqueRect)) {
+      occluders[smallest] = draw.mOpaqueRect;
+    }
+  }
 
-  uint8_t* current = start;
+  return removed;
+}
+
+void
+DrawTargetCaptureImpl::ReplayToTiles(const TileSet& aTiles)
+{
+  // Bin the commands: changes to the transform and the clip go to every
+  // tile, drawing commands only to the tiles they can touch.
+  std::vector<std::vector<DrawingCommand*> > bins(aTiles.mTileCount);
+  CommandBoundsTracker tracker(mSize);
+  // The tiles start out with the capture's initial transform, see below.
+  tracker.SetTransform(Matrix());
+
+  for (CaptureCommandList::Iterator iter(mCommands); !iter.Done(); iter.Next()) {
+    DrawingCommand* command = iter.Get();
+    Rect bounds;
+
+    switch (command->GetType()) {
+    case CommandType::SETTRANSFORM:
+      tracker.SetTransform(static_cast<SetTransformCommand*>(command)->GetTransform());
+      break;
+    case CommandType::PUSHCLIP:
+    case CommandType::PUSHCLIPRECT:
+      tracker.PushClip(command);
+      break;
+    case CommandType::POPCLIP:
+    {
+      ClipState popped;
+      tracker.PopClip(&popped);
+      break;
+    }
+    default:
+      if (!tracker.GetDeviceBounds(command, &bounds)) {
+        break;
+      }
+      for (size_t i = 0; i < aTiles.mTileCount; i++) {
+        const Tile& tile = aTiles.mTiles[i];
+        IntSize size = tile.mDrawTarget->GetSize();
+        Rect tileRect(Float(tile.mTileOrigin.x), Float(tile.mTileOrigin.y),
+                      Float(size.width), Float(size.height));
+        if (tileRect.Intersects(bounds)) {
+          bins[i].push_back(command);
+        }
+      }
+      continue;
+    }
+
+    for (size_t i = 0; i < aTiles.mTileCount; i++) {
+      bins[i].push_back(command);
+    }
+  }
 
-  while (current < start + mDrawCommandStorage.size()) {
-    reinterpret_cast<DrawingCommand*>(current + sizeof(uint32_t))->ExecuteOnDT(aDT, aTransform);
-    current += *(uint32_t*)current;
+  for (size_t tileIndex = 0; tileIndex < aTiles.mTileCount; tileIndex++) {
+    const Tile& tile = aTiles.mTiles[tileIndex];
+    Matrix oldTransform = tile.mDrawTarget->GetTransform();
+    Matrix transform = Matrix::Translation(Float(-tile.mTileOrigin.x),
+                                           Float(-tile.mTileOrigin.y));
+    // Commands before the first SetTransform draw with the capture's initial
+    // identity transform.
+    tile.mDrawTarget->SetTransform(transform);
+    const std::vector<DrawingCommand*>& bin = bins[tileIndex];
+    for (size_t i = 0; i < bin.size(); i++) {
+      bin[i]->ExecuteOnDT(tile.mDrawTarget, transform);
+    }
+    tile.mDrawTarget->SetTransform(oldTransform);
+    tile.mDrawTarget->Flush();
   }
 }
 
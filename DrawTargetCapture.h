@@ -9,6 +9,7 @@
 #include "2D.h"
 #include <vector>
 
+#include "CaptureCommandList.h"
 #include "Filters.h"
 
 namespace mozilla {
@@ -20,6 +21,7 @@ class DrawTargetCaptureImpl : public DrawTargetCapture
 {
 public:
   DrawTargetCaptureImpl()
+    : mHasTransform(false)
   {}
 
   bool Init(const IntSize& aSize, DrawTarget* aRefDT);
@@ -131,6 +133,10 @@ public:
     return mRefDT->CreateFilter(aType);
   }
 
+  virtual void ClearCommands();
+  virtual uint32_t OptimizeCommands();
+  virtual void ReplayToTiles(const TileSet& aTiles);
+
   void ReplayToDrawTarget(DrawTarget* aDT, const Matrix& aTransform);
 
 protected:
@@ -138,23 +144,19 @@ protected:
 
 private:
 
-  // This storage system was used to minimize the amount of heap allocations
-  // that are required while recording. It should be noted there's no
-  // guarantees on the alignments of DrawingCommands allocated in this array.
   template<typename T>
   T* AppendToCommandList()
   {
-    size_t oldSize = mDrawCommandStorage.size();
-    mDrawCommandStorage.resize(mDrawCommandStorage.size() + sizeof(T) + sizeof(uint32_t));
-    uint8_t* nextDrawLocation = &mDrawCommandStorage.front() + oldSize;
-    *(uint32_t*)(nextDrawLocation) = sizeof(T) + sizeof(uint32_t);
-    return reinterpret_cast<T*>(nextDrawLocation + sizeof(uint32_t));
+    return mCommands.Append<T>();
   }
   RefPtr<DrawTarget> mRefDT;
 
   IntSize mSize;
 
-  std::vector<uint8_t> mDrawCommandStorage;
+  CaptureCommandList mCommands;
+  // Whether a transform was ever set. If so, the command list starts with the
+  // current transform after ClearCommands().
+  bool mHasTransform;
 };
 
 } /* namespace mozilla */
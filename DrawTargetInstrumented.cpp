@@ -0,0 +1,441 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "DrawTargetInstrumented.h"
+
+#include "Tools.h"
+
+#include <sstream>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <chrono>
+#endif
+
+namespace mozilla {
+namespace gfx {
+
+static uint64_t
+NowInNanoseconds()
+{
+#ifdef WIN32
+  // steady_clock only has millisecond resolution with older MSVC versions.
+  static LARGE_INTEGER sFrequency;
+  if (!sFrequency.QuadPart) {
+    ::QueryPerformanceFrequency(&sFrequency);
+  }
+  LARGE_INTEGER now;
+  ::QueryPerformanceCounter(&now);
+  return uint64_t(double(now.QuadPart) * 1e9 / double(sFrequency.QuadPart));
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static uint64_t
+SurfaceBytes(const IntSize &aSize, SurfaceFormat aFormat)
+{
+  return uint64_t(aSize.width) * aSize.height * BytesPerPixel(aFormat);
+}
+
+/**
+ * Times the enclosing scope and adds it to aStats as a call to aOperation on
+ * destruction. The pixel and allocation counts can be filled in meanwhile.
+ */
+class AutoRecordOperation
+{
+public:
+  AutoRecordOperation(DrawTargetStats *aStats, DrawTargetStats::Operation aOperation,
+                      uint64_t aPixels = 0)
+    : mStats(aStats)
+    , mOperation(aOperation)
+    , mPixels(aPixels)
+    , mAllocatedBytes(0)
+    , mStart(NowInNanoseconds())
+  {}
+
+  ~AutoRecordOperation()
+  {
+    mStats->Record(mOperation, NowInNanoseconds() - mStart, mPixels, mAllocatedBytes);
+  }
+
+  void SetAllocatedBytes(uint64_t aBytes) { mAllocatedBytes = aBytes; }
+
+private:
+  DrawTargetStats *mStats;
+  DrawTargetStats::Operation mOperation;
+  uint64_t mPixels;
+  uint64_t mAllocatedBytes;
+  uint64_t mStart;
+};
+
+// Indexed by DrawTargetStats::Operation.
+static const char* const sOperationNames[] = {
+  "FillRect",
+  "StrokeRect",
+  "StrokeLine",
+  "Stroke",
+  "Fill",
+  "FillGlyphs",
+  "Mask",
+  "MaskSurface",
+  "DrawSurface",
+  "DrawSurfaceWithShadow",
+  "DrawFilter",
+  "ClearRect",
+  "CopySurface",
+  "CopyRect",
+  "PushClip",
+  "PushClipRect",
+  "PopClip",
+  "Snapshot",
+  "Flush",
+  "CreateSourceSurfaceFromData",
+  "OptimizeSourceSurface",
+  "CreateSimilarDrawTarget"
+};
+
+static_assert(sizeof(sOperationNames) / sizeof(sOperationNames[0]) ==
+                DrawTargetStats::OPERATION_COUNT,
+              "Every operation needs a name");
+
+void
+DrawTargetStats::Reset()
+{
+  memset(mCounters, 0, sizeof(mCounters));
+}
+
+/* static */ const char*
+DrawTargetStats::GetOperationName(Operation aOperation)
+{
+  return sOperationNames[aOperation];
+}
+
+std::string
+DrawTargetStats::ToJSON() const
+{
+  std::stringstream json;
+  json << "{";
+  bool first = true;
+  for (int i = 0; i < OPERATION_COUNT; i++) {
+    const Counters& counters = mCounters[i];
+    if (!counters.mCalls) {
+      continue;
+    }
+    if (!first) {
+      json << ", ";
+    }
+    first = false;
+    json << "\"" << sOperationNames[i] << "\": {"
+         << "\"calls\": " << counters.mCalls
+         << ", \"timeMs\": " << double(counters.mNanoseconds) / 1e6
+         << ", \"pixels\": " << counters.mPixels
+         << ", \"allocatedBytes\": " << counters.mAllocatedBytes
+         << "}";
+  }
+  json << "}";
+  return json.str();
+}
+
+DrawTargetInstrumented::DrawTargetInstrumented(DrawTarget *aDT, DrawTargetStats *aStats)
+  : mDT(aDT)
+  , mStats(aStats)
+{
+  mFormat = aDT->GetFormat();
+  mTransform = aDT->GetTransform();
+  mPermitSubpixelAA = aDT->GetPermitSubpixelAA();
+}
+
+static uint64_t
+PixelsWithin(const Rect &aBounds, const Rect &aLimit)
+{
+  Rect bounds = aBounds.Intersect(aLimit);
+  bounds.RoundOut();
+  if (bounds.IsEmpty()) {
+    return 0;
+  }
+  return uint64_t(bounds.width) * uint64_t(bounds.height);
+}
+
+Rect
+DrawTargetInstrumented::ClipBounds()
+{
+  if (!mClipBounds.empty()) {
+    return mClipBounds.back();
+  }
+  IntSize size = mDT->GetSize();
+  return Rect(0, 0, size.width, size.height);
+}
+
+uint64_t
+DrawTargetInstrumented::PixelsIn(const Rect &aBounds)
+{
+  return PixelsWithin(aBounds, ClipBounds());
+}
+
+uint64_t
+DrawTargetInstrumented::PixelsInTarget(const Rect &aBounds)
+{
+  IntSize size = mDT->GetSize();
+  return PixelsWithin(aBounds, Rect(0, 0, size.width, size.height));
+}
+
+TemporaryRef<SourceSurface>
+DrawTargetInstrumented::Snapshot()
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::SNAPSHOT);
+  return mDT->Snapshot();
+}
+
+void
+DrawTargetInstrumented::Flush()
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::FLUSH);
+  mDT->Flush();
+}
+
+void
+DrawTargetInstrumented::DrawSurface(SourceSurface *aSurface,
+                                    const Rect &aDest,
+                                    const Rect &aSource,
+                                    const DrawSurfaceOptions &aSurfOptions,
+                                    const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::DRAW_SURFACE,
+                             PixelsInUserRect(aDest));
+  mDT->DrawSurface(aSurface, aDest, aSource, aSurfOptions, aOptions);
+}
+
+void
+DrawTargetInstrumented::DrawFilter(FilterNode *aNode,
+                                   const Rect &aSourceRect,
+                                   const Point &aDestPoint,
+                                   const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::DRAW_FILTER,
+                             PixelsInUserRect(Rect(aDestPoint, aSourceRect.Size())));
+  mDT->DrawFilter(aNode, aSourceRect, aDestPoint, aOptions);
+}
+
+void
+DrawTargetInstrumented::DrawSurfaceWithShadow(SourceSurface *aSurface,
+                                              const Point &aDest,
+                                              const Color &aColor,
+                                              const Point &aOffset,
+                                              Float aSigma,
+                                              CompositionOp aOperator)
+{
+  // This works in device space. Cover the surface and its shadow, blurred by
+  // three times the standard deviation.
+  Rect surfaceRect(aDest, Size(aSurface->GetSize()));
+  Rect shadowRect = surfaceRect + aOffset;
+  shadowRect.Inflate(3 * aSigma);
+  AutoRecordOperation record(mStats, DrawTargetStats::DRAW_SURFACE_WITH_SHADOW,
+                             PixelsIn(surfaceRect.Union(shadowRect)));
+  mDT->DrawSurfaceWithShadow(aSurface, aDest, aColor, aOffset, aSigma, aOperator);
+}
+
+void
+DrawTargetInstrumented::ClearRect(const Rect &aRect)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::CLEAR_RECT,
+                             PixelsInUserRect(aRect));
+  mDT->ClearRect(aRect);
+}
+
+void
+DrawTargetInstrumented::CopySurface(SourceSurface *aSurface,
+                                    const IntRect &aSourceRect,
+                                    const IntPoint &aDestination)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::COPY_SURFACE,
+                             PixelsInTarget(Rect(IntRect(aDestination, aSourceRect.Size()))));
+  mDT->CopySurface(aSurface, aSourceRect, aDestination);
+}
+
+void
+DrawTargetInstrumented::CopyRect(const IntRect &aSourceRect,
+                                 const IntPoint &aDestination)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::COPY_RECT,
+                             PixelsInTarget(Rect(IntRect(aDestination, aSourceRect.Size()))));
+  mDT->CopyRect(aSourceRect, aDestination);
+}
+
+void
+DrawTargetInstrumented::FillRect(const Rect &aRect,
+                                 const Pattern &aPattern,
+                                 const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::FILL_RECT,
+                             PixelsInUserRect(aRect));
+  mDT->FillRect(aRect, aPattern, aOptions);
+}
+
+void
+DrawTargetInstrumented::StrokeRect(const Rect &aRect,
+                                   const Pattern &aPattern,
+                                   const StrokeOptions &aStrokeOptions,
+                                   const DrawOptions &aOptions)
+{
+  Rect bounds = aRect;
+  bounds.Inflate(aStrokeOptions.mLineWidth / 2);
+  AutoRecordOperation record(mStats, DrawTargetStats::STROKE_RECT,
+                             PixelsInUserRect(bounds));
+  mDT->StrokeRect(aRect, aPattern, aStrokeOptions, aOptions);
+}
+
+void
+DrawTargetInstrumented::StrokeLine(const Point &aStart,
+                                   const Point &aEnd,
+                                   const Pattern &aPattern,
+                                   const StrokeOptions &aStrokeOptions,
+                                   const DrawOptions &aOptions)
+{
+  Rect bounds(aStart, Size());
+  bounds = bounds.UnionEdges(Rect(aEnd, Size()));
+  bounds.Inflate(aStrokeOptions.mLineWidth / 2);
+  AutoRecordOperation record(mStats, DrawTargetStats::STROKE_LINE,
+                             PixelsInUserRect(bounds));
+  mDT->StrokeLine(aStart, aEnd, aPattern, aStrokeOptions, aOptions);
+}
+
+void
+DrawTargetInstrumented::Stroke(const Path *aPath,
+                               const Pattern &aPattern,
+                               const StrokeOptions &aStrokeOptions,
+                               const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::STROKE,
+                             PixelsIn(aPath->GetStrokedBounds(aStrokeOptions, mTransform)));
+  mDT->Stroke(aPath, aPattern, aStrokeOptions, aOptions);
+}
+
+void
+DrawTargetInstrumented::Fill(const Path *aPath,
+                             const Pattern &aPattern,
+                             const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::FILL,
+                             PixelsIn(aPath->GetBounds(mTransform)));
+  mDT->Fill(aPath, aPattern, aOptions);
+}
+
+void
+DrawTargetInstrumented::FillGlyphs(ScaledFont *aFont,
+                                   const GlyphBuffer &aBuffer,
+                                   const Pattern &aPattern,
+                                   const DrawOptions &aOptions,
+                                   const GlyphRenderingOptions *aRenderingOptions)
+{
+  // Glyph extents aren't known without building their paths.
+  AutoRecordOperation record(mStats, DrawTargetStats::FILL_GLYPHS);
+  mDT->FillGlyphs(aFont, aBuffer, aPattern, aOptions, aRenderingOptions);
+}
+
+void
+DrawTargetInstrumented::Mask(const Pattern &aSource,
+                             const Pattern &aMask,
+                             const DrawOptions &aOptions)
+{
+  // Both patterns may extend indefinitely, a surface pattern clamps to its
+  // edges for example, so count everything within the clip.
+  AutoRecordOperation record(mStats, DrawTargetStats::MASK, PixelsIn(ClipBounds()));
+  mDT->Mask(aSource, aMask, aOptions);
+}
+
+void
+DrawTargetInstrumented::MaskSurface(const Pattern &aSource,
+                                    SourceSurface *aMask,
+                                    Point aOffset,
+                                    const DrawOptions &aOptions)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::MASK_SURFACE,
+                             PixelsInUserRect(Rect(aOffset, Size(aMask->GetSize()))));
+  mDT->MaskSurface(aSource, aMask, aOffset, aOptions);
+}
+
+void
+DrawTargetInstrumented::PushClip(const Path *aPath)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::PUSH_CLIP);
+  mDT->PushClip(aPath);
+  mClipBounds.push_back(ClipBounds().Intersect(aPath->GetBounds(mTransform)));
+}
+
+void
+DrawTargetInstrumented::PushClipRect(const Rect &aRect)
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::PUSH_CLIP_RECT);
+  mDT->PushClipRect(aRect);
+  mClipBounds.push_back(ClipBounds().Intersect(mTransform.TransformBounds(aRect)));
+}
+
+void
+DrawTargetInstrumented::PopClip()
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::POP_CLIP);
+  mDT->PopClip();
+  if (!mClipBounds.empty()) {
+    mClipBounds.pop_back();
+  }
+}
+
+TemporaryRef<SourceSurface>
+DrawTargetInstrumented::CreateSourceSurfaceFromData(unsigned char *aData,
+                                                    const IntSize &aSize,
+                                                    int32_t aStride,
+                                                    SurfaceFormat aFormat) const
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::CREATE_SOURCE_SURFACE_FROM_DATA);
+  RefPtr<SourceSurface> surface =
+    mDT->CreateSourceSurfaceFromData(aData, aSize, aStride, aFormat);
+  if (surface) {
+    record.SetAllocatedBytes(SurfaceBytes(aSize, aFormat));
+  }
+  return surface.forget();
+}
+
+TemporaryRef<SourceSurface>
+DrawTargetInstrumented::OptimizeSourceSurface(SourceSurface *aSurface) const
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::OPTIMIZE_SOURCE_SURFACE);
+  RefPtr<SourceSurface> surface = mDT->OptimizeSourceSurface(aSurface);
+  if (surface && surface != aSurface) {
+    record.SetAllocatedBytes(SurfaceBytes(surface->GetSize(), surface->GetFormat()));
+  }
+  return surface.forget();
+}
+
+TemporaryRef<DrawTarget>
+DrawTargetInstrumented::CreateSimilarDrawTarget(const IntSize &aSize, SurfaceFormat aFormat) const
+{
+  AutoRecordOperation record(mStats, DrawTargetStats::CREATE_SIMILAR_DRAW_TARGET);
+  RefPtr<DrawTarget> dt = mDT->CreateSimilarDrawTarget(aSize, aFormat);
+  if (!dt) {
+    return nullptr;
+  }
+  record.SetAllocatedBytes(SurfaceBytes(aSize, aFormat));
+  return new DrawTargetInstrumented(dt, mStats);
+}
+
+void
+DrawTargetInstrumented::SetTransform(const Matrix &aTransform)
+{
+  mDT->SetTransform(aTransform);
+  DrawTarget::SetTransform(aTransform);
+}
+
+void
+DrawTargetInstrumented::SetPermitSubpixelAA(bool aPermitSubpixelAA)
+{
+  mDT->SetPermitSubpixelAA(aPermitSubpixelAA);
+  DrawTarget::SetPermitSubpixelAA(aPermitSubpixelAA);
+}
+
+}
+}
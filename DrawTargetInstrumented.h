@@ -0,0 +1,171 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_DRAWTARGETINSTRUMENTED_H_
+#define MOZILLA_GFX_DRAWTARGETINSTRUMENTED_H_
+
+#include "2D.h"
+#include "Filters.h"
+
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+/* This DrawTarget forwards all calls to another DrawTarget and records the
+ * number of calls, the time spent in them, the number of pixels they cover
+ * and the size of the surfaces they allocate in a DrawTargetStats object.
+ * Surfaces, paths and other resources are those of the wrapped DrawTarget and
+ * are passed through unchanged.
+ */
+class DrawTargetInstrumented : public DrawTarget
+{
+public:
+  MOZ_DECLARE_REFCOUNTED_VIRTUAL_TYPENAME(DrawTargetInstrumented)
+  DrawTargetInstrumented(DrawTarget *aDT, DrawTargetStats *aStats);
+
+  virtual DrawTargetType GetType() const MOZ_OVERRIDE { return mDT->GetType(); }
+  virtual BackendType GetBackendType() const { return mDT->GetBackendType(); }
+  virtual TemporaryRef<SourceSurface> Snapshot();
+  virtual IntSize GetSize() { return mDT->GetSize(); }
+
+  virtual bool LockBits(uint8_t** aData, IntSize* aSize,
+                        int32_t* aStride, SurfaceFormat* aFormat)
+  {
+    return mDT->LockBits(aData, aSize, aStride, aFormat);
+  }
+  virtual void ReleaseBits(uint8_t* aData) { mDT->ReleaseBits(aData); }
+
+  virtual void Flush();
+
+  virtual void DrawSurface(SourceSurface *aSurface,
+                           const Rect &aDest,
+                           const Rect &aSource,
+                           const DrawSurfaceOptions &aSurfOptions = DrawSurfaceOptions(),
+                           const DrawOptions &aOptions = DrawOptions());
+
+  virtual void DrawFilter(FilterNode *aNode,
+                          const Rect &aSourceRect,
+                          const Point &aDestPoint,
+                          const DrawOptions &aOptions = DrawOptions());
+
+  virtual void DrawSurfaceWithShadow(SourceSurface *aSurface,
+                                     const Point &aDest,
+                                     const Color &aColor,
+                                     const Point &aOffset,
+                                     Float aSigma,
+                                     CompositionOp aOperator);
+
+  virtual void ClearRect(const Rect &aRect);
+
+  virtual void CopySurface(SourceSurface *aSurface,
+                           const IntRect &aSourceRect,
+                           const IntPoint &aDestination);
+
+  virtual void CopyRect(const IntRect &aSourceRect,
+                        const IntPoint &aDestination);
+
+  virtual void FillRect(const Rect &aRect,
+                        const Pattern &aPattern,
+                        const DrawOptions &aOptions = DrawOptions());
+
+  virtual void StrokeRect(const Rect &aRect,
+                          const Pattern &aPattern,
+                          const StrokeOptions &aStrokeOptions = StrokeOptions(),
+                          const DrawOptions &aOptions = DrawOptions());
+
+  virtual void StrokeLine(const Point &aStart,
+                          const Point &aEnd,
+                          const Pattern &aPattern,
+                          const StrokeOptions &aStrokeOptions = StrokeOptions(),
+                          const DrawOptions &aOptions = DrawOptions());
+
+  virtual void Stroke(const Path *aPath,
+                      const Pattern &aPattern,
+                      const StrokeOptions &aStrokeOptions = StrokeOptions(),
+                      const DrawOptions &aOptions = DrawOptions());
+
+  virtual void Fill(const Path *aPath,
+                    const Pattern &aPattern,
+                    const DrawOptions &aOptions = DrawOptions());
+
+  virtual void FillGlyphs(ScaledFont *aFont,
+                          const GlyphBuffer &aBuffer,
+                          const Pattern &aPattern,
+                          const DrawOptions &aOptions = DrawOptions(),
+                          const GlyphRenderingOptions *aRenderingOptions = nullptr);
+
+  virtual void Mask(const Pattern &aSource,
+                    const Pattern &aMask,
+                    const DrawOptions &aOptions = DrawOptions());
+
+  virtual void MaskSurface(const Pattern &aSource,
+                           SourceSurface *aMask,
+                           Point aOffset,
+                           const DrawOptions &aOptions = DrawOptions());
+
+  virtual void PushClip(const Path *aPath);
+  virtual void PushClipRect(const Rect &aRect);
+  virtual void PopClip();
+
+  virtual TemporaryRef<SourceSurface> CreateSourceSurfaceFromData(unsigned char *aData,
+                                                                  const IntSize &aSize,
+                                                                  int32_t aStride,
+                                                                  SurfaceFormat aFormat) const;
+  virtual TemporaryRef<SourceSurface> OptimizeSourceSurface(SourceSurface *aSurface) const;
+
+  virtual TemporaryRef<SourceSurface>
+    CreateSourceSurfaceFromNativeSurface(const NativeSurface &aSurface) const
+  {
+    return mDT->CreateSourceSurfaceFromNativeSurface(aSurface);
+  }
+
+  virtual TemporaryRef<DrawTarget>
+    CreateSimilarDrawTarget(const IntSize &aSize, SurfaceFormat aFormat) const;
+
+  virtual TemporaryRef<PathBuilder> CreatePathBuilder(FillRule aFillRule = FillRule::FILL_WINDING) const
+  {
+    return mDT->CreatePathBuilder(aFillRule);
+  }
+
+  virtual TemporaryRef<GradientStops>
+    CreateGradientStops(GradientStop *aStops,
+                        uint32_t aNumStops,
+                        ExtendMode aExtendMode = ExtendMode::CLAMP) const
+  {
+    return mDT->CreateGradientStops(aStops, aNumStops, aExtendMode);
+  }
+
+  virtual TemporaryRef<FilterNode> CreateFilter(FilterType aType)
+  {
+    return mDT->CreateFilter(aType);
+  }
+
+  virtual void SetTransform(const Matrix &aTransform);
+
+  virtual void *GetNativeSurface(NativeSurfaceType aType) { return mDT->GetNativeSurface(aType); }
+
+  virtual void SetPermitSubpixelAA(bool aPermitSubpixelAA);
+
+private:
+  // Device space bounds of the current clip, within the DrawTarget.
+  Rect ClipBounds();
+  // Area of the device space bounds aBounds within the current clip.
+  uint64_t PixelsIn(const Rect &aBounds);
+  // Area of the device space bounds aBounds within the DrawTarget, for the
+  // operations that ignore the clip.
+  uint64_t PixelsInTarget(const Rect &aBounds);
+  uint64_t PixelsInUserRect(const Rect &aRect) { return PixelsIn(mTransform.TransformBounds(aRect)); }
+
+  RefPtr<DrawTarget> mDT;
+  RefPtr<DrawTargetStats> mStats;
+  // ClipBounds for every pushed clip, innermost last.
+  std::vector<Rect> mClipBounds;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_DRAWTARGETINSTRUMENTED_H_ */
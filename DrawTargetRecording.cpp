@@ -471,7 +471,7 @@ DrawTargetRecording::CreateSourceSurfaceFromData(unsigned char *aData,
 
   RefPtr<SourceSurface> retSurf = new SourceSurfaceRecording(surf, mRecorder);
 
-  mRecorder->RecordEvent(RecordedSourceSurfaceCreation(retSurf, aData, aStride, aSize, aFormat));
+  mRecorder->RecordSourceSurfaceCreation(retSurf, aData, aStride, aSize, aFormat);
 
   return retSurf.forget();
 }
@@ -495,15 +495,13 @@ DrawTargetRecording::OptimizeSourceSurface(SourceSurface *aSurface) const
     // Insert a bogus source surface.
     uint8_t *sourceData = new uint8_t[surf->GetSize().width * surf->GetSize().height * BytesPerPixel(surf->GetFormat())];
     memset(sourceData, 0, surf->GetSize().width * surf->GetSize().height * BytesPerPixel(surf->GetFormat()));
-    mRecorder->RecordEvent(
-      RecordedSourceSurfaceCreation(retSurf, sourceData,
-                                    surf->GetSize().width * BytesPerPixel(surf->GetFormat()),
-                                    surf->GetSize(), surf->GetFormat()));
+    mRecorder->RecordSourceSurfaceCreation(retSurf, sourceData,
+                                           surf->GetSize().width * BytesPerPixel(surf->GetFormat()),
+                                           surf->GetSize(), surf->GetFormat());
     delete [] sourceData;
   } else {
-    mRecorder->RecordEvent(
-      RecordedSourceSurfaceCreation(retSurf, dataSurf->GetData(), dataSurf->Stride(),
-                                    dataSurf->GetSize(), dataSurf->GetFormat()));
+    mRecorder->RecordSourceSurfaceCreation(retSurf, dataSurf->GetData(), dataSurf->Stride(),
+                                           dataSurf->GetSize(), dataSurf->GetFormat());
   }
 
   return retSurf.forget();
@@ -523,15 +521,13 @@ DrawTargetRecording::CreateSourceSurfaceFromNativeSurface(const NativeSurface &a
     // Insert a bogus source surface.
     uint8_t *sourceData = new uint8_t[surf->GetSize().width * surf->GetSize().height * BytesPerPixel(surf->GetFormat())];
     memset(sourceData, 0, surf->GetSize().width * surf->GetSize().height * BytesPerPixel(surf->GetFormat()));
-    mRecorder->RecordEvent(
-      RecordedSourceSurfaceCreation(retSurf, sourceData,
-                                    surf->GetSize().width * BytesPerPixel(surf->GetFormat()),
-                                    surf->GetSize(), surf->GetFormat()));
+    mRecorder->RecordSourceSurfaceCreation(retSurf, sourceData,
+                                           surf->GetSize().width * BytesPerPixel(surf->GetFormat()),
+                                           surf->GetSize(), surf->GetFormat());
     delete [] sourceData;
   } else {
-    mRecorder->RecordEvent(
-      RecordedSourceSurfaceCreation(retSurf, dataSurf->GetData(), dataSurf->Stride(),
-                                    dataSurf->GetSize(), dataSurf->GetFormat()));
+    mRecorder->RecordSourceSurfaceCreation(retSurf, dataSurf->GetData(), dataSurf->Stride(),
+                                           dataSurf->GetSize(), dataSurf->GetFormat());
   }
 
   return retSurf.forget();
@@ -11,6 +11,8 @@
 #include "ScaledFontBase.h"
 #include "ScaledFontCairo.h"
 #include "FilterNodeSoftware.h"
+#include "MipmapCache.h"
+#include "ShadowMaskCache.h"
 
 #include "core/SkDevice.h"
 #include "core/SkTypeface.h"
@@ -266,7 +268,15 @@ struct AutoPaintSetup {
     : mNeedsRestore(false), mAlpha(1.0)
   {
     Init(aCanvas, aOptions, aMaskBounds);
-    SetPaintPattern(mPaint, aPattern, mTmpBitmap, mAlpha);
+#ifdef USE_SKIA_GPU
+    if (aCanvas->getGrContext()) {
+      SetPaintPattern(mPaint, aPattern, mTmpBitmap, mAlpha);
+      return;
+    }
+#endif
+    // In software, minified surfaces are drawn from a smaller copy.
+    MipmappedPattern mipmapped(aPattern, SkiaMatrixToGfxMatrix(aCanvas->getTotalMatrix()));
+    SetPaintPattern(mPaint, mipmapped.Get(), mTmpBitmap, mAlpha);
   }
 
   AutoPaintSetup(SkCanvas *aCanvas, const DrawOptions& aOptions, const Rect* aMaskBounds = nullptr)
@@ -343,10 +353,21 @@ DrawTargetSkia::DrawSurface(SourceSurface *aSurface,
 
   MarkChanged();
 
+  // In software, minified surfaces are drawn from a smaller copy.
+  RefPtr<SourceSurface> surface = aSurface;
+  Rect source = aSource;
+  if (aSurfOptions.mFilter != Filter::POINT && !UsingSkiaGPU()) {
+    RefPtr<DataSourceSurface> level =
+      MipmapCache::GetLevelForDrawSurface(aSurface, aDest, aSource, mTransform, &source);
+    if (level) {
+      surface = level;
+    }
+  }
+
   SkRect destRect = RectToSkRect(aDest);
-  SkRect sourceRect = RectToSkRect(aSource);
+  SkRect sourceRect = RectToSkRect(source);
 
-  TempBitmap bitmap = GetBitmapForSurface(aSurface);
+  TempBitmap bitmap = GetBitmapForSurface(surface);
  
   AutoPaintSetup paint(mCanvas.get(), aOptions, &aDest);
   if (aSurfOptions.mFilter == Filter::POINT) {
@@ -396,6 +417,43 @@ DrawTargetSkia::DrawSurfaceWithShadow(SourceSurface *aSurface,
 
   TempBitmap bitmap = GetBitmapForSurface(aSurface);
 
+  if (ShadowMaskCache::IsEnabled()) {
+    // Draw the shadow from a mask that is kept across draws, instead of having
+    // the image filter blur the surface again every time. The surface is only
+    // read back when its mask isn't cached yet.
+    IntPoint maskOffset;
+    RefPtr<DataSourceSurface> mask =
+      ShadowMaskCache::GetMask(aSurface, [aSurface]() { return aSurface->GetDataSurface(); },
+                               aSigma, true, &maskOffset);
+    if (mask) {
+      TempBitmap maskBitmap = GetBitmapForSurface(mask);
+      Point shadowOrigin = aDest + aOffset + Point(maskOffset.x, maskOffset.y);
+
+      // Like the drop shadow filter, composite the shadow and the surface on
+      // top of it as a whole.
+      bool needsGroup = aOperator != CompositionOp::OP_OVER;
+      if (needsGroup) {
+        Rect bounds = Rect(aDest, Size(aSurface->GetSize())).Union(
+          Rect(shadowOrigin, Size(mask->GetSize())));
+        SkRect skBounds = RectToSkRect(bounds);
+        SkPaint groupPaint;
+        groupPaint.setXfermodeMode(GfxOpToSkiaOp(aOperator));
+        mCanvas->saveLayer(&skBounds, &groupPaint);
+      }
+
+      SkPaint shadowPaint;
+      shadowPaint.setColor(ColorToSkColor(aColor, 1.0));
+      mCanvas->drawBitmap(maskBitmap.mBitmap, shadowOrigin.x, shadowOrigin.y, &shadowPaint);
+      mCanvas->drawBitmap(bitmap.mBitmap, aDest.x, aDest.y);
+
+      if (needsGroup) {
+        mCanvas->restore();
+      }
+      mCanvas->restore();
+      return;
+    }
+  }
+
   SkPaint paint;
 
   SkImageFilter* filter = SkDropShadowImageFilter::Create(aOffset.x, aOffset.y,
@@ -15,11 +15,18 @@ namespace mozilla {
 namespace gfx {
 
 DrawTargetTiled::DrawTargetTiled()
+  : mQueuePerTile(false)
 {
 }
 
+DrawTargetTiled::~DrawTargetTiled()
+{
+  // Whoever owns the tiles expects them to contain everything drawn to us.
+  RasterizeTiles();
+}
+
 bool
-DrawTargetTiled::Init(const TileSet& aTiles)
+DrawTargetTiled::Init(const TileSet& aTiles, bool aQueuePerTile)
 {
   if (!aTiles.mTileCount) {
     return false;
@@ -45,25 +52,47 @@ DrawTargetTiled::Init(const TileSet& aTiles)
     mRect.height = newYMost - mRect.y;
   }
   mFormat = mTiles[0].mDrawTarget->GetFormat();
+
+  if (aQueuePerTile && mTiles.size() > 1) {
+    for (size_t i = 0; i < mTiles.size(); i++) {
+      RefPtr<DrawTarget> tileDT = mTiles[i].mDrawTarget;
+      RefPtr<DrawTargetCapture> capture = tileDT->CreateCaptureDT(tileDT->GetSize());
+      if (!capture) {
+        return false;
+      }
+      mTiles[i].mRasterTarget = tileDT;
+      mTiles[i].mDrawTarget = capture;
+    }
+    mQueuePerTile = true;
+  }
   return true;
 }
 
+void
+DrawTargetTiled::RasterizeTiles()
+{
+  if (!mQueuePerTile) {
+    return;
+  }
+
+  // State such as the clip stack and the transform lives on in the tiles'
+  // own DrawTargets, so the queues can simply be emptied after replaying.
+  for (size_t i = 0; i < mTiles.size(); i++) {
+    DrawTargetCapture* capture = static_cast<DrawTargetCapture*>(mTiles[i].mDrawTarget.get());
+    capture->OptimizeCommands();
+    mTiles[i].mRasterTarget->DrawCapturedDT(capture, Matrix());
+    mTiles[i].mRasterTarget->Flush();
+    capture->ClearCommands();
+  }
+}
+
 TemporaryRef<SourceSurface>
 DrawTargetTiled::Snapshot()
 {
+  RasterizeTiles();
   return new SnapshotTiled(mTiles, mRect);
 }
 
-// Skip the mClippedOut check since this is only used for Flush() which
-// should happen even if we're clipped.
-#define TILED_COMMAND(command) \
-  void \
-  DrawTargetTiled::command() \
-  { \
-    for (size_t i = 0; i < mTiles.size(); i++) { \
-      mTiles[i].mDrawTarget->command(); \
-    } \
-  }
 #define TILED_COMMAND1(command, type1) \
   void \
   DrawTargetTiled::command(type1 arg1) \
@@ -101,7 +130,20 @@ DrawTargetTiled::Snapshot()
     } \
   }
 
-TILED_COMMAND(Flush)
+void
+DrawTargetTiled::Flush()
+{
+  if (mQueuePerTile) {
+    // This flushes the tiles as part of rasterizing them.
+    RasterizeTiles();
+    return;
+  }
+
+  for (size_t i = 0; i < mTiles.size(); i++) {
+    mTiles[i].mDrawTarget->Flush();
+  }
+}
+
 TILED_COMMAND4(DrawFilter, FilterNode*, const Rect&, const Point&, const DrawOptions&)
 TILED_COMMAND1(ClearRect, const Rect&)
 TILED_COMMAND4(MaskSurface, const Pattern&, SourceSurface*, Point, const DrawOptions&)
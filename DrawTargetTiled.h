@@ -24,16 +24,37 @@ struct TileInternal : public Tile {
     , mClippedOut(false)
   {}
 
+  // The DrawTarget holding this tile's pixels. When queueing per tile
+  // mDrawTarget is a capture DrawTarget queueing up commands for this one.
+  DrawTarget* RasterTarget() const
+  {
+    return mRasterTarget ? mRasterTarget.get() : mDrawTarget.get();
+  }
+
   bool mClippedOut;
+  RefPtr<DrawTarget> mRasterTarget;
 };
 
 
+/* This DrawTarget distributes drawing over a set of tiles. By default every
+ * command is executed on each affected tile straight away. When initialized
+ * with aQueuePerTile each tile instead gets its own command queue (a capture
+ * DrawTarget). When Flush() or Snapshot() is called the queues are culled with
+ * OptimizeCommands and replayed one tile at a time, so each tile's pixels stay
+ * in cache while all of its commands are drawn. Those two calls are the only
+ * points where the tiles' own DrawTargets are guaranteed to be up to date.
+ *
+ * The queues are replayed on the calling thread. Replaying them concurrently
+ * would need the backends and the resources drawn with them to be usable
+ * from several threads at once, and their reference counts aren't atomic.
+ */
 class DrawTargetTiled : public DrawTarget
 {
 public:
   DrawTargetTiled();
+  ~DrawTargetTiled();
 
-  bool Init(const TileSet& mTiles);
+  bool Init(const TileSet& mTiles, bool aQueuePerTile = false);
 
   virtual bool IsTiledDrawTarget() const { return true; }
 
@@ -144,9 +165,14 @@ public:
   }
 
 private:
+  // Executes the queued up commands of all tiles, this is a no-op unless
+  // we're queueing per tile.
+  void RasterizeTiles();
+
   std::vector<TileInternal> mTiles;
   std::vector<std::vector<uint32_t> > mClippedOutTilesStack;
   IntRect mRect;
+  bool mQueuePerTile;
 };
 
 class SnapshotTiled : public SourceSurface
@@ -156,7 +182,7 @@ public:
     : mRect(aRect)
   {
     for (size_t i = 0; i < aTiles.size(); i++) {
-      mSnapshots.push_back(aTiles[i].mDrawTarget->Snapshot());
+      mSnapshots.push_back(aTiles[i].RasterTarget()->Snapshot());
       mOrigins.push_back(aTiles[i].mTileOrigin);
     }
   }
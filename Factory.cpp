@@ -44,11 +44,17 @@
 
 #include "DrawTargetDual.h"
 #include "DrawTargetTiled.h"
+#include "DrawTargetInstrumented.h"
 #include "DrawTargetRecording.h"
 
 #include "SourceSurfaceRawData.h"
 
 #include "DrawEventRecorder.h"
+#include "FilterNodeSoftware.h"
+#include "MipmapCache.h"
+#include "Scale.h"
+#include "ShadowMaskCache.h"
+#include "WorkerPool.h"
 
 #include "Logging.h"
 
@@ -150,6 +156,62 @@ HasCPUIDBit(unsigned int level, CPUIDRegister reg, unsigned int bit)
 #endif
 #endif
 
+// AVX2 needs support from the CPU as well as from the OS, which has to save
+// the upper halves of the ymm registers on context switches (XCR0 bits 1
+// and 2). The AVX2 feature flag lives in leaf 7 subleaf 0, which HasCPUIDBit
+// can't query.
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+
+static bool
+DetectAVX2()
+{
+  unsigned int regs[4];
+  if (__get_cpuid_max(0, nullptr) < 7 ||
+      !__get_cpuid(1, &regs[eax], &regs[ebx], &regs[ecx], &regs[edx]) ||
+      (regs[ecx] & ((1u<<27) | (1u<<28))) != ((1u<<27) | (1u<<28))) {
+    return false;
+  }
+
+  unsigned int xcr0, xcr0High;
+  __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0High) : "c"(0));
+  if ((xcr0 & 6) != 6) {
+    return false;
+  }
+
+  __cpuid_count(7, 0, regs[eax], regs[ebx], regs[ecx], regs[edx]);
+  return !!(regs[ebx] & (1u<<5));
+}
+
+#define HAVE_AVX2_DETECTION
+#elif defined(_MSC_VER) && _MSC_VER >= 1600 && (defined(_M_IX86) || defined(_M_AMD64))
+#include <intrin.h>
+
+static bool
+DetectAVX2()
+{
+  int regs[4];
+  __cpuid(regs, 0);
+  if (regs[eax] < 7) {
+    return false;
+  }
+
+  __cpuid(regs, 1);
+  if ((unsigned(regs[ecx]) & ((1u<<27) | (1u<<28))) != ((1u<<27) | (1u<<28))) {
+    return false;
+  }
+
+  if ((_xgetbv(0) & 6) != 6) {
+    return false;
+  }
+
+  __cpuidex(regs, 7, 0);
+  return !!(unsigned(regs[ebx]) & (1u<<5));
+}
+
+#define HAVE_AVX2_DETECTION
+#endif
+
 namespace mozilla {
 namespace gfx {
 
@@ -194,6 +256,25 @@ Factory::HasSSE2()
 #endif
 }
 
+bool
+Factory::HasAVX2()
+{
+#ifdef HAVE_AVX2_DETECTION
+  static enum {
+    UNINITIALIZED,
+    NO_AVX2,
+    HAS_AVX2
+  } sDetectionState = UNINITIALIZED;
+
+  if (sDetectionState == UNINITIALIZED) {
+    sDetectionState = DetectAVX2() ? HAS_AVX2 : NO_AVX2;
+  }
+  return sDetectionState == HAS_AVX2;
+#else
+  return false;
+#endif
+}
+
 bool
 Factory::CheckSurfaceSize(const IntSize &sz, int32_t limit)
 {
@@ -326,6 +407,12 @@ Factory::CreateRecordingDrawTarget(DrawEventRecorder *aRecorder, DrawTarget *aDT
   return new DrawTargetRecording(aRecorder, aDT);
 }
 
+TemporaryRef<DrawTarget>
+Factory::CreateInstrumentedDrawTarget(DrawTarget *aDT, DrawTargetStats *aStats)
+{
+  return new DrawTargetInstrumented(aDT, aStats);
+}
+
 TemporaryRef<DrawTarget>
 Factory::CreateDrawTargetForData(BackendType aBackend, 
                                  unsigned char *aData, 
@@ -387,11 +474,11 @@ Factory::CreateDrawTargetForData(BackendType aBackend,
 }
 
 TemporaryRef<DrawTarget>
-Factory::CreateTiledDrawTarget(const TileSet& aTileSet)
+Factory::CreateTiledDrawTarget(const TileSet& aTileSet, bool aQueuePerTile)
 {
   RefPtr<DrawTargetTiled> dt = new DrawTargetTiled();
 
-  if (!dt->Init(aTileSet)) {
+  if (!dt->Init(aTileSet, aQueuePerTile)) {
     return nullptr;
   }
 
@@ -778,9 +865,16 @@ Factory::CreateDataSourceSurfaceWithStride(const IntSize &aSize,
 }
 
 TemporaryRef<DrawEventRecorder>
-Factory::CreateEventRecorderForFile(const char *aFilename)
+Factory::CreateEventRecorderForFile(const char *aFilename, bool aCompress)
+{
+  return new DrawEventRecorderFile(aFilename, aCompress);
+}
+
+TemporaryRef<DrawEventRecorder>
+Factory::CreateEventRecorderForMemory(size_t aCapacity, const char *aFilename,
+                                      bool aCompress)
 {
-  return new DrawEventRecorderFile(aFilename);
+  return new DrawEventRecorderMemory(aCapacity, aFilename, aCompress);
 }
 
 void
@@ -797,6 +891,93 @@ Factory::SetLogForwarder(LogForwarder* aLogFwd) {
   mLogForwarder = aLogFwd;
 }
 
+int32_t Factory::mSoftwareFilterTileSize = 0;
+bool Factory::mSoftwareFilterTilesInParallel = false;
+
+void
+Factory::SetSoftwareFilterTiling(int32_t aTileSize, bool aParallel)
+{
+  mSoftwareFilterTileSize = std::max(aTileSize, 0);
+  mSoftwareFilterTilesInParallel = aParallel;
+}
+
+WorkerPool*
+Factory::GetSoftwareFilterWorkerPool()
+{
+  // Filters create DrawTargets while rendering; with a global recorder those
+  // would all record into it from the worker threads.
+  if (!mSoftwareFilterTilesInParallel || mRecorder) {
+    return nullptr;
+  }
+  return WorkerPool::Get();
+}
+
+void
+Factory::SetSoftwareFilterCacheSize(size_t aMaxBytes)
+{
+  FilterNodeSoftware::SetSharedCacheSize(aMaxBytes);
+}
+
+CacheStats
+Factory::GetSoftwareFilterCacheStats()
+{
+  return FilterNodeSoftware::GetSharedCacheStats();
+}
+
+void
+Factory::SetShadowMaskCacheSize(size_t aMaxBytes)
+{
+  ShadowMaskCache::SetMaxBytes(aMaxBytes);
+}
+
+CacheStats
+Factory::GetShadowMaskCacheStats()
+{
+  return ShadowMaskCache::GetStats();
+}
+
+void
+Factory::InvalidateShadowMasks(SourceSurface* aSurface)
+{
+  ShadowMaskCache::Invalidate(aSurface);
+}
+
+void
+Factory::SetScaledSurfaceCacheSize(size_t aMaxBytes)
+{
+  ScaledSurfaceCache::SetMaxBytes(aMaxBytes);
+}
+
+CacheStats
+Factory::GetScaledSurfaceCacheStats()
+{
+  return ScaledSurfaceCache::GetStats();
+}
+
+void
+Factory::InvalidateScaledSurfaces(SourceSurface* aSurface)
+{
+  ScaledSurfaceCache::Invalidate(aSurface);
+}
+
+void
+Factory::SetMipmapCacheSize(size_t aMaxBytes)
+{
+  MipmapCache::SetMaxBytes(aMaxBytes);
+}
+
+CacheStats
+Factory::GetMipmapCacheStats()
+{
+  return MipmapCache::GetStats();
+}
+
+void
+Factory::InvalidateMipmaps(SourceSurface* aSurface)
+{
+  MipmapCache::Invalidate(aSurface);
+}
+
 // static
 void
 CriticalLogger::OutputMessage(const std::string &aString, int aLevel)
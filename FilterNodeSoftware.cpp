@@ -11,11 +11,14 @@
 #include "2D.h"
 #include "Tools.h"
 #include "Blur.h"
+#include "CacheHelpers.h"
 #include <map>
 #include "FilterProcessing.h"
 #include "Logging.h"
 #include "mozilla/PodOperations.h"
 #include "mozilla/DebugOnly.h"
+#include "mozilla/ThreadLocal.h"
+#include "WorkerPool.h"
 
 // #define DEBUG_DUMP_SURFACES
 
@@ -507,7 +510,7 @@ GetDataSurfaceInRect(SourceSurface *aSurface,
   MOZ_ASSERT(dataSource);
 
   if (aEdgeMode == EDGE_MODE_WRAP) {
-    TileSurface(dataSource, target, intersectInDestSpace.TopLeft());
+    TileSurface(dataSource, target, sourceRect.TopLeft() - aDestRect.TopLeft());
     return target.forget();
   }
 
@@ -521,6 +524,208 @@ GetDataSurfaceInRect(SourceSurface *aSurface,
   return target.forget();
 }
 
+/**
+ * The state of one tile that is being pulled through the filter graph by
+ * RenderTiles. It holds the output caches of all filters involved in the
+ * tile, and is only ever touched by the thread rendering the tile.
+ */
+struct FilterTileState
+{
+  explicit FilterTileState(const std::map<SourceSurface*, RefPtr<DataSourceSurface> > &aInputData)
+    : mInputData(aInputData)
+  {}
+
+  /**
+   * Returns a copy of aRect of the input surface aSurface. Input surfaces are
+   * shared between tiles and use non-atomic reference counting, so they're
+   * only accessed through raw pointers to their data surfaces, which
+   * RenderTiles keeps alive.
+   */
+  TemporaryRef<DataSourceSurface> CopyInput(SourceSurface* aSurface, const IntRect& aRect)
+  {
+    std::map<SourceSurface*, RefPtr<DataSourceSurface> >::const_iterator it =
+      mInputData.find(aSurface);
+    if (aRect.IsEmpty() || it == mInputData.end() || !it->second) {
+      return nullptr;
+    }
+
+    DataSourceSurface* data = it->second;
+    RefPtr<DataSourceSurface> copy =
+      Factory::CreateDataSourceSurface(aRect.Size(), data->GetFormat());
+    if (MOZ2D_WARN_IF(!copy)) {
+      return nullptr;
+    }
+    CopyRect(data, copy, aRect, IntPoint());
+    return copy.forget();
+  }
+
+  const std::map<SourceSurface*, RefPtr<DataSourceSurface> > &mInputData;
+  std::map<FilterNodeSoftware*, FilterNodeSoftware::OutputCache> mOutputCaches;
+};
+
+static ThreadLocal<FilterTileState*> sCurrentTile;
+static std::once_flag sCurrentTileInit;
+
+static FilterTileState*
+CurrentTileState()
+{
+  return sCurrentTile.initialized() ? sCurrentTile.get() : nullptr;
+}
+
+static const uint64_t kHashOffsetBasis = 14695981039346656037ULL;
+static const uint64_t kHashPrime = 1099511628211ULL;
+
+static uint64_t
+HashBytes(uint64_t aHash, const void* aData, size_t aLength)
+{
+  const uint8_t* data = static_cast<const uint8_t*>(aData);
+  for (size_t i = 0; i < aLength; i++) {
+    aHash = (aHash ^ data[i]) * kHashPrime;
+  }
+  return aHash;
+}
+
+template<typename T>
+static uint64_t
+HashValue(uint64_t aHash, const T& aValue)
+{
+  return HashBytes(aHash, &aValue, sizeof(T));
+}
+
+// Input surfaces are identified by a serial number that is attached to them
+// the first time they're hashed.
+static SurfaceSerials sSurfaceSerials;
+
+/**
+ * Filter output that is kept across draws and shared between filter nodes
+ * with the same subgraph hash, see Factory::SetSoftwareFilterCacheSize.
+ * Tiles that RenderTiles hands to worker threads bypass it.
+ */
+class SharedFilterCache
+{
+public:
+  bool IsEnabled() const { return mCache.IsEnabled(); }
+  void SetMaxBytes(size_t aMaxBytes) { mCache.SetMaxBytes(aMaxBytes); }
+  CacheStats GetStats() const { return mCache.GetStats(); }
+
+  /**
+   * Looks for an entry for aHash that covers aRect and makes it the most
+   * recently used one.
+   */
+  bool Lookup(uint64_t aHash, const IntRect& aRect,
+              IntRect* aCachedRect, RefPtr<DataSourceSurface>* aOutput)
+  {
+    Entry* entry = mCache.Lookup(aHash, [&aRect](const Entry& aEntry) {
+      return aEntry.mRect.Contains(aRect);
+    });
+    if (!entry) {
+      return false;
+    }
+    *aCachedRect = entry->mRect;
+    *aOutput = entry->mOutput;
+    return true;
+  }
+
+  void Insert(uint64_t aHash, const IntRect& aRect, DataSourceSurface* aOutput)
+  {
+    size_t bytes = size_t(aOutput->Stride()) * aOutput->GetSize().height;
+    if (bytes > mCache.GetMaxBytes()) {
+      return;
+    }
+
+    // Entries for the same hash that the new one covers are useless now.
+    mCache.Remove(aHash, [&aRect](const Entry& aEntry) {
+      return aRect.Contains(aEntry.mRect);
+    });
+    Entry entry = { aRect, aOutput };
+    mCache.Insert(aHash, entry, bytes);
+  }
+
+private:
+  struct Entry {
+    IntRect mRect;
+    RefPtr<DataSourceSurface> mOutput;
+  };
+
+  LRUCache<uint64_t, Entry> mCache;
+};
+
+static SharedFilterCache sSharedFilterCache;
+
+/* static */ void
+FilterNodeSoftware::SetSharedCacheSize(size_t aMaxBytes)
+{
+  sSharedFilterCache.SetMaxBytes(aMaxBytes);
+}
+
+/* static */ CacheStats
+FilterNodeSoftware::GetSharedCacheStats()
+{
+  return sSharedFilterCache.GetStats();
+}
+
+void
+FilterNodeSoftware::RecordAttributeBytes(uint32_t aIndex, const void* aData, size_t aLength)
+{
+  mAttributeHashes[aIndex] = HashBytes(kHashOffsetBasis, aData, aLength);
+  mSubgraphHashValid = false;
+}
+
+uint64_t
+FilterNodeSoftware::GetSubgraphHash()
+{
+  if (mSubgraphHashValid) {
+    return mSubgraphHash;
+  }
+
+  uint64_t hash = HashValue(kHashOffsetBasis, mType);
+  for (std::map<uint32_t, uint64_t>::const_iterator it = mAttributeHashes.begin();
+       it != mAttributeHashes.end(); ++it) {
+    hash = HashValue(hash, it->first);
+    hash = HashValue(hash, it->second);
+  }
+  for (size_t i = 0; i < mInputFilters.size(); i++) {
+    // Tag each input so filter hashes and surface serials can't collide.
+    if (mInputFilters[i]) {
+      hash = HashValue(hash, uint8_t(1));
+      hash = HashValue(hash, mInputFilters[i]->GetSubgraphHash());
+    } else if (mInputSurfaces[i]) {
+      hash = HashValue(hash, uint8_t(2));
+      hash = HashValue(hash, sSurfaceSerials.Get(mInputSurfaces[i]));
+    } else {
+      hash = HashValue(hash, uint8_t(0));
+    }
+  }
+
+  mSubgraphHash = hash;
+  mSubgraphHashValid = true;
+  return hash;
+}
+
+void
+FilterNodeSoftware::ClearRequestedRects()
+{
+  // Requests only travel from consumers to inputs, so if nothing was
+  // requested from us our inputs don't hold requests on our behalf either.
+  OutputCache& cache = GetOutputCache();
+  if (cache.mRequestedRect.IsEmpty()) {
+    return;
+  }
+  cache.mRequestedRect = IntRect();
+  for (size_t i = 0; i < mInputFilters.size(); i++) {
+    if (mInputFilters[i]) {
+      mInputFilters[i]->ClearRequestedRects();
+    }
+  }
+}
+
+FilterNodeSoftware::FilterNodeSoftware()
+  : mType(FilterType::BLEND)
+  , mSubgraphHash(0)
+  , mSubgraphHashValid(false)
+{
+}
+
 /* static */ TemporaryRef<FilterNode>
 FilterNodeSoftware::Create(FilterType aType)
 {
@@ -605,9 +810,51 @@ FilterNodeSoftware::Create(FilterType aType)
       filter = new FilterNodeLightingSoftware<DistantLightSoftware, SpecularLightingSoftware>("FilterNodeLightingSoftware<DistantLight, SpecularLighting>");
       break;
   }
+  if (filter) {
+    filter->mType = aType;
+  }
   return filter.forget();
 }
 
+static void
+DrawOutput(DrawTarget* aDrawTarget, DataSourceSurface* aOutput,
+           const IntRect &aOutputRect, const Rect &aSourceRect,
+           const Point &aDestPoint, const DrawOptions &aOptions)
+{
+  Point sourceToDestOffset = aDestPoint - aSourceRect.TopLeft();
+  Rect renderedSourceRect = Rect(aOutputRect).Intersect(aSourceRect);
+  Rect renderedDestRect = renderedSourceRect + sourceToDestOffset;
+  if (aOutput->GetFormat() == SurfaceFormat::A8) {
+    // Interpret the result as having implicitly black color channels.
+    aDrawTarget->PushClipRect(renderedDestRect);
+    aDrawTarget->MaskSurface(ColorPattern(Color(0.0, 0.0, 0.0, 1.0)),
+                             aOutput,
+                             Point(aOutputRect.TopLeft()) + sourceToDestOffset,
+                             aOptions);
+    aDrawTarget->PopClip();
+  } else {
+    aDrawTarget->DrawSurface(aOutput, renderedDestRect,
+                             renderedSourceRect - Point(aOutputRect.TopLeft()),
+                             DrawSurfaceOptions(), aOptions);
+  }
+}
+
+/**
+ * Drawing the output tile by tile only matches drawing it at once if the
+ * operator leaves everything outside a tile alone and the tile edges end up
+ * on device pixel boundaries, otherwise we'd get seams.
+ */
+static bool
+CanDrawInTiles(DrawTarget* aDrawTarget, const Rect &aSourceRect,
+               const Point &aDestPoint, const DrawOptions &aOptions)
+{
+  Point sourceToDestOffset = aDestPoint - aSourceRect.TopLeft();
+  return IsOperatorBoundByMask(aOptions.mCompositionOp) &&
+         aDrawTarget->GetTransform().IsIntegerTranslation() &&
+         sourceToDestOffset.x == floor(sourceToDestOffset.x) &&
+         sourceToDestOffset.y == floor(sourceToDestOffset.y);
+}
+
 void
 FilterNodeSoftware::Draw(DrawTarget* aDrawTarget,
                          const Rect &aSourceRect,
@@ -638,6 +885,21 @@ FilterNodeSoftware::Draw(DrawTarget* aDrawTarget,
     return;
   }
 
+  int32_t tileSize = Factory::GetSoftwareFilterTileSize();
+  if (tileSize > 0 &&
+      (outputRect.width > tileSize || outputRect.height > tileSize) &&
+      CanDrawInTiles(aDrawTarget, aSourceRect, aDestPoint, aOptions)) {
+#ifdef DEBUG_DUMP_SURFACES
+    printf("rendering in tiles of %d pixels\n", tileSize);
+    printf("</pre>\n");
+#endif
+    RenderTiles(outputRect, tileSize, Factory::GetSoftwareFilterWorkerPool(),
+                [&] (const IntRect& aTileRect, DataSourceSurface* aTile) {
+      DrawOutput(aDrawTarget, aTile, aTileRect, aSourceRect, aDestPoint, aOptions);
+    });
+    return;
+  }
+
   RefPtr<DataSourceSurface> result;
   if (!outputRect.IsEmpty()) {
     result = GetOutput(outputRect);
@@ -658,22 +920,100 @@ FilterNodeSoftware::Draw(DrawTarget* aDrawTarget,
   printf("</pre>\n");
 #endif
 
-  Point sourceToDestOffset = aDestPoint - aSourceRect.TopLeft();
-  Rect renderedSourceRect = Rect(outputRect).Intersect(aSourceRect);
-  Rect renderedDestRect = renderedSourceRect + sourceToDestOffset;
-  if (result->GetFormat() == SurfaceFormat::A8) {
-    // Interpret the result as having implicitly black color channels.
-    aDrawTarget->PushClipRect(renderedDestRect);
-    aDrawTarget->MaskSurface(ColorPattern(Color(0.0, 0.0, 0.0, 1.0)),
-                             result,
-                             Point(outputRect.TopLeft()) + sourceToDestOffset,
-                             aOptions);
-    aDrawTarget->PopClip();
-  } else {
-    aDrawTarget->DrawSurface(result, renderedDestRect,
-                             renderedSourceRect - Point(outputRect.TopLeft()),
-                             DrawSurfaceOptions(), aOptions);
+  DrawOutput(aDrawTarget, result, outputRect, aSourceRect, aDestPoint, aOptions);
+}
+
+void
+FilterNodeSoftware::RenderTiles(const IntRect &aRect, int32_t aTileSize,
+                                WorkerPool* aPool, const TileCallback &aCallback)
+{
+  MOZ_ASSERT(aTileSize > 0);
+  if (aRect.IsEmpty() || IntRectOverflows(aRect)) {
+    return;
+  }
+
+  std::call_once(sCurrentTileInit, [] {
+    if (!sCurrentTile.init()) {
+      gfxWarning() << "Failed to allocate thread local storage for filter tiles";
+    }
+  });
+  if (!sCurrentTile.initialized()) {
+    return;
   }
+
+  // Resolve the input surfaces up front, on this thread. The tiles only read
+  // from the resulting data surfaces, which stay alive until we return.
+  std::map<SourceSurface*, RefPtr<DataSourceSurface> > inputData;
+  std::set<FilterNodeSoftware*> visited;
+  CollectInputData(inputData, visited);
+
+  int32_t columns = (aRect.width - 1) / aTileSize + 1;
+  int32_t rows = (aRect.height - 1) / aTileSize + 1;
+  int32_t tileCount = columns * rows;
+
+  // Render the tiles in batches of one tile per thread, so the output of at
+  // most one batch is alive at a time.
+  int32_t batchSize = aPool ? aPool->GetThreadCount() : 1;
+  std::vector<IntRect> tileRects(batchSize);
+  std::vector<RefPtr<DataSourceSurface> > tiles(batchSize);
+
+  for (int32_t first = 0; first < tileCount; first += batchSize) {
+    int32_t count = std::min(batchSize, tileCount - first);
+    for (int32_t i = 0; i < count; i++) {
+      int32_t column = (first + i) % columns;
+      int32_t row = (first + i) / columns;
+      IntRect tileRect(aRect.x + column * aTileSize, aRect.y + row * aTileSize,
+                       aTileSize, aTileSize);
+      tileRects[i] = GetOutputRectInRect(tileRect.Intersect(aRect));
+    }
+
+    ParallelFor(aPool, 0, count, [&] (int32_t aIndex) {
+      FilterTileState state(inputData);
+      // Waiting for a TaskGroup can run another tile on this thread from
+      // inside a filter, so restore whatever tile was current before.
+      FilterTileState* previous = sCurrentTile.get();
+      sCurrentTile.set(&state);
+      if (!tileRects[aIndex].IsEmpty()) {
+        tiles[aIndex] = GetOutput(tileRects[aIndex]);
+      }
+      sCurrentTile.set(previous);
+    });
+
+    for (int32_t i = 0; i < count; i++) {
+      if (tiles[i]) {
+        aCallback(tileRects[i], tiles[i]);
+        tiles[i] = nullptr;
+      }
+    }
+  }
+}
+
+void
+FilterNodeSoftware::CollectInputData(std::map<SourceSurface*, RefPtr<DataSourceSurface> > &aInputData,
+                                     std::set<FilterNodeSoftware*> &aVisited)
+{
+  if (!aVisited.insert(this).second) {
+    return;
+  }
+
+  for (size_t i = 0; i < mInputSurfaces.size(); i++) {
+    SourceSurface* surface = mInputSurfaces[i];
+    if (surface && !aInputData.count(surface)) {
+      aInputData[surface] = surface->GetDataSurface();
+    }
+  }
+  for (size_t i = 0; i < mInputFilters.size(); i++) {
+    if (mInputFilters[i]) {
+      mInputFilters[i]->CollectInputData(aInputData, aVisited);
+    }
+  }
+}
+
+FilterNodeSoftware::OutputCache&
+FilterNodeSoftware::GetOutputCache()
+{
+  FilterTileState* tile = CurrentTileState();
+  return tile ? tile->mOutputCaches[this] : mOutputCache;
 }
 
 TemporaryRef<DataSourceSurface>
@@ -685,26 +1025,279 @@ FilterNodeSoftware::GetOutput(const IntRect &aRect)
     return nullptr;
   }
 
-  if (!mCachedRect.Contains(aRect)) {
+  OutputCache& cache = GetOutputCache();
+  bool useSharedCache = sSharedFilterCache.IsEnabled();
+  if (cache.mCachedRect.Contains(aRect)) {
+    MOZ_ASSERT(cache.mCachedOutput, "cached rect but no cached output?");
+  } else if (useSharedCache &&
+             sSharedFilterCache.Lookup(GetSubgraphHash(),
+                                       cache.mRequestedRect.Union(aRect),
+                                       &cache.mCachedRect, &cache.mCachedOutput)) {
+    ClearRequestedRects();
+  } else {
     RequestRect(aRect);
-    mCachedOutput = Render(mRequestedRect);
-    if (!mCachedOutput) {
-      mCachedRect = IntRect();
-      mRequestedRect = IntRect();
+    cache.mCachedOutput = RenderPointwiseChain(cache.mRequestedRect);
+    if (!cache.mCachedOutput) {
+      cache.mCachedOutput = Render(cache.mRequestedRect);
+    }
+    if (!cache.mCachedOutput) {
+      cache.mCachedRect = IntRect();
+      cache.mRequestedRect = IntRect();
       return nullptr;
     }
-    mCachedRect = mRequestedRect;
-    mRequestedRect = IntRect();
-  } else {
-    MOZ_ASSERT(mCachedOutput, "cached rect but no cached output?");
+    cache.mCachedRect = cache.mRequestedRect;
+    cache.mRequestedRect = IntRect();
+    if (useSharedCache) {
+      sSharedFilterCache.Insert(GetSubgraphHash(), cache.mCachedRect,
+                                cache.mCachedOutput);
+    }
+  }
+  return GetDataSurfaceInRect(cache.mCachedOutput, cache.mCachedRect, aRect, EDGE_MODE_NONE);
+}
+
+/**
+ * One step of a chain of pointwise filters that is evaluated in a single pass,
+ * see FilterNodeSoftware::RenderPointwiseChain. All stages work on B8G8R8A8
+ * pixels; every stage except FILL reads the output of the previous stage, or
+ * the chain's input for the first stage.
+ */
+struct PointwiseStage
+{
+  enum Type {
+    FILL,
+    COLOR_MATRIX,
+    LOOKUP,
+    PREMULTIPLY,
+    UNPREMULTIPLY,
+    ARITHMETIC_COMBINE
+  };
+
+  explicit PointwiseStage(Type aType)
+    : mType(aType)
+    , mColor(0)
+    , mK1(0), mK2(0), mK3(0), mK4(0)
+  {
+    memset(mTables, 0, sizeof(mTables));
+  }
+
+  Type mType;
+
+  // FILL
+  uint32_t mColor;
+
+  // COLOR_MATRIX
+  Matrix5x4 mMatrix;
+
+  // LOOKUP, indexed by B8G8R8A8_COMPONENT_BYTEOFFSET_*.
+  uint8_t mTables[4][256];
+
+  // ARITHMETIC_COMBINE, with the previous stage's output as the first input
+  // and mInput as the second one. If mInput is null the previous output is
+  // used for both.
+  RefPtr<DataSourceSurface> mInput;
+  Float mK1, mK2, mK3, mK4;
+};
+
+// Strips of roughly this many bytes are taken through all stages of a
+// pointwise chain before moving on, so that every stage after the first one
+// finds its input in the cache.
+static const int32_t kPointwiseStripBytes = 32 * 1024;
+
+static void
+AppendPointwiseStage(std::vector<PointwiseStage>& aStages,
+                     const PointwiseStage& aStage)
+{
+  if (aStage.mType == PointwiseStage::LOOKUP && !aStages.empty() &&
+      aStages.back().mType == PointwiseStage::LOOKUP) {
+    // Consecutive lookups compose into a single lookup without any loss.
+    PointwiseStage& previous = aStages.back();
+    for (int32_t c = 0; c < 4; c++) {
+      for (int32_t i = 0; i < 256; i++) {
+        previous.mTables[c][i] = aStage.mTables[c][previous.mTables[c][i]];
+      }
+    }
+    return;
   }
-  return GetDataSurfaceInRect(mCachedOutput, mCachedRect, aRect, EDGE_MODE_NONE);
+  aStages.push_back(aStage);
+}
+
+static void
+ApplyPointwiseStage(const PointwiseStage& aStage, const IntSize& aSize,
+                    int32_t aY, uint8_t* aTargetData, int32_t aTargetStride,
+                    uint8_t* aSourceData, int32_t aSourceStride)
+{
+  switch (aStage.mType) {
+    case PointwiseStage::FILL:
+      for (int32_t y = 0; y < aSize.height; y++) {
+        uint32_t* row = (uint32_t*)(aTargetData + y * aTargetStride);
+        for (int32_t x = 0; x < aSize.width; x++) {
+          row[x] = aStage.mColor;
+        }
+      }
+      break;
+    case PointwiseStage::COLOR_MATRIX:
+      FilterProcessing::DoColorMatrixCalculation(
+        aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aStage.mMatrix);
+      break;
+    case PointwiseStage::LOOKUP:
+      for (int32_t y = 0; y < aSize.height; y++) {
+        uint8_t* source = aSourceData + y * aSourceStride;
+        uint8_t* target = aTargetData + y * aTargetStride;
+        for (int32_t x = 0; x < aSize.width * 4; x += 4) {
+          for (int32_t c = 0; c < 4; c++) {
+            target[x + c] = aStage.mTables[c][source[x + c]];
+          }
+        }
+      }
+      break;
+    case PointwiseStage::PREMULTIPLY:
+      FilterProcessing::DoPremultiplicationCalculation(
+        aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+      break;
+    case PointwiseStage::UNPREMULTIPLY:
+      FilterProcessing::DoUnpremultiplicationCalculation(
+        aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+      break;
+    case PointwiseStage::ARITHMETIC_COMBINE:
+    {
+      uint8_t* inputData = aSourceData;
+      int32_t inputStride = aSourceStride;
+      if (aStage.mInput) {
+        inputStride = aStage.mInput->Stride();
+        inputData = aStage.mInput->GetData() + aY * inputStride;
+      }
+      FilterProcessing::DoArithmeticCombineCalculation(
+        aSize, aTargetData, aTargetStride, aSourceData, aSourceStride,
+        inputData, inputStride, aStage.mK1, aStage.mK2, aStage.mK3, aStage.mK4);
+      break;
+    }
+  }
+}
+
+/**
+ * Runs aStages over aSize pixels, reading from aSourceData (which may be null
+ * if the first stage is a FILL) and writing to aTargetData. Only the first
+ * stage reads aSourceData, all later stages work in place on the target.
+ */
+static void
+ApplyPointwiseStages(const std::vector<PointwiseStage>& aStages,
+                     const IntSize& aSize,
+                     uint8_t* aTargetData, int32_t aTargetStride,
+                     uint8_t* aSourceData, int32_t aSourceStride)
+{
+  int32_t stripHeight = std::max(1, kPointwiseStripBytes / aTargetStride);
+  for (int32_t y = 0; y < aSize.height; y += stripHeight) {
+    IntSize stripSize(aSize.width, std::min(stripHeight, aSize.height - y));
+    uint8_t* targetData = aTargetData + y * aTargetStride;
+    uint8_t* sourceData = aSourceData ? aSourceData + y * aSourceStride : nullptr;
+    int32_t sourceStride = aSourceStride;
+    for (size_t i = 0; i < aStages.size(); i++) {
+      ApplyPointwiseStage(aStages[i], stripSize, y, targetData, aTargetStride,
+                          sourceData, sourceStride);
+      sourceData = targetData;
+      sourceStride = aTargetStride;
+    }
+  }
+}
+
+TemporaryRef<DataSourceSurface>
+FilterNodeSoftware::RenderPointwiseChain(const IntRect& aRect)
+{
+  std::vector<PointwiseStage> headStages;
+  if (!AppendPointwiseStages(aRect, headStages)) {
+    return nullptr;
+  }
+
+  // Walk up our first input for as long as it is a pointwise filter whose
+  // output nobody else needs and which doesn't have it cached already. Its
+  // output also has to cover all of aRect; where it doesn't, its consumer
+  // sees transparent black rather than the result of its stages. The stages
+  // of each filter are collected from the bottom of the chain up.
+  std::vector<FilterNodeSoftware*> chain;
+  std::vector<std::vector<PointwiseStage> > chainStages(1);
+  chainStages[0].swap(headStages);
+  FilterNodeSoftware* last = this;
+  while (!last->mInputFilters.empty() && last->mInputFilters[0]) {
+    FilterNodeSoftware* input = last->mInputFilters[0];
+    if (input->mInvalidationListeners.size() != 1 ||
+        input->GetOutputCache().mCachedRect.Contains(aRect) ||
+        !input->GetOutputRectInRect(aRect).Contains(aRect)) {
+      break;
+    }
+    std::vector<PointwiseStage> stages;
+    if (!input->AppendPointwiseStages(aRect, stages)) {
+      break;
+    }
+    chain.push_back(input);
+    chainStages.push_back(std::vector<PointwiseStage>());
+    chainStages.back().swap(stages);
+    last = input;
+  }
+
+  std::vector<PointwiseStage> stages;
+  for (size_t i = chainStages.size(); i > 0; i--) {
+    for (size_t j = 0; j < chainStages[i - 1].size(); j++) {
+      AppendPointwiseStage(stages, chainStages[i - 1][j]);
+    }
+  }
+  if (stages.size() < 2) {
+    // A single stage is no faster than Render().
+    return nullptr;
+  }
+
+  RefPtr<DataSourceSurface> input;
+  if (stages[0].mType != PointwiseStage::FILL) {
+    // Input 0 is the first input for all pointwise filters.
+    input = last->GetInputDataSourceSurface(0, aRect, NEED_COLOR_CHANNELS);
+    if (!input) {
+      return nullptr;
+    }
+  }
+
+  RefPtr<DataSourceSurface> target =
+    Factory::CreateDataSourceSurface(aRect.Size(), SurfaceFormat::B8G8R8A8);
+  if (MOZ2D_WARN_IF(!target)) {
+    return nullptr;
+  }
+
+  bool hasOtherInputs = false;
+  for (size_t i = 0; i < stages.size(); i++) {
+    hasOtherInputs |= !!stages[i].mInput;
+  }
+
+  if (!input && !hasOtherInputs) {
+    // Everything is derived from a flood color, so the result is a flood too.
+    // Compute its color once.
+    RefPtr<DataSourceSurface> pixel =
+      Factory::CreateDataSourceSurface(IntSize(1, 1), SurfaceFormat::B8G8R8A8);
+    if (MOZ2D_WARN_IF(!pixel)) {
+      return nullptr;
+    }
+    ApplyPointwiseStages(stages, IntSize(1, 1), pixel->GetData(), pixel->Stride(),
+                         nullptr, 0);
+    PointwiseStage fill(PointwiseStage::FILL);
+    fill.mColor = *(uint32_t*)pixel->GetData();
+    stages.assign(1, fill);
+  }
+
+  ApplyPointwiseStages(stages, aRect.Size(), target->GetData(), target->Stride(),
+                       input ? input->GetData() : nullptr,
+                       input ? input->Stride() : 0);
+
+  // The filters we rendered on behalf of won't render the rect they were
+  // asked for, so don't let it linger until their next GetOutput call.
+  for (size_t i = 0; i < chain.size(); i++) {
+    chain[i]->GetOutputCache().mRequestedRect = IntRect();
+  }
+
+  return target.forget();
 }
 
 void
 FilterNodeSoftware::RequestRect(const IntRect &aRect)
 {
-  mRequestedRect = mRequestedRect.Union(aRect);
+  OutputCache& cache = GetOutputCache();
+  cache.mRequestedRect = cache.mRequestedRect.Union(aRect);
   RequestFromInputsForRect(aRect);
 }
 
@@ -722,7 +1315,7 @@ FilterNodeSoftware::RequestInputRect(uint32_t aInputEnumIndex, const IntRect &aR
   if (mInputSurfaces[inputIndex]) {
     return;
   }
-  RefPtr<FilterNodeSoftware> filter = mInputFilters[inputIndex];
+  FilterNodeSoftware* filter = mInputFilters[inputIndex];
   MOZ_ASSERT(filter, "missing input");
   filter->RequestRect(filter->GetOutputRectInRect(aRect));
 }
@@ -762,24 +1355,42 @@ FilterNodeSoftware::GetInputDataSourceSurface(uint32_t aInputEnumIndex,
     return nullptr;
   }
 
+  // Wrapping repeats all of the padded source rect, no matter which part of
+  // it aRect covers.
+  IntRect inputRect = aRect;
+  if (aEdgeMode == EDGE_MODE_WRAP &&
+      aTransparencyPaddedSourceRect && !aTransparencyPaddedSourceRect->IsEmpty()) {
+    inputRect = inputRect.Union(*aTransparencyPaddedSourceRect);
+  }
+
   RefPtr<SourceSurface> surface;
   IntRect surfaceRect;
 
   if (mInputSurfaces[inputIndex]) {
     // Input from input surface
-    surface = mInputSurfaces[inputIndex];
+    SourceSurface* inputSurface = mInputSurfaces[inputIndex];
 #ifdef DEBUG_DUMP_SURFACES
     printf("input from input surface:\n");
 #endif
-    surfaceRect = IntRect(IntPoint(0, 0), surface->GetSize());
+    surfaceRect = IntRect(IntPoint(0, 0), inputSurface->GetSize());
+    FilterTileState* tile = CurrentTileState();
+    if (tile) {
+      // Only copy the part this tile needs. Wrapping needs all of it.
+      if (aEdgeMode != EDGE_MODE_WRAP) {
+        surfaceRect = surfaceRect.Intersect(aRect);
+      }
+      surface = tile->CopyInput(inputSurface, surfaceRect);
+    } else {
+      surface = inputSurface;
+    }
   } else {
     // Input from input filter
 #ifdef DEBUG_DUMP_SURFACES
     printf("getting input from input filter %s...\n", mInputFilters[inputIndex]->GetName());
 #endif
-    RefPtr<FilterNodeSoftware> filter = mInputFilters[inputIndex];
+    FilterNodeSoftware* filter = mInputFilters[inputIndex];
     MOZ_ASSERT(filter, "missing input");
-    IntRect inputFilterOutput = filter->GetOutputRectInRect(aRect);
+    IntRect inputFilterOutput = filter->GetOutputRectInRect(inputRect);
     if (!inputFilterOutput.IsEmpty()) {
       surface = filter->GetOutput(inputFilterOutput);
     }
@@ -805,7 +1416,7 @@ FilterNodeSoftware::GetInputDataSourceSurface(uint32_t aInputEnumIndex,
   }
 
   if (aTransparencyPaddedSourceRect && !aTransparencyPaddedSourceRect->IsEmpty()) {
-    IntRect srcRect = aTransparencyPaddedSourceRect->Intersect(aRect);
+    IntRect srcRect = aTransparencyPaddedSourceRect->Intersect(inputRect);
     surface = GetDataSurfaceInRect(surface, surfaceRect, srcRect, EDGE_MODE_NONE);
     surfaceRect = srcRect;
   }
@@ -872,7 +1483,7 @@ FilterNodeSoftware::GetInputRectInRect(uint32_t aInputEnumIndex,
     return aInRect.Intersect(IntRect(IntPoint(0, 0),
                                      mInputSurfaces[inputIndex]->GetSize()));
   }
-  RefPtr<FilterNodeSoftware> filter = mInputFilters[inputIndex];
+  FilterNodeSoftware* filter = mInputFilters[inputIndex];
   MOZ_ASSERT(filter, "missing input");
   return filter->GetOutputRectInRect(aInRect);
 }
@@ -908,8 +1519,9 @@ FilterNodeSoftware::FilterInvalidated(FilterNodeSoftware* aFilter)
 void
 FilterNodeSoftware::Invalidate()
 {
-  mCachedOutput = nullptr;
-  mCachedRect = IntRect();
+  mOutputCache.mCachedOutput = nullptr;
+  mOutputCache.mCachedRect = IntRect();
+  mSubgraphHashValid = false;
   for (std::vector<FilterInvalidationListener*>::iterator it = mInvalidationListeners.begin();
        it != mInvalidationListeners.end(); it++) {
     (*it)->FilterInvalidated(this);
@@ -991,6 +1603,7 @@ FilterNodeBlendSoftware::SetAttribute(uint32_t aIndex, uint32_t aBlendMode)
 {
   MOZ_ASSERT(aIndex == ATT_BLEND_BLENDMODE);
   mBlendMode = static_cast<BlendMode>(aBlendMode);
+  RecordAttribute(aIndex, aBlendMode);
   Invalidate();
 }
 
@@ -1116,6 +1729,7 @@ FilterNodeTransformSoftware::SetAttribute(uint32_t aIndex, uint32_t aFilter)
 {
   MOZ_ASSERT(aIndex == ATT_TRANSFORM_FILTER);
   mFilter = static_cast<Filter>(aFilter);
+  RecordAttribute(aIndex, aFilter);
   Invalidate();
 }
 
@@ -1124,6 +1738,7 @@ FilterNodeTransformSoftware::SetAttribute(uint32_t aIndex, const Matrix &aMatrix
 {
   MOZ_ASSERT(aIndex == ATT_TRANSFORM_MATRIX);
   mMatrix = aMatrix;
+  RecordAttribute(aIndex, aMatrix);
   Invalidate();
 }
 
@@ -1224,6 +1839,7 @@ FilterNodeMorphologySoftware::SetAttribute(uint32_t aIndex,
   MOZ_ASSERT(aIndex == ATT_MORPHOLOGY_RADII);
   mRadii.width = std::min(std::max(aRadii.width, 0), 100000);
   mRadii.height = std::min(std::max(aRadii.height, 0), 100000);
+  RecordAttribute(aIndex, aRadii);
   Invalidate();
 }
 
@@ -1233,6 +1849,7 @@ FilterNodeMorphologySoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_MORPHOLOGY_OPERATOR);
   mOperator = static_cast<MorphologyOperator>(aOperator);
+  RecordAttribute(aIndex, aOperator);
   Invalidate();
 }
 
@@ -1350,6 +1967,7 @@ FilterNodeColorMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_COLOR_MATRIX_MATRIX);
   mMatrix = aMatrix;
+  RecordAttribute(aIndex, aMatrix);
   Invalidate();
 }
 
@@ -1359,6 +1977,7 @@ FilterNodeColorMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_COLOR_MATRIX_ALPHA_MODE);
   mAlphaMode = (AlphaMode)aAlphaMode;
+  RecordAttribute(aIndex, aAlphaMode);
   Invalidate();
 }
 
@@ -1435,6 +2054,24 @@ FilterNodeColorMatrixSoftware::Render(const IntRect& aRect)
   return result.forget();
 }
 
+bool
+FilterNodeColorMatrixSoftware::AppendPointwiseStages(const IntRect& aRect,
+                                                     std::vector<PointwiseStage>& aStages)
+{
+  if (mAlphaMode == ALPHA_MODE_PREMULTIPLIED) {
+    aStages.push_back(PointwiseStage(PointwiseStage::UNPREMULTIPLY));
+  }
+
+  PointwiseStage stage(PointwiseStage::COLOR_MATRIX);
+  stage.mMatrix = mMatrix;
+  aStages.push_back(stage);
+
+  if (mAlphaMode == ALPHA_MODE_PREMULTIPLIED) {
+    aStages.push_back(PointwiseStage(PointwiseStage::PREMULTIPLY));
+  }
+  return true;
+}
+
 void
 FilterNodeColorMatrixSoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
@@ -1452,6 +2089,7 @@ FilterNodeFloodSoftware::SetAttribute(uint32_t aIndex, const Color &aColor)
 {
   MOZ_ASSERT(aIndex == ATT_FLOOD_COLOR);
   mColor = aColor;
+  RecordAttribute(aIndex, aColor);
   Invalidate();
 }
 
@@ -1522,6 +2160,16 @@ FilterNodeFloodSoftware::GetOutput(const IntRect& aRect)
   return Render(aRect);
 }
 
+bool
+FilterNodeFloodSoftware::AppendPointwiseStages(const IntRect& aRect,
+                                               std::vector<PointwiseStage>& aStages)
+{
+  PointwiseStage stage(PointwiseStage::FILL);
+  stage.mColor = ColorToBGRA(mColor);
+  aStages.push_back(stage);
+  return true;
+}
+
 IntRect
 FilterNodeFloodSoftware::GetOutputRectInRect(const IntRect& aRect)
 {
@@ -1547,6 +2195,7 @@ FilterNodeTileSoftware::SetAttribute(uint32_t aIndex,
   MOZ_ASSERT(aIndex == ATT_TILE_SOURCE_RECT);
   mSourceRect = IntRect(int32_t(aSourceRect.x), int32_t(aSourceRect.y),
                         int32_t(aSourceRect.width), int32_t(aSourceRect.height));
+  RecordAttribute(aIndex, aSourceRect);
   Invalidate();
 }
 
@@ -1668,6 +2317,7 @@ FilterNodeComponentTransferSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aDisable);
   Invalidate();
 }
 
@@ -1677,15 +2327,9 @@ FilterNodeComponentTransferSoftware::GenerateLookupTable(ptrdiff_t aComponent,
                                                          bool aDisabled)
 {
   if (aDisabled) {
-    static uint8_t sIdentityLookupTable[256];
-    static bool sInitializedIdentityLookupTable = false;
-    if (!sInitializedIdentityLookupTable) {
-      for (int32_t i = 0; i < 256; i++) {
-        sIdentityLookupTable[i] = i;
-      }
-      sInitializedIdentityLookupTable = true;
+    for (int32_t i = 0; i < 256; i++) {
+      aTables[aComponent][i] = i;
     }
-    memcpy(aTables[aComponent], sIdentityLookupTable, 256);
   } else {
     FillLookupTable(aComponent, aTables[aComponent]);
   }
@@ -1783,6 +2427,23 @@ FilterNodeComponentTransferSoftware::Render(const IntRect& aRect)
   return target.forget();
 }
 
+bool
+FilterNodeComponentTransferSoftware::AppendPointwiseStages(const IntRect& aRect,
+                                                           std::vector<PointwiseStage>& aStages)
+{
+  if (mDisableR && mDisableG && mDisableB && mDisableA) {
+    return true;
+  }
+
+  PointwiseStage stage(PointwiseStage::LOOKUP);
+  GenerateLookupTable(B8G8R8A8_COMPONENT_BYTEOFFSET_R, stage.mTables, mDisableR);
+  GenerateLookupTable(B8G8R8A8_COMPONENT_BYTEOFFSET_G, stage.mTables, mDisableG);
+  GenerateLookupTable(B8G8R8A8_COMPONENT_BYTEOFFSET_B, stage.mTables, mDisableB);
+  GenerateLookupTable(B8G8R8A8_COMPONENT_BYTEOFFSET_A, stage.mTables, mDisableA);
+  aStages.push_back(stage);
+  return true;
+}
+
 void
 FilterNodeComponentTransferSoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
@@ -1826,6 +2487,7 @@ FilterNodeTableTransferSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aFloat, aSize);
   Invalidate();
 }
 
@@ -1895,6 +2557,7 @@ FilterNodeDiscreteTransferSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aFloat, aSize);
   Invalidate();
 }
 
@@ -1984,6 +2647,7 @@ FilterNodeLinearTransferSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -2032,6 +2696,10 @@ FilterNodeGammaTransferSoftware::FilterNodeGammaTransferSoftware()
  , mExponentG(0)
  , mExponentB(0)
  , mExponentA(0)
+ , mOffsetR(0)
+ , mOffsetG(0)
+ , mOffsetB(0)
+ , mOffsetA(0)
 {}
 
 void
@@ -2078,6 +2746,7 @@ FilterNodeGammaTransferSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -2140,6 +2809,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_KERNEL_SIZE);
   mKernelSize = aKernelSize;
+  RecordAttribute(aIndex, aKernelSize);
   Invalidate();
 }
 
@@ -2150,6 +2820,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_KERNEL_MATRIX);
   mKernelMatrix = std::vector<Float>(aMatrix, aMatrix + aSize);
+  RecordAttribute(aIndex, aMatrix, aSize);
   Invalidate();
 }
 
@@ -2166,6 +2837,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex, Float aValue)
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -2179,6 +2851,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex, const Size &aKer
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aKernelUnitLength);
   Invalidate();
 }
 
@@ -2188,6 +2861,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_TARGET);
   mTarget = aTarget;
+  RecordAttribute(aIndex, aTarget);
   Invalidate();
 }
 
@@ -2197,6 +2871,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_SOURCE_RECT);
   mSourceRect = aSourceRect;
+  RecordAttribute(aIndex, aSourceRect);
   Invalidate();
 }
 
@@ -2206,6 +2881,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_EDGE_MODE);
   mEdgeMode = static_cast<ConvolveMatrixEdgeMode>(aEdgeMode);
+  RecordAttribute(aIndex, aEdgeMode);
   Invalidate();
 }
 
@@ -2215,6 +2891,7 @@ FilterNodeConvolveMatrixSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_CONVOLVE_MATRIX_PRESERVE_ALPHA);
   mPreserveAlpha = aPreserveAlpha;
+  RecordAttribute(aIndex, aPreserveAlpha);
   Invalidate();
 }
 
@@ -2226,7 +2903,12 @@ static uint8_t* sColorSamplingAccessControlEnd = nullptr;
 struct DebugOnlyAutoColorSamplingAccessControl
 {
   explicit DebugOnlyAutoColorSamplingAccessControl(DataSourceSurface* aSurface)
+    // The checks use globals, skip them when tiles may render concurrently.
+    : mEnabled(!CurrentTileState())
   {
+    if (!mEnabled) {
+      return;
+    }
     sColorSamplingAccessControlStart = aSurface->GetData();
     sColorSamplingAccessControlEnd = sColorSamplingAccessControlStart +
       aSurface->Stride() * aSurface->GetSize().height;
@@ -2235,8 +2917,12 @@ struct DebugOnlyAutoColorSamplingAccessControl
 
   ~DebugOnlyAutoColorSamplingAccessControl()
   {
-    sColorSamplingAccessControlEnabled = false;
+    if (mEnabled) {
+      sColorSamplingAccessControlEnabled = false;
+    }
   }
+
+  bool mEnabled;
 };
 
 static inline void
@@ -2403,6 +3089,55 @@ TranslateDoubleToShifts(double aDouble, int32_t &aShiftL, int32_t &aShiftR)
   }
 }
 
+// Convolves with FilterProcessing::ApplyConvolveMatrix, which needs the
+// kernel unit lengths to be whole pixels. aTargetData points at the first
+// target pixel and aSourceData at the source pixel under it. Returns false if
+// the kernel has to be applied by ConvolvePixel instead.
+static bool
+ConvolveWithFilterProcessing(const uint8_t* aSourceData, int32_t aSourceStride,
+                             uint8_t* aTargetData, int32_t aTargetStride,
+                             const IntSize& aSize, const std::vector<Float>& aKernel,
+                             const IntSize& aKernelSize, const IntPoint& aTarget,
+                             int32_t aKernelUnitLengthX, int32_t aKernelUnitLengthY,
+                             Float aBias, bool aPreserveAlpha)
+{
+  if (aKernelUnitLengthX < 1 || aKernelUnitLengthY < 1) {
+    return false;
+  }
+
+  const uint8_t* firstSample = aSourceData -
+    aTarget.y * aKernelUnitLengthY * aSourceStride - 4 * aTarget.x * aKernelUnitLengthX;
+  if (!FilterProcessing::ApplyConvolveMatrix(firstSample, aSourceStride,
+                                             aTargetData, aTargetStride, aSize,
+                                             &aKernel.front(), aKernelSize,
+                                             IntSize(aKernelUnitLengthX, aKernelUnitLengthY),
+                                             aBias)) {
+    return false;
+  }
+
+  if (aPreserveAlpha) {
+    for (int32_t y = 0; y < aSize.height; y++) {
+      for (int32_t x = 0; x < aSize.width; x++) {
+        aTargetData[y * aTargetStride + 4 * x + B8G8R8A8_COMPONENT_BYTEOFFSET_A] =
+          aSourceData[y * aSourceStride + 4 * x + B8G8R8A8_COMPONENT_BYTEOFFSET_A];
+      }
+    }
+  }
+  return true;
+}
+
+// Fractional kernel unit lengths need ConvolvePixel's interpolation.
+static bool
+ConvolveWithFilterProcessing(const uint8_t* aSourceData, int32_t aSourceStride,
+                             uint8_t* aTargetData, int32_t aTargetStride,
+                             const IntSize& aSize, const std::vector<Float>& aKernel,
+                             const IntSize& aKernelSize, const IntPoint& aTarget,
+                             Float aKernelUnitLengthX, Float aKernelUnitLengthY,
+                             Float aBias, bool aPreserveAlpha)
+{
+  return false;
+}
+
 template<typename CoordType>
 TemporaryRef<DataSourceSurface>
 FilterNodeConvolveMatrixSoftware::DoRender(const IntRect& aRect,
@@ -2442,6 +3177,14 @@ FilterNodeConvolveMatrixSoftware::DoRender(const IntRect& aRect,
   // Why exactly are we reversing the kernel?
   std::vector<Float> kernel = ReversedVector(mKernelMatrix);
   kernel = ScaledVector(kernel, mDivisor);
+
+  if (ConvolveWithFilterProcessing(sourceData, sourceStride, targetData, targetStride,
+                                   aRect.Size(), kernel, mKernelSize, mTarget,
+                                   aKernelUnitLengthX, aKernelUnitLengthY,
+                                   mBias, mPreserveAlpha)) {
+    return target.forget();
+  }
+
   Float maxResultAbs = std::max(MaxVectorSum(kernel) + mBias,
                                 MaxVectorSum(ScaledVector(kernel, -1)) - mBias);
   maxResultAbs = std::max(maxResultAbs, 1.0f);
@@ -2476,7 +3219,12 @@ FilterNodeConvolveMatrixSoftware::DoRender(const IntRect& aRect,
 void
 FilterNodeConvolveMatrixSoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
-  RequestInputRect(IN_CONVOLVE_MATRIX_IN, InflatedSourceRect(aRect));
+  IntRect srcRect = InflatedSourceRect(aRect);
+  if (mEdgeMode == EDGE_MODE_WRAP && !srcRect.IsEmpty()) {
+    // See GetInputDataSourceSurface, wrapping needs all of mSourceRect.
+    srcRect = srcRect.Union(mSourceRect);
+  }
+  RequestInputRect(IN_CONVOLVE_MATRIX_IN, srcRect);
 }
 
 IntRect
@@ -2545,6 +3293,7 @@ FilterNodeDisplacementMapSoftware::SetAttribute(uint32_t aIndex,
 {
   MOZ_ASSERT(aIndex == ATT_DISPLACEMENT_MAP_SCALE);
   mScale = aScale;
+  RecordAttribute(aIndex, aScale);
   Invalidate();
 }
 
@@ -2561,6 +3310,7 @@ FilterNodeDisplacementMapSoftware::SetAttribute(uint32_t aIndex, uint32_t aValue
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -2661,6 +3411,7 @@ FilterNodeTurbulenceSoftware::SetAttribute(uint32_t aIndex, const Size &aBaseFre
       MOZ_CRASH();
       break;
   }
+  RecordAttribute(aIndex, aBaseFrequency);
   Invalidate();
 }
 
@@ -2675,6 +3426,7 @@ FilterNodeTurbulenceSoftware::SetAttribute(uint32_t aIndex, const IntRect &aRect
       MOZ_CRASH();
       break;
   }
+  RecordAttribute(aIndex, aRect);
   Invalidate();
 }
 
@@ -2683,6 +3435,7 @@ FilterNodeTurbulenceSoftware::SetAttribute(uint32_t aIndex, bool aStitchable)
 {
   MOZ_ASSERT(aIndex == ATT_TURBULENCE_STITCHABLE);
   mStitchable = aStitchable;
+  RecordAttribute(aIndex, aStitchable);
   Invalidate();
 }
 
@@ -2703,6 +3456,7 @@ FilterNodeTurbulenceSoftware::SetAttribute(uint32_t aIndex, uint32_t aValue)
       MOZ_CRASH();
       break;
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -2748,6 +3502,7 @@ FilterNodeArithmeticCombineSoftware::SetAttribute(uint32_t aIndex,
   mK3 = aFloat[2];
   mK4 = aFloat[3];
 
+  RecordAttribute(aIndex, aFloat, aSize);
   Invalidate();
 }
 
@@ -2779,6 +3534,28 @@ FilterNodeArithmeticCombineSoftware::Render(const IntRect& aRect)
   return FilterProcessing::ApplyArithmeticCombine(input1, input2, k1, k2, k3, k4);
 }
 
+bool
+FilterNodeArithmeticCombineSoftware::AppendPointwiseStages(const IntRect& aRect,
+                                                           std::vector<PointwiseStage>& aStages)
+{
+  PointwiseStage stage(PointwiseStage::ARITHMETIC_COMBINE);
+  stage.mInput =
+    GetInputDataSourceSurface(IN_ARITHMETIC_COMBINE_IN2, aRect, NEED_COLOR_CHANNELS);
+  stage.mK1 = mK1;
+  stage.mK2 = mK2;
+  stage.mK3 = mK3;
+  stage.mK4 = mK4;
+
+  // Like in Render, a missing second input is treated as transparent.
+  if (!stage.mInput) {
+    stage.mK1 = 0.0f;
+    stage.mK3 = 0.0f;
+  }
+
+  aStages.push_back(stage);
+  return true;
+}
+
 void
 FilterNodeArithmeticCombineSoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
@@ -2822,6 +3599,7 @@ FilterNodeCompositeSoftware::SetAttribute(uint32_t aIndex, uint32_t aCompositeOp
 {
   MOZ_ASSERT(aIndex == ATT_COMPOSITE_OPERATOR);
   mOperator = static_cast<CompositeOperator>(aCompositeOperator);
+  RecordAttribute(aIndex, aCompositeOperator);
   Invalidate();
 }
 
@@ -2901,6 +3679,22 @@ FilterNodeBlurXYSoftware::InputIndex(uint32_t aInputEnumIndex)
   }
 }
 
+/**
+ * The quality FilterNodeBlurXYSoftware blurs B8G8R8A8 inputs with. Small
+ * blurs are cheap enough to be done with the real Gaussian kernel instead of
+ * the box blur approximation. Large ones are done at reduced resolution,
+ * where losing detail that the blur removes anyway is fine.
+ */
+static GaussianBlurQuality
+ColorBlurQuality(const Size& aStdDeviation)
+{
+  return FilterProcessing::ExactGaussianBlurRadius(aStdDeviation.width) <=
+           FilterProcessing::kMaxExactGaussianBlurRadius &&
+         FilterProcessing::ExactGaussianBlurRadius(aStdDeviation.height) <=
+           FilterProcessing::kMaxExactGaussianBlurRadius ?
+    GAUSSIAN_BLUR_EXACT : GAUSSIAN_BLUR_DOWNSCALED;
+}
+
 TemporaryRef<DataSourceSurface>
 FilterNodeBlurXYSoftware::Render(const IntRect& aRect)
 {
@@ -2922,25 +3716,28 @@ FilterNodeBlurXYSoftware::Render(const IntRect& aRect)
   Rect r(0, 0, srcRect.width, srcRect.height);
 
   if (input->GetFormat() == SurfaceFormat::A8) {
+    // A8 inputs are always box blurred, large ones at reduced resolution.
+    // ApplyGaussianBlur only handles four channels at once, and expanding them
+    // would make the blur four times as much work, so they can come out
+    // slightly different from the alpha of the same blur applied to a
+    // B8G8R8A8 input.
     target = Factory::CreateDataSourceSurface(srcRect.Size(), SurfaceFormat::A8);
     if (MOZ2D_WARN_IF(!target)) {
       return nullptr;
     }
     CopyRect(input, target, IntRect(IntPoint(), input->GetSize()), IntPoint());
     AlphaBoxBlur blur(r, target->Stride(), sigmaXY.width, sigmaXY.height);
-    blur.Blur(target->GetData());
+    blur.BlurDownscaled(target->GetData(), WorkerPool::Get());
   } else {
-    RefPtr<DataSourceSurface> channel0, channel1, channel2, channel3;
-    FilterProcessing::SeparateColorChannels(input, channel0, channel1, channel2, channel3);
-    if (MOZ2D_WARN_IF(!(channel0 && channel1 && channel2))) {
+    target = Factory::CreateDataSourceSurface(srcRect.Size(), SurfaceFormat::B8G8R8A8);
+    if (MOZ2D_WARN_IF(!target)) {
+      return nullptr;
+    }
+    CopyRect(input, target, IntRect(IntPoint(), input->GetSize()), IntPoint());
+    if (!FilterProcessing::ApplyGaussianBlur(target, sigmaXY, ColorBlurQuality(sigmaXY),
+                                             WorkerPool::Get())) {
       return nullptr;
     }
-    AlphaBoxBlur blur(r, channel0->Stride(), sigmaXY.width, sigmaXY.height);
-    blur.Blur(channel0->GetData());
-    blur.Blur(channel1->GetData());
-    blur.Blur(channel2->GetData());
-    blur.Blur(channel3->GetData());
-    target = FilterProcessing::CombineColorChannels(channel0, channel1, channel2, channel3);
   }
 
   return GetDataSurfaceInRect(target, srcRect, aRect, EDGE_MODE_NONE);
@@ -2957,6 +3754,11 @@ FilterNodeBlurXYSoftware::InflatedSourceOrDestRect(const IntRect &aDestRect)
 {
   Size sigmaXY = StdDeviationXY();
   IntSize d = AlphaBoxBlur::CalculateBlurRadius(Point(sigmaXY.width, sigmaXY.height));
+  if (ColorBlurQuality(sigmaXY) == GAUSSIAN_BLUR_EXACT) {
+    // The exact kernel reaches further than the box blur.
+    d.width = std::max(d.width, FilterProcessing::ExactGaussianBlurRadius(sigmaXY.width));
+    d.height = std::max(d.height, FilterProcessing::ExactGaussianBlurRadius(sigmaXY.height));
+  }
   IntRect srcRect = aDestRect;
   srcRect.Inflate(d);
   return srcRect;
@@ -2977,8 +3779,10 @@ FilterNodeGaussianBlurSoftware::FilterNodeGaussianBlurSoftware()
 static float
 ClampStdDeviation(float aStdDeviation)
 {
-  // Cap software blur radius for performance reasons.
-  return std::min(std::max(0.0f, aStdDeviation), 100.0f);
+  // Cap software blur radius for performance reasons. The blur itself takes
+  // the same time per pixel for any radius, but the surfaces it works on grow
+  // with it.
+  return std::min(std::max(0.0f, aStdDeviation), 500.0f);
 }
 
 void
@@ -2992,6 +3796,7 @@ FilterNodeGaussianBlurSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aStdDeviation);
   Invalidate();
 }
 
@@ -3016,6 +3821,7 @@ FilterNodeDirectionalBlurSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aStdDeviation);
   Invalidate();
 }
 
@@ -3030,6 +3836,7 @@ FilterNodeDirectionalBlurSoftware::SetAttribute(uint32_t aIndex,
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aBlurDirection);
   Invalidate();
 }
 
@@ -3060,6 +3867,7 @@ FilterNodeCropSoftware::SetAttribute(uint32_t aIndex,
   if (!srcRect.ToIntRect(&mCropRect)) {
     mCropRect = IntRect();
   }
+  RecordAttribute(aIndex, aSourceRect);
   Invalidate();
 }
 
@@ -3098,6 +3906,14 @@ FilterNodePremultiplySoftware::Render(const IntRect& aRect)
   return input ? Premultiply(input) : nullptr;
 }
 
+bool
+FilterNodePremultiplySoftware::AppendPointwiseStages(const IntRect& aRect,
+                                                     std::vector<PointwiseStage>& aStages)
+{
+  aStages.push_back(PointwiseStage(PointwiseStage::PREMULTIPLY));
+  return true;
+}
+
 void
 FilterNodePremultiplySoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
@@ -3127,6 +3943,14 @@ FilterNodeUnpremultiplySoftware::Render(const IntRect& aRect)
   return input ? Unpremultiply(input) : nullptr;
 }
 
+bool
+FilterNodeUnpremultiplySoftware::AppendPointwiseStages(const IntRect& aRect,
+                                                       std::vector<PointwiseStage>& aStages)
+{
+  aStages.push_back(PointwiseStage(PointwiseStage::UNPREMULTIPLY));
+  return true;
+}
+
 void
 FilterNodeUnpremultiplySoftware::RequestFromInputsForRect(const IntRect &aRect)
 {
@@ -3225,7 +4049,10 @@ FilterNodeLightingSoftware<LightType, LightingType>::FilterNodeLightingSoftware(
 #if defined(MOZILLA_INTERNAL_API) && (defined(DEBUG) || defined(FORCE_BUILD_REFCNT_LOGGING))
  , mTypeName(aTypeName)
 #endif
-{}
+{
+  mLight.Prepare();
+  mLighting.Prepare();
+}
 
 template<typename LightType, typename LightingType>
 int32_t
@@ -3242,6 +4069,8 @@ void
 FilterNodeLightingSoftware<LightType, LightingType>::SetAttribute(uint32_t aIndex, const Point3D &aPoint)
 {
   if (mLight.SetAttribute(aIndex, aPoint)) {
+    mLight.Prepare();
+    RecordAttribute(aIndex, aPoint);
     Invalidate();
     return;
   }
@@ -3254,6 +4083,11 @@ FilterNodeLightingSoftware<LightType, LightingType>::SetAttribute(uint32_t aInde
 {
   if (mLight.SetAttribute(aIndex, aValue) ||
       mLighting.SetAttribute(aIndex, aValue)) {
+    // Prepare here rather than in Render, tiles of this filter may be
+    // rendered concurrently.
+    mLight.Prepare();
+    mLighting.Prepare();
+    RecordAttribute(aIndex, aValue);
     Invalidate();
     return;
   }
@@ -3264,6 +4098,7 @@ FilterNodeLightingSoftware<LightType, LightingType>::SetAttribute(uint32_t aInde
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aValue);
   Invalidate();
 }
 
@@ -3278,6 +4113,7 @@ FilterNodeLightingSoftware<LightType, LightingType>::SetAttribute(uint32_t aInde
     default:
       MOZ_CRASH();
   }
+  RecordAttribute(aIndex, aKernelUnitLength);
   Invalidate();
 }
 
@@ -3287,6 +4123,7 @@ FilterNodeLightingSoftware<LightType, LightingType>::SetAttribute(uint32_t aInde
 {
   MOZ_ASSERT(aIndex == ATT_LIGHTING_COLOR);
   mColor = aColor;
+  RecordAttribute(aIndex, aColor);
   Invalidate();
 }
 
@@ -3457,8 +4294,6 @@ FilterNodeLightingSoftware<LightType, LightingType>::DoRender(const IntRect& aRe
   int32_t targetStride = target->Stride();
 
   uint32_t lightColor = ColorToBGRA(mColor);
-  mLight.Prepare();
-  mLighting.Prepare();
 
   for (int32_t y = 0; y < size.height; y++) {
     for (int32_t x = 0; x < size.width; x++) {
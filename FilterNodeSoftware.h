@@ -7,6 +7,9 @@
 #define _MOZILLA_GFX_FILTERNODESOFTWARE_H_
 
 #include "Filters.h"
+#include <functional>
+#include <map>
+#include <set>
 #include <vector>
 
 namespace mozilla {
@@ -16,6 +19,9 @@ class DataSourceSurface;
 class DrawTarget;
 struct DrawOptions;
 class FilterNodeSoftware;
+class WorkerPool;
+struct FilterTileState;
+struct PointwiseStage;
 
 /**
  * Can be attached to FilterNodeSoftware instances using
@@ -39,6 +45,7 @@ class FilterNodeSoftware : public FilterNode,
 {
 public:
   MOZ_DECLARE_REFCOUNTED_VIRTUAL_TYPENAME(FilterNodeSoftware)
+  FilterNodeSoftware();
   virtual ~FilterNodeSoftware();
 
   // Factory method, intended to be called from DrawTarget*::CreateFilter.
@@ -48,6 +55,23 @@ public:
   void Draw(DrawTarget* aDrawTarget, const Rect &aSourceRect,
             const Point &aDestPoint, const DrawOptions &aOptions);
 
+  typedef std::function<void(const IntRect&, DataSourceSurface*)> TileCallback;
+
+  /**
+   * Renders the output of this filter in aRect as a grid of tiles of at most
+   * aTileSize x aTileSize pixels and passes each tile, along with its rect in
+   * filter space, to aCallback. Every tile is pulled through the filter graph
+   * separately and the intermediate surfaces of a tile are released once it
+   * has been handed to aCallback, so peak memory use depends on the tile size
+   * rather than on the size of aRect. Apart from the shared output cache (see
+   * Factory::SetSoftwareFilterCacheSize) nothing is cached across calls.
+   * With a non-null aPool batches of tiles are rendered concurrently;
+   * aCallback is always called on the calling thread. Tiles without output
+   * are skipped.
+   */
+  void RenderTiles(const IntRect &aRect, int32_t aTileSize, WorkerPool* aPool,
+                   const TileCallback &aCallback);
+
   virtual FilterBackend GetBackendType() MOZ_OVERRIDE { return FILTER_BACKEND_SOFTWARE; }
   virtual void SetInput(uint32_t aIndex, SourceSurface *aSurface) MOZ_OVERRIDE;
   virtual void SetInput(uint32_t aIndex, FilterNode *aFilter) MOZ_OVERRIDE;
@@ -60,6 +84,10 @@ public:
   // FilterInvalidationListener implementation
   virtual void FilterInvalidated(FilterNodeSoftware* aFilter);
 
+  // Back the corresponding Factory methods.
+  static void SetSharedCacheSize(size_t aMaxBytes);
+  static CacheStats GetSharedCacheStats();
+
 protected:
 
   // The following methods are intended to be overriden by subclasses.
@@ -106,6 +134,17 @@ protected:
    */
   virtual TemporaryRef<DataSourceSurface> GetOutput(const IntRect &aRect);
 
+  /**
+   * Filters whose output pixels only depend on the input pixels at the same
+   * position override this to append the PointwiseStages that make up their
+   * operation to aStages. The first stage reads from input 0, stages for any
+   * further inputs fetch those for aRect. Returns false if the filter can't
+   * be described like this.
+   */
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages)
+  { return false; }
+
   // The following methods are non-virtual helper methods.
 
   /**
@@ -162,6 +201,38 @@ protected:
    */
   size_t NumberOfSetInputs();
 
+  /**
+   * Stores the rect we want to render and cache on the next call to GetOutput,
+   * and our cached output.
+   */
+  struct OutputCache {
+    IntRect mRequestedRect;
+    IntRect mCachedRect;
+    RefPtr<DataSourceSurface> mCachedOutput;
+  };
+
+  /**
+   * Returns mOutputCache, or the cache for this filter that belongs to the
+   * tile being rendered on the calling thread during RenderTiles.
+   */
+  OutputCache& GetOutputCache();
+
+  /**
+   * Adds data surfaces for the input surfaces of this filter and its inputs
+   * to aInputData. Used by RenderTiles to make sure tiles never touch the
+   * input surfaces themselves.
+   */
+  void CollectInputData(std::map<SourceSurface*, RefPtr<DataSourceSurface> > &aInputData,
+                        std::set<FilterNodeSoftware*> &aVisited);
+
+  /**
+   * Renders aRect for this filter together with the pointwise filters that
+   * feed into it and have no other consumers in a single pass, without
+   * rendering or caching their output separately. Returns nullptr if there
+   * is nothing to gain, in which case the caller falls back to Render().
+   */
+  TemporaryRef<DataSourceSurface> RenderPointwiseChain(const IntRect& aRect);
+
   /**
    * Discard the cached surface that was stored in the GetOutput default
    * implementation. Needs to be called whenever attributes or inputs are set
@@ -184,6 +255,39 @@ protected:
   void SetInput(uint32_t aIndex, SourceSurface *aSurface,
                 FilterNodeSoftware *aFilter);
 
+  /**
+   * Records the value an attribute was set to, so that the output of this
+   * filter can be shared through the cross-draw output cache with filters of
+   * the same type, attributes and inputs. Must be called by every SetAttribute
+   * implementation that affects the output. Attribute indices are unique
+   * within a filter type, so the value replaces any earlier one for aIndex.
+   */
+  template<typename T>
+  void RecordAttribute(uint32_t aIndex, const T& aValue)
+  {
+    RecordAttributeBytes(aIndex, &aValue, sizeof(T));
+  }
+
+  void RecordAttribute(uint32_t aIndex, const Float* aValues, uint32_t aSize)
+  {
+    RecordAttributeBytes(aIndex, aValues, aSize * sizeof(Float));
+  }
+
+private:
+  void RecordAttributeBytes(uint32_t aIndex, const void* aData, size_t aLength);
+
+  /**
+   * A hash of our type, attributes and inputs, recursively. Filters with equal
+   * hashes are assumed to produce identical output.
+   */
+  uint64_t GetSubgraphHash();
+
+  /**
+   * Forgets the rects requested from this filter and its inputs, for when
+   * our output was found in the shared cache and they won't be rendered.
+   */
+  void ClearRequestedRects();
+
 protected:
   /**
    * mInputSurfaces / mInputFilters: For each input index, either a surface or
@@ -200,17 +304,14 @@ protected:
    */
   std::vector<FilterInvalidationListener*> mInvalidationListeners;
 
-  /**
-   * Stores the rect which we want to render and cache on the next call to
-   * GetOutput.
-   */
-  IntRect mRequestedRect;
+  OutputCache mOutputCache;
 
-  /**
-   * Stores our cached output.
-   */
-  IntRect mCachedRect;
-  RefPtr<DataSourceSurface> mCachedOutput;
+  FilterType mType;
+  std::map<uint32_t, uint64_t> mAttributeHashes;
+  uint64_t mSubgraphHash;
+  bool mSubgraphHashValid;
+
+  friend struct FilterTileState;
 };
 
 // Subclasses for specific filters.
@@ -291,6 +392,8 @@ protected:
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
   virtual int32_t InputIndex(uint32_t aInputEnumIndex) MOZ_OVERRIDE;
   virtual void RequestFromInputsForRect(const IntRect &aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
 
 private:
   Matrix5x4 mMatrix;
@@ -309,6 +412,8 @@ protected:
   virtual TemporaryRef<DataSourceSurface> GetOutput(const IntRect &aRect) MOZ_OVERRIDE;
   virtual TemporaryRef<DataSourceSurface> Render(const IntRect& aRect) MOZ_OVERRIDE;
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
 
 private:
   Color mColor;
@@ -349,6 +454,8 @@ protected:
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
   virtual int32_t InputIndex(uint32_t aInputEnumIndex) MOZ_OVERRIDE;
   virtual void RequestFromInputsForRect(const IntRect &aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
   virtual void GenerateLookupTable(ptrdiff_t aComponent, uint8_t aTables[4][256],
                                    bool aDisabled);
   virtual void FillLookupTable(ptrdiff_t aComponent, uint8_t aTable[256]) = 0;
@@ -559,6 +666,8 @@ protected:
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
   virtual int32_t InputIndex(uint32_t aInputEnumIndex) MOZ_OVERRIDE;
   virtual void RequestFromInputsForRect(const IntRect &aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
 
 private:
   Float mK1;
@@ -665,6 +774,8 @@ protected:
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
   virtual int32_t InputIndex(uint32_t aInputEnumIndex) MOZ_OVERRIDE;
   virtual void RequestFromInputsForRect(const IntRect &aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
 };
 
 class FilterNodeUnpremultiplySoftware : public FilterNodeSoftware
@@ -677,6 +788,8 @@ protected:
   virtual IntRect GetOutputRectInRect(const IntRect& aRect) MOZ_OVERRIDE;
   virtual int32_t InputIndex(uint32_t aInputEnumIndex) MOZ_OVERRIDE;
   virtual void RequestFromInputsForRect(const IntRect &aRect) MOZ_OVERRIDE;
+  virtual bool AppendPointwiseStages(const IntRect& aRect,
+                                     std::vector<PointwiseStage>& aStages) MOZ_OVERRIDE;
 };
 
 template<typename LightType, typename LightingType>
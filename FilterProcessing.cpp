@@ -4,7 +4,17 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "FilterProcessing.h"
+#include "Blur.h"
+#include "DataSurfaceHelpers.h"
+#include "ImageScaling.h"
 #include "Logging.h"
+#include "Tools.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
 
 namespace mozilla {
 namespace gfx {
@@ -48,6 +58,11 @@ TemporaryRef<DataSourceSurface>
 FilterProcessing::ApplyBlending(DataSourceSurface* aInput1, DataSourceSurface* aInput2,
                                 BlendMode aBlendMode)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    return ApplyBlending_AVX2(aInput1, aInput2, aBlendMode);
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2
     return ApplyBlending_SSE2(aInput1, aInput2, aBlendMode);
@@ -93,6 +108,11 @@ FilterProcessing::ApplyMorphologyVertical(uint8_t* aSourceData, int32_t aSourceS
 TemporaryRef<DataSourceSurface>
 FilterProcessing::ApplyColorMatrix(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    return ApplyColorMatrix_AVX2(aInput, aMatrix);
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2
     return ApplyColorMatrix_SSE2(aInput, aMatrix);
@@ -101,10 +121,37 @@ FilterProcessing::ApplyColorMatrix(DataSourceSurface* aInput, const Matrix5x4 &a
   return ApplyColorMatrix_Scalar(aInput, aMatrix);
 }
 
+void
+FilterProcessing::DoColorMatrixCalculation(const IntSize& aSize,
+                                           uint8_t* aTargetData, int32_t aTargetStride,
+                                           uint8_t* aSourceData, int32_t aSourceStride,
+                                           const Matrix5x4 &aMatrix)
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    DoColorMatrixCalculation_AVX2(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+    return;
+  }
+#endif
+  if (Factory::HasSSE2()) {
+#ifdef USE_SSE2
+    DoColorMatrixCalculation_SSE2(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+    return;
+#endif
+  }
+  DoColorMatrixCalculation_Scalar(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+}
+
 void
 FilterProcessing::ApplyComposition(DataSourceSurface* aSource, DataSourceSurface* aDest,
                                    CompositeOperator aOperator)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    ApplyComposition_AVX2(aSource, aDest, aOperator);
+    return;
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2
     ApplyComposition_SSE2(aSource, aDest, aOperator);
@@ -181,6 +228,13 @@ FilterProcessing::DoPremultiplicationCalculation(const IntSize& aSize,
                                                  uint8_t* aTargetData, int32_t aTargetStride,
                                                  uint8_t* aSourceData, int32_t aSourceStride)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    DoPremultiplicationCalculation_AVX2(
+      aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+    return;
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2 
     DoPremultiplicationCalculation_SSE2(
@@ -197,6 +251,13 @@ FilterProcessing::DoUnpremultiplicationCalculation(const IntSize& aSize,
                                                    uint8_t* aTargetData, int32_t aTargetStride,
                                                    uint8_t* aSourceData, int32_t aSourceStride)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    DoUnpremultiplicationCalculation_AVX2(
+      aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+    return;
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2 
     DoUnpremultiplicationCalculation_SSE2(
@@ -223,6 +284,11 @@ FilterProcessing::RenderTurbulence(const IntSize &aSize, const Point &aOffset, c
 TemporaryRef<DataSourceSurface>
 FilterProcessing::ApplyArithmeticCombine(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4)
 {
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    return ApplyArithmeticCombine_AVX2(aInput1, aInput2, aK1, aK2, aK3, aK4);
+  }
+#endif
   if (Factory::HasSSE2()) {
 #ifdef USE_SSE2
     return ApplyArithmeticCombine_SSE2(aInput1, aInput2, aK1, aK2, aK3, aK4);
@@ -231,5 +297,392 @@ FilterProcessing::ApplyArithmeticCombine(DataSourceSurface* aInput1, DataSourceS
   return ApplyArithmeticCombine_Scalar(aInput1, aInput2, aK1, aK2, aK3, aK4);
 }
 
+void
+FilterProcessing::DoArithmeticCombineCalculation(const IntSize& aSize,
+                                                 uint8_t* aTargetData, int32_t aTargetStride,
+                                                 uint8_t* aSource1Data, int32_t aSource1Stride,
+                                                 uint8_t* aSource2Data, int32_t aSource2Stride,
+                                                 Float aK1, Float aK2, Float aK3, Float aK4)
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    DoArithmeticCombineCalculation_AVX2(aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride, aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+    return;
+  }
+#endif
+  if (Factory::HasSSE2()) {
+#ifdef USE_SSE2
+    DoArithmeticCombineCalculation_SSE2(aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride, aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+    return;
+#endif
+  }
+  DoArithmeticCombineCalculation_Scalar(aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride, aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+}
+
+void
+FilterProcessing::BoxBlurColumns(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                 const int32_t aLobes[3][2], uint8_t* aScratch)
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    BoxBlurColumns_AVX2(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+    return;
+  }
+#endif
+  if (Factory::HasSSE2()) {
+#ifdef USE_SSE2
+    BoxBlurColumns_SSE2(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+    return;
+#endif
+  }
+  BoxBlurColumns_Scalar(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+}
+
+void
+FilterProcessing::GaussianBlurColumns(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                      const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch)
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    GaussianBlurColumns_AVX2(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+    return;
+  }
+#endif
+  if (Factory::HasSSE2()) {
+#ifdef USE_SSE2
+    GaussianBlurColumns_SSE2(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+    return;
+#endif
+  }
+  GaussianBlurColumns_Scalar(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+}
+
+bool
+FilterProcessing::ApplyConvolveMatrix(const uint8_t* aSourceData, int32_t aSourceStride,
+                                      uint8_t* aTargetData, int32_t aTargetStride,
+                                      const IntSize& aSize, const Float* aKernel,
+                                      const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                      Float aBias)
+{
+  if (Factory::HasSSE2()) {
+#ifdef USE_SSE2
+    return ApplyConvolveMatrix_SSE2(aSourceData, aSourceStride, aTargetData, aTargetStride,
+                                    aSize, aKernel, aKernelSize, aKernelUnitLength, aBias);
+#endif
+  }
+  return ApplyConvolveMatrix_Scalar(aSourceData, aSourceStride, aTargetData, aTargetStride,
+                                    aSize, aKernel, aKernelSize, aKernelUnitLength, aBias);
+}
+
+// Surfaces with fewer pixels than this are always blurred on the calling
+// thread, splitting them up would cost more than it saves.
+static const int32_t kMinParallelBlurPixels = 256 * 256;
+
+// The minimum width of a strip of columns handed to a worker.
+static const int32_t kMinBlurStripBytes = 256;
+
+// The column kernels work on up to this many bytes of a row at a time.
+static const int32_t kMaxBlurColumnBytes = 32;
+
+static void
+CopyPixelRows(const uint8_t* aSource, int32_t aSourceStride,
+              uint8_t* aDest, int32_t aDestStride, const IntSize& aSize)
+{
+  for (int32_t y = 0; y < aSize.height; y++) {
+    memcpy(aDest + aDestStride * y, aSource + aSourceStride * y, aSize.width * 4);
+  }
+}
+
+/**
+ * Copies the aSize sized block of 32-bit pixels at aSource to aDest with rows
+ * and columns swapped, so that aDest is aSize.height pixels wide.
+ */
+static void
+TransposePixels(const uint8_t* aSource, int32_t aSourceStride,
+                uint8_t* aDest, int32_t aDestStride,
+                const IntSize& aSize, WorkerPool* aPool)
+{
+  // Going through the pixels in small square blocks keeps both the rows that
+  // are read and the rows that are written in the cache.
+  const int32_t blockSize = 16;
+  int32_t blocks = (aSize.width + blockSize - 1) / blockSize;
+  int32_t strips = aPool ? std::max<int32_t>(1, std::min<int32_t>(aPool->GetThreadCount(), blocks)) : 1;
+  ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+    int32_t startX = blockSize * int32_t(int64_t(blocks) * aStrip / strips);
+    int32_t endX = std::min(blockSize * int32_t(int64_t(blocks) * (aStrip + 1) / strips),
+                            aSize.width);
+    for (int32_t blockX = startX; blockX < endX; blockX += blockSize) {
+      for (int32_t blockY = 0; blockY < aSize.height; blockY += blockSize) {
+        int32_t blockEndX = std::min(blockX + blockSize, endX);
+        int32_t blockEndY = std::min(blockY + blockSize, aSize.height);
+        for (int32_t x = blockX; x < blockEndX; x++) {
+          uint8_t* dest = aDest + aDestStride * x;
+          for (int32_t y = blockY; y < blockEndY; y++) {
+            memcpy(dest + 4 * y, aSource + aSourceStride * y + 4 * x, 4);
+          }
+        }
+      }
+    }
+  });
+}
+
+int32_t
+FilterProcessing::ExactGaussianBlurRadius(Float aStdDeviation)
+{
+  return int32_t(ceil(3 * aStdDeviation));
+}
+
+/**
+ * Fills aWeights with the 2 * aRadius + 1 weights of a Gaussian with the
+ * given standard deviation, cut off at aRadius and scaled to add up to
+ * exactly 1 << 14.
+ */
+static void
+ComputeGaussianWeights(Float aStdDeviation, int32_t aRadius, int16_t* aWeights)
+{
+  double weights[2 * FilterProcessing::kMaxExactGaussianBlurRadius + 1];
+  double sum = 0;
+  for (int32_t i = -aRadius; i <= aRadius; i++) {
+    weights[i + aRadius] = exp(-double(i * i) / (2.0 * aStdDeviation * aStdDeviation));
+    sum += weights[i + aRadius];
+  }
+  int32_t total = 0;
+  for (int32_t i = 0; i <= 2 * aRadius; i++) {
+    aWeights[i] = int16_t(floor(weights[i] / sum * (1 << 14) + 0.5));
+    total += aWeights[i];
+  }
+  // Rounding can leave the sum slightly off, which would brighten or darken
+  // the whole image. The center weight is the largest, so it absorbs the
+  // difference with the least relative error.
+  aWeights[aRadius] += (1 << 14) - total;
+}
+
+/**
+ * Scales aSource up by aFactor into aDest with bilinear filtering. aDest may
+ * be up to aFactor - 1 pixels smaller than that in each direction, the extra
+ * rows and columns are dropped. The rows of aDest are split between aPool's
+ * threads.
+ */
+static void
+UpscaleBilinear(DataSourceSurface* aSource, DataSourceSurface* aDest,
+                const IntSize& aFactor, WorkerPool* aPool)
+{
+  IntSize sourceSize = aSource->GetSize();
+  IntSize destSize = aDest->GetSize();
+  std::vector<BilinearStep> columns, rows;
+  ComputeBilinearSteps(sourceSize.width, destSize.width, aFactor.width, columns);
+  ComputeBilinearSteps(sourceSize.height, destSize.height, aFactor.height, rows);
+
+  int32_t rowLength = destSize.width * 4;
+  int32_t strips = aPool ? std::max<int32_t>(1, std::min<int32_t>(aPool->GetThreadCount(), destSize.height)) : 1;
+  ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+    // Source rows scaled up horizontally, still multiplied by 256. Consecutive
+    // destination rows mostly interpolate between the same two source rows, so
+    // the last two are kept around.
+    std::vector<uint16_t> expandedRows[2];
+    int32_t expandedIndices[2] = { -1, -1 };
+    auto expandRow = [&] (int32_t aIndex) -> const uint16_t* {
+      for (int32_t i = 0; i < 2; i++) {
+        if (expandedIndices[i] == aIndex) {
+          return &expandedRows[i].front();
+        }
+      }
+      // Replace whichever row the other one isn't going to need next.
+      int32_t slot = expandedIndices[0] < expandedIndices[1] ? 0 : 1;
+      std::vector<uint16_t>& expanded = expandedRows[slot];
+      expanded.resize(rowLength);
+      expandedIndices[slot] = aIndex;
+      const uint8_t* source = aSource->GetData() + aSource->Stride() * aIndex;
+      for (int32_t x = 0; x < destSize.width; x++) {
+        const uint8_t* pixel0 = source + 4 * columns[x].mIndex0;
+        const uint8_t* pixel1 = source + 4 * columns[x].mIndex1;
+        uint32_t weight = columns[x].mWeight;
+        for (int32_t i = 0; i < 4; i++) {
+          expanded[4 * x + i] = uint16_t(pixel0[i] * (256 - weight) + pixel1[i] * weight);
+        }
+      }
+      return &expanded.front();
+    };
+
+    int32_t startY = int32_t(int64_t(destSize.height) * aStrip / strips);
+    int32_t endY = int32_t(int64_t(destSize.height) * (aStrip + 1) / strips);
+    for (int32_t y = startY; y < endY; y++) {
+      const uint16_t* top = expandRow(rows[y].mIndex0);
+      const uint16_t* bottom = expandRow(rows[y].mIndex1);
+      uint32_t weight = rows[y].mWeight;
+      uint8_t* dest = aDest->GetData() + aDest->Stride() * y;
+      for (int32_t i = 0; i < rowLength; i++) {
+        dest[i] = uint8_t((top[i] * (256 - weight) + bottom[i] * weight + (1 << 15)) >> 16);
+      }
+    }
+  });
+}
+
+/**
+ * The GAUSSIAN_BLUR_DOWNSCALED path of ApplyGaussianBlur, for a surface that
+ * is scaled down by aFactor.
+ */
+static bool
+ApplyDownscaledGaussianBlur(DataSourceSurface* aSurface, const Size& aStdDeviation,
+                            const IntSize& aFactor, WorkerPool* aPool)
+{
+  IntSize size = aSurface->GetSize();
+  IntSize reducedSize((size.width + aFactor.width - 1) / aFactor.width,
+                      (size.height + aFactor.height - 1) / aFactor.height);
+
+  // ImageHalfScaler drops the last row or column of odd sized images. Pad the
+  // surface to a multiple of aFactor by repeating its edges, which is what
+  // the blur does beyond them anyway.
+  IntSize paddedSize(reducedSize.width * aFactor.width, reducedSize.height * aFactor.height);
+  RefPtr<DataSourceSurface> padded =
+    Factory::CreateDataSourceSurface(paddedSize, SurfaceFormat::B8G8R8A8);
+  RefPtr<DataSourceSurface> reduced =
+    Factory::CreateDataSourceSurface(reducedSize, SurfaceFormat::B8G8R8A8);
+  if (MOZ2D_WARN_IF(!padded || !reduced)) {
+    return false;
+  }
+  for (int32_t y = 0; y < paddedSize.height; y++) {
+    const uint8_t* source = aSurface->GetData() + aSurface->Stride() * std::min(y, size.height - 1);
+    uint8_t* dest = padded->GetData() + padded->Stride() * y;
+    memcpy(dest, source, size.width * 4);
+    for (int32_t x = size.width; x < paddedSize.width; x++) {
+      memcpy(dest + 4 * x, source + 4 * (size.width - 1), 4);
+    }
+  }
+
+  ImageHalfScaler scaler(padded->GetData(), padded->Stride(), paddedSize);
+  // ScaleForSize stops halving as soon as the next step would get to the size
+  // it's given, so ask for one pixel less.
+  scaler.ScaleForSize(IntSize(reducedSize.width - 1, reducedSize.height - 1));
+  if (MOZ2D_WARN_IF(scaler.GetSize() != reducedSize)) {
+    return false;
+  }
+  CopyPixelRows(scaler.GetScaledData(), scaler.GetStride(),
+                reduced->GetData(), reduced->Stride(), reducedSize);
+
+  Size reducedDeviation(AlphaBoxBlur::DownscaledStdDeviation(aStdDeviation.width, aFactor.width),
+                        AlphaBoxBlur::DownscaledStdDeviation(aStdDeviation.height, aFactor.height));
+  if (!FilterProcessing::ApplyGaussianBlur(reduced, reducedDeviation, GAUSSIAN_BLUR_BOX, aPool)) {
+    return false;
+  }
+
+  UpscaleBilinear(reduced, aSurface, aFactor, aPool);
+  return true;
+}
+
+bool
+FilterProcessing::ApplyGaussianBlur(DataSourceSurface* aSurface, const Size& aStdDeviation,
+                                    GaussianBlurQuality aQuality, WorkerPool* aPool)
+{
+  MOZ_ASSERT(aSurface->GetFormat() == SurfaceFormat::B8G8R8A8);
+
+  IntSize size = aSurface->GetSize();
+  IntSize radius =
+    AlphaBoxBlur::CalculateBlurRadius(Point(aStdDeviation.width, aStdDeviation.height));
+  if (size.width <= 0 || size.height <= 0 || (radius.width == 0 && radius.height == 0)) {
+    return true;
+  }
+
+  if (aQuality == GAUSSIAN_BLUR_DOWNSCALED) {
+    IntSize factor(AlphaBoxBlur::DownscaleFactor(aStdDeviation.width),
+                   AlphaBoxBlur::DownscaleFactor(aStdDeviation.height));
+    if (factor != IntSize(1, 1)) {
+      return ApplyDownscaledGaussianBlur(aSurface, aStdDeviation, factor, aPool);
+    }
+  }
+
+  if (size.width * size.height < kMinParallelBlurPixels) {
+    aPool = nullptr;
+  }
+
+  // The column kernels read and write whole vectors of 16 bytes, which may
+  // run into the padding at the end of each row, but not past it.
+  RefPtr<DataSourceSurface> target = aSurface;
+  if (aSurface->Stride() < GetAlignedStride<16>(size.width * 4)) {
+    target = Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
+    if (MOZ2D_WARN_IF(!target)) {
+      return false;
+    }
+  }
+
+  // The horizontal blur is done by blurring the columns of a transposed copy,
+  // that way both directions get to process whole vectors of pixels at once.
+  RefPtr<DataSourceSurface> transposed;
+  if (radius.width > 0) {
+    transposed = Factory::CreateDataSourceSurface(IntSize(size.height, size.width),
+                                                  SurfaceFormat::B8G8R8A8);
+    if (MOZ2D_WARN_IF(!transposed)) {
+      return false;
+    }
+  }
+
+  // Every strip gets two scratch columns from this.
+  int32_t maxStrips = aPool ? int32_t(aPool->GetThreadCount()) : 1;
+  size_t stripScratchBytes = size_t(2) * kMaxBlurColumnBytes * std::max(size.width, size.height);
+  uint8_t* scratch = new (std::nothrow) uint8_t[stripScratchBytes * maxStrips];
+  if (MOZ2D_WARN_IF(!scratch)) {
+    return false;
+  }
+
+  // Blurs the columns of the aSize sized surface at aData.
+  auto blurColumns = [&] (uint8_t* aData, int32_t aStride, const IntSize& aSize,
+                          Float aSigma, int32_t aRadius) {
+    int32_t exactRadius = ExactGaussianBlurRadius(aSigma);
+    bool exact = aQuality == GAUSSIAN_BLUR_EXACT && exactRadius <= kMaxExactGaussianBlurRadius;
+    int16_t weights[2 * kMaxExactGaussianBlurRadius + 1];
+    int32_t lobes[3][2];
+    if (exact) {
+      ComputeGaussianWeights(aSigma, exactRadius, weights);
+    } else {
+      AlphaBoxBlur::ComputeLobes(aRadius, lobes);
+    }
+
+    // All bytes of a row are blurred independently of each other, so strips
+    // of columns can be handed to different threads. The strips are cut at
+    // multiples of 16 bytes, the smallest vector the kernels use.
+    int32_t rowBytes = GetAlignedStride<16>(aSize.width * 4);
+    int32_t strips = std::max(1, std::min(maxStrips, rowBytes / kMinBlurStripBytes));
+    ParallelFor(aPool, 0, strips, [&] (int32_t aStrip) {
+      int32_t start = 16 * int32_t(int64_t(rowBytes / 16) * aStrip / strips);
+      int32_t end = 16 * int32_t(int64_t(rowBytes / 16) * (aStrip + 1) / strips);
+      uint8_t* stripScratch = scratch + stripScratchBytes * aStrip;
+      if (exact) {
+        GaussianBlurColumns(aData + start, aStride, aSize.height, end - start,
+                            weights, exactRadius, stripScratch);
+      } else {
+        BoxBlurColumns(aData + start, aStride, aSize.height, end - start,
+                       lobes, stripScratch);
+      }
+    });
+  };
+
+  if (target != aSurface) {
+    CopyPixelRows(aSurface->GetData(), aSurface->Stride(),
+                  target->GetData(), target->Stride(), size);
+  }
+
+  if (radius.width > 0) {
+    TransposePixels(target->GetData(), target->Stride(),
+                    transposed->GetData(), transposed->Stride(), size, aPool);
+    blurColumns(transposed->GetData(), transposed->Stride(), transposed->GetSize(),
+                aStdDeviation.width, radius.width);
+    TransposePixels(transposed->GetData(), transposed->Stride(),
+                    target->GetData(), target->Stride(), transposed->GetSize(), aPool);
+  }
+
+  if (radius.height > 0) {
+    blurColumns(target->GetData(), target->Stride(), size,
+                aStdDeviation.height, radius.height);
+  }
+
+  if (target != aSurface) {
+    CopyPixelRows(target->GetData(), target->Stride(),
+                  aSurface->GetData(), aSurface->Stride(), size);
+  }
+
+  delete [] scratch;
+  return true;
+}
+
 } // namespace gfx
 } // namespace mozilla
@@ -7,16 +7,36 @@
 #define _MOZILLA_GFX_FILTERPROCESSING_H_
 
 #include "2D.h"
+#include "Blur.h"
 #include "Filters.h"
 
 namespace mozilla {
 namespace gfx {
 
+class WorkerPool;
+
 const ptrdiff_t B8G8R8A8_COMPONENT_BYTEOFFSET_B = 0;
 const ptrdiff_t B8G8R8A8_COMPONENT_BYTEOFFSET_G = 1;
 const ptrdiff_t B8G8R8A8_COMPONENT_BYTEOFFSET_R = 2;
 const ptrdiff_t B8G8R8A8_COMPONENT_BYTEOFFSET_A = 3;
 
+// How FilterProcessing::ApplyGaussianBlur approximates a Gaussian blur.
+enum GaussianBlurQuality {
+  // The same triple box blur AlphaBoxBlur uses. Each pixel costs the same
+  // time for any radius.
+  GAUSSIAN_BLUR_BOX,
+  // A true Gaussian kernel, cut off at ExactGaussianBlurRadius, in every
+  // direction where that is at most kMaxExactGaussianBlurRadius, and
+  // GAUSSIAN_BLUR_BOX in the others. Costs time proportional to the radius.
+  GAUSSIAN_BLUR_EXACT,
+  // GAUSSIAN_BLUR_BOX, except that directions with a standard deviation of at
+  // least kMinDownscaledBlurStdDeviation are scaled down with ImageHalfScaler,
+  // blurred at the reduced resolution and scaled back up bilinearly. Away
+  // from the edges the result is within kMaxDownscaledBlurError of
+  // GAUSSIAN_BLUR_BOX, at a cost that shrinks as the deviation grows.
+  GAUSSIAN_BLUR_DOWNSCALED
+};
+
 class FilterProcessing
 {
 public:
@@ -43,6 +63,10 @@ public:
                                           const IntRect& aDestRect, int32_t aRadius,
                                           MorphologyOperator aOperator);
   static TemporaryRef<DataSourceSurface> ApplyColorMatrix(DataSourceSurface* aInput, const Matrix5x4 &aMatrix);
+  static void DoColorMatrixCalculation(const IntSize& aSize,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       uint8_t* aSourceData, int32_t aSourceStride,
+                                       const Matrix5x4 &aMatrix);
   static void ApplyComposition(DataSourceSurface* aSource, DataSourceSurface* aDest, CompositeOperator aOperator);
   static void SeparateColorChannels(DataSourceSurface* aSource,
                                     RefPtr<DataSourceSurface>& aChannel0,
@@ -63,8 +87,81 @@ public:
                      int32_t aSeed, int aNumOctaves, TurbulenceType aType, bool aStitch, const Rect &aTileRect);
   static TemporaryRef<DataSourceSurface>
     ApplyArithmeticCombine(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4);
+  static void DoArithmeticCombineCalculation(const IntSize& aSize,
+                                             uint8_t* aTargetData, int32_t aTargetStride,
+                                             uint8_t* aSource1Data, int32_t aSource1Stride,
+                                             uint8_t* aSource2Data, int32_t aSource2Stride,
+                                             Float aK1, Float aK2, Float aK3, Float aK4);
+
+  // The largest kernel radius, in pixels, that GAUSSIAN_BLUR_EXACT convolves
+  // with exact Gaussian weights.
+  static const int32_t kMaxExactGaussianBlurRadius = 8;
+
+  // The radius GAUSSIAN_BLUR_EXACT cuts the Gaussian kernel off at: three
+  // standard deviations, rounded up, beyond which less than 0.3% of its
+  // weight lies. AlphaBoxBlur::CalculateBlurRadius is only about two thirds
+  // of that.
+  static int32_t ExactGaussianBlurRadius(Float aStdDeviation);
+
+  // The smallest standard deviation GAUSSIAN_BLUR_DOWNSCALED blurs at reduced
+  // resolution, the same as for AlphaBoxBlur::BlurDownscaled.
+  static const int32_t kMinDownscaledBlurStdDeviation =
+    AlphaBoxBlur::kMinDownscaledStdDeviation;
+
+  // The largest difference in any channel between the GAUSSIAN_BLUR_DOWNSCALED
+  // and GAUSSIAN_BLUR_BOX results for the same surface, for pixels at least
+  // the blur radius away from its edges. Closer to the edges the two repeat
+  // the edge pixels differently, so they can differ more.
+  static const int32_t kMaxDownscaledBlurError = AlphaBoxBlur::kMaxDownscaledError;
+
+  // The smallest radii ApplyMorphologyHorizontal and ApplyMorphologyVertical
+  // use a running minimum or maximum for, which costs the same per pixel
+  // whatever the radius. Below them, looking at every pixel in the window is
+  // still quicker. Rows have to be transposed first, so they break even later
+  // than columns.
+  static const int32_t kMinRunningMorphologyRadiusX = 6;
+  static const int32_t kMinRunningMorphologyRadiusY = 2;
+
+  /**
+   * Blurs the premultiplied B8G8R8A8 surface aSurface in place, with all four
+   * channels of each pixel processed together. Rows or columns outside the
+   * surface repeat the nearest edge. See GaussianBlurQuality for how aQuality
+   * trades speed for accuracy.
+   *
+   * If aPool is non-null, large surfaces are split into strips which are
+   * blurred on the pool's threads. Returns false if memory for the blur
+   * couldn't be allocated, in which case aSurface is left unchanged.
+   */
+  static bool ApplyGaussianBlur(DataSourceSurface* aSurface, const Size& aStdDeviation,
+                                GaussianBlurQuality aQuality, WorkerPool* aPool);
+
+  /**
+   * Convolves the aSize pixels at aTargetData with the aKernelSize kernel
+   * aKernel, whose weights are in row order and already divided by the
+   * divisor, and adds aBias to every channel. aSourceData points at the
+   * sample that the first weight applies to for the first target pixel, the
+   * samples for the other weights are aKernelUnitLength pixels apart.
+   *
+   * The weights are rounded to 16-bit fixed point, and kernels that are the
+   * product of a column and a row are applied as two one-dimensional passes.
+   * Rows of aTargetData must be 16-byte aligned and have room for a multiple
+   * of four pixels. Returns false, without touching aTargetData, if the
+   * weights can't be represented that way, or only so coarsely that results
+   * could be off by more than one level, which happens when small weights
+   * are mixed with much larger ones.
+   */
+  static bool ApplyConvolveMatrix(const uint8_t* aSourceData, int32_t aSourceStride,
+                                  uint8_t* aTargetData, int32_t aTargetStride,
+                                  const IntSize& aSize, const Float* aKernel,
+                                  const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                  Float aBias);
 
 protected:
+  static void BoxBlurColumns(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                             const int32_t aLobes[3][2], uint8_t* aScratch);
+  static void GaussianBlurColumns(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                  const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch);
+
   static void ExtractAlpha_Scalar(const IntSize& size, uint8_t* sourceData, int32_t sourceStride, uint8_t* alphaData, int32_t alphaStride);
   static TemporaryRef<DataSourceSurface> ConvertToB8G8R8A8_Scalar(SourceSurface* aSurface);
   static void ApplyMorphologyHorizontal_Scalar(uint8_t* aSourceData, int32_t aSourceStride,
@@ -76,6 +173,10 @@ protected:
                                                const IntRect& aDestRect, int32_t aRadius,
                                                MorphologyOperator aOperator);
   static TemporaryRef<DataSourceSurface> ApplyColorMatrix_Scalar(DataSourceSurface* aInput, const Matrix5x4 &aMatrix);
+  static void DoColorMatrixCalculation_Scalar(const IntSize& aSize,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       uint8_t* aSourceData, int32_t aSourceStride,
+                                       const Matrix5x4 &aMatrix);
   static void ApplyComposition_Scalar(DataSourceSurface* aSource, DataSourceSurface* aDest, CompositeOperator aOperator);
 
   static void SeparateColorChannels_Scalar(const IntSize &size, uint8_t* sourceData, int32_t sourceStride, uint8_t* channel0Data, uint8_t* channel1Data, uint8_t* channel2Data, uint8_t* channel3Data, int32_t channelStride);
@@ -91,6 +192,20 @@ protected:
                             int32_t aSeed, int aNumOctaves, TurbulenceType aType, bool aStitch, const Rect &aTileRect);
   static TemporaryRef<DataSourceSurface>
     ApplyArithmeticCombine_Scalar(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4);
+  static void DoArithmeticCombineCalculation_Scalar(const IntSize& aSize,
+                                             uint8_t* aTargetData, int32_t aTargetStride,
+                                             uint8_t* aSource1Data, int32_t aSource1Stride,
+                                             uint8_t* aSource2Data, int32_t aSource2Stride,
+                                             Float aK1, Float aK2, Float aK3, Float aK4);
+  static void BoxBlurColumns_Scalar(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                    const int32_t aLobes[3][2], uint8_t* aScratch);
+  static void GaussianBlurColumns_Scalar(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                         const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch);
+  static bool ApplyConvolveMatrix_Scalar(const uint8_t* aSourceData, int32_t aSourceStride,
+                                         uint8_t* aTargetData, int32_t aTargetStride,
+                                         const IntSize& aSize, const Float* aKernel,
+                                         const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                         Float aBias);
 
 #ifdef USE_SSE2
   static void ExtractAlpha_SSE2(const IntSize& size, uint8_t* sourceData, int32_t sourceStride, uint8_t* alphaData, int32_t alphaStride);
@@ -105,6 +220,10 @@ protected:
                                              const IntRect& aDestRect, int32_t aRadius,
                                              MorphologyOperator aOperator);
   static TemporaryRef<DataSourceSurface> ApplyColorMatrix_SSE2(DataSourceSurface* aInput, const Matrix5x4 &aMatrix);
+  static void DoColorMatrixCalculation_SSE2(const IntSize& aSize,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       uint8_t* aSourceData, int32_t aSourceStride,
+                                       const Matrix5x4 &aMatrix);
   static void ApplyComposition_SSE2(DataSourceSurface* aSource, DataSourceSurface* aDest, CompositeOperator aOperator);
   static void SeparateColorChannels_SSE2(const IntSize &size, uint8_t* sourceData, int32_t sourceStride, uint8_t* channel0Data, uint8_t* channel1Data, uint8_t* channel2Data, uint8_t* channel3Data, int32_t channelStride);
   static void CombineColorChannels_SSE2(const IntSize &size, int32_t resultStride, uint8_t* resultData, int32_t channelStride, uint8_t* channel0Data, uint8_t* channel1Data, uint8_t* channel2Data, uint8_t* channel3Data);
@@ -119,6 +238,47 @@ protected:
                           int32_t aSeed, int aNumOctaves, TurbulenceType aType, bool aStitch, const Rect &aTileRect);
   static TemporaryRef<DataSourceSurface>
     ApplyArithmeticCombine_SSE2(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4);
+  static void DoArithmeticCombineCalculation_SSE2(const IntSize& aSize,
+                                             uint8_t* aTargetData, int32_t aTargetStride,
+                                             uint8_t* aSource1Data, int32_t aSource1Stride,
+                                             uint8_t* aSource2Data, int32_t aSource2Stride,
+                                             Float aK1, Float aK2, Float aK3, Float aK4);
+  static void BoxBlurColumns_SSE2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                  const int32_t aLobes[3][2], uint8_t* aScratch);
+  static void GaussianBlurColumns_SSE2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                       const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch);
+  static bool ApplyConvolveMatrix_SSE2(const uint8_t* aSourceData, int32_t aSourceStride,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       const IntSize& aSize, const Float* aKernel,
+                                       const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                       Float aBias);
+#endif
+
+#ifdef USE_AVX2
+  static TemporaryRef<DataSourceSurface> ApplyBlending_AVX2(DataSourceSurface* aInput1, DataSourceSurface* aInput2, BlendMode aBlendMode);
+  static TemporaryRef<DataSourceSurface> ApplyColorMatrix_AVX2(DataSourceSurface* aInput, const Matrix5x4 &aMatrix);
+  static void DoColorMatrixCalculation_AVX2(const IntSize& aSize,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       uint8_t* aSourceData, int32_t aSourceStride,
+                                       const Matrix5x4 &aMatrix);
+  static void ApplyComposition_AVX2(DataSourceSurface* aSource, DataSourceSurface* aDest, CompositeOperator aOperator);
+  static void DoPremultiplicationCalculation_AVX2(const IntSize& aSize,
+                                        uint8_t* aTargetData, int32_t aTargetStride,
+                                        uint8_t* aSourceData, int32_t aSourceStride);
+  static void DoUnpremultiplicationCalculation_AVX2(const IntSize& aSize,
+                                               uint8_t* aTargetData, int32_t aTargetStride,
+                                               uint8_t* aSourceData, int32_t aSourceStride);
+  static TemporaryRef<DataSourceSurface>
+    ApplyArithmeticCombine_AVX2(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4);
+  static void DoArithmeticCombineCalculation_AVX2(const IntSize& aSize,
+                                             uint8_t* aTargetData, int32_t aTargetStride,
+                                             uint8_t* aSource1Data, int32_t aSource1Stride,
+                                             uint8_t* aSource2Data, int32_t aSource2Stride,
+                                             Float aK1, Float aK2, Float aK3, Float aK4);
+  static void BoxBlurColumns_AVX2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                  const int32_t aLobes[3][2], uint8_t* aScratch);
+  static void GaussianBlurColumns_AVX2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                       const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch);
 #endif
 };
 
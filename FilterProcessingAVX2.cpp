@@ -0,0 +1,129 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+// Callers must check Factory::HasAVX2() before calling anything in here.
+//
+// This file is built with the same flags as the rest of Moz2D. Only the code
+// below the target pragma gets AVX2 code generation. Every header whose inline
+// functions and templates are shared with other files is included above it,
+// so the copies emitted here are the same plain ones the linker may pick from
+// any other object file. MSVC doesn't need /arch:AVX2 to compile the AVX2
+// intrinsics, so this file is built without it.
+
+#include "2D.h"
+#include "Filters.h"
+#include "FilterProcessing.h"
+#include "Logging.h"
+#include "Tools.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#define SIMD_COMPILE_AVX2
+
+#include "FilterProcessingSIMD-inl.h"
+
+#ifndef USE_AVX2
+static_assert(false, "If this file is built, FilterProcessing.h should know about it!");
+#endif
+
+namespace mozilla {
+namespace gfx {
+
+TemporaryRef<DataSourceSurface>
+FilterProcessing::ApplyBlending_AVX2(DataSourceSurface* aInput1, DataSourceSurface* aInput2,
+                                     BlendMode aBlendMode)
+{
+  return ApplyBlending_SIMD<__m256i,__m256i,__m256i>(aInput1, aInput2, aBlendMode);
+}
+
+TemporaryRef<DataSourceSurface>
+FilterProcessing::ApplyColorMatrix_AVX2(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
+{
+  return ApplyColorMatrix_SIMD<__m256i,__m256i,__m256i>(aInput, aMatrix);
+}
+
+void
+FilterProcessing::DoColorMatrixCalculation_AVX2(const IntSize& aSize,
+                                   uint8_t* aTargetData, int32_t aTargetStride,
+                                   uint8_t* aSourceData, int32_t aSourceStride,
+                                   const Matrix5x4 &aMatrix)
+{
+  DoColorMatrixCalculation_SIMD<__m256i,__m256i,__m256i>(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+}
+
+void
+FilterProcessing::ApplyComposition_AVX2(DataSourceSurface* aSource, DataSourceSurface* aDest,
+                                        CompositeOperator aOperator)
+{
+  return ApplyComposition_SIMD<__m256i,__m256i,__m256i>(aSource, aDest, aOperator);
+}
+
+void
+FilterProcessing::DoPremultiplicationCalculation_AVX2(const IntSize& aSize,
+                                     uint8_t* aTargetData, int32_t aTargetStride,
+                                     uint8_t* aSourceData, int32_t aSourceStride)
+{
+  DoPremultiplicationCalculation_SIMD<__m256i,__m256i,__m256i>(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+}
+
+void
+FilterProcessing::DoUnpremultiplicationCalculation_AVX2(
+                                 const IntSize& aSize,
+                                 uint8_t* aTargetData, int32_t aTargetStride,
+                                 uint8_t* aSourceData, int32_t aSourceStride)
+{
+  DoUnpremultiplicationCalculation_SIMD<__m256i,__m256i>(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride);
+}
+
+TemporaryRef<DataSourceSurface>
+FilterProcessing::ApplyArithmeticCombine_AVX2(DataSourceSurface* aInput1, DataSourceSurface* aInput2, Float aK1, Float aK2, Float aK3, Float aK4)
+{
+  return ApplyArithmeticCombine_SIMD<__m256i,__m256i,__m256i>(aInput1, aInput2, aK1, aK2, aK3, aK4);
+}
+
+void
+FilterProcessing::DoArithmeticCombineCalculation_AVX2(const IntSize& aSize,
+                                         uint8_t* aTargetData, int32_t aTargetStride,
+                                         uint8_t* aSource1Data, int32_t aSource1Stride,
+                                         uint8_t* aSource2Data, int32_t aSource2Stride,
+                                         Float aK1, Float aK2, Float aK3, Float aK4)
+{
+  DoArithmeticCombineCalculation_SIMD<__m256i,__m256i,__m256i>(
+    aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride,
+    aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+}
+
+void
+FilterProcessing::BoxBlurColumns_AVX2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                      const int32_t aLobes[3][2], uint8_t* aScratch)
+{
+  BoxBlurColumns_SIMD<__m256i,__m256i,__m256i,__m256>(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+}
+
+void
+FilterProcessing::GaussianBlurColumns_AVX2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                           const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch)
+{
+  GaussianBlurColumns_SIMD<__m256i,__m256i,__m256i>(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+}
+
+} // namespace mozilla
+} // namespace gfx
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
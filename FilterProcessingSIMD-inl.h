@@ -5,12 +5,42 @@
 
 #include "FilterProcessing.h"
 
+#include "Logging.h"
 #include "SIMD.h"
 #include "SVGTurbulenceRenderer-inl.h"
+#include "Tools.h"
+
+#include <string.h>
 
 namespace mozilla {
 namespace gfx {
 
+// The pixel loops below handle sizeof(u8x16_t) / 4 pixels per iteration.
+// Rows are only padded to a multiple of four pixels, so with vectors wider
+// than 16 bytes the last iteration of a row may have to stop after the first
+// four pixels. aPixelsLeft is the number of pixels from aData to the end of
+// the row.
+template<typename u8x16_t>
+static MOZ_ALWAYS_INLINE u8x16_t
+LoadPixels(const uint8_t* aData, int32_t aPixelsLeft)
+{
+  if (sizeof(u8x16_t) > 16 && aPixelsLeft <= 4) {
+    return simd::Load8Lo<u8x16_t>(aData);
+  }
+  return simd::Load8<u8x16_t>(aData);
+}
+
+template<typename u8x16_t>
+static MOZ_ALWAYS_INLINE void
+StorePixels(uint8_t* aData, u8x16_t aPixels, int32_t aPixelsLeft)
+{
+  if (sizeof(u8x16_t) > 16 && aPixelsLeft <= 4) {
+    simd::Store8Lo(aData, aPixels);
+  } else {
+    simd::Store8(aData, aPixels);
+  }
+}
+
 template<typename u8x16_t>
 inline TemporaryRef<DataSourceSurface>
 ConvertToB8G8R8A8_SIMD(SourceSurface* aSurface)
@@ -301,14 +331,15 @@ ApplyBlending_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInput2)
   int32_t source1Stride = aInput1->Stride();
   int32_t source2Stride = aInput2->Stride();
 
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < size.height; y++) {
-    for (int32_t x = 0; x < size.width; x += 4) {
+    for (int32_t x = 0; x < size.width; x += pixelsPerVector) {
       int32_t targetIndex = y * targetStride + 4 * x;
       int32_t source1Index = y * source1Stride + 4 * x;
       int32_t source2Index = y * source2Stride + 4 * x;
 
-      u8x16_t s1234 = simd::Load8<u8x16_t>(&source2Data[source2Index]);
-      u8x16_t d1234 = simd::Load8<u8x16_t>(&source1Data[source1Index]);
+      u8x16_t s1234 = LoadPixels<u8x16_t>(&source2Data[source2Index], size.width - x);
+      u8x16_t d1234 = LoadPixels<u8x16_t>(&source1Data[source1Index], size.width - x);
 
       // The blending calculation for the RGB channels all need access to the
       // alpha channel of their pixel, and the alpha calculation is different,
@@ -330,7 +361,7 @@ ApplyBlending_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInput2)
       blendedA = BlendAlphaOfFourPixels<i16x8_t,i32x4_t>(s_rrrraaaa1234, d_rrrraaaa1234);
 
       u8x16_t result1234 = ShuffleAndPackComponents<i32x4_t,i16x8_t,u8x16_t>(blendedB, blendedG, blendedR, blendedA);
-      simd::Store8(&targetData[targetIndex], result1234);
+      StorePixels(&targetData[targetIndex], result1234, size.width - x);
     }
   }
 
@@ -364,6 +395,117 @@ Morph8(u8x16_t a, u8x16_t b)
     simd::Min8(a, b) : simd::Max8(a, b);
 }
 
+// Sets each of the aCount vectors at aDest to the per-byte minimum or maximum
+// of the 2 * aRadius + 1 vectors at aSource starting at the same index, at a
+// cost per vector that doesn't depend on aRadius (van Herk / Gil-Werman). The
+// source is split into blocks as long as the window, so every window is the
+// end of one block followed by the start of the next. The ends of the blocks
+// are computed back to front into aSuffix, which needs room for
+// aCount + 2 * aRadius vectors; the starts are accumulated on the way forward.
+template<MorphologyOperator op, typename u8x16_t>
+static void
+MorphologyRunning_SIMD(const uint8_t* aSource, int32_t aSourceStride,
+                       uint8_t* aDest, int32_t aDestStride,
+                       int32_t aCount, int32_t aRadius, uint8_t* aSuffix)
+{
+  int32_t window = 2 * aRadius + 1;
+  int32_t count = aCount + 2 * aRadius;
+
+  for (int32_t blockStart = 0; blockStart < count; blockStart += window) {
+    int32_t i = std::min(blockStart + window, count) - 1;
+    u8x16_t suffix = simd::Load8<u8x16_t>(aSource + i * aSourceStride);
+    simd::Store8(aSuffix + 16 * i, suffix);
+    for (i--; i >= blockStart; i--) {
+      suffix = Morph8<op,u8x16_t>(suffix, simd::Load8<u8x16_t>(aSource + i * aSourceStride));
+      simd::Store8(aSuffix + 16 * i, suffix);
+    }
+  }
+
+  // The window of aDest[j] ends at aSource[j + window - 1], where the
+  // running prefix of that block has got to.
+  u8x16_t prefix = simd::FromZero8<u8x16_t>();
+  int32_t blockLeft = 0;
+  for (int32_t i = 0; i < count; i++) {
+    u8x16_t source = simd::Load8<u8x16_t>(aSource + i * aSourceStride);
+    if (blockLeft == 0) {
+      prefix = source;
+      blockLeft = window;
+    } else {
+      prefix = Morph8<op,u8x16_t>(prefix, source);
+    }
+    blockLeft--;
+    int32_t j = i - window + 1;
+    if (j >= 0) {
+      u8x16_t suffix = simd::Load8<u8x16_t>(aSuffix + 16 * j);
+      simd::Store8(aDest + j * aDestStride, Morph8<op,u8x16_t>(suffix, prefix));
+    }
+  }
+}
+
+// ApplyMorphologyHorizontal_SIMD for large radii. Four rows at a time are
+// transposed into a column of vectors that each hold one pixel of every row,
+// which MorphologyRunning_SIMD can run down. Returns false if the scratch
+// buffers can't be allocated.
+template<MorphologyOperator op, typename u8x16_t>
+static bool
+ApplyMorphologyHorizontalRunning_SIMD(uint8_t* aSourceData, int32_t aSourceStride,
+                                      uint8_t* aDestData, int32_t aDestStride,
+                                      const IntRect& aDestRect, int32_t aRadius)
+{
+  int32_t width = aDestRect.width;
+  int32_t count = width + 2 * aRadius;
+  AlignedArray<uint8_t> columns(16 * count);
+  AlignedArray<uint8_t> suffix(16 * count);
+  AlignedArray<uint8_t> result(16 * width);
+  if (MOZ2D_WARN_IF(!columns.mPtr || !suffix.mPtr || !result.mPtr)) {
+    return false;
+  }
+
+  for (int32_t y = aDestRect.y; y < aDestRect.YMost(); y += 4) {
+    // A last strip of fewer than four rows repeats its last row.
+    int32_t rows = std::min(4, aDestRect.YMost() - y);
+    for (int32_t row = 0; row < 4; row++) {
+      const uint8_t* source = aSourceData +
+        (y + std::min(row, rows - 1)) * aSourceStride + 4 * (aDestRect.x - aRadius);
+      for (int32_t i = 0; i < count; i++) {
+        memcpy(&columns[16 * i + 4 * row], &source[4 * i], 4);
+      }
+    }
+
+    MorphologyRunning_SIMD<op,u8x16_t>(columns, 16, result, 16, width, aRadius, suffix);
+
+    for (int32_t row = 0; row < rows; row++) {
+      uint8_t* dest = aDestData + (y + row) * aDestStride + 4 * aDestRect.x;
+      for (int32_t x = 0; x < width; x++) {
+        memcpy(&dest[4 * x], &result[16 * x + 4 * row], 4);
+      }
+    }
+  }
+  return true;
+}
+
+// ApplyMorphologyVertical_SIMD for large radii, running down the columns four
+// pixels wide. Returns false if the scratch buffer can't be allocated.
+template<MorphologyOperator op, typename u8x16_t>
+static bool
+ApplyMorphologyVerticalRunning_SIMD(uint8_t* aSourceData, int32_t aSourceStride,
+                                    uint8_t* aDestData, int32_t aDestStride,
+                                    const IntRect& aDestRect, int32_t aRadius)
+{
+  AlignedArray<uint8_t> suffix(16 * (aDestRect.height + 2 * aRadius));
+  if (MOZ2D_WARN_IF(!suffix.mPtr)) {
+    return false;
+  }
+
+  for (int32_t x = aDestRect.x; x < aDestRect.XMost(); x += 4) {
+    MorphologyRunning_SIMD<op,u8x16_t>(
+      aSourceData + (aDestRect.y - aRadius) * aSourceStride + 4 * x, aSourceStride,
+      aDestData + aDestRect.y * aDestStride + 4 * x, aDestStride,
+      aDestRect.height, aRadius, suffix);
+  }
+  return true;
+}
+
 // Set every pixel to the per-component minimum or maximum of the pixels around
 // it that are up to aRadius pixels away from it (horizontally).
 template<MorphologyOperator op, typename i16x8_t, typename u8x16_t>
@@ -428,6 +570,17 @@ inline void ApplyMorphologyHorizontal_SIMD(uint8_t* aSourceData, int32_t aSource
                                            const IntRect& aDestRect, int32_t aRadius,
                                            MorphologyOperator aOp)
 {
+  if (aRadius >= FilterProcessing::kMinRunningMorphologyRadiusX) {
+    bool done = aOp == MORPHOLOGY_OPERATOR_ERODE ?
+      ApplyMorphologyHorizontalRunning_SIMD<MORPHOLOGY_OPERATOR_ERODE,u8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius) :
+      ApplyMorphologyHorizontalRunning_SIMD<MORPHOLOGY_OPERATOR_DILATE,u8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
+    if (done) {
+      return;
+    }
+  }
+
   if (aOp == MORPHOLOGY_OPERATOR_ERODE) {
     ApplyMorphologyHorizontal_SIMD<MORPHOLOGY_OPERATOR_ERODE,i16x8_t,u8x16_t>(
       aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
@@ -472,6 +625,17 @@ inline void ApplyMorphologyVertical_SIMD(uint8_t* aSourceData, int32_t aSourceSt
                                            const IntRect& aDestRect, int32_t aRadius,
                                            MorphologyOperator aOp)
 {
+  if (aRadius >= FilterProcessing::kMinRunningMorphologyRadiusY) {
+    bool done = aOp == MORPHOLOGY_OPERATOR_ERODE ?
+      ApplyMorphologyVerticalRunning_SIMD<MORPHOLOGY_OPERATOR_ERODE,u8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius) :
+      ApplyMorphologyVerticalRunning_SIMD<MORPHOLOGY_OPERATOR_DILATE,u8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
+    if (done) {
+      return;
+    }
+  }
+
   if (aOp == MORPHOLOGY_OPERATOR_ERODE) {
     ApplyMorphologyVertical_SIMD<MORPHOLOGY_OPERATOR_ERODE,i16x8_t,u8x16_t>(
       aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
@@ -509,21 +673,12 @@ ColorMatrixMultiply(i16x8_t p, i16x8_t rows_bg, i16x8_t rows_ra, const i32x4_t&
 }
 
 template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
-static TemporaryRef<DataSourceSurface>
-ApplyColorMatrix_SIMD(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
+static void
+DoColorMatrixCalculation_SIMD(const IntSize& size,
+                              uint8_t* targetData, int32_t targetStride,
+                              uint8_t* sourceData, int32_t sourceStride,
+                              const Matrix5x4 &aMatrix)
 {
-  IntSize size = aInput->GetSize();
-  RefPtr<DataSourceSurface> target =
-    Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
-  if (!target) {
-    return nullptr;
-  }
-
-  uint8_t* sourceData = aInput->GetData();
-  uint8_t* targetData = target->GetData();
-  int32_t sourceStride = aInput->Stride();
-  int32_t targetStride = target->Stride();
-
   const int16_t factor = 128;
   const Float floatElementMax = INT16_MAX / factor; // 255
   MOZ_ASSERT((floatElementMax * factor) <= INT16_MAX, "badly chosen float-to-int scale");
@@ -576,8 +731,9 @@ ApplyColorMatrix_SIMD(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
   i32x4_t rowsBias_v =
     simd::From32<i32x4_t>(rowBias[0], rowBias[1], rowBias[2], rowBias[3]);
 
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < size.height; y++) {
-    for (int32_t x = 0; x < size.width; x += 4) {
+    for (int32_t x = 0; x < size.width; x += pixelsPerVector) {
       MOZ_ASSERT(sourceStride >= 4 * (x + 4), "need to be able to read 4 pixels at this position");
       MOZ_ASSERT(targetStride >= 4 * (x + 4), "need to be able to write 4 pixels at this position");
       int32_t sourceIndex = y * sourceStride + 4 * x;
@@ -586,7 +742,7 @@ ApplyColorMatrix_SIMD(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
       // We load 4 pixels, unpack them, process them 1 pixel at a time, and
       // finally pack and store the 4 result pixels.
 
-      u8x16_t p1234 = simd::Load8<u8x16_t>(&sourceData[sourceIndex]);
+      u8x16_t p1234 = LoadPixels<u8x16_t>(&sourceData[sourceIndex], size.width - x);
 
       // Splat needed to get each pixel twice into i16x8
       i16x8_t p11 = simd::UnpackLo8x8ToI16x8(simd::Splat32On8<0>(p1234));
@@ -604,9 +760,25 @@ ApplyColorMatrix_SIMD(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
                                                         simd::ShiftRight32<7>(result_p2),
                                                         simd::ShiftRight32<7>(result_p3),
                                                         simd::ShiftRight32<7>(result_p4));
-      simd::Store8(&targetData[targetIndex], result_p1234);
+      StorePixels(&targetData[targetIndex], result_p1234, size.width - x);
     }
   }
+}
+
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static TemporaryRef<DataSourceSurface>
+ApplyColorMatrix_SIMD(DataSourceSurface* aInput, const Matrix5x4 &aMatrix)
+{
+  IntSize size = aInput->GetSize();
+  RefPtr<DataSourceSurface> target =
+    Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
+  if (!target) {
+    return nullptr;
+  }
+
+  DoColorMatrixCalculation_SIMD<i32x4_t,i16x8_t,u8x16_t>(
+    size, target->GetData(), target->Stride(),
+    aInput->GetData(), aInput->Stride(), aMatrix);
 
   return target;
 }
@@ -706,13 +878,14 @@ ApplyComposition(DataSourceSurface* aSource, DataSourceSurface* aDest)
   uint32_t sourceStride = aSource->Stride();
   uint32_t destStride = aDest->Stride();
 
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < size.height; y++) {
-    for (int32_t x = 0; x < size.width; x += 4) {
+    for (int32_t x = 0; x < size.width; x += pixelsPerVector) {
       uint32_t sourceIndex = y * sourceStride + 4 * x;
       uint32_t destIndex = y * destStride + 4 * x;
 
-      u8x16_t s1234 = simd::Load8<u8x16_t>(&sourceData[sourceIndex]);
-      u8x16_t d1234 = simd::Load8<u8x16_t>(&destData[destIndex]);
+      u8x16_t s1234 = LoadPixels<u8x16_t>(&sourceData[sourceIndex], size.width - x);
+      u8x16_t d1234 = LoadPixels<u8x16_t>(&destData[destIndex], size.width - x);
 
       u16x8_t s12 = simd::UnpackLo8x8ToU16x8(s1234);
       u16x8_t d12 = simd::UnpackLo8x8ToU16x8(d1234);
@@ -727,7 +900,7 @@ ApplyComposition(DataSourceSurface* aSource, DataSourceSurface* aDest)
       u16x8_t result34 = CompositeTwoPixels<i32x4_t,u16x8_t,op>(s34, sa34, d34, da34);
 
       u8x16_t result1234 = simd::PackAndSaturate16To8(result12, result34);
-      simd::Store8(&destData[destIndex], result1234);
+      StorePixels(&destData[destIndex], result1234, size.width - x);
     }
   }
 }
@@ -859,12 +1032,13 @@ DoPremultiplicationCalculation_SIMD(const IntSize& aSize,
                                     uint8_t* aSourceData, int32_t aSourceStride)
 {
   const u8x16_t alphaMask = simd::From8<u8x16_t>(0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff, 0, 0, 0, 0xff);
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < aSize.height; y++) {
-    for (int32_t x = 0; x < aSize.width; x += 4) {
+    for (int32_t x = 0; x < aSize.width; x += pixelsPerVector) {
       int32_t inputIndex = y * aSourceStride + 4 * x;
       int32_t targetIndex = y * aTargetStride + 4 * x;
 
-      u8x16_t p1234 = simd::Load8<u8x16_t>(&aSourceData[inputIndex]);
+      u8x16_t p1234 = LoadPixels<u8x16_t>(&aSourceData[inputIndex], aSize.width - x);
       u16x8_t p12 = simd::UnpackLo8x8ToU16x8(p1234);
       u16x8_t p34 = simd::UnpackHi8x8ToU16x8(p1234);
 
@@ -879,7 +1053,7 @@ DoPremultiplicationCalculation_SIMD(const IntSize& aSize,
       // Get the original alpha channel value back from p1234.
       result = simd::Pick(alphaMask, result, p1234);
 
-      simd::Store8(&aTargetData[targetIndex], result);
+      StorePixels(&aTargetData[targetIndex], result, aSize.width - x);
     }
   }
 }
@@ -894,7 +1068,10 @@ DoPremultiplicationCalculation_SIMD(const IntSize& aSize,
 //
 // This table has been created using the python code
 // ", ".join("%d" % (round(255.0 * 256 / alpha) if alpha > 0 else 0) for alpha in range(256))
-static const uint16_t sAlphaFactors[256] = {
+//
+// The extra zero at the end allows reading the factor for alpha 255 as a 32
+// bit value.
+static const uint16_t sAlphaFactors[257] = {
   0, 65280, 32640, 21760, 16320, 13056, 10880, 9326, 8160, 7253, 6528, 5935,
   5440, 5022, 4663, 4352, 4080, 3840, 3627, 3436, 3264, 3109, 2967, 2838, 2720,
   2611, 2511, 2418, 2331, 2251, 2176, 2106, 2040, 1978, 1920, 1865, 1813, 1764,
@@ -912,32 +1089,68 @@ static const uint16_t sAlphaFactors[256] = {
   328, 326, 325, 323, 322, 320, 318, 317, 315, 314, 312, 311, 309, 308, 306,
   305, 304, 302, 301, 299, 298, 297, 295, 294, 293, 291, 290, 289, 288, 286,
   285, 284, 283, 281, 280, 279, 278, 277, 275, 274, 273, 272, 271, 270, 269,
-  268, 266, 265, 264, 263, 262, 261, 260, 259, 258, 257, 256
+  268, 266, 265, 264, 263, 262, 261, 260, 259, 258, 257, 256, 0
 };
 
+// Looks up the alpha factors for the four pixels in p1234, laid out to match
+// UnpackLo8x8ToU16x8(p1234) and UnpackHi8x8ToU16x8(p1234). The alpha channel
+// itself gets the factor 1 << 8 so that it stays unchanged.
+template<typename u16x8_t, typename u8x16_t>
+static MOZ_ALWAYS_INLINE void
+UnpremultiplyFactors(u8x16_t p1234, u16x8_t& aF12, u16x8_t& aF34)
+{
+  union {
+    u8x16_t p;
+    uint8_t u8[4][4];
+  };
+  p = p1234;
+
+  uint16_t aF1 = sAlphaFactors[u8[0][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
+  uint16_t aF2 = sAlphaFactors[u8[1][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
+  uint16_t aF3 = sAlphaFactors[u8[2][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
+  uint16_t aF4 = sAlphaFactors[u8[3][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
+  aF12 = simd::FromU16<u16x8_t>(aF1, aF1, aF1, 1 << 8, aF2, aF2, aF2, 1 << 8);
+  aF34 = simd::FromU16<u16x8_t>(aF3, aF3, aF3, 1 << 8, aF4, aF4, aF4, 1 << 8);
+}
+
+#ifdef SIMD_COMPILE_AVX2
+// Unpacking works per 128 bit lane, so the low halves hold pixels 1, 2, 5
+// and 6 and the high halves pixels 3, 4, 7 and 8.
+static MOZ_ALWAYS_INLINE void
+UnpremultiplyFactors(__m256i p12345678, __m256i& aF1256, __m256i& aF3478)
+{
+  static_assert(B8G8R8A8_COMPONENT_BYTEOFFSET_A == 3, "alpha has to be the top byte");
+
+  // Gather the factors as 32 bit values, the top half of each one is the
+  // next table entry and gets masked off.
+  __m256i alpha = _mm256_srli_epi32(p12345678, 24);
+  __m256i factors = _mm256_and_si256(
+    _mm256_i32gather_epi32((const int*)sAlphaFactors, alpha, 2), _mm256_set1_epi32(0xffff));
+
+  // { f, f } and { f, 1 << 8 } for every pixel, interleaved per pixel pair.
+  __m256i ff = _mm256_or_si256(factors, _mm256_slli_epi32(factors, 16));
+  __m256i f256 = _mm256_or_si256(factors, _mm256_set1_epi32(1 << 24));
+  aF1256 = _mm256_unpacklo_epi32(ff, f256);
+  aF3478 = _mm256_unpackhi_epi32(ff, f256);
+}
+#endif
+
 template<typename u16x8_t, typename u8x16_t>
 static void
 DoUnpremultiplicationCalculation_SIMD(const IntSize& aSize,
                                  uint8_t* aTargetData, int32_t aTargetStride,
                                  uint8_t* aSourceData, int32_t aSourceStride)
 {
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < aSize.height; y++) {
-    for (int32_t x = 0; x < aSize.width; x += 4) {
+    for (int32_t x = 0; x < aSize.width; x += pixelsPerVector) {
       int32_t inputIndex = y * aSourceStride + 4 * x;
       int32_t targetIndex = y * aTargetStride + 4 * x;
-      union {
-        u8x16_t p1234;
-        uint8_t u8[4][4];
-      };
-      p1234 = simd::Load8<u8x16_t>(&aSourceData[inputIndex]);
+      u8x16_t p1234 = LoadPixels<u8x16_t>(&aSourceData[inputIndex], aSize.width - x);
 
       // Prepare the alpha factors.
-      uint16_t aF1 = sAlphaFactors[u8[0][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
-      uint16_t aF2 = sAlphaFactors[u8[1][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
-      uint16_t aF3 = sAlphaFactors[u8[2][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
-      uint16_t aF4 = sAlphaFactors[u8[3][B8G8R8A8_COMPONENT_BYTEOFFSET_A]];
-      u16x8_t aF12 = simd::FromU16<u16x8_t>(aF1, aF1, aF1, 1 << 8, aF2, aF2, aF2, 1 << 8);
-      u16x8_t aF34 = simd::FromU16<u16x8_t>(aF3, aF3, aF3, 1 << 8, aF4, aF4, aF4, 1 << 8);
+      u16x8_t aF12, aF34;
+      UnpremultiplyFactors(p1234, aF12, aF34);
 
       u16x8_t p12 = simd::UnpackLo8x8ToU16x8(p1234);
       u16x8_t p34 = simd::UnpackHi8x8ToU16x8(p1234);
@@ -947,7 +1160,7 @@ DoUnpremultiplicationCalculation_SIMD(const IntSize& aSize,
       p34 = simd::ShiftRight16<8>(simd::Add16(simd::Mul16(p34, aF34), simd::FromU16<u16x8_t>(128)));
 
       u8x16_t result = simd::PackAndSaturate16To8(p12, p34);
-      simd::Store8(&aTargetData[targetIndex], result);
+      StorePixels(&aTargetData[targetIndex], result, aSize.width - x);
     }
   }
 }
@@ -1013,23 +1226,13 @@ ArithmeticCombineTwoPixels(i16x8_t in1, i16x8_t in2,
 }
 
 template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
-static TemporaryRef<DataSourceSurface>
-ApplyArithmeticCombine_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInput2,
-                            Float aK1, Float aK2, Float aK3, Float aK4)
+static void
+DoArithmeticCombineCalculation_SIMD(const IntSize& size,
+                                    uint8_t* targetData, int32_t targetStride,
+                                    uint8_t* source1Data, int32_t source1Stride,
+                                    uint8_t* source2Data, int32_t source2Stride,
+                                    Float aK1, Float aK2, Float aK3, Float aK4)
 {
-  IntSize size = aInput1->GetSize();
-  RefPtr<DataSourceSurface> target =
-  Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
-  if (!target) {
-    return nullptr;
-  }
-
-  uint8_t* source1Data = aInput1->GetData();
-  uint8_t* source2Data = aInput2->GetData();
-  uint8_t* targetData = target->GetData();
-  uint32_t source1Stride = aInput1->Stride();
-  uint32_t source2Stride = aInput2->Stride();
-  uint32_t targetStride = target->Stride();
 
   // The arithmetic combine filter does the following calculation:
   // result = k1 * in1 * in2 + k2 * in1 + k3 * in2 + k4
@@ -1051,15 +1254,16 @@ ApplyArithmeticCombine_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInpu
   i16x8_t k1And4 = simd::InterleaveLo16(k1, k4);
   i16x8_t k2And3 = simd::InterleaveLo16(k2, k3);
 
+  const int32_t pixelsPerVector = sizeof(u8x16_t) / 4;
   for (int32_t y = 0; y < size.height; y++) {
-    for (int32_t x = 0; x < size.width; x += 4) {
+    for (int32_t x = 0; x < size.width; x += pixelsPerVector) {
       uint32_t source1Index = y * source1Stride + 4 * x;
       uint32_t source2Index = y * source2Stride + 4 * x;
       uint32_t targetIndex = y * targetStride + 4 * x;
 
       // Load and unpack.
-      u8x16_t in1 = simd::Load8<u8x16_t>(&source1Data[source1Index]);
-      u8x16_t in2 = simd::Load8<u8x16_t>(&source2Data[source2Index]);
+      u8x16_t in1 = LoadPixels<u8x16_t>(&source1Data[source1Index], size.width - x);
+      u8x16_t in2 = LoadPixels<u8x16_t>(&source2Data[source2Index], size.width - x);
       i16x8_t in1_12 = simd::UnpackLo8x8ToI16x8(in1);
       i16x8_t in1_34 = simd::UnpackHi8x8ToI16x8(in1);
       i16x8_t in2_12 = simd::UnpackLo8x8ToI16x8(in2);
@@ -1070,12 +1274,488 @@ ApplyArithmeticCombine_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInpu
       i16x8_t result_34 = ArithmeticCombineTwoPixels<i32x4_t,i16x8_t>(in1_34, in2_34, k1And4, k2And3);
 
       // Pack and store.
-      simd::Store8(&targetData[targetIndex], simd::PackAndSaturate16To8(result_12, result_34));
+      StorePixels(&targetData[targetIndex], simd::PackAndSaturate16To8(result_12, result_34), size.width - x);
     }
   }
+}
+
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static TemporaryRef<DataSourceSurface>
+ApplyArithmeticCombine_SIMD(DataSourceSurface* aInput1, DataSourceSurface* aInput2,
+                            Float aK1, Float aK2, Float aK3, Float aK4)
+{
+  IntSize size = aInput1->GetSize();
+  RefPtr<DataSourceSurface> target =
+  Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
+  if (!target) {
+    return nullptr;
+  }
+
+  DoArithmeticCombineCalculation_SIMD<i32x4_t,i16x8_t,u8x16_t>(
+    size, target->GetData(), target->Stride(),
+    aInput1->GetData(), aInput1->Stride(),
+    aInput2->GetData(), aInput2->Stride(),
+    aK1, aK2, aK3, aK4);
 
   return target;
 }
 
+// Adds aWeights[0] * aRowA + aWeights[1] * aRowB to aSums, separately for
+// each of the bytes in the rows. aSums[i] holds the sums for the bytes
+// 4 * i to 4 * i + 3. aWeights repeats the same two weights.
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static MOZ_ALWAYS_INLINE void
+AccumulateRows(i32x4_t aSums[4], u8x16_t aRowA, u8x16_t aRowB, i16x8_t aWeights)
+{
+  i16x8_t a_lo = simd::UnpackLo8x8ToI16x8(aRowA);
+  i16x8_t a_hi = simd::UnpackHi8x8ToI16x8(aRowA);
+  i16x8_t b_lo = simd::UnpackLo8x8ToI16x8(aRowB);
+  i16x8_t b_hi = simd::UnpackHi8x8ToI16x8(aRowB);
+  aSums[0] = simd::Add32(aSums[0], simd::MulAdd16x8x2To32x4(simd::InterleaveLo16(a_lo, b_lo), aWeights));
+  aSums[1] = simd::Add32(aSums[1], simd::MulAdd16x8x2To32x4(simd::InterleaveHi16(a_lo, b_lo), aWeights));
+  aSums[2] = simd::Add32(aSums[2], simd::MulAdd16x8x2To32x4(simd::InterleaveLo16(a_hi, b_hi), aWeights));
+  aSums[3] = simd::Add32(aSums[3], simd::MulAdd16x8x2To32x4(simd::InterleaveHi16(a_hi, b_hi), aWeights));
+}
+
+// Box blurs one column of sizeof(u8x16_t) bytes. Like AlphaBoxBlur, rows
+// outside the surface repeat the nearest edge row. Only the rows are
+// blurred, every byte is treated as a separate channel, so this works on
+// any pixel format.
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t, typename f32x4_t>
+static void
+BoxBlurColumn_SIMD(const uint8_t* aSource, int32_t aSourceStride,
+                   uint8_t* aDest, int32_t aDestStride, int32_t aRows,
+                   int32_t aTopLobe, int32_t aBottomLobe, int32_t aPixelsLeft)
+{
+  f32x4_t reciprocal = simd::FromF32<f32x4_t>(1.0f / (aTopLobe + aBottomLobe + 1));
+  i16x8_t add = simd::FromI16<i16x8_t>(1, 0, 1, 0, 1, 0, 1, 0);
+  i16x8_t addAndSubtract = simd::FromI16<i16x8_t>(1, -1, 1, -1, 1, -1, 1, -1);
+
+  i32x4_t sums[4] = { simd::From32<i32x4_t>(0), simd::From32<i32x4_t>(0),
+                      simd::From32<i32x4_t>(0), simd::From32<i32x4_t>(0) };
+  for (int32_t i = -aTopLobe; i <= aBottomLobe; i++) {
+    int32_t y = std::min(std::max(i, 0), aRows - 1);
+    u8x16_t row = LoadPixels<u8x16_t>(aSource + aSourceStride * y, aPixelsLeft);
+    AccumulateRows(sums, row, row, add);
+  }
+
+  for (int32_t y = 0; y < aRows; y++) {
+    i32x4_t p1 = simd::F32ToI32(simd::MulF32(simd::I32ToF32(sums[0]), reciprocal));
+    i32x4_t p2 = simd::F32ToI32(simd::MulF32(simd::I32ToF32(sums[1]), reciprocal));
+    i32x4_t p3 = simd::F32ToI32(simd::MulF32(simd::I32ToF32(sums[2]), reciprocal));
+    i32x4_t p4 = simd::F32ToI32(simd::MulF32(simd::I32ToF32(sums[3]), reciprocal));
+    StorePixels(aDest + aDestStride * y, simd::PackAndSaturate32To8(p1, p2, p3, p4), aPixelsLeft);
+
+    int32_t next = std::min(y + aBottomLobe + 1, aRows - 1);
+    int32_t last = std::max(y - aTopLobe, 0);
+    AccumulateRows(sums, LoadPixels<u8x16_t>(aSource + aSourceStride * next, aPixelsLeft),
+                   LoadPixels<u8x16_t>(aSource + aSourceStride * last, aPixelsLeft),
+                   addAndSubtract);
+  }
+}
+
+// Runs the three box blurs given by aLobes over every row of aData. aRowBytes
+// must be a multiple of 16. aScratch needs room for 2 * 32 * aRows bytes.
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t, typename f32x4_t>
+static void
+BoxBlurColumns_SIMD(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                    const int32_t aLobes[3][2], uint8_t* aScratch)
+{
+  // Blurring one column all the way down before moving on keeps the running
+  // sums in registers, and the two scratch columns in the cache.
+  const int32_t columnBytes = sizeof(u8x16_t);
+  uint8_t* scratch1 = aScratch;
+  uint8_t* scratch2 = aScratch + columnBytes * aRows;
+  for (int32_t x = 0; x < aRowBytes; x += columnBytes) {
+    int32_t pixelsLeft = (aRowBytes - x) / 4;
+    BoxBlurColumn_SIMD<i32x4_t,i16x8_t,u8x16_t,f32x4_t>(
+      aData + x, aStride, scratch1, columnBytes, aRows, aLobes[0][0], aLobes[0][1], pixelsLeft);
+    BoxBlurColumn_SIMD<i32x4_t,i16x8_t,u8x16_t,f32x4_t>(
+      scratch1, columnBytes, scratch2, columnBytes, aRows, aLobes[1][0], aLobes[1][1], pixelsLeft);
+    BoxBlurColumn_SIMD<i32x4_t,i16x8_t,u8x16_t,f32x4_t>(
+      scratch2, columnBytes, aData + x, aStride, aRows, aLobes[2][0], aLobes[2][1], pixelsLeft);
+  }
+}
+
+// Convolves every row of aData with the 2 * aRadius + 1 weights at aWeights,
+// which add up to 1 << 14. Rows outside the surface repeat the nearest edge
+// row. aRowBytes must be a multiple of 16, aScratch needs room for 32 * aRows
+// bytes.
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static void
+GaussianBlurColumns_SIMD(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                         const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch)
+{
+  MOZ_ASSERT(aRadius <= FilterProcessing::kMaxExactGaussianBlurRadius);
+
+  // The rows are multiplied and added two at a time, so pad the kernel to an
+  // even number of weights.
+  const int32_t pairs = aRadius + 1;
+  i16x8_t weights[FilterProcessing::kMaxExactGaussianBlurRadius + 1];
+  for (int32_t i = 0; i < pairs; i++) {
+    int16_t a = aWeights[2 * i];
+    int16_t b = 2 * i + 1 <= 2 * aRadius ? aWeights[2 * i + 1] : 0;
+    weights[i] = simd::FromI16<i16x8_t>(a, b, a, b, a, b, a, b);
+  }
+  i32x4_t rounding = simd::From32<i32x4_t>(1 << 13);
+
+  const int32_t columnBytes = sizeof(u8x16_t);
+  for (int32_t x = 0; x < aRowBytes; x += columnBytes) {
+    int32_t pixelsLeft = (aRowBytes - x) / 4;
+    const uint8_t* source = aData + x;
+    for (int32_t y = 0; y < aRows; y++) {
+      i32x4_t sums[4] = { rounding, rounding, rounding, rounding };
+      for (int32_t i = 0; i < pairs; i++) {
+        int32_t rowA = std::min(std::max(y - aRadius + 2 * i, 0), aRows - 1);
+        int32_t rowB = std::min(std::max(y - aRadius + 2 * i + 1, 0), aRows - 1);
+        AccumulateRows(sums, LoadPixels<u8x16_t>(source + aStride * rowA, pixelsLeft),
+                       LoadPixels<u8x16_t>(source + aStride * rowB, pixelsLeft),
+                       weights[i]);
+      }
+      u8x16_t result =
+        simd::PackAndSaturate32To8(simd::ShiftRight32<14>(sums[0]), simd::ShiftRight32<14>(sums[1]),
+                                   simd::ShiftRight32<14>(sums[2]), simd::ShiftRight32<14>(sums[3]));
+      StorePixels(aScratch + columnBytes * y, result, pixelsLeft);
+    }
+    // Every output row reads the input rows around it, so the column can
+    // only be written back once it's done.
+    for (int32_t y = 0; y < aRows; y++) {
+      StorePixels(aData + x + aStride * y,
+                  LoadPixels<u8x16_t>(aScratch + columnBytes * y, pixelsLeft), pixelsLeft);
+    }
+  }
+}
+
+// Loads the four pixels at aData, which needn't be aligned. Only the first
+// aPixelsLeft of them are read if there are fewer than four, the others are
+// zero.
+template<typename u8x16_t>
+static MOZ_ALWAYS_INLINE u8x16_t
+LoadPixelsUnaligned(const uint8_t* aData, int32_t aPixelsLeft)
+{
+  if (aPixelsLeft >= 4) {
+    return simd::LoadUnaligned8<u8x16_t>(aData);
+  }
+  uint8_t pixels[16] = { 0 };
+  memcpy(pixels, aData, 4 * aPixelsLeft);
+  return simd::LoadUnaligned8<u8x16_t>(pixels);
+}
+
+// AccumulateRows for rows of four pixels with 16-bit channels, each row
+// being two vectors.
+template<typename i32x4_t, typename i16x8_t>
+static MOZ_ALWAYS_INLINE void
+AccumulateRows16(i32x4_t aSums[4], i16x8_t aRowA01, i16x8_t aRowA23,
+                 i16x8_t aRowB01, i16x8_t aRowB23, i16x8_t aWeights)
+{
+  aSums[0] = simd::Add32(aSums[0], simd::MulAdd16x8x2To32x4(simd::InterleaveLo16(aRowA01, aRowB01), aWeights));
+  aSums[1] = simd::Add32(aSums[1], simd::MulAdd16x8x2To32x4(simd::InterleaveHi16(aRowA01, aRowB01), aWeights));
+  aSums[2] = simd::Add32(aSums[2], simd::MulAdd16x8x2To32x4(simd::InterleaveLo16(aRowA23, aRowB23), aWeights));
+  aSums[3] = simd::Add32(aSums[3], simd::MulAdd16x8x2To32x4(simd::InterleaveHi16(aRowA23, aRowB23), aWeights));
+}
+
+// The number of fractional bits of the 16-bit results of the first pass of
+// a separable convolution. The row weights are scaled so that their absolute
+// values add up to one, which keeps those results within [-255, 255].
+static const int32_t kConvolveIntermediateBits = 7;
+
+// Returns the largest number of fractional bits, up to 24, with which all of
+// aWeights fit in 16 bits and the sum of aBias and the products of aWeights
+// with values up to aMaxValue stays well within 32 bits. Returns -1 if there
+// is none.
+static inline int32_t
+ConvolveWeightsShift(const Float* aWeights, int32_t aCount, Float aMaxValue, Float aBias)
+{
+  Float maxWeight = 0;
+  Float weightSum = 0;
+  for (int32_t i = 0; i < aCount; i++) {
+    maxWeight = std::max(maxWeight, Float(fabs(aWeights[i])));
+    weightSum += fabs(aWeights[i]);
+  }
+  Float maxSum = weightSum * aMaxValue + Float(fabs(aBias)) + 1;
+
+  int32_t shift = -1;
+  for (int32_t i = 0; i <= 24; i++) {
+    Float scale = Float(1 << i);
+    if (maxWeight * scale > INT16_MAX - 1 || maxSum * scale > Float(1 << 30)) {
+      break;
+    }
+    shift = i;
+  }
+  return shift;
+}
+
+// The most that rounding the weights to fixed point may move a result, in
+// levels of the 8-bit result. The result is rounded as well, so this keeps it
+// within one level of the exact one.
+static const Float kMaxConvolveRoundingError = 0.5f;
+
+// Returns how far the sum of the products of aWeights with values up to
+// aMaxValue can move when the weights are rounded to aShift fractional bits.
+// ConvolveWeightsShift picks the shift by the largest weight, so with small
+// weights next to large ones this can be several levels.
+static inline Float
+ConvolveRoundingError(const Float* aWeights, int32_t aCount, Float aMaxValue, int32_t aShift)
+{
+  Float scale = Float(1 << aShift);
+  Float error = 0;
+  for (int32_t i = 0; i < aCount; i++) {
+    Float rounded = floorf(aWeights[i] * scale + 0.5f) / scale;
+    error += Float(fabs(aWeights[i] - rounded));
+  }
+  return error * aMaxValue;
+}
+
+// If aKernel is the product of a column vector and a row vector, sets
+// aColumn and aRow to them, with the absolute values of aRow adding up to one,
+// and returns true.
+static inline bool
+SeparateKernel(const Float* aKernel, const IntSize& aKernelSize, Float* aColumn, Float* aRow)
+{
+  int32_t pivot = 0;
+  for (int32_t i = 1; i < aKernelSize.width * aKernelSize.height; i++) {
+    if (fabs(aKernel[i]) > fabs(aKernel[pivot])) {
+      pivot = i;
+    }
+  }
+  Float pivotWeight = aKernel[pivot];
+  if (pivotWeight == 0) {
+    return false;
+  }
+  int32_t pivotX = pivot % aKernelSize.width;
+  int32_t pivotY = pivot / aKernelSize.width;
+
+  Float rowSum = 0;
+  for (int32_t x = 0; x < aKernelSize.width; x++) {
+    rowSum += fabs(aKernel[pivotY * aKernelSize.width + x]);
+  }
+  for (int32_t x = 0; x < aKernelSize.width; x++) {
+    aRow[x] = aKernel[pivotY * aKernelSize.width + x] / rowSum;
+  }
+  for (int32_t y = 0; y < aKernelSize.height; y++) {
+    aColumn[y] = aKernel[y * aKernelSize.width + pivotX] / pivotWeight * rowSum;
+  }
+
+  Float tolerance = Float(fabs(pivotWeight)) * 1e-5f;
+  for (int32_t y = 0; y < aKernelSize.height; y++) {
+    for (int32_t x = 0; x < aKernelSize.width; x++) {
+      if (fabs(aColumn[y] * aRow[x] - aKernel[y * aKernelSize.width + x]) > tolerance) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// The non-zero weights of a kernel as 16-bit fixed point numbers, in pairs,
+// along with the offsets of the samples they apply to.
+struct ConvolveTaps
+{
+  ConvolveTaps() : mPairs(0) {}
+
+  // aOffsets[i] is the offset, in source elements, of the sample for
+  // aWeights[i]. Returns false if out of memory.
+  bool Init(const Float* aWeights, const int32_t* aOffsets, int32_t aCount, int32_t aShift)
+  {
+    for (int32_t i = 0; i < aCount; i++) {
+      int16_t weight = int16_t(floorf(aWeights[i] * Float(1 << aShift) + 0.5f));
+      if (weight) {
+        mOffsets.push_back(aOffsets[i]);
+        mWeights.push_back(weight);
+      }
+    }
+    if (mWeights.size() % 2) {
+      mOffsets.push_back(mOffsets.empty() ? 0 : mOffsets.back());
+      mWeights.push_back(0);
+    }
+    mPairs = mWeights.size() / 2;
+
+    // Each pair is repeated for the four channels, ready for
+    // MulAdd16x8x2To32x4.
+    mVectors.Realloc(8 * mPairs);
+    if (mPairs && !mVectors.mPtr) {
+      return false;
+    }
+    for (int32_t i = 0; i < mPairs; i++) {
+      for (int32_t j = 0; j < 8; j++) {
+        mVectors[8 * i + j] = mWeights[2 * i + j % 2];
+      }
+    }
+    return true;
+  }
+
+  std::vector<int32_t> mOffsets;
+  std::vector<int16_t> mWeights;
+  AlignedArray<int16_t> mVectors;
+  int32_t mPairs;
+};
+
+// Convolves aSize pixels with aTaps. Every channel of the result is the sum
+// of aAddend and the weighted samples, shifted right by aShift. 8-bit results
+// are clamped to [0, 255], 16-bit ones are written as four int16_t channels
+// per pixel. aTargetData must be 16-byte aligned, and have room for the
+// width rounded up to a multiple of four pixels.
+template<bool a16BitTarget, typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static void
+ConvolveTaps_SIMD(const uint8_t* aSourceData, int32_t aSourceStride,
+                  uint8_t* aTargetData, int32_t aTargetStride, const IntSize& aSize,
+                  const ConvolveTaps& aTaps, int32_t aAddend, int32_t aShift)
+{
+  i32x4_t addend = simd::From32<i32x4_t>(aAddend);
+  for (int32_t y = 0; y < aSize.height; y++) {
+    const uint8_t* sourceRow = aSourceData + y * aSourceStride;
+    uint8_t* targetRow = aTargetData + y * aTargetStride;
+    for (int32_t x = 0; x < aSize.width; x += 4) {
+      int32_t pixelsLeft = aSize.width - x;
+      const uint8_t* source = sourceRow + 4 * x;
+      i32x4_t sums[4] = { addend, addend, addend, addend };
+      for (int32_t i = 0; i < aTaps.mPairs; i++) {
+        AccumulateRows(sums,
+                       LoadPixelsUnaligned<u8x16_t>(source + aTaps.mOffsets[2 * i], pixelsLeft),
+                       LoadPixelsUnaligned<u8x16_t>(source + aTaps.mOffsets[2 * i + 1], pixelsLeft),
+                       simd::Load16<i16x8_t>(aTaps.mVectors.mPtr + 8 * i));
+      }
+      for (int32_t i = 0; i < 4; i++) {
+        sums[i] = simd::ShiftRight32(sums[i], aShift);
+      }
+      if (a16BitTarget) {
+        int16_t* target = reinterpret_cast<int16_t*>(targetRow) + 4 * x;
+        simd::Store16(target, simd::PackAndSaturate32To16(sums[0], sums[1]));
+        simd::Store16(target + 8, simd::PackAndSaturate32To16(sums[2], sums[3]));
+      } else {
+        simd::Store8(targetRow + 4 * x,
+                     simd::PackAndSaturate32To8(sums[0], sums[1], sums[2], sums[3]));
+      }
+    }
+  }
+}
+
+// ConvolveTaps_SIMD for 16-bit sources with 8-bit results. The source has to
+// be 16-byte aligned and padded like the 16-bit results of ConvolveTaps_SIMD,
+// and aTaps may only reach whole rows away.
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static void
+ConvolveTaps16_SIMD(const int16_t* aSourceData, int32_t aSourceStride,
+                    uint8_t* aTargetData, int32_t aTargetStride, const IntSize& aSize,
+                    const ConvolveTaps& aTaps, int32_t aAddend, int32_t aShift)
+{
+  i32x4_t addend = simd::From32<i32x4_t>(aAddend);
+  for (int32_t y = 0; y < aSize.height; y++) {
+    const int16_t* sourceRow = aSourceData + y * aSourceStride;
+    uint8_t* targetRow = aTargetData + y * aTargetStride;
+    for (int32_t x = 0; x < aSize.width; x += 4) {
+      const int16_t* source = sourceRow + 4 * x;
+      i32x4_t sums[4] = { addend, addend, addend, addend };
+      for (int32_t i = 0; i < aTaps.mPairs; i++) {
+        const int16_t* a = source + aTaps.mOffsets[2 * i];
+        const int16_t* b = source + aTaps.mOffsets[2 * i + 1];
+        AccumulateRows16(sums, simd::Load16<i16x8_t>(a), simd::Load16<i16x8_t>(a + 8),
+                         simd::Load16<i16x8_t>(b), simd::Load16<i16x8_t>(b + 8),
+                         simd::Load16<i16x8_t>(aTaps.mVectors.mPtr + 8 * i));
+      }
+      for (int32_t i = 0; i < 4; i++) {
+        sums[i] = simd::ShiftRight32(sums[i], aShift);
+      }
+      simd::Store8(targetRow + 4 * x,
+                   simd::PackAndSaturate32To8(sums[0], sums[1], sums[2], sums[3]));
+    }
+  }
+}
+
+// The value to start sums at so that shifting them right by aShift rounds
+// to nearest, with aBias, in units of the result, added.
+static inline int32_t
+ConvolveAddend(Float aBias, int32_t aShift)
+{
+  return int32_t(floorf(aBias * Float(1 << aShift) + 0.5f)) + (aShift ? 1 << (aShift - 1) : 0);
+}
+
+template<typename i32x4_t, typename i16x8_t, typename u8x16_t>
+static bool
+ApplyConvolveMatrix_SIMD(const uint8_t* aSourceData, int32_t aSourceStride,
+                         uint8_t* aTargetData, int32_t aTargetStride,
+                         const IntSize& aSize, const Float* aKernel,
+                         const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                         Float aBias)
+{
+  // A separable kernel can be applied as a pass along the rows, which
+  // writes 16-bit results, followed by one down the columns.
+  std::vector<Float> column(aKernelSize.height);
+  std::vector<Float> row(aKernelSize.width);
+  if (aKernelSize.width > 1 && aKernelSize.height > 1 &&
+      SeparateKernel(aKernel, aKernelSize, &column.front(), &row.front())) {
+    int32_t rowShift = ConvolveWeightsShift(&row.front(), aKernelSize.width, 255, 0);
+    Float intermediateBias = aBias * 255 * (1 << kConvolveIntermediateBits);
+    int32_t columnShift = ConvolveWeightsShift(&column.front(), aKernelSize.height,
+                                               INT16_MAX, intermediateBias);
+
+    int32_t intermediateStride = 4 * ((aSize.width + 3) & ~3);
+    int32_t intermediateRows = aSize.height + (aKernelSize.height - 1) * aKernelUnitLength.height;
+    AlignedArray<int16_t> intermediate;
+    if (rowShift >= kConvolveIntermediateBits && columnShift >= 0) {
+      // The errors of the first pass, including rounding its results, are
+      // scaled by the column weights. Its results are within [-255, 255].
+      Float columnSum = 0;
+      for (int32_t y = 0; y < aKernelSize.height; y++) {
+        columnSum += Float(fabs(column[y]));
+      }
+      Float rowError = ConvolveRoundingError(&row.front(), aKernelSize.width, 255, rowShift) +
+                       0.5f / (1 << kConvolveIntermediateBits);
+      Float error = rowError * columnSum +
+                    ConvolveRoundingError(&column.front(), aKernelSize.height, 255, columnShift);
+      if (error <= kMaxConvolveRoundingError) {
+        intermediate.Realloc(intermediateStride * intermediateRows);
+      }
+    }
+
+    std::vector<int32_t> rowOffsets(aKernelSize.width);
+    for (int32_t x = 0; x < aKernelSize.width; x++) {
+      rowOffsets[x] = 4 * x * aKernelUnitLength.width;
+    }
+    std::vector<int32_t> columnOffsets(aKernelSize.height);
+    for (int32_t y = 0; y < aKernelSize.height; y++) {
+      columnOffsets[y] = y * aKernelUnitLength.height * intermediateStride;
+    }
+    ConvolveTaps rowTaps, columnTaps;
+    if (intermediate.mPtr &&
+        rowTaps.Init(&row.front(), &rowOffsets.front(), aKernelSize.width, rowShift) &&
+        columnTaps.Init(&column.front(), &columnOffsets.front(), aKernelSize.height, columnShift)) {
+      int32_t intermediateShift = rowShift - kConvolveIntermediateBits;
+      ConvolveTaps_SIMD<true,i32x4_t,i16x8_t,u8x16_t>(
+        aSourceData, aSourceStride,
+        reinterpret_cast<uint8_t*>(intermediate.mPtr), intermediateStride * sizeof(int16_t),
+        IntSize(aSize.width, intermediateRows), rowTaps,
+        ConvolveAddend(0, intermediateShift), intermediateShift);
+      int32_t shift = columnShift + kConvolveIntermediateBits;
+      ConvolveTaps16_SIMD<i32x4_t,i16x8_t,u8x16_t>(
+        intermediate, intermediateStride, aTargetData, aTargetStride, aSize, columnTaps,
+        ConvolveAddend(aBias * 255, shift), shift);
+      return true;
+    }
+  }
+
+  int32_t count = aKernelSize.width * aKernelSize.height;
+  int32_t shift = ConvolveWeightsShift(aKernel, count, 255, aBias * 255);
+  if (shift < 0 ||
+      ConvolveRoundingError(aKernel, count, 255, shift) > kMaxConvolveRoundingError) {
+    return false;
+  }
+  std::vector<int32_t> offsets(count);
+  for (int32_t y = 0; y < aKernelSize.height; y++) {
+    for (int32_t x = 0; x < aKernelSize.width; x++) {
+      offsets[y * aKernelSize.width + x] =
+        y * aKernelUnitLength.height * aSourceStride + 4 * x * aKernelUnitLength.width;
+    }
+  }
+  ConvolveTaps taps;
+  if (!taps.Init(aKernel, &offsets.front(), count, shift)) {
+    return false;
+  }
+  ConvolveTaps_SIMD<false,i32x4_t,i16x8_t,u8x16_t>(
+    aSourceData, aSourceStride, aTargetData, aTargetStride, aSize, taps,
+    ConvolveAddend(aBias * 255, shift), shift);
+  return true;
+}
+
 } // namespace mozilla
 } // namespace gfx
@@ -59,6 +59,15 @@ FilterProcessing::ApplyColorMatrix_SSE2(DataSourceSurface* aInput, const Matrix5
   return ApplyColorMatrix_SIMD<__m128i,__m128i,__m128i>(aInput, aMatrix);
 }
 
+void
+FilterProcessing::DoColorMatrixCalculation_SSE2(const IntSize& aSize,
+                                   uint8_t* aTargetData, int32_t aTargetStride,
+                                   uint8_t* aSourceData, int32_t aSourceStride,
+                                   const Matrix5x4 &aMatrix)
+{
+  DoColorMatrixCalculation_SIMD<__m128i,__m128i,__m128i>(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+}
+
 void
 FilterProcessing::ApplyComposition_SSE2(DataSourceSurface* aSource, DataSourceSurface* aDest,
                                         CompositeOperator aOperator)
@@ -108,5 +117,43 @@ FilterProcessing::ApplyArithmeticCombine_SSE2(DataSourceSurface* aInput1, DataSo
   return ApplyArithmeticCombine_SIMD<__m128i,__m128i,__m128i>(aInput1, aInput2, aK1, aK2, aK3, aK4);
 }
 
+void
+FilterProcessing::DoArithmeticCombineCalculation_SSE2(const IntSize& aSize,
+                                         uint8_t* aTargetData, int32_t aTargetStride,
+                                         uint8_t* aSource1Data, int32_t aSource1Stride,
+                                         uint8_t* aSource2Data, int32_t aSource2Stride,
+                                         Float aK1, Float aK2, Float aK3, Float aK4)
+{
+  DoArithmeticCombineCalculation_SIMD<__m128i,__m128i,__m128i>(
+    aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride,
+    aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+}
+
+void
+FilterProcessing::BoxBlurColumns_SSE2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                      const int32_t aLobes[3][2], uint8_t* aScratch)
+{
+  BoxBlurColumns_SIMD<__m128i,__m128i,__m128i,__m128>(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+}
+
+void
+FilterProcessing::GaussianBlurColumns_SSE2(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                           const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch)
+{
+  GaussianBlurColumns_SIMD<__m128i,__m128i,__m128i>(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+}
+
+bool
+FilterProcessing::ApplyConvolveMatrix_SSE2(const uint8_t* aSourceData, int32_t aSourceStride,
+                                           uint8_t* aTargetData, int32_t aTargetStride,
+                                           const IntSize& aSize, const Float* aKernel,
+                                           const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                           Float aBias)
+{
+  return ApplyConvolveMatrix_SIMD<__m128i,__m128i,__m128i>(
+    aSourceData, aSourceStride, aTargetData, aTargetStride,
+    aSize, aKernel, aKernelSize, aKernelUnitLength, aBias);
+}
+
 } // namespace mozilla
 } // namespace gfx
@@ -73,6 +73,17 @@ FilterProcessing::ApplyMorphologyHorizontal_Scalar(uint8_t* aSourceData, int32_t
                                                    const IntRect& aDestRect, int32_t aRadius,
                                                    MorphologyOperator aOp)
 {
+  if (aRadius >= kMinRunningMorphologyRadiusX) {
+    bool done = aOp == MORPHOLOGY_OPERATOR_ERODE ?
+      ApplyMorphologyHorizontalRunning_SIMD<MORPHOLOGY_OPERATOR_ERODE,simd::Scalaru8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius) :
+      ApplyMorphologyHorizontalRunning_SIMD<MORPHOLOGY_OPERATOR_DILATE,simd::Scalaru8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
+    if (done) {
+      return;
+    }
+  }
+
   if (aOp == MORPHOLOGY_OPERATOR_ERODE) {
     gfx::ApplyMorphologyHorizontal_Scalar<MORPHOLOGY_OPERATOR_ERODE>(
       aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
@@ -125,6 +136,17 @@ FilterProcessing::ApplyMorphologyVertical_Scalar(uint8_t* aSourceData, int32_t a
                                                    const IntRect& aDestRect, int32_t aRadius,
                                                    MorphologyOperator aOp)
 {
+  if (aRadius >= kMinRunningMorphologyRadiusY) {
+    bool done = aOp == MORPHOLOGY_OPERATOR_ERODE ?
+      ApplyMorphologyVerticalRunning_SIMD<MORPHOLOGY_OPERATOR_ERODE,simd::Scalaru8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius) :
+      ApplyMorphologyVerticalRunning_SIMD<MORPHOLOGY_OPERATOR_DILATE,simd::Scalaru8x16_t>(
+        aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
+    if (done) {
+      return;
+    }
+  }
+
   if (aOp == MORPHOLOGY_OPERATOR_ERODE) {
     gfx::ApplyMorphologyVertical_Scalar<MORPHOLOGY_OPERATOR_ERODE>(
       aSourceData, aSourceStride, aDestData, aDestStride, aDestRect, aRadius);
@@ -140,6 +162,15 @@ FilterProcessing::ApplyColorMatrix_Scalar(DataSourceSurface* aInput, const Matri
   return ApplyColorMatrix_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(aInput, aMatrix);
 }
 
+void
+FilterProcessing::DoColorMatrixCalculation_Scalar(const IntSize& aSize,
+                                   uint8_t* aTargetData, int32_t aTargetStride,
+                                   uint8_t* aSourceData, int32_t aSourceStride,
+                                   const Matrix5x4 &aMatrix)
+{
+  DoColorMatrixCalculation_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(aSize, aTargetData, aTargetStride, aSourceData, aSourceStride, aMatrix);
+}
+
 void
 FilterProcessing::ApplyComposition_Scalar(DataSourceSurface* aSource, DataSourceSurface* aDest,
                                           CompositeOperator aOperator)
@@ -240,5 +271,43 @@ FilterProcessing::ApplyArithmeticCombine_Scalar(DataSourceSurface* aInput1, Data
   return ApplyArithmeticCombine_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(aInput1, aInput2, aK1, aK2, aK3, aK4);
 }
 
+void
+FilterProcessing::DoArithmeticCombineCalculation_Scalar(const IntSize& aSize,
+                                         uint8_t* aTargetData, int32_t aTargetStride,
+                                         uint8_t* aSource1Data, int32_t aSource1Stride,
+                                         uint8_t* aSource2Data, int32_t aSource2Stride,
+                                         Float aK1, Float aK2, Float aK3, Float aK4)
+{
+  DoArithmeticCombineCalculation_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(
+    aSize, aTargetData, aTargetStride, aSource1Data, aSource1Stride,
+    aSource2Data, aSource2Stride, aK1, aK2, aK3, aK4);
+}
+
+void
+FilterProcessing::BoxBlurColumns_Scalar(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                        const int32_t aLobes[3][2], uint8_t* aScratch)
+{
+  BoxBlurColumns_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t,simd::Scalarf32x4_t>(aData, aStride, aRows, aRowBytes, aLobes, aScratch);
+}
+
+void
+FilterProcessing::GaussianBlurColumns_Scalar(uint8_t* aData, int32_t aStride, int32_t aRows, int32_t aRowBytes,
+                                             const int16_t* aWeights, int32_t aRadius, uint8_t* aScratch)
+{
+  GaussianBlurColumns_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(aData, aStride, aRows, aRowBytes, aWeights, aRadius, aScratch);
+}
+
+bool
+FilterProcessing::ApplyConvolveMatrix_Scalar(const uint8_t* aSourceData, int32_t aSourceStride,
+                                             uint8_t* aTargetData, int32_t aTargetStride,
+                                             const IntSize& aSize, const Float* aKernel,
+                                             const IntSize& aKernelSize, const IntSize& aKernelUnitLength,
+                                             Float aBias)
+{
+  return ApplyConvolveMatrix_SIMD<simd::Scalari32x4_t,simd::Scalari16x8_t,simd::Scalaru8x16_t>(
+    aSourceData, aSourceStride, aTargetData, aTargetStride,
+    aSize, aKernel, aKernelSize, aKernelUnitLength, aBias);
+}
+
 } // namespace mozilla
 } // namespace gfx
@@ -81,6 +81,14 @@ GfxMatrixToSkiaMatrix(const Matrix& mat, SkMatrix& retval)
                   0, 0, SK_Scalar1);
 }
 
+static inline Matrix
+SkiaMatrixToGfxMatrix(const SkMatrix& mat)
+{
+    return Matrix(SkScalarToFloat(mat.getScaleX()), SkScalarToFloat(mat.getSkewY()),
+                  SkScalarToFloat(mat.getSkewX()), SkScalarToFloat(mat.getScaleY()),
+                  SkScalarToFloat(mat.getTranslateX()), SkScalarToFloat(mat.getTranslateY()));
+}
+
 static inline SkPaint::Cap
 CapStyleToSkiaCap(CapStyle aCap)
 {
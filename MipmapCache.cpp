@@ -0,0 +1,282 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "MipmapCache.h"
+#include "CacheHelpers.h"
+#include "ImageScaling.h"
+#include "Logging.h"
+#include "Tools.h"
+
+#include <cmath>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+namespace {
+
+void RemoveLevels(uint64_t aSerial);
+
+// Surfaces are identified by a serial number that is attached to them the
+// first time they're drawn minified. Invalidating a surface gives it a new
+// one.
+SurfaceSerials sSurfaceSerials(RemoveLevels);
+
+/**
+ * The levels of each surface that have been built so far, by serial.
+ * Levels[0] is level 1, the surface itself is level 0. Keeps the total size
+ * of all levels within budget by dropping the levels of the least recently
+ * drawn surfaces.
+ */
+typedef std::vector<RefPtr<DataSourceSurface> > Levels;
+LRUCache<uint64_t, Levels> sPyramidCache;
+
+// The serials of surfaces that have gone away since the cache was last used.
+// Surfaces can be released on any thread, by DrawTargetTiled's workers for
+// example, so their levels are only removed the next time the cache is used
+// on its own thread. That also keeps releasing a level, which may have a
+// serial of its own, from changing the cache while it removes an entry.
+std::mutex sReleasedLock;
+std::vector<uint64_t> sReleasedSerials;
+
+void
+RemoveLevels(uint64_t aSerial)
+{
+  if (!sPyramidCache.GetMaxBytes()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(sReleasedLock);
+  sReleasedSerials.push_back(aSerial);
+}
+
+// Removes the levels of released surfaces, on the cache's thread.
+void
+RemoveReleasedLevels()
+{
+  std::vector<uint64_t> released;
+  {
+    std::lock_guard<std::mutex> lock(sReleasedLock);
+    released.swap(sReleasedSerials);
+  }
+  for (size_t i = 0; i < released.size(); i++) {
+    sPyramidCache.Remove(released[i]);
+  }
+}
+
+size_t
+LevelBytes(DataSourceSurface* aLevel)
+{
+  return size_t(aLevel->Stride()) * aLevel->GetSize().height;
+}
+
+/**
+ * Returns aSource halved along both axes, in a new surface of the same
+ * format. aSource must be at least 2x2 pixels.
+ */
+TemporaryRef<DataSourceSurface>
+HalveSurface(DataSourceSurface* aSource)
+{
+  IntSize size = aSource->GetSize();
+  IntSize halfSize(size.width / 2, size.height / 2);
+  RefPtr<DataSourceSurface> level =
+    Factory::CreateDataSourceSurface(halfSize, aSource->GetFormat());
+  if (MOZ2D_WARN_IF(!level)) {
+    return nullptr;
+  }
+
+  ImageHalfScaler scaler(aSource->GetData(), aSource->Stride(), size);
+  // ScaleForSize stops halving as soon as the next step would get to the size
+  // it's given, so ask for one pixel less.
+  scaler.ScaleForSize(IntSize(halfSize.width - 1, halfSize.height - 1));
+  if (MOZ2D_WARN_IF(scaler.GetSize() != halfSize)) {
+    return nullptr;
+  }
+  for (int32_t y = 0; y < halfSize.height; y++) {
+    memcpy(level->GetData() + y * level->Stride(),
+           scaler.GetScaledData() + y * scaler.GetStride(), halfSize.width * 4);
+  }
+  return level.forget();
+}
+
+// The number of times aSize can be halved before a side gets to zero.
+int32_t
+MaxLevel(const IntSize& aSize, bool aExactSize)
+{
+  int32_t level = 0;
+  IntSize size = aSize;
+  while (size.width >= 2 && size.height >= 2 &&
+         (!aExactSize || (size.width % 2 == 0 && size.height % 2 == 0))) {
+    size.width /= 2;
+    size.height /= 2;
+    level++;
+  }
+  return level;
+}
+
+}
+
+TemporaryRef<DataSourceSurface>
+MipmapCache::GetLevel(SourceSurface* aSurface, const Matrix& aTransform,
+                      bool aExactSize, int32_t* aScale)
+{
+  if (!sPyramidCache.IsEnabled() || BytesPerPixel(aSurface->GetFormat()) != 4) {
+    return nullptr;
+  }
+
+  // The number of surface pixels per device pixel along each axis of the
+  // surface.
+  Float scaleX = hypotf(aTransform._11, aTransform._12);
+  Float scaleY = hypotf(aTransform._21, aTransform._22);
+  if (!(scaleX > 0 && scaleY > 0)) {
+    return nullptr;
+  }
+  Float minification = std::min(1 / scaleX, 1 / scaleY);
+  if (!(minification >= 2)) {
+    return nullptr;
+  }
+
+  int32_t level = 0;
+  while (level < 30 && Float(2 << level) <= minification) {
+    level++;
+  }
+  level = std::min(level, MaxLevel(aSurface->GetSize(), aExactSize));
+  if (level == 0) {
+    return nullptr;
+  }
+
+  RemoveReleasedLevels();
+  uint64_t serial = sSurfaceSerials.Get(aSurface);
+  *aScale = 1 << level;
+  Levels* cached = sPyramidCache.Lookup(serial, [level](const Levels& aLevels) {
+    return int32_t(aLevels.size()) >= level;
+  });
+  if (cached) {
+    return (*cached)[level - 1].get();
+  }
+
+  Levels levels;
+  cached = sPyramidCache.Peek(serial);
+  if (cached) {
+    levels = *cached;
+  }
+  size_t bytes = 0;
+  for (size_t i = 0; i < levels.size(); i++) {
+    bytes += LevelBytes(levels[i]);
+  }
+
+  RefPtr<DataSourceSurface> current;
+  if (levels.empty()) {
+    current = aSurface->GetDataSurface();
+    if (MOZ2D_WARN_IF(!current)) {
+      return nullptr;
+    }
+  } else {
+    current = levels.back();
+  }
+
+  // Levels that don't fit in the budget any more are still returned, just
+  // not kept.
+  size_t cachedLevels = levels.size();
+  bool cache = true;
+  for (int32_t i = levels.size(); i < level; i++) {
+    current = HalveSurface(current);
+    if (!current) {
+      return nullptr;
+    }
+    cache = cache && bytes + LevelBytes(current) <= sPyramidCache.GetMaxBytes();
+    if (cache) {
+      levels.push_back(current);
+      bytes += LevelBytes(current);
+    }
+  }
+  if (levels.size() > cachedLevels) {
+    sPyramidCache.Remove(serial);
+    sPyramidCache.Insert(serial, levels, bytes);
+  }
+  return current.forget();
+}
+
+TemporaryRef<DataSourceSurface>
+MipmapCache::GetLevelForDrawSurface(SourceSurface* aSurface, const Rect& aDest,
+                                    const Rect& aSource, const Matrix& aTransform,
+                                    Rect* aLevelSource)
+{
+  if (aSource.IsEmpty() || aDest.IsEmpty()) {
+    return nullptr;
+  }
+
+  Matrix surfaceToDevice =
+    Matrix::Scaling(aDest.width / aSource.width, aDest.height / aSource.height) * aTransform;
+  int32_t scale;
+  RefPtr<DataSourceSurface> level = GetLevel(aSurface, surfaceToDevice, false, &scale);
+  if (!level) {
+    return nullptr;
+  }
+  *aLevelSource = Rect(aSource.x / scale, aSource.y / scale,
+                       aSource.width / scale, aSource.height / scale);
+  return level.forget();
+}
+
+void
+MipmapCache::SetMaxBytes(size_t aMaxBytes)
+{
+  {
+    std::lock_guard<std::mutex> lock(sReleasedLock);
+    sReleasedSerials.clear();
+  }
+  sPyramidCache.SetMaxBytes(aMaxBytes);
+}
+
+CacheStats
+MipmapCache::GetStats()
+{
+  if (sPyramidCache.IsEnabled()) {
+    RemoveReleasedLevels();
+  }
+  return sPyramidCache.GetStats();
+}
+
+void
+MipmapCache::Invalidate(SourceSurface* aSurface)
+{
+  if (!sPyramidCache.IsEnabled()) {
+    return;
+  }
+  uint64_t serial = sSurfaceSerials.Renew(aSurface);
+  if (serial) {
+    sPyramidCache.Remove(serial);
+  }
+}
+
+MipmappedPattern::MipmappedPattern(const Pattern& aPattern, const Matrix& aTransform)
+  : mPattern(aPattern)
+  , mMipmapped(nullptr, ExtendMode::CLAMP)
+{
+  if (aPattern.GetType() != PatternType::SURFACE) {
+    return;
+  }
+  const SurfacePattern& pattern = static_cast<const SurfacePattern&>(aPattern);
+  if (pattern.mFilter == Filter::POINT || !pattern.mSamplingRect.IsEmpty()) {
+    return;
+  }
+
+  int32_t scale;
+  RefPtr<DataSourceSurface> level =
+    MipmapCache::GetLevel(pattern.mSurface, pattern.mMatrix * aTransform,
+                          pattern.mExtendMode != ExtendMode::CLAMP, &scale);
+  if (!level) {
+    return;
+  }
+  mMipmapped.mSurface = level;
+  mMipmapped.mExtendMode = pattern.mExtendMode;
+  mMipmapped.mFilter = pattern.mFilter;
+  mMipmapped.mMatrix = pattern.mMatrix;
+  mMipmapped.mMatrix.PreScale(scale, scale);
+}
+
+}
+}
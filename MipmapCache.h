@@ -0,0 +1,81 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_MIPMAPCACHE_H_
+#define MOZILLA_GFX_MIPMAPCACHE_H_
+
+#include "2D.h"
+
+namespace mozilla {
+namespace gfx {
+
+/**
+ * Mipmap pyramids that let the software backends draw minified surfaces from
+ * a smaller copy, see Factory::SetMipmapCacheSize.
+ *
+ * Level n of a surface's pyramid is the surface halved n times along both
+ * axes by ImageHalfScaler, each level being built from the one before it.
+ * Levels are built on demand and dropped once the surface goes away. Odd rows
+ * and columns are dropped while halving, so a pixel of level n covers exactly
+ * 2^n by 2^n pixels of the surface.
+ */
+class MipmapCache
+{
+public:
+  /**
+   * Returns the level of aSurface to draw in its place when it is drawn with
+   * aTransform, which maps its pixels to device pixels, and sets *aScale to
+   * the number of surface pixels a level pixel covers along each axis. The
+   * deepest level that still has at least one level pixel per device pixel is
+   * picked. Returns null if aSurface isn't minified by a factor of two or
+   * more, its format isn't a 32-bit one, or the cache is disabled on this
+   * thread.
+   *
+   * If aExactSize is true only levels whose size is exactly that of aSurface
+   * divided by *aScale are returned, as repeating patterns need.
+   */
+  static TemporaryRef<DataSourceSurface>
+    GetLevel(SourceSurface* aSurface, const Matrix& aTransform, bool aExactSize,
+             int32_t* aScale);
+
+  /**
+   * GetLevel for DrawTarget::DrawSurface. If the draw of aSource to aDest,
+   * under aTransform, minifies aSurface, returns the level to draw instead and
+   * sets *aLevelSource to the part of the level that corresponds to aSource.
+   */
+  static TemporaryRef<DataSourceSurface>
+    GetLevelForDrawSurface(SourceSurface* aSurface, const Rect& aDest,
+                           const Rect& aSource, const Matrix& aTransform,
+                           Rect* aLevelSource);
+
+  static void SetMaxBytes(size_t aMaxBytes);
+  static CacheStats GetStats();
+  static void Invalidate(SourceSurface* aSurface);
+};
+
+/**
+ * aPattern, or if it is a SurfacePattern that aTransform minifies, a copy of
+ * it that draws a level of its surface instead. Patterns that use the POINT
+ * filter or a sampling rect are left alone.
+ */
+class MipmappedPattern
+{
+public:
+  MipmappedPattern(const Pattern& aPattern, const Matrix& aTransform);
+
+  const Pattern& Get() const
+  {
+    return mMipmapped.mSurface ? mMipmapped : mPattern;
+  }
+
+private:
+  const Pattern& mPattern;
+  SurfacePattern mMipmapped;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_MIPMAPCACHE_H_ */
@@ -27,11 +27,45 @@ static std::string NameFromBackend(BackendType aType)
   }
 }
 
+// Size of the blocks events are constructed in, and the alignment of every
+// event in them.
+static const size_t kArenaBlockSize = 64 * 1024;
+static const size_t kArenaAlignment = 16;
+
+RecordedEventArena::RecordedEventArena()
+  : mBlockUsed(kArenaBlockSize)
+{
+}
+
+RecordedEventArena::~RecordedEventArena()
+{
+  for (size_t i = 0; i < mEvents.size(); i++) {
+    mEvents[i]->~RecordedEvent();
+  }
+  for (size_t i = 0; i < mBlocks.size(); i++) {
+    delete [] mBlocks[i];
+  }
+}
+
+void *
+RecordedEventArena::Allocate(size_t aSize)
+{
+  aSize = (aSize + kArenaAlignment - 1) & ~(kArenaAlignment - 1);
+  MOZ_ASSERT(aSize <= kArenaBlockSize);
+  if (kArenaBlockSize - mBlockUsed < aSize) {
+    mBlocks.push_back(new char[kArenaBlockSize]);
+    mBlockUsed = 0;
+  }
+  void *result = mBlocks.back() + mBlockUsed;
+  mBlockUsed += aSize;
+  return result;
+}
+
 #define LOAD_EVENT_TYPE(_typeenum, _class) \
-  case _typeenum: return new _class(aStream)
+  case _typeenum: return aArena.Adopt(new (aArena.Allocate(sizeof(_class))) _class(aStream))
 
 RecordedEvent *
-RecordedEvent::LoadEventFromStream(std::istream &aStream, EventType aType)
+RecordedEvent::LoadEvent(MemReader &aStream, EventType aType, RecordedEventArena &aArena)
 {
   switch (aType) {
     LOAD_EVENT_TYPE(DRAWTARGETCREATION, RecordedDrawTargetCreation);
@@ -66,6 +100,9 @@ RecordedEvent::LoadEventFromStream(std::istream &aStream, EventType aType)
     LOAD_EVENT_TYPE(MASKSURFACE, RecordedMaskSurface);
     LOAD_EVENT_TYPE(FILTERNODESETATTRIBUTE, RecordedFilterNodeSetAttribute);
     LOAD_EVENT_TYPE(FILTERNODESETINPUT, RecordedFilterNodeSetInput);
+    LOAD_EVENT_TYPE(SURFACEDATASTORE, RecordedSurfaceDataStore);
+    LOAD_EVENT_TYPE(SOURCESURFACEFROMSTOREDDATA, RecordedSourceSurfaceFromStoredData);
+    LOAD_EVENT_TYPE(SURFACEDATARELEASE, RecordedSurfaceDataRelease);
   default:
     return nullptr;
   }
@@ -139,6 +176,12 @@ RecordedEvent::GetEventName(EventType aType)
     return "SetAttribute";
   case FILTERNODESETINPUT:
     return "SetInput";
+  case SURFACEDATASTORE:
+    return "SurfaceDataStore";
+  case SOURCESURFACEFROMSTOREDDATA:
+    return "SourceSurfaceFromStoredData";
+  case SURFACEDATARELEASE:
+    return "SurfaceDataRelease";
   default:
     return "Unknown";
   }
@@ -176,7 +219,7 @@ RecordedEvent::RecordPatternData(std::ostream &aStream, const PatternStorage &aP
 }
 
 void
-RecordedEvent::ReadPatternData(std::istream &aStream, PatternStorage &aPattern) const
+RecordedEvent::ReadPatternData(MemReader &aStream, PatternStorage &aPattern) const
 {
   ReadElement(aStream, aPattern.mType);
 
@@ -280,7 +323,7 @@ RecordedEvent::RecordStrokeOptions(std::ostream &aStream, const StrokeOptions &a
 }
 
 void
-RecordedEvent::ReadStrokeOptions(std::istream &aStream, StrokeOptions &aStrokeOptions)
+RecordedEvent::ReadStrokeOptions(MemReader &aStream, StrokeOptions &aStrokeOptions)
 {
   uint64_t dashLength;
   JoinStyle joinStyle;
@@ -344,7 +387,37 @@ RecordedEvent::OutputSimplePatternInfo(const PatternStorage &aStorage, std::stri
   }
 }
 
-RecordedDrawingEvent::RecordedDrawingEvent(EventType aType, std::istream &aStream)
+void
+RecordedEvent::GetPatternObjects(const PatternStorage &aStorage, std::vector<ReferencePtr> &aObjects) const
+{
+  switch (aStorage.mType) {
+  case PatternType::LINEAR_GRADIENT:
+    {
+      const LinearGradientPatternStorage *store =
+        reinterpret_cast<const LinearGradientPatternStorage*>(&aStorage.mStorage);
+      aObjects.push_back(store->mStops);
+      return;
+    }
+  case PatternType::RADIAL_GRADIENT:
+    {
+      const RadialGradientPatternStorage *store =
+        reinterpret_cast<const RadialGradientPatternStorage*>(&aStorage.mStorage);
+      aObjects.push_back(store->mStops);
+      return;
+    }
+  case PatternType::SURFACE:
+    {
+      const SurfacePatternStorage *store =
+        reinterpret_cast<const SurfacePatternStorage*>(&aStorage.mStorage);
+      aObjects.push_back(store->mSurface);
+      return;
+    }
+  default:
+    return;
+  }
+}
+
+RecordedDrawingEvent::RecordedDrawingEvent(EventType aType, MemReader &aStream)
   : RecordedEvent(aType)
 {
   ReadElement(aStream, mDT);
@@ -395,7 +468,7 @@ RecordedDrawTargetCreation::RecordToStream(ostream &aStream) const
   }
 }
 
-RecordedDrawTargetCreation::RecordedDrawTargetCreation(istream &aStream)
+RecordedDrawTargetCreation::RecordedDrawTargetCreation(MemReader &aStream)
   : RecordedEvent(DRAWTARGETCREATION)
   , mExistingData(nullptr)
 {
@@ -440,7 +513,7 @@ RecordedDrawTargetDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedDrawTargetDestruction::RecordedDrawTargetDestruction(istream &aStream)
+RecordedDrawTargetDestruction::RecordedDrawTargetDestruction(MemReader &aStream)
   : RecordedEvent(DRAWTARGETDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -532,7 +605,7 @@ RecordedFillRect::RecordToStream(ostream &aStream) const
   RecordPatternData(aStream, mPattern);
 }
 
-RecordedFillRect::RecordedFillRect(istream &aStream)
+RecordedFillRect::RecordedFillRect(MemReader &aStream)
   : RecordedDrawingEvent(FILLRECT, aStream)
 {
   ReadElement(aStream, mRect);
@@ -547,6 +620,13 @@ RecordedFillRect::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedFillRect::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 void
 RecordedStrokeRect::PlayEvent(Translator *aTranslator) const
 {
@@ -563,7 +643,7 @@ RecordedStrokeRect::RecordToStream(ostream &aStream) const
   RecordStrokeOptions(aStream, mStrokeOptions);
 }
 
-RecordedStrokeRect::RecordedStrokeRect(istream &aStream)
+RecordedStrokeRect::RecordedStrokeRect(MemReader &aStream)
   : RecordedDrawingEvent(STROKERECT, aStream)
 {
   ReadElement(aStream, mRect);
@@ -580,6 +660,13 @@ RecordedStrokeRect::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedStrokeRect::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 void
 RecordedStrokeLine::PlayEvent(Translator *aTranslator) const
 {
@@ -597,7 +684,7 @@ RecordedStrokeLine::RecordToStream(ostream &aStream) const
   RecordStrokeOptions(aStream, mStrokeOptions);
 }
 
-RecordedStrokeLine::RecordedStrokeLine(istream &aStream)
+RecordedStrokeLine::RecordedStrokeLine(MemReader &aStream)
   : RecordedDrawingEvent(STROKELINE, aStream)
 {
   ReadElement(aStream, mBegin);
@@ -615,13 +702,20 @@ RecordedStrokeLine::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedStrokeLine::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 void
 RecordedFill::PlayEvent(Translator *aTranslator) const
 {
   aTranslator->LookupDrawTarget(mDT)->Fill(aTranslator->LookupPath(mPath), *GenericPattern(mPattern, aTranslator), mOptions);
 }
 
-RecordedFill::RecordedFill(istream &aStream)
+RecordedFill::RecordedFill(MemReader &aStream)
   : RecordedDrawingEvent(FILL, aStream)
 {
   ReadElement(aStream, mPath);
@@ -645,6 +739,14 @@ RecordedFill::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedFill::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mPath);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 RecordedFillGlyphs::~RecordedFillGlyphs()
 {
   delete [] mGlyphs;
@@ -659,7 +761,7 @@ RecordedFillGlyphs::PlayEvent(Translator *aTranslator) const
   aTranslator->LookupDrawTarget(mDT)->FillGlyphs(aTranslator->LookupScaledFont(mScaledFont), buffer, *GenericPattern(mPattern, aTranslator), mOptions);
 }
 
-RecordedFillGlyphs::RecordedFillGlyphs(istream &aStream)
+RecordedFillGlyphs::RecordedFillGlyphs(MemReader &aStream)
   : RecordedDrawingEvent(FILLGLYPHS, aStream)
 {
   ReadElement(aStream, mScaledFont);
@@ -688,13 +790,21 @@ RecordedFillGlyphs::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedFillGlyphs::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mScaledFont);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 void
 RecordedMask::PlayEvent(Translator *aTranslator) const
 {
   aTranslator->LookupDrawTarget(mDT)->Mask(*GenericPattern(mSource, aTranslator), *GenericPattern(mMask, aTranslator), mOptions);
 }
 
-RecordedMask::RecordedMask(istream &aStream)
+RecordedMask::RecordedMask(MemReader &aStream)
   : RecordedDrawingEvent(MASK, aStream)
 {
   ReadElement(aStream, mOptions);
@@ -720,6 +830,14 @@ RecordedMask::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mMask, aStringStream);
 }
 
+void
+RecordedMask::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  GetPatternObjects(mSource, aObjects);
+  GetPatternObjects(mMask, aObjects);
+}
+
 void
 RecordedStroke::PlayEvent(Translator *aTranslator) const
 {
@@ -736,7 +854,7 @@ RecordedStroke::RecordToStream(ostream &aStream) const
   RecordStrokeOptions(aStream, mStrokeOptions);
 }
 
-RecordedStroke::RecordedStroke(istream &aStream)
+RecordedStroke::RecordedStroke(MemReader &aStream)
   : RecordedDrawingEvent(STROKE, aStream)
 {
   ReadElement(aStream, mPath);
@@ -752,6 +870,14 @@ RecordedStroke::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedStroke::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mPath);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 void
 RecordedClearRect::PlayEvent(Translator *aTranslator) const
 {
@@ -765,7 +891,7 @@ RecordedClearRect::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRect);
 }
 
-RecordedClearRect::RecordedClearRect(istream &aStream)
+RecordedClearRect::RecordedClearRect(MemReader &aStream)
   : RecordedDrawingEvent(CLEARRECT, aStream)
 {
     ReadElement(aStream, mRect);
@@ -793,7 +919,7 @@ RecordedCopySurface::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mDest);
 }
 
-RecordedCopySurface::RecordedCopySurface(istream &aStream)
+RecordedCopySurface::RecordedCopySurface(MemReader &aStream)
   : RecordedDrawingEvent(COPYSURFACE, aStream)
 {
   ReadElement(aStream, mSourceSurface);
@@ -807,6 +933,13 @@ RecordedCopySurface::OutputSimpleEventInfo(stringstream &aStringStream) const
   aStringStream << "[" << mDT<< "] CopySurface (" << mSourceSurface << ")";
 }
 
+void
+RecordedCopySurface::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mSourceSurface);
+}
+
 void
 RecordedPushClip::PlayEvent(Translator *aTranslator) const
 {
@@ -820,7 +953,7 @@ RecordedPushClip::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mPath);
 }
 
-RecordedPushClip::RecordedPushClip(istream &aStream)
+RecordedPushClip::RecordedPushClip(MemReader &aStream)
   : RecordedDrawingEvent(PUSHCLIP, aStream)
 {
   ReadElement(aStream, mPath);
@@ -832,6 +965,13 @@ RecordedPushClip::OutputSimpleEventInfo(stringstream &aStringStream) const
   aStringStream << "[" << mDT << "] PushClip (" << mPath << ") ";
 }
 
+void
+RecordedPushClip::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mPath);
+}
+
 void
 RecordedPushClipRect::PlayEvent(Translator *aTranslator) const
 {
@@ -845,7 +985,7 @@ RecordedPushClipRect::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRect);
 }
 
-RecordedPushClipRect::RecordedPushClipRect(istream &aStream)
+RecordedPushClipRect::RecordedPushClipRect(MemReader &aStream)
   : RecordedDrawingEvent(PUSHCLIPRECT, aStream)
 {
   ReadElement(aStream, mRect);
@@ -869,7 +1009,7 @@ RecordedPopClip::RecordToStream(ostream &aStream) const
   RecordedDrawingEvent::RecordToStream(aStream);
 }
 
-RecordedPopClip::RecordedPopClip(istream &aStream)
+RecordedPopClip::RecordedPopClip(MemReader &aStream)
   : RecordedDrawingEvent(POPCLIP, aStream)
 {
 }
@@ -893,7 +1033,7 @@ RecordedSetTransform::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mTransform);
 }
 
-RecordedSetTransform::RecordedSetTransform(istream &aStream)
+RecordedSetTransform::RecordedSetTransform(MemReader &aStream)
   : RecordedDrawingEvent(SETTRANSFORM, aStream)
 {
   ReadElement(aStream, mTransform);
@@ -925,7 +1065,7 @@ RecordedDrawSurface::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mOptions);
 }
 
-RecordedDrawSurface::RecordedDrawSurface(istream &aStream)
+RecordedDrawSurface::RecordedDrawSurface(MemReader &aStream)
   : RecordedDrawingEvent(DRAWSURFACE, aStream)
 {
   ReadElement(aStream, mRefSource);
@@ -941,6 +1081,13 @@ RecordedDrawSurface::OutputSimpleEventInfo(stringstream &aStringStream) const
   aStringStream << "[" << mDT << "] DrawSurface (" << mRefSource << ")";
 }
 
+void
+RecordedDrawSurface::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mRefSource);
+}
+
 void
 RecordedDrawFilter::PlayEvent(Translator *aTranslator) const
 {
@@ -959,7 +1106,7 @@ RecordedDrawFilter::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mOptions);
 }
 
-RecordedDrawFilter::RecordedDrawFilter(istream &aStream)
+RecordedDrawFilter::RecordedDrawFilter(MemReader &aStream)
   : RecordedDrawingEvent(DRAWFILTER, aStream)
 {
   ReadElement(aStream, mNode);
@@ -974,6 +1121,13 @@ RecordedDrawFilter::OutputSimpleEventInfo(stringstream &aStringStream) const
   aStringStream << "[" << mDT << "] DrawFilter (" << mNode << ")";
 }
 
+void
+RecordedDrawFilter::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mNode);
+}
+
 void
 RecordedDrawSurfaceWithShadow::PlayEvent(Translator *aTranslator) const
 {
@@ -994,7 +1148,7 @@ RecordedDrawSurfaceWithShadow::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mOp);
 }
 
-RecordedDrawSurfaceWithShadow::RecordedDrawSurfaceWithShadow(istream &aStream)
+RecordedDrawSurfaceWithShadow::RecordedDrawSurfaceWithShadow(MemReader &aStream)
   : RecordedDrawingEvent(DRAWSURFACEWITHSHADOW, aStream)
 {
   ReadElement(aStream, mRefSource);
@@ -1012,6 +1166,13 @@ RecordedDrawSurfaceWithShadow::OutputSimpleEventInfo(stringstream &aStringStream
     mColor.r << ", " << mColor.g << ", " << mColor.b << ", " << mColor.a << ")";
 }
 
+void
+RecordedDrawSurfaceWithShadow::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mRefSource);
+}
+
 RecordedPathCreation::RecordedPathCreation(PathRecording *aPath)
   : RecordedEvent(PATHCREATION), mRefPtr(aPath), mFillRule(aPath->mFillRule), mPathOps(aPath->mPathOps)
 {
@@ -1074,7 +1235,7 @@ RecordedPathCreation::RecordToStream(ostream &aStream) const
 
 }
 
-RecordedPathCreation::RecordedPathCreation(istream &aStream)
+RecordedPathCreation::RecordedPathCreation(MemReader &aStream)
   : RecordedEvent(PATHCREATION)
 {
   uint64_t size;
@@ -1118,7 +1279,7 @@ RecordedPathDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedPathDestruction::RecordedPathDestruction(istream &aStream)
+RecordedPathDestruction::RecordedPathDestruction(MemReader &aStream)
   : RecordedEvent(PATHDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1156,12 +1317,13 @@ RecordedSourceSurfaceCreation::RecordToStream(ostream &aStream) const
   }
 }
 
-RecordedSourceSurfaceCreation::RecordedSourceSurfaceCreation(istream &aStream)
+RecordedSourceSurfaceCreation::RecordedSourceSurfaceCreation(MemReader &aStream)
   : RecordedEvent(SOURCESURFACECREATION), mDataOwned(true)
 {
   ReadElement(aStream, mRefPtr);
   ReadElement(aStream, mSize);
   ReadElement(aStream, mFormat);
+  mStride = mSize.width * BytesPerPixel(mFormat);
   mData = (uint8_t*)new char[mSize.width * mSize.height * BytesPerPixel(mFormat)];
   aStream.read((char*)mData, mSize.width * mSize.height * BytesPerPixel(mFormat));
 }
@@ -1172,6 +1334,105 @@ RecordedSourceSurfaceCreation::OutputSimpleEventInfo(stringstream &aStringStream
   aStringStream << "[" << mRefPtr << "] SourceSurface created (Size: " << mSize.width << "x" << mSize.height << ")";
 }
 
+RecordedSurfaceDataStore::~RecordedSurfaceDataStore()
+{
+  if (mDataOwned) {
+    delete [] mData;
+  }
+}
+
+void
+RecordedSurfaceDataStore::PlayEvent(Translator *aTranslator) const
+{
+  RefPtr<SourceSurface> src = aTranslator->GetReferenceDrawTarget()->
+    CreateSourceSurfaceFromData(mData, mSize, mSize.width * BytesPerPixel(mFormat), mFormat);
+  aTranslator->AddStoredSurfaceData(mDataId, src);
+}
+
+void
+RecordedSurfaceDataStore::RecordToStream(ostream &aStream) const
+{
+  WriteElement(aStream, mDataId);
+  WriteElement(aStream, mSize);
+  WriteElement(aStream, mFormat);
+  for (int y = 0; y < mSize.height; y++) {
+    aStream.write((const char*)mData + y * mStride, BytesPerPixel(mFormat) * mSize.width);
+  }
+}
+
+RecordedSurfaceDataStore::RecordedSurfaceDataStore(MemReader &aStream)
+  : RecordedEvent(SURFACEDATASTORE), mDataOwned(true)
+{
+  ReadElement(aStream, mDataId);
+  ReadElement(aStream, mSize);
+  ReadElement(aStream, mFormat);
+  mStride = mSize.width * BytesPerPixel(mFormat);
+  mData = (uint8_t*)new char[mSize.width * mSize.height * BytesPerPixel(mFormat)];
+  aStream.read((char*)mData, mSize.width * mSize.height * BytesPerPixel(mFormat));
+}
+
+void
+RecordedSurfaceDataStore::OutputSimpleEventInfo(stringstream &aStringStream) const
+{
+  aStringStream << "[" << hex << mDataId << dec << "] SurfaceData stored (Size: "
+                << mSize.width << "x" << mSize.height << ")";
+}
+
+void
+RecordedSourceSurfaceFromStoredData::PlayEvent(Translator *aTranslator) const
+{
+  SourceSurface *src = aTranslator->LookupStoredSurfaceData(mDataId);
+  if (!src) {
+    gfxWarning() << "Recording refers to missing surface data " << mDataId;
+  }
+  aTranslator->AddSourceSurface(mRefPtr, src);
+}
+
+void
+RecordedSourceSurfaceFromStoredData::RecordToStream(ostream &aStream) const
+{
+  WriteElement(aStream, mRefPtr);
+  WriteElement(aStream, mDataId);
+}
+
+RecordedSourceSurfaceFromStoredData::RecordedSourceSurfaceFromStoredData(MemReader &aStream)
+  : RecordedEvent(SOURCESURFACEFROMSTOREDDATA)
+{
+  ReadElement(aStream, mRefPtr);
+  ReadElement(aStream, mDataId);
+}
+
+void
+RecordedSourceSurfaceFromStoredData::OutputSimpleEventInfo(stringstream &aStringStream) const
+{
+  aStringStream << "[" << mRefPtr << "] SourceSurface created from stored data "
+                << hex << mDataId << dec;
+}
+
+void
+RecordedSurfaceDataRelease::PlayEvent(Translator *aTranslator) const
+{
+  aTranslator->RemoveStoredSurfaceData(mDataId);
+}
+
+void
+RecordedSurfaceDataRelease::RecordToStream(ostream &aStream) const
+{
+  WriteElement(aStream, mDataId);
+}
+
+RecordedSurfaceDataRelease::RecordedSurfaceDataRelease(MemReader &aStream)
+  : RecordedEvent(SURFACEDATARELEASE)
+{
+  ReadElement(aStream, mDataId);
+}
+
+void
+RecordedSurfaceDataRelease::OutputSimpleEventInfo(stringstream &aStringStream) const
+{
+  aStringStream << "[" << hex << mDataId << dec << "] SurfaceData released";
+}
+
 void
 RecordedSourceSurfaceDestruction::PlayEvent(Translator *aTranslator) const
 {
@@ -1184,7 +1445,7 @@ RecordedSourceSurfaceDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedSourceSurfaceDestruction::RecordedSourceSurfaceDestruction(istream &aStream)
+RecordedSourceSurfaceDestruction::RecordedSourceSurfaceDestruction(MemReader &aStream)
   : RecordedEvent(SOURCESURFACEDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1215,7 +1476,7 @@ RecordedFilterNodeCreation::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mType);
 }
 
-RecordedFilterNodeCreation::RecordedFilterNodeCreation(istream &aStream)
+RecordedFilterNodeCreation::RecordedFilterNodeCreation(MemReader &aStream)
   : RecordedEvent(FILTERNODECREATION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1240,7 +1501,7 @@ RecordedFilterNodeDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedFilterNodeDestruction::RecordedFilterNodeDestruction(istream &aStream)
+RecordedFilterNodeDestruction::RecordedFilterNodeDestruction(MemReader &aStream)
   : RecordedEvent(FILTERNODEDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1276,7 +1537,7 @@ RecordedGradientStopsCreation::RecordToStream(ostream &aStream) const
   aStream.write((const char*)mStops, mNumStops * sizeof(GradientStop));
 }
 
-RecordedGradientStopsCreation::RecordedGradientStopsCreation(istream &aStream)
+RecordedGradientStopsCreation::RecordedGradientStopsCreation(MemReader &aStream)
   : RecordedEvent(GRADIENTSTOPSCREATION), mDataOwned(true)
 {
   ReadElement(aStream, mRefPtr);
@@ -1305,7 +1566,7 @@ RecordedGradientStopsDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedGradientStopsDestruction::RecordedGradientStopsDestruction(istream &aStream)
+RecordedGradientStopsDestruction::RecordedGradientStopsDestruction(MemReader &aStream)
   : RecordedEvent(GRADIENTSTOPSDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1331,7 +1592,7 @@ RecordedSnapshot::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mDT);
 }
 
-RecordedSnapshot::RecordedSnapshot(istream &aStream)
+RecordedSnapshot::RecordedSnapshot(MemReader &aStream)
   : RecordedEvent(SNAPSHOT)
 {
   ReadElement(aStream, mRefPtr);
@@ -1344,6 +1605,13 @@ RecordedSnapshot::OutputSimpleEventInfo(stringstream &aStringStream) const
   aStringStream << "[" << mRefPtr << "] Snapshot Created (DT: " << mDT << ")";
 }
 
+void
+RecordedSnapshot::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mRefPtr);
+  aObjects.push_back(mDT);
+}
+
 RecordedScaledFontCreation::~RecordedScaledFontCreation()
 {
   delete [] mData;
@@ -1384,7 +1652,7 @@ RecordedScaledFontCreation::SetFontData(const uint8_t *aData, uint32_t aSize, ui
   mGlyphSize = aGlyphSize;
 }
 
-RecordedScaledFontCreation::RecordedScaledFontCreation(istream &aStream)
+RecordedScaledFontCreation::RecordedScaledFontCreation(MemReader &aStream)
   : RecordedEvent(SCALEDFONTCREATION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1407,7 +1675,7 @@ RecordedScaledFontDestruction::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mRefPtr);
 }
 
-RecordedScaledFontDestruction::RecordedScaledFontDestruction(istream &aStream)
+RecordedScaledFontDestruction::RecordedScaledFontDestruction(MemReader &aStream)
   : RecordedEvent(SCALEDFONTDESTRUCTION)
 {
   ReadElement(aStream, mRefPtr);
@@ -1438,7 +1706,7 @@ RecordedMaskSurface::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mOptions);
 }
 
-RecordedMaskSurface::RecordedMaskSurface(istream &aStream)
+RecordedMaskSurface::RecordedMaskSurface(MemReader &aStream)
   : RecordedDrawingEvent(MASKSURFACE, aStream)
 {
   ReadPatternData(aStream, mPattern);
@@ -1454,6 +1722,14 @@ RecordedMaskSurface::OutputSimpleEventInfo(stringstream &aStringStream) const
   OutputSimplePatternInfo(mPattern, aStringStream);
 }
 
+void
+RecordedMaskSurface::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mDT);
+  aObjects.push_back(mRefMask);
+  GetPatternObjects(mPattern, aObjects);
+}
+
 template<typename T>
 void
 ReplaySetAttribute(FilterNode *aNode, uint32_t aIndex, T aValue)
@@ -1502,7 +1778,7 @@ RecordedFilterNodeSetAttribute::RecordToStream(ostream &aStream) const
   aStream.write((const char*)&mPayload.front(), mPayload.size());
 }
 
-RecordedFilterNodeSetAttribute::RecordedFilterNodeSetAttribute(istream &aStream)
+RecordedFilterNodeSetAttribute::RecordedFilterNodeSetAttribute(MemReader &aStream)
   : RecordedEvent(FILTERNODESETATTRIBUTE)
 {
   ReadElement(aStream, mNode);
@@ -1542,7 +1818,7 @@ RecordedFilterNodeSetInput::RecordToStream(ostream &aStream) const
   WriteElement(aStream, mInputSurface);
 }
 
-RecordedFilterNodeSetInput::RecordedFilterNodeSetInput(istream &aStream)
+RecordedFilterNodeSetInput::RecordedFilterNodeSetInput(MemReader &aStream)
   : RecordedEvent(FILTERNODESETINPUT)
 {
   ReadElement(aStream, mNode);
@@ -1565,5 +1841,12 @@ RecordedFilterNodeSetInput::OutputSimpleEventInfo(stringstream &aStringStream) c
   aStringStream << ")";
 }
 
+void
+RecordedFilterNodeSetInput::GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+{
+  aObjects.push_back(mNode);
+  aObjects.push_back(mInputFilter ? mInputFilter : mInputSurface);
+}
+
 }
 }
@@ -10,6 +10,7 @@
 #include <ostream>
 #include <sstream>
 #include <cstring>
+#include <new>
 #include "RecordingTypes.h"
 #include "PathRecording.h"
 
@@ -23,7 +24,7 @@ namespace gfx {
 const uint16_t kMajorRevision = 3;
 // A change in minor revision means additions of new events. New streams will
 // not play in older players.
-const uint16_t kMinorRevision = 2;
+const uint16_t kMinorRevision = 4;
 
 struct ReferencePtr
 {
@@ -90,6 +91,12 @@ public:
   virtual void AddScaledFont(ReferencePtr aRefPtr, ScaledFont *aScaledFont) = 0;
   virtual void RemoveScaledFont(ReferencePtr aRefPtr) = 0;
 
+  // Surfaces holding pixel data that is shared between several recorded
+  // source surfaces, keyed by the content hash of that data.
+  virtual SourceSurface *LookupStoredSurfaceData(uint64_t aDataId) = 0;
+  virtual void AddStoredSurfaceData(uint64_t aDataId, SourceSurface *aSurface) = 0;
+  virtual void RemoveStoredSurfaceData(uint64_t aDataId) = 0;
+
   virtual DrawTarget *GetReferenceDrawTarget() = 0;
   virtual FontType GetDesiredFontType() = 0;
 };
@@ -137,6 +144,8 @@ struct PatternStorage
   };
 };
 
+class RecordedEventArena;
+
 class RecordedEvent {
 public:
   enum EventType {
@@ -171,9 +180,14 @@ public:
     FILTERNODEDESTRUCTION,
     DRAWFILTER,
     FILTERNODESETATTRIBUTE,
-    FILTERNODESETINPUT
+    FILTERNODESETINPUT,
+    SURFACEDATASTORE,
+    SOURCESURFACEFROMSTOREDDATA,
+    SURFACEDATARELEASE
   };
-  static const uint32_t kTotalEventTypes = RecordedEvent::FILTERNODESETINPUT + 1;
+  static const uint32_t kTotalEventTypes = RecordedEvent::SURFACEDATARELEASE + 1;
+
+  virtual ~RecordedEvent() {}
 
   static std::string GetEventName(EventType aType);
 
@@ -184,10 +198,10 @@ public:
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const { }
 
   void RecordPatternData(std::ostream &aStream, const PatternStorage &aPatternStorage) const;
-  void ReadPatternData(std::istream &aStream, PatternStorage &aPatternStorage) const;
+  void ReadPatternData(MemReader &aStream, PatternStorage &aPatternStorage) const;
   void StorePattern(PatternStorage &aDestination, const Pattern &aSource) const;
   void RecordStrokeOptions(std::ostream &aStream, const StrokeOptions &aStrokeOptions) const;
-  void ReadStrokeOptions(std::istream &aStream, StrokeOptions &aStrokeOptions);
+  void ReadStrokeOptions(MemReader &aStream, StrokeOptions &aStrokeOptions);
 
   virtual std::string GetName() const = 0;
 
@@ -195,9 +209,25 @@ public:
 
   virtual ReferencePtr GetDestinedDT() { return nullptr; }
 
+  /* Appends every recorded object this event uses to aObjects, including the
+   * draw target it draws to and the object it creates or destroys. Playback
+   * uses this to find out which events depend on each other.
+   */
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const
+  {
+    aObjects.push_back(GetObjectRef());
+  }
+
+  void GetPatternObjects(const PatternStorage &aStorage, std::vector<ReferencePtr> &aObjects) const;
+
   void OutputSimplePatternInfo(const PatternStorage &aStorage, std::stringstream &aOutput) const;
 
-  static RecordedEvent *LoadEventFromStream(std::istream &aStream, EventType aType);
+  /* Decodes an event of type aType from aStream and constructs it in aArena,
+   * which owns it from then on. Returns nullptr for unknown types. Whether
+   * the event was complete has to be checked on aStream.
+   */
+  static RecordedEvent *LoadEvent(MemReader &aStream, EventType aType,
+                                  RecordedEventArena &aArena);
 
   EventType GetType() { return (EventType)mType; }
 protected:
@@ -210,6 +240,39 @@ protected:
   std::vector<Float> mDashPatternStorage;
 };
 
+/* Owns decoded events. Rather than being allocated one by one, events are
+ * constructed one after the other in large blocks, and they're all destroyed
+ * along with the arena. Events in an arena must not be deleted by themselves.
+ * An arena must only be used by one thread at a time.
+ */
+class RecordedEventArena
+{
+public:
+  RecordedEventArena();
+  ~RecordedEventArena();
+
+  // Returns memory for an event of aSize bytes, which must be handed to
+  // Adopt once it's constructed.
+  void *Allocate(size_t aSize);
+
+  RecordedEvent *Adopt(RecordedEvent *aEvent)
+  {
+    mEvents.push_back(aEvent);
+    return aEvent;
+  }
+
+  // Makes room for aCount more events without reallocating.
+  void Reserve(size_t aCount) { mEvents.reserve(mEvents.size() + aCount); }
+
+private:
+  RecordedEventArena(const RecordedEventArena&) MOZ_DELETE;
+  RecordedEventArena& operator=(const RecordedEventArena&) MOZ_DELETE;
+
+  std::vector<char*> mBlocks;
+  size_t mBlockUsed;
+  std::vector<RecordedEvent*> mEvents;
+};
+
 class RecordedDrawingEvent : public RecordedEvent
 {
 public:
@@ -221,7 +284,7 @@ protected:
   {
   }
 
-  RecordedDrawingEvent(EventType aType, std::istream &aStream);
+  RecordedDrawingEvent(EventType aType, MemReader &aStream);
   virtual void RecordToStream(std::ostream &aStream) const;
 
   virtual ReferencePtr GetObjectRef() const;
@@ -255,7 +318,7 @@ public:
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedDrawTargetCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedDrawTargetCreation(MemReader &aStream);
 };
 
 class RecordedDrawTargetDestruction : public RecordedEvent {
@@ -278,7 +341,7 @@ public:
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedDrawTargetDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedDrawTargetDestruction(MemReader &aStream);
 };
 
 class RecordedFillRect : public RecordedDrawingEvent {
@@ -293,12 +356,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "FillRect"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedFillRect(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFillRect(MemReader &aStream);
 
   Rect mRect;
   PatternStorage mPattern;
@@ -319,12 +383,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "StrokeRect"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedStrokeRect(std::istream &aStream);
+  MOZ_IMPLICIT RecordedStrokeRect(MemReader &aStream);
 
   Rect mRect;
   PatternStorage mPattern;
@@ -347,12 +412,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "StrokeLine"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedStrokeLine(std::istream &aStream);
+  MOZ_IMPLICIT RecordedStrokeLine(MemReader &aStream);
 
   Point mBegin;
   Point mEnd;
@@ -373,12 +439,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "Fill"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedFill(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFill(MemReader &aStream);
 
   ReferencePtr mPath;
   PatternStorage mPattern;
@@ -402,12 +469,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "FillGlyphs"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedFillGlyphs(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFillGlyphs(MemReader &aStream);
 
   ReferencePtr mScaledFont;
   PatternStorage mPattern;
@@ -429,12 +497,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "Mask"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedMask(std::istream &aStream);
+  MOZ_IMPLICIT RecordedMask(MemReader &aStream);
 
   PatternStorage mSource;
   PatternStorage mMask;
@@ -455,12 +524,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "Stroke"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedStroke(std::istream &aStream);
+  MOZ_IMPLICIT RecordedStroke(MemReader &aStream);
 
   ReferencePtr mPath;
   PatternStorage mPattern;
@@ -484,7 +554,7 @@ public:
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedClearRect(std::istream &aStream);
+  MOZ_IMPLICIT RecordedClearRect(MemReader &aStream);
 
   Rect mRect;
 };
@@ -502,12 +572,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "CopySurface"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedCopySurface(std::istream &aStream);
+  MOZ_IMPLICIT RecordedCopySurface(MemReader &aStream);
 
   ReferencePtr mSourceSurface;
   IntRect mSourceRect;
@@ -525,12 +596,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "PushClip"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedPushClip(std::istream &aStream);
+  MOZ_IMPLICIT RecordedPushClip(MemReader &aStream);
 
   ReferencePtr mPath;
 };
@@ -551,7 +623,7 @@ public:
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedPushClipRect(std::istream &aStream);
+  MOZ_IMPLICIT RecordedPushClipRect(MemReader &aStream);
 
   Rect mRect;
 };
@@ -571,7 +643,7 @@ public:
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedPopClip(std::istream &aStream);
+  MOZ_IMPLICIT RecordedPopClip(MemReader &aStream);
 };
 
 class RecordedSetTransform : public RecordedDrawingEvent {
@@ -590,7 +662,7 @@ public:
 private:
   friend class RecordedEvent;
 
-   MOZ_IMPLICIT RecordedSetTransform(std::istream &aStream);
+   MOZ_IMPLICIT RecordedSetTransform(MemReader &aStream);
 
   Matrix mTransform;
 };
@@ -609,12 +681,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
   
   virtual std::string GetName() const { return "DrawSurface"; }
 private:
   friend class RecordedEvent;
 
-   MOZ_IMPLICIT RecordedDrawSurface(std::istream &aStream);
+   MOZ_IMPLICIT RecordedDrawSurface(MemReader &aStream);
 
   ReferencePtr mRefSource;
   Rect mDest;
@@ -637,12 +710,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
   
   virtual std::string GetName() const { return "DrawSurfaceWithShadow"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedDrawSurfaceWithShadow(std::istream &aStream);
+  MOZ_IMPLICIT RecordedDrawSurfaceWithShadow(MemReader &aStream);
 
   ReferencePtr mRefSource;
   Point mDest;
@@ -667,12 +741,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "DrawFilter"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedDrawFilter(std::istream &aStream);
+  MOZ_IMPLICIT RecordedDrawFilter(MemReader &aStream);
 
   ReferencePtr mNode;
   Rect mSourceRect;
@@ -699,7 +774,7 @@ private:
   FillRule mFillRule;
   std::vector<PathOp> mPathOps;
 
-  MOZ_IMPLICIT RecordedPathCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedPathCreation(MemReader &aStream);
 };
 
 class RecordedPathDestruction : public RecordedEvent {
@@ -721,7 +796,7 @@ private:
 
   ReferencePtr mRefPtr;
 
-  MOZ_IMPLICIT RecordedPathDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedPathDestruction(MemReader &aStream);
 };
 
 class RecordedSourceSurfaceCreation : public RecordedEvent {
@@ -752,7 +827,93 @@ private:
   SurfaceFormat mFormat;
   bool mDataOwned;
 
-  MOZ_IMPLICIT RecordedSourceSurfaceCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedSourceSurfaceCreation(MemReader &aStream);
+};
+
+/* Stores a copy of pixel data under its content hash so that any number of
+ * later RecordedSourceSurfaceFromStoredData events can refer to it without
+ * repeating the data.
+ */
+class RecordedSurfaceDataStore : public RecordedEvent {
+public:
+  RecordedSurfaceDataStore(uint64_t aDataId, uint8_t *aData, int32_t aStride,
+                           const IntSize &aSize, SurfaceFormat aFormat)
+    : RecordedEvent(SURFACEDATASTORE), mDataId(aDataId), mData(aData)
+    , mStride(aStride), mSize(aSize), mFormat(aFormat), mDataOwned(false)
+  {
+  }
+
+  ~RecordedSurfaceDataStore();
+
+  virtual void PlayEvent(Translator *aTranslator) const;
+
+  virtual void RecordToStream(std::ostream &aStream) const;
+  virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+
+  virtual std::string GetName() const { return "SurfaceData Store"; }
+  virtual ReferencePtr GetObjectRef() const { return nullptr; }
+
+  uint64_t GetDataId() const { return mDataId; }
+private:
+  friend class RecordedEvent;
+
+  uint64_t mDataId;
+  uint8_t *mData;
+  int32_t mStride;
+  IntSize mSize;
+  SurfaceFormat mFormat;
+  bool mDataOwned;
+
+  MOZ_IMPLICIT RecordedSurfaceDataStore(MemReader &aStream);
+};
+
+class RecordedSourceSurfaceFromStoredData : public RecordedEvent {
+public:
+  RecordedSourceSurfaceFromStoredData(ReferencePtr aRefPtr, uint64_t aDataId)
+    : RecordedEvent(SOURCESURFACEFROMSTOREDDATA), mRefPtr(aRefPtr), mDataId(aDataId)
+  {
+  }
+
+  virtual void PlayEvent(Translator *aTranslator) const;
+
+  virtual void RecordToStream(std::ostream &aStream) const;
+  virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+
+  virtual std::string GetName() const { return "SourceSurface From Stored Data"; }
+  virtual ReferencePtr GetObjectRef() const { return mRefPtr; }
+
+  uint64_t GetDataId() const { return mDataId; }
+private:
+  friend class RecordedEvent;
+
+  ReferencePtr mRefPtr;
+  uint64_t mDataId;
+
+  MOZ_IMPLICIT RecordedSourceSurfaceFromStoredData(MemReader &aStream);
+};
+
+class RecordedSurfaceDataRelease : public RecordedEvent {
+public:
+  MOZ_IMPLICIT RecordedSurfaceDataRelease(uint64_t aDataId)
+    : RecordedEvent(SURFACEDATARELEASE), mDataId(aDataId)
+  {
+  }
+
+  virtual void PlayEvent(Translator *aTranslator) const;
+
+  virtual void RecordToStream(std::ostream &aStream) const;
+  virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+
+  virtual std::string GetName() const { return "SurfaceData Release"; }
+  virtual ReferencePtr GetObjectRef() const { return nullptr; }
+
+  uint64_t GetDataId() const { return mDataId; }
+private:
+  friend class RecordedEvent;
+
+  uint64_t mDataId;
+
+  MOZ_IMPLICIT RecordedSurfaceDataRelease(MemReader &aStream);
 };
 
 class RecordedSourceSurfaceDestruction : public RecordedEvent {
@@ -774,7 +935,7 @@ private:
 
   ReferencePtr mRefPtr;
 
-  MOZ_IMPLICIT RecordedSourceSurfaceDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedSourceSurfaceDestruction(MemReader &aStream);
 };
 
 class RecordedFilterNodeCreation : public RecordedEvent {
@@ -799,7 +960,7 @@ private:
   ReferencePtr mRefPtr;
   FilterType mType;
 
-  MOZ_IMPLICIT RecordedFilterNodeCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFilterNodeCreation(MemReader &aStream);
 };
 
 class RecordedFilterNodeDestruction : public RecordedEvent {
@@ -821,7 +982,7 @@ private:
 
   ReferencePtr mRefPtr;
 
-  MOZ_IMPLICIT RecordedFilterNodeDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFilterNodeDestruction(MemReader &aStream);
 };
 
 class RecordedGradientStopsCreation : public RecordedEvent {
@@ -851,7 +1012,7 @@ private:
   ExtendMode mExtendMode;
   bool mDataOwned;
 
-  MOZ_IMPLICIT RecordedGradientStopsCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedGradientStopsCreation(MemReader &aStream);
 };
 
 class RecordedGradientStopsDestruction : public RecordedEvent {
@@ -873,7 +1034,7 @@ private:
 
   ReferencePtr mRefPtr;
 
-  MOZ_IMPLICIT RecordedGradientStopsDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedGradientStopsDestruction(MemReader &aStream);
 };
 
 class RecordedSnapshot : public RecordedEvent {
@@ -887,6 +1048,7 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
   
   virtual std::string GetName() const { return "Snapshot"; }
   virtual ReferencePtr GetObjectRef() const { return mRefPtr; }
@@ -896,7 +1058,7 @@ private:
   ReferencePtr mRefPtr;
   ReferencePtr mDT;
 
-  MOZ_IMPLICIT RecordedSnapshot(std::istream &aStream);
+  MOZ_IMPLICIT RecordedSnapshot(MemReader &aStream);
 };
 
 class RecordedScaledFontCreation : public RecordedEvent {
@@ -933,7 +1095,7 @@ private:
   Float mGlyphSize;
   uint32_t mIndex;
 
-  MOZ_IMPLICIT RecordedScaledFontCreation(std::istream &aStream);
+  MOZ_IMPLICIT RecordedScaledFontCreation(MemReader &aStream);
 };
 
 class RecordedScaledFontDestruction : public RecordedEvent {
@@ -955,7 +1117,7 @@ private:
 
   ReferencePtr mRefPtr;
 
-  MOZ_IMPLICIT RecordedScaledFontDestruction(std::istream &aStream);
+  MOZ_IMPLICIT RecordedScaledFontDestruction(MemReader &aStream);
 };
 
 class RecordedMaskSurface : public RecordedDrawingEvent {
@@ -972,12 +1134,13 @@ public:
 
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
   
   virtual std::string GetName() const { return "MaskSurface"; }
 private:
   friend class RecordedEvent;
 
-  MOZ_IMPLICIT RecordedMaskSurface(std::istream &aStream);
+  MOZ_IMPLICIT RecordedMaskSurface(MemReader &aStream);
 
   PatternStorage mPattern;
   ReferencePtr mRefMask;
@@ -1036,7 +1199,7 @@ private:
   ArgType mArgType;
   std::vector<uint8_t> mPayload;
 
-  MOZ_IMPLICIT RecordedFilterNodeSetAttribute(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFilterNodeSetAttribute(MemReader &aStream);
 };
 
 class RecordedFilterNodeSetInput : public RecordedEvent
@@ -1057,6 +1220,7 @@ public:
   virtual void PlayEvent(Translator *aTranslator) const;
   virtual void RecordToStream(std::ostream &aStream) const;
   virtual void OutputSimpleEventInfo(std::stringstream &aStringStream) const;
+  virtual void GetReferencedObjects(std::vector<ReferencePtr> &aObjects) const;
 
   virtual std::string GetName() const { return "SetInput"; }
 
@@ -1070,7 +1234,7 @@ private:
   ReferencePtr mInputFilter;
   ReferencePtr mInputSurface;
 
-  MOZ_IMPLICIT RecordedFilterNodeSetInput(std::istream &aStream);
+  MOZ_IMPLICIT RecordedFilterNodeSetInput(MemReader &aStream);
 };
 
 }
@@ -0,0 +1,453 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RecordedEventGraph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <set>
+
+namespace mozilla {
+namespace gfx {
+
+namespace {
+
+// Recorded objects, stored surface data and the reference draw target are
+// tracked in separate namespaces.
+enum UsageKind
+{
+  USAGE_OBJECT,
+  USAGE_SURFACE_DATA,
+  USAGE_REFERENCE_DRAWTARGET
+};
+
+typedef std::pair<uint32_t, uint64_t> Usage;
+// What every object shares data with after playback.
+typedef std::map<Usage, std::vector<Usage> > SharedDataMap;
+
+const uint32_t kNoEvent = UINT32_MAX;
+
+void
+AddUsage(const SharedDataMap &aSharedData, const Usage &aUsage, std::vector<Usage> &aUsages)
+{
+  // This also stops at cycles, which can occur when an address is reused.
+  if (std::find(aUsages.begin(), aUsages.end(), aUsage) != aUsages.end()) {
+    return;
+  }
+  aUsages.push_back(aUsage);
+
+  SharedDataMap::const_iterator iter = aSharedData.find(aUsage);
+  if (iter == aSharedData.end()) {
+    return;
+  }
+  for (size_t i = 0; i < iter->second.size(); i++) {
+    AddUsage(aSharedData, iter->second[i], aUsages);
+  }
+}
+
+// Events that create an object from scratch, any earlier object at the same
+// address is gone.
+bool
+CreatesObject(RecordedEvent::EventType aType)
+{
+  switch (aType) {
+  case RecordedEvent::DRAWTARGETCREATION:
+  case RecordedEvent::PATHCREATION:
+  case RecordedEvent::SOURCESURFACECREATION:
+  case RecordedEvent::SOURCESURFACEFROMSTOREDDATA:
+  case RecordedEvent::GRADIENTSTOPSCREATION:
+  case RecordedEvent::SNAPSHOT:
+  case RecordedEvent::SCALEDFONTCREATION:
+  case RecordedEvent::FILTERNODECREATION:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Events that create their object through the reference draw target or the
+// Factory.
+bool
+UsesReferenceDrawTarget(RecordedEvent::EventType aType)
+{
+  switch (aType) {
+  case RecordedEvent::DRAWTARGETCREATION:
+  case RecordedEvent::PATHCREATION:
+  case RecordedEvent::SOURCESURFACECREATION:
+  case RecordedEvent::GRADIENTSTOPSCREATION:
+  case RecordedEvent::SCALEDFONTCREATION:
+  case RecordedEvent::FILTERNODECREATION:
+  case RecordedEvent::SURFACEDATASTORE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+uint64_t
+GetSurfaceDataId(RecordedEvent *aEvent)
+{
+  switch (aEvent->GetType()) {
+  case RecordedEvent::SURFACEDATASTORE:
+    return static_cast<RecordedSurfaceDataStore*>(aEvent)->GetDataId();
+  case RecordedEvent::SOURCESURFACEFROMSTOREDDATA:
+    return static_cast<RecordedSourceSurfaceFromStoredData*>(aEvent)->GetDataId();
+  case RecordedEvent::SURFACEDATARELEASE:
+    return static_cast<RecordedSurfaceDataRelease*>(aEvent)->GetDataId();
+  default:
+    return 0;
+  }
+}
+
+}
+
+RecordedEventGraph::RecordedEventGraph(const std::vector<RecordedEvent*> &aEvents)
+  : mDependents(aEvents.size())
+  , mDependencyCounts(aEvents.size(), 0)
+  , mDependencyCount(0)
+{
+  // The last event that used every object so far.
+  std::map<Usage, uint32_t> lastUses;
+  SharedDataMap sharedData;
+  std::set<void*> drawTargets;
+
+  std::vector<ReferencePtr> objects;
+  std::vector<Usage> usages;
+  std::vector<uint32_t> dependencies;
+
+  for (uint32_t i = 0; i < aEvents.size(); i++) {
+    RecordedEvent *event = aEvents[i];
+    RecordedEvent::EventType type = event->GetType();
+    Usage object(USAGE_OBJECT, event->GetObjectRef().mLongPtr);
+
+    if (CreatesObject(type)) {
+      sharedData.erase(object);
+    }
+    if (event->GetDestinedDT()) {
+      drawTargets.insert(event->GetDestinedDT());
+    }
+
+    objects.clear();
+    event->GetReferencedObjects(objects);
+    usages.clear();
+    for (size_t j = 0; j < objects.size(); j++) {
+      if (objects[j]) {
+        AddUsage(sharedData, Usage(USAGE_OBJECT, objects[j].mLongPtr), usages);
+      }
+    }
+    if (uint64_t dataId = GetSurfaceDataId(event)) {
+      usages.push_back(Usage(USAGE_SURFACE_DATA, dataId));
+    }
+    if (UsesReferenceDrawTarget(type)) {
+      usages.push_back(Usage(USAGE_REFERENCE_DRAWTARGET, 0));
+    }
+
+    dependencies.clear();
+    for (size_t j = 0; j < usages.size(); j++) {
+      std::pair<std::map<Usage, uint32_t>::iterator, bool> inserted =
+        lastUses.insert(std::make_pair(usages[j], i));
+      if (!inserted.second) {
+        dependencies.push_back(inserted.first->second);
+        inserted.first->second = i;
+      }
+    }
+    std::sort(dependencies.begin(), dependencies.end());
+    dependencies.erase(std::unique(dependencies.begin(), dependencies.end()),
+                       dependencies.end());
+    for (size_t j = 0; j < dependencies.size(); j++) {
+      mDependents[dependencies[j]].push_back(i);
+    }
+    mDependencyCounts[i] = dependencies.size();
+    mDependencyCount += dependencies.size();
+
+    // A snapshot shares data with its draw target, a filter with its inputs
+    // and a surface with the stored data it was created from.
+    if (type == RecordedEvent::SNAPSHOT ||
+        type == RecordedEvent::FILTERNODESETINPUT ||
+        type == RecordedEvent::SOURCESURFACEFROMSTOREDDATA) {
+      std::vector<Usage> &shared = sharedData[object];
+      for (size_t j = 0; j < usages.size(); j++) {
+        if (usages[j] != object &&
+            std::find(shared.begin(), shared.end(), usages[j]) == shared.end()) {
+          shared.push_back(usages[j]);
+        }
+      }
+    }
+  }
+
+  mDrawTargetCount = drawTargets.size();
+}
+
+void
+RecordedEventGraph::Play(WorkerPool *aPool, const PlayFunc &aPlay) const
+{
+  uint32_t eventCount = mDependents.size();
+
+  if (!aPool) {
+    // Dependencies always come first in the recording.
+    for (uint32_t i = 0; i < eventCount; i++) {
+      aPlay(i);
+    }
+    return;
+  }
+
+  std::vector<std::atomic<uint32_t> > remaining(eventCount);
+  for (uint32_t i = 0; i < eventCount; i++) {
+    remaining[i] = mDependencyCounts[i];
+  }
+
+  TaskGroup group(aPool);
+  std::function<void(uint32_t)> playFrom = [&] (uint32_t aEvent) {
+    // Keep going with the earliest event that became ready, that's usually
+    // the next one drawing to the same draw target. Everything else that
+    // became ready goes to the pool.
+    while (aEvent != kNoEvent) {
+      aPlay(aEvent);
+
+      uint32_t next = kNoEvent;
+      const std::vector<uint32_t> &dependents = mDependents[aEvent];
+      for (size_t i = 0; i < dependents.size(); i++) {
+        uint32_t dependent = dependents[i];
+        if (--remaining[dependent]) {
+          continue;
+        }
+        if (next == kNoEvent) {
+          next = dependent;
+        } else {
+          group.Dispatch([&playFrom, dependent] () { playFrom(dependent); });
+        }
+      }
+      aEvent = next;
+    }
+  };
+
+  for (uint32_t i = 0; i < eventCount; i++) {
+    if (!mDependencyCounts[i]) {
+      group.Dispatch([&playFrom, i] () { playFrom(i); });
+    }
+  }
+  group.Wait();
+}
+
+void
+RecordedEventGraph::Play(WorkerPool *aPool, const std::vector<RecordedEvent*> &aEvents,
+                         Translator *aTranslator) const
+{
+  MOZ_ASSERT(aEvents.size() == mDependents.size());
+
+  std::mutex lock;
+  Play(aPool, [&] (uint32_t aEvent) {
+    SynchronizedTranslator translator(aTranslator, &lock);
+    aEvents[aEvent]->PlayEvent(&translator);
+  });
+}
+
+double
+RecordedEventGraph::GetCriticalPathLength(const std::vector<double> &aDurations) const
+{
+  MOZ_ASSERT(aDurations.size() == mDependents.size());
+
+  // The earliest time every event can start at. A single pass in recording
+  // order works as events only depend on earlier ones.
+  std::vector<double> start(mDependents.size(), 0);
+  double length = 0;
+  for (size_t i = 0; i < mDependents.size(); i++) {
+    double end = start[i] + aDurations[i];
+    length = std::max(length, end);
+    for (size_t j = 0; j < mDependents[i].size(); j++) {
+      uint32_t dependent = mDependents[i][j];
+      start[dependent] = std::max(start[dependent], end);
+    }
+  }
+  return length;
+}
+
+DrawTarget*
+SynchronizedTranslator::LookupDrawTarget(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupDrawTarget(aRefPtr);
+}
+
+Path*
+SynchronizedTranslator::LookupPath(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupPath(aRefPtr);
+}
+
+SourceSurface*
+SynchronizedTranslator::LookupSourceSurface(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupSourceSurface(aRefPtr);
+}
+
+FilterNode*
+SynchronizedTranslator::LookupFilterNode(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupFilterNode(aRefPtr);
+}
+
+GradientStops*
+SynchronizedTranslator::LookupGradientStops(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupGradientStops(aRefPtr);
+}
+
+ScaledFont*
+SynchronizedTranslator::LookupScaledFont(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupScaledFont(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddDrawTarget(ReferencePtr aRefPtr, DrawTarget *aDT)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddDrawTarget(aRefPtr, aDT);
+}
+
+void
+SynchronizedTranslator::RemoveDrawTarget(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveDrawTarget(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddPath(ReferencePtr aRefPtr, Path *aPath)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddPath(aRefPtr, aPath);
+}
+
+void
+SynchronizedTranslator::RemovePath(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemovePath(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddSourceSurface(ReferencePtr aRefPtr, SourceSurface *aSurface)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddSourceSurface(aRefPtr, aSurface);
+}
+
+void
+SynchronizedTranslator::RemoveSourceSurface(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveSourceSurface(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddFilterNode(ReferencePtr aRefPtr, FilterNode *aFilter)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddFilterNode(aRefPtr, aFilter);
+}
+
+void
+SynchronizedTranslator::RemoveFilterNode(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveFilterNode(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddGradientStops(ReferencePtr aRefPtr, GradientStops *aStops)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddGradientStops(aRefPtr, aStops);
+}
+
+void
+SynchronizedTranslator::RemoveGradientStops(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveGradientStops(aRefPtr);
+}
+
+void
+SynchronizedTranslator::AddScaledFont(ReferencePtr aRefPtr, ScaledFont *aScaledFont)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddScaledFont(aRefPtr, aScaledFont);
+}
+
+void
+SynchronizedTranslator::RemoveScaledFont(ReferencePtr aRefPtr)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveScaledFont(aRefPtr);
+}
+
+SourceSurface*
+SynchronizedTranslator::LookupStoredSurfaceData(uint64_t aDataId)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->LookupStoredSurfaceData(aDataId);
+}
+
+void
+SynchronizedTranslator::AddStoredSurfaceData(uint64_t aDataId, SourceSurface *aSurface)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->AddStoredSurfaceData(aDataId, aSurface);
+}
+
+void
+SynchronizedTranslator::RemoveStoredSurfaceData(uint64_t aDataId)
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  mTranslator->RemoveStoredSurfaceData(aDataId);
+}
+
+DrawTarget*
+SynchronizedTranslator::GetReferenceDrawTarget()
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->GetReferenceDrawTarget();
+}
+
+FontType
+SynchronizedTranslator::GetDesiredFontType()
+{
+  std::lock_guard<std::mutex> lock(*mLock);
+  WillForward();
+  return mTranslator->GetDesiredFontType();
+}
+
+}
+}
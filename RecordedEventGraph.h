@@ -0,0 +1,131 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_RECORDEDEVENTGRAPH_H_
+#define MOZILLA_GFX_RECORDEDEVENTGRAPH_H_
+
+#include "RecordedEvent.h"
+#include "WorkerPool.h"
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+/**
+ * The dependencies between the events of a recording, used to play back the
+ * events drawing to independent draw targets concurrently.
+ *
+ * Two events depend on each other when they use the same recorded object, as
+ * reported by RecordedEvent::GetReferencedObjects. Some objects share data
+ * with others after playback: a snapshot with the draw target it was taken
+ * from, a filter with its inputs and a surface with the stored surface data
+ * it was created from. Using such an object counts as using the objects it
+ * shares data with. Events that create objects go through the reference draw
+ * target, they all depend on each other as well.
+ *
+ * Every object is therefore used by one event at a time, in recording order,
+ * which matters since most objects use non-atomic reference counting. Events
+ * that have nothing in common can run in any order.
+ */
+class RecordedEventGraph
+{
+public:
+  typedef std::function<void(uint32_t aEvent)> PlayFunc;
+
+  /**
+   * Builds the graph for aEvents. The events are only used while the graph is
+   * being built.
+   */
+  explicit RecordedEventGraph(const std::vector<RecordedEvent*> &aEvents);
+
+  /**
+   * Calls aPlay with the index of every event, each once all events it
+   * depends on have been played, and returns when all of them have been.
+   * With a null pool the events are played in recording order on the calling
+   * thread.
+   */
+  void Play(WorkerPool *aPool, const PlayFunc &aPlay) const;
+
+  /**
+   * Plays aEvents, which must be the events the graph was built for, through
+   * aTranslator. Calls to the translator are serialized.
+   */
+  void Play(WorkerPool *aPool, const std::vector<RecordedEvent*> &aEvents,
+            Translator *aTranslator) const;
+
+  uint32_t GetEventCount() const { return mDependents.size(); }
+  uint32_t GetDependencyCount() const { return mDependencyCount; }
+  // The number of different draw targets that are drawn to.
+  uint32_t GetDrawTargetCount() const { return mDrawTargetCount; }
+
+  /**
+   * Returns the length of the longest chain of dependent events, where event
+   * i takes aDurations[i]. No schedule can play the events in less time.
+   */
+  double GetCriticalPathLength(const std::vector<double> &aDurations) const;
+
+private:
+  std::vector<std::vector<uint32_t> > mDependents;
+  std::vector<uint32_t> mDependencyCounts;
+  uint32_t mDependencyCount;
+  uint32_t mDrawTargetCount;
+};
+
+/**
+ * A translator that forwards all calls to another translator while holding a
+ * lock, so that events played on different threads can share it. The objects
+ * returned by lookups aren't protected by the lock, RecordedEventGraph makes
+ * sure no two threads use one at the same time.
+ *
+ * This is meant to be created on the stack for every event that is played.
+ */
+class SynchronizedTranslator : public Translator
+{
+public:
+  SynchronizedTranslator(Translator *aTranslator, std::mutex *aLock)
+    : mTranslator(aTranslator)
+    , mLock(aLock)
+  {}
+
+  virtual DrawTarget *LookupDrawTarget(ReferencePtr aRefPtr);
+  virtual Path *LookupPath(ReferencePtr aRefPtr);
+  virtual SourceSurface *LookupSourceSurface(ReferencePtr aRefPtr);
+  virtual FilterNode *LookupFilterNode(ReferencePtr aRefPtr);
+  virtual GradientStops *LookupGradientStops(ReferencePtr aRefPtr);
+  virtual ScaledFont *LookupScaledFont(ReferencePtr aRefPtr);
+  virtual void AddDrawTarget(ReferencePtr aRefPtr, DrawTarget *aDT);
+  virtual void RemoveDrawTarget(ReferencePtr aRefPtr);
+  virtual void AddPath(ReferencePtr aRefPtr, Path *aPath);
+  virtual void RemovePath(ReferencePtr aRefPtr);
+  virtual void AddSourceSurface(ReferencePtr aRefPtr, SourceSurface *aSurface);
+  virtual void RemoveSourceSurface(ReferencePtr aRefPtr);
+  virtual void AddFilterNode(ReferencePtr aRefPtr, FilterNode *aFilter);
+  virtual void RemoveFilterNode(ReferencePtr aRefPtr);
+  virtual void AddGradientStops(ReferencePtr aRefPtr, GradientStops *aStops);
+  virtual void RemoveGradientStops(ReferencePtr aRefPtr);
+  virtual void AddScaledFont(ReferencePtr aRefPtr, ScaledFont *aScaledFont);
+  virtual void RemoveScaledFont(ReferencePtr aRefPtr);
+  virtual SourceSurface *LookupStoredSurfaceData(uint64_t aDataId);
+  virtual void AddStoredSurfaceData(uint64_t aDataId, SourceSurface *aSurface);
+  virtual void RemoveStoredSurfaceData(uint64_t aDataId);
+  virtual DrawTarget *GetReferenceDrawTarget();
+  virtual FontType GetDesiredFontType();
+
+protected:
+  // Called with the lock held before every call is forwarded, for
+  // translators whose state depends on the event being played.
+  virtual void WillForward() {}
+
+  Translator *mTranslator;
+  std::mutex *mLock;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_RECORDEDEVENTGRAPH_H_ */
@@ -0,0 +1,234 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RecordingCompression.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+// A block is a series of sequences. Every sequence starts with a token byte
+// holding the number of literals in the high nibble and the match length
+// minus kMinMatch in the low nibble, a nibble of 15 means more length bytes
+// follow. The literals come next, then the little endian 16-bit offset of
+// the match. The last sequence only has literals.
+static const size_t kMinMatch = 4;
+static const size_t kMaxOffset = 65535;
+// The last match has to start this far from the end of the block, and the
+// last bytes are always literals.
+static const size_t kMatchStartMargin = 12;
+static const size_t kLastLiterals = 5;
+
+static const int kHashBits = 14;
+
+static inline uint32_t
+Load32(const uint8_t *aData)
+{
+  uint32_t value;
+  memcpy(&value, aData, sizeof(value));
+  return value;
+}
+
+static inline uint64_t
+Load64(const uint8_t *aData)
+{
+  uint64_t value;
+  memcpy(&value, aData, sizeof(value));
+  return value;
+}
+
+static inline uint32_t
+HashSequence(uint32_t aSequence)
+{
+  return (aSequence * 2654435761U) >> (32 - kHashBits);
+}
+
+static inline uint8_t*
+WriteLength(uint8_t *aOut, size_t aLength)
+{
+  while (aLength >= 255) {
+    *aOut++ = 255;
+    aLength -= 255;
+  }
+  *aOut++ = uint8_t(aLength);
+  return aOut;
+}
+
+static inline uint8_t*
+WriteLiterals(uint8_t *aOut, uint8_t *aToken, const uint8_t *aLiterals, size_t aLength)
+{
+  if (aLength >= 15) {
+    *aToken = 15 << 4;
+    aOut = WriteLength(aOut, aLength - 15);
+  } else {
+    *aToken = uint8_t(aLength << 4);
+  }
+  if (aLength) {
+    memcpy(aOut, aLiterals, aLength);
+  }
+  return aOut + aLength;
+}
+
+size_t
+RecordingCompression::Compress(const char *aSource, size_t aLength, char *aDest)
+{
+  const uint8_t *data = reinterpret_cast<const uint8_t*>(aSource);
+  uint8_t *out = reinterpret_cast<uint8_t*>(aDest);
+  size_t anchor = 0;
+
+  if (aLength > kMatchStartMargin) {
+    // Last position at which each hashed 4 byte sequence was seen.
+    std::vector<uint32_t> table(1 << kHashBits, 0);
+    size_t matchStartLimit = aLength - kMatchStartMargin;
+    size_t matchEndLimit = aLength - kLastLiterals;
+    size_t misses = 0;
+    size_t pos = 1;
+
+    while (pos < matchStartLimit) {
+      uint32_t sequence = Load32(data + pos);
+      uint32_t &entry = table[HashSequence(sequence)];
+      size_t ref = entry;
+      entry = uint32_t(pos);
+
+      if (pos - ref > kMaxOffset || Load32(data + ref) != sequence) {
+        // Skip ahead faster through data that doesn't compress.
+        pos += 1 + (misses++ >> 6);
+        continue;
+      }
+      misses = 0;
+
+      size_t matchEnd = pos + kMinMatch;
+      size_t refEnd = ref + kMinMatch;
+      while (matchEnd + 8 <= matchEndLimit &&
+             Load64(data + matchEnd) == Load64(data + refEnd)) {
+        matchEnd += 8;
+        refEnd += 8;
+      }
+      while (matchEnd < matchEndLimit && data[matchEnd] == data[refEnd]) {
+        matchEnd++;
+        refEnd++;
+      }
+      while (pos > anchor && ref > 0 && data[pos - 1] == data[ref - 1]) {
+        pos--;
+        ref--;
+      }
+
+      uint8_t *token = out++;
+      out = WriteLiterals(out, token, data + anchor, pos - anchor);
+
+      size_t offset = pos - ref;
+      *out++ = uint8_t(offset);
+      *out++ = uint8_t(offset >> 8);
+
+      size_t matchLength = matchEnd - pos - kMinMatch;
+      if (matchLength >= 15) {
+        *token |= 15;
+        out = WriteLength(out, matchLength - 15);
+      } else {
+        *token |= uint8_t(matchLength);
+      }
+
+      pos = anchor = matchEnd;
+      if (pos - 2 < matchStartLimit) {
+        table[HashSequence(Load32(data + pos - 2))] = uint32_t(pos - 2);
+      }
+    }
+  }
+
+  uint8_t *token = out++;
+  out = WriteLiterals(out, token, data + anchor, aLength - anchor);
+
+  return out - reinterpret_cast<uint8_t*>(aDest);
+}
+
+static inline bool
+ReadLength(const uint8_t *&aIn, const uint8_t *aEnd, size_t &aLength)
+{
+  uint8_t value;
+  do {
+    if (aIn == aEnd) {
+      return false;
+    }
+    value = *aIn++;
+    aLength += value;
+  } while (value == 255);
+  return true;
+}
+
+bool
+RecordingCompression::Decompress(const char *aSource, size_t aLength,
+                                 char *aDest, size_t aDestLength)
+{
+  const uint8_t *in = reinterpret_cast<const uint8_t*>(aSource);
+  const uint8_t *inEnd = in + aLength;
+  uint8_t *dest = reinterpret_cast<uint8_t*>(aDest);
+  uint8_t *out = dest;
+  uint8_t *outEnd = dest + aDestLength;
+
+  while (in < inEnd) {
+    uint8_t token = *in++;
+
+    size_t literalLength = token >> 4;
+    if (literalLength == 15 && !ReadLength(in, inEnd, literalLength)) {
+      return false;
+    }
+    if (literalLength > size_t(inEnd - in) || literalLength > size_t(outEnd - out)) {
+      return false;
+    }
+    memcpy(out, in, literalLength);
+    in += literalLength;
+    out += literalLength;
+
+    if (in == inEnd) {
+      break;
+    }
+
+    if (inEnd - in < 2) {
+      return false;
+    }
+    size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+    if (!offset || offset > size_t(out - dest)) {
+      return false;
+    }
+
+    size_t matchLength = token & 15;
+    if (matchLength == 15 && !ReadLength(in, inEnd, matchLength)) {
+      return false;
+    }
+    matchLength += kMinMatch;
+    if (matchLength > size_t(outEnd - out)) {
+      return false;
+    }
+
+    const uint8_t *match = out - offset;
+    if (offset >= 8) {
+      // Copying 8 bytes at a time is safe as the source is always at least
+      // that far behind.
+      uint8_t *copyEnd = out + matchLength;
+      while (out + 8 <= copyEnd) {
+        memcpy(out, match, 8);
+        out += 8;
+        match += 8;
+      }
+      while (out < copyEnd) {
+        *out++ = *match++;
+      }
+    } else {
+      // Short offsets repeat a pattern, the copy has to go byte by byte.
+      for (size_t i = 0; i < matchLength; i++) {
+        *out++ = *match++;
+      }
+    }
+  }
+
+  return out == outEnd;
+}
+
+}
+}
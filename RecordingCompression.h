@@ -0,0 +1,44 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_RECORDINGCOMPRESSION_H_
+#define MOZILLA_GFX_RECORDINGCOMPRESSION_H_
+
+#include <stddef.h>
+
+namespace mozilla {
+namespace gfx {
+
+/* A small and fast LZ77 codec used to compress the chunks of a recording.
+ * The output uses the LZ4 block format, which favours compression and
+ * decompression speed over ratio. Recordings mostly consist of pixel data
+ * and runs of similar events, both of which compress well with it.
+ */
+class RecordingCompression
+{
+public:
+  // Size of the buffer Compress() needs for aLength bytes of input.
+  static size_t MaxCompressedLength(size_t aLength)
+  {
+    return aLength + aLength / 255 + 16;
+  }
+
+  /* Compresses aLength bytes from aSource into aDest, which must hold at
+   * least MaxCompressedLength(aLength) bytes. Returns the compressed length.
+   */
+  static size_t Compress(const char *aSource, size_t aLength, char *aDest);
+
+  /* Decompresses aLength bytes from aSource into aDest. Returns false if the
+   * input is malformed or doesn't decompress to exactly aDestLength bytes,
+   * nothing is ever written beyond aDest + aDestLength.
+   */
+  static bool Decompress(const char *aSource, size_t aLength,
+                         char *aDest, size_t aDestLength);
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_RECORDINGCOMPRESSION_H_ */
@@ -0,0 +1,328 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "RecordingReader.h"
+
+#include "Logging.h"
+#include "RecordingCompression.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mozilla {
+namespace gfx {
+
+using namespace std;
+
+// Size of the magic number and revisions at the start of every recording.
+static const size_t kHeaderSize = sizeof(uint32_t) + 2 * sizeof(uint16_t);
+
+template<class T>
+static T
+ReadAt(const char *aData)
+{
+  T value;
+  memcpy(&value, aData, sizeof(T));
+  return value;
+}
+
+RecordingReader::RecordingReader()
+  : mData(nullptr)
+  , mLength(0)
+#ifdef WIN32
+  , mFile(INVALID_HANDLE_VALUE)
+  , mMapping(nullptr)
+#endif
+  , mMajorRevision(0)
+  , mMinorRevision(0)
+  , mHasIndex(false)
+{
+}
+
+RecordingReader::~RecordingReader()
+{
+#ifdef WIN32
+  if (mData) {
+    ::UnmapViewOfFile(mData);
+  }
+  if (mMapping) {
+    ::CloseHandle(mMapping);
+  }
+  if (mFile != INVALID_HANDLE_VALUE) {
+    ::CloseHandle(mFile);
+  }
+#else
+  if (mData) {
+    munmap(const_cast<char*>(mData), mLength);
+  }
+#endif
+}
+
+bool
+RecordingReader::Map(const char *aFilename)
+{
+#ifdef WIN32
+  mFile = ::CreateFileA(aFilename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (mFile == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if (!::GetFileSizeEx(mFile, &size) || !size.QuadPart) {
+    return false;
+  }
+
+  mMapping = ::CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mMapping) {
+    return false;
+  }
+
+  mData = static_cast<const char*>(::MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+  mLength = size_t(size.QuadPart);
+  return !!mData;
+#else
+  int fd = open(aFilename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) || !info.st_size) {
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  mData = static_cast<const char*>(data);
+  mLength = info.st_size;
+  return true;
+#endif
+}
+
+RecordingReader*
+RecordingReader::Open(const char *aFilename, std::string *aError)
+{
+  RecordingReader *reader = new RecordingReader();
+
+  const char *error = nullptr;
+  uint32_t magic = 0;
+
+  if (!reader->Map(aFilename)) {
+    error = "Could not open file";
+  } else if (reader->mLength < kHeaderSize) {
+    error = "File is not a valid recording";
+  } else {
+    magic = ReadAt<uint32_t>(reader->mData);
+    reader->mMajorRevision = ReadAt<uint16_t>(reader->mData + sizeof(uint32_t));
+    reader->mMinorRevision = ReadAt<uint16_t>(reader->mData + sizeof(uint32_t) + sizeof(uint16_t));
+
+    if (magic != kMagicInt && magic != kChunkedMagicInt) {
+      error = "File is not a valid recording";
+    } else if (reader->mMajorRevision != kMajorRevision) {
+      error = "Recording was made with a different major revision";
+    } else if (reader->mMinorRevision > kMinorRevision) {
+      error = "Recording was made with a later minor revision";
+    }
+  }
+
+  if (error) {
+    if (aError) {
+      *aError = error;
+    }
+    gfxWarning() << "Failed to open recording " << aFilename << ": " << error;
+    delete reader;
+    return nullptr;
+  }
+
+  if (magic == kMagicInt) {
+    size_t length = reader->mLength - kHeaderSize;
+    Chunk chunk = { reader->mData + kHeaderSize, length, 0, false, length };
+    reader->mChunks.push_back(chunk);
+  } else if (!reader->ReadIndex()) {
+    reader->ScanChunks(kHeaderSize);
+  }
+
+  return reader;
+}
+
+bool
+RecordingReader::ReadIndex()
+{
+  if (mLength < kHeaderSize + sizeof(RecordingTrailer)) {
+    return false;
+  }
+
+  size_t trailerOffset = mLength - sizeof(RecordingTrailer);
+  RecordingTrailer trailer = ReadAt<RecordingTrailer>(mData + trailerOffset);
+
+  if (trailer.mMagic != kTrailerMagic || trailer.mIndexOffset > trailerOffset ||
+      (trailerOffset - trailer.mIndexOffset) / sizeof(RecordingIndexEntry) != trailer.mChunkCount) {
+    return false;
+  }
+
+  std::vector<Chunk> chunks;
+  const char *index = mData + trailer.mIndexOffset;
+  for (uint32_t i = 0; i < trailer.mChunkCount; i++) {
+    RecordingIndexEntry entry = ReadAt<RecordingIndexEntry>(index + i * sizeof(RecordingIndexEntry));
+
+    // mOffset comes from the file, don't add to it so that a corrupt value
+    // can't wrap around.
+    if (trailer.mIndexOffset < sizeof(RecordingChunkHeader) ||
+        entry.mOffset > trailer.mIndexOffset - sizeof(RecordingChunkHeader)) {
+      return false;
+    }
+
+    RecordingChunkHeader header = ReadAt<RecordingChunkHeader>(mData + entry.mOffset);
+    size_t dataOffset = entry.mOffset + sizeof(RecordingChunkHeader);
+    if (header.mEventCount != entry.mEventCount ||
+        header.mLength > trailer.mIndexOffset - dataOffset ||
+        !AddChunk(header, dataOffset, chunks)) {
+      return false;
+    }
+  }
+
+  mChunks.swap(chunks);
+  mHasIndex = true;
+  return true;
+}
+
+void
+RecordingReader::ScanChunks(size_t aOffset)
+{
+  // No usable index, the recording was probably not finished properly. Walk
+  // the chunk headers and stop at the first incomplete chunk.
+  while (aOffset + sizeof(RecordingChunkHeader) <= mLength) {
+    RecordingChunkHeader header = ReadAt<RecordingChunkHeader>(mData + aOffset);
+    aOffset += sizeof(RecordingChunkHeader);
+
+    if (header.mLength > mLength - aOffset || !AddChunk(header, aOffset, mChunks)) {
+      break;
+    }
+    aOffset += header.mLength;
+  }
+}
+
+bool
+RecordingReader::AddChunk(const RecordingChunkHeader &aHeader, size_t aDataOffset,
+                          std::vector<Chunk> &aChunks) const
+{
+  Chunk chunk = { mData + aDataOffset, size_t(aHeader.mLength), aHeader.mEventCount,
+                  false, aHeader.mLength };
+
+  if (aHeader.mMagic == kCompressedChunkMagic) {
+    if (aHeader.mLength < sizeof(uint64_t)) {
+      return false;
+    }
+    chunk.mCompressed = true;
+    chunk.mDecompressedLength = ReadAt<uint64_t>(chunk.mData);
+  } else if (aHeader.mMagic != kChunkMagic) {
+    return false;
+  }
+
+  aChunks.push_back(chunk);
+  return true;
+}
+
+bool
+RecordingReader::ReadChunk(size_t aChunk, RecordedEventArena &aArena,
+                           std::vector<RecordedEvent*> &aEvents) const
+{
+  const Chunk &chunk = mChunks[aChunk];
+  const char *data = chunk.mData;
+  size_t length = chunk.mLength;
+
+  vector<char> decompressed;
+  if (chunk.mCompressed) {
+    uint64_t decompressedLength = chunk.mDecompressedLength;
+    size_t compressedLength = chunk.mLength - sizeof(uint64_t);
+    // Every byte of compressed data expands to at most 255 bytes, don't
+    // trust a length that is obviously bogus.
+    if (decompressedLength > uint64_t(compressedLength) * 255) {
+      gfxWarning() << "Corrupt compressed chunk in recording";
+      return false;
+    }
+
+    decompressed.resize(size_t(decompressedLength));
+    if (!decompressed.empty() &&
+        !RecordingCompression::Decompress(chunk.mData + sizeof(uint64_t), compressedLength,
+                                          &decompressed.front(), decompressed.size())) {
+      gfxWarning() << "Corrupt compressed chunk in recording";
+      return false;
+    }
+    data = decompressed.empty() ? nullptr : &decompressed.front();
+    length = decompressed.size();
+  }
+
+  MemReader stream(data, length);
+
+  if (chunk.mEventCount) {
+    aEvents.reserve(aEvents.size() + chunk.mEventCount);
+    aArena.Reserve(chunk.mEventCount);
+  }
+
+  while (stream.Remaining()) {
+    int32_t type;
+    ReadElement(stream, type);
+    if (!stream.good()) {
+      gfxWarning() << "Truncated event in recording";
+      return false;
+    }
+
+    RecordedEvent *event =
+      RecordedEvent::LoadEvent(stream, (RecordedEvent::EventType)type, aArena);
+    if (!event) {
+      gfxWarning() << "Unknown event type " << type << " in recording";
+      return false;
+    }
+    if (!stream.good()) {
+      // The arena still destroys the partly read event.
+      gfxWarning() << "Truncated event in recording";
+      return false;
+    }
+
+    aEvents.push_back(event);
+  }
+
+  return true;
+}
+
+uint64_t
+RecordingReader::GetEventDataLength() const
+{
+  uint64_t length = 0;
+  for (size_t i = 0; i < mChunks.size(); i++) {
+    length += mChunks[i].mDecompressedLength;
+  }
+  return length;
+}
+
+bool
+RecordingReader::ReadAllEvents(RecordedEventArena &aArena,
+                               std::vector<RecordedEvent*> &aEvents) const
+{
+  for (size_t i = 0; i < mChunks.size(); i++) {
+    if (!ReadChunk(i, aArena, aEvents)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+}
@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_RECORDINGREADER_H_
+#define MOZILLA_GFX_RECORDINGREADER_H_
+
+#include "RecordedEvent.h"
+
+#include <string>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+/* Provides access to the events in a recording file. The file is memory
+ * mapped and events are decoded straight from the mapping.
+ *
+ * Both chunked recordings and plain event streams can be read. A plain
+ * stream, or a chunked recording that was never finished, is presented as
+ * chunks without knowing their event counts up front. Chunks are independent
+ * of each other and may be decoded from several threads at once.
+ */
+class RecordingReader
+{
+public:
+  ~RecordingReader();
+
+  /* Maps aFilename and validates its header. Returns nullptr if the file can't
+   * be played by this build, aError then describes why.
+   */
+  static RecordingReader *Open(const char *aFilename, std::string *aError = nullptr);
+
+  uint16_t GetMajorRevision() const { return mMajorRevision; }
+  uint16_t GetMinorRevision() const { return mMinorRevision; }
+
+  // Whether chunk boundaries and event counts came from the index footer.
+  bool HasIndex() const { return mHasIndex; }
+
+  size_t GetChunkCount() const { return mChunks.size(); }
+
+  // Number of events in a chunk, or 0 if this isn't known before decoding.
+  uint32_t GetEventCount(size_t aChunk) const { return mChunks[aChunk].mEventCount; }
+
+  // Size of the recording file.
+  size_t GetLength() const { return mLength; }
+
+  // Size of all events in the recording once decompressed.
+  uint64_t GetEventDataLength() const;
+
+  /* Decodes the events in chunk aChunk straight from the mapping and appends
+   * them to aEvents. The events are constructed in aArena and live as long as
+   * it does, threads decoding chunks at the same time need an arena each.
+   * Returns false if the chunk is corrupt, events decoded before the
+   * corruption was detected are still appended. Compressed chunks are
+   * decompressed into a temporary buffer first.
+   */
+  bool ReadChunk(size_t aChunk, RecordedEventArena &aArena,
+                 std::vector<RecordedEvent*> &aEvents) const;
+
+  // Decodes all chunks in order.
+  bool ReadAllEvents(RecordedEventArena &aArena, std::vector<RecordedEvent*> &aEvents) const;
+
+private:
+  struct Chunk {
+    const char *mData;
+    size_t mLength;
+    uint32_t mEventCount;
+    bool mCompressed;
+    uint64_t mDecompressedLength;
+  };
+
+  RecordingReader();
+
+  bool Map(const char *aFilename);
+  bool ReadIndex();
+  void ScanChunks(size_t aOffset);
+  bool AddChunk(const RecordingChunkHeader &aHeader, size_t aDataOffset,
+                std::vector<Chunk> &aChunks) const;
+
+  const char *mData;
+  size_t mLength;
+#ifdef WIN32
+  void *mFile;
+  void *mMapping;
+#endif
+
+  uint16_t mMajorRevision;
+  uint16_t mMinorRevision;
+  bool mHasIndex;
+  std::vector<Chunk> mChunks;
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_RECORDINGREADER_H_ */
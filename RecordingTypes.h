@@ -7,10 +7,93 @@
 #define MOZILLA_GFX_RECORDINGTYPES_H_
 
 #include <ostream>
+#include <streambuf>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
 
 namespace mozilla {
 namespace gfx {
 
+// Magic number at the start of a plain event stream, a header followed by
+// events until the end of the file.
+const uint32_t kMagicInt = 0xc001feed;
+
+// Magic number at the start of a chunked recording. The layout is:
+//
+//   uint32_t kChunkedMagicInt
+//   uint16_t major revision, uint16_t minor revision
+//   chunks:  RecordingChunkHeader followed by mLength bytes of events
+//   index:   RecordingIndexEntry for every chunk
+//   RecordingTrailer
+//
+// Events inside a chunk are encoded exactly as in a plain stream. The index
+// and trailer are only written when the recording is finished properly, a
+// reader can fall back to walking the chunk headers if they're missing.
+//
+// Compressed chunks have their own magic. Their data starts with the
+// uint64_t length of the events once decompressed, followed by the events
+// compressed with RecordingCompression.
+const uint32_t kChunkedMagicInt = 0xc001f00d;
+const uint32_t kChunkMagic = 0x6b6e6863;   // 'chnk'
+const uint32_t kCompressedChunkMagic = 0x7a6e6863; // 'chnz'
+const uint32_t kTrailerMagic = 0x78646e69; // 'indx'
+
+struct RecordingChunkHeader
+{
+  uint32_t mMagic;
+  uint32_t mEventCount;
+  uint64_t mLength;
+};
+
+struct RecordingIndexEntry
+{
+  uint64_t mOffset;
+  uint32_t mEventCount;
+  uint32_t mReserved;
+};
+
+struct RecordingTrailer
+{
+  uint64_t mIndexOffset;
+  uint32_t mChunkCount;
+  uint32_t mMagic;
+};
+
+// Reads events straight from a block of memory, such as a mapped recording.
+// It has the subset of the std::istream interface that events are decoded
+// with, without going through a stream buffer for every element. Reading past
+// the end fails the reader and leaves the destination zeroed.
+class MemReader
+{
+public:
+  MemReader(const char *aData, size_t aLength)
+    : mData(aData)
+    , mEnd(aData + aLength)
+    , mGood(true)
+  {}
+
+  void read(char *aOut, size_t aLength)
+  {
+    if (aLength > Remaining()) {
+      memset(aOut, 0, aLength);
+      mData = mEnd;
+      mGood = false;
+      return;
+    }
+    memcpy(aOut, mData, aLength);
+    mData += aLength;
+  }
+
+  bool good() const { return mGood; }
+  size_t Remaining() const { return mEnd - mData; }
+
+private:
+  const char *mData;
+  const char *mEnd;
+  bool mGood;
+};
+
 template<class T>
 struct ElementStreamFormat
 {
@@ -18,7 +101,7 @@ struct ElementStreamFormat
   {
     aStream.write(reinterpret_cast<const char*>(&aElement), sizeof(T));
   }
-  static void Read(std::istream &aStream, T &aElement)
+  static void Read(MemReader &aStream, T &aElement)
   {
     aStream.read(reinterpret_cast<char *>(&aElement), sizeof(T));
   }
@@ -30,11 +113,39 @@ void WriteElement(std::ostream &aStream, const T &aElement)
   ElementStreamFormat<T>::Write(aStream, aElement);
 }
 template<class T>
-void ReadElement(std::istream &aStream, T &aElement)
+void ReadElement(MemReader &aStream, T &aElement)
 {
   ElementStreamFormat<T>::Read(aStream, aElement);
 }
 
+// Stream buffer appending everything written to it to a growable block of
+// memory.
+class VectorStreamBuffer : public std::streambuf
+{
+public:
+  const char *Data() const { return mData.empty() ? nullptr : &mData.front(); }
+  size_t Length() const { return mData.size(); }
+  void Clear() { mData.clear(); }
+
+protected:
+  virtual int_type overflow(int_type aChar)
+  {
+    if (aChar != traits_type::eof()) {
+      mData.push_back(traits_type::to_char_type(aChar));
+    }
+    return traits_type::not_eof(aChar);
+  }
+
+  virtual std::streamsize xsputn(const char *aData, std::streamsize aLength)
+  {
+    mData.insert(mData.end(), aData, aData + aLength);
+    return aLength;
+  }
+
+private:
+  std::vector<char> mData;
+};
+
 }
 }
 
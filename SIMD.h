@@ -8,13 +8,21 @@
 
 /**
  * Consumers of this file need to #define SIMD_COMPILE_SSE2 before including it
- * if they want access to the SSE2 functions.
+ * if they want access to the SSE2 functions, or SIMD_COMPILE_AVX2 for the AVX2
+ * functions. The latter must only be defined in code that has AVX2 code
+ * generation enabled, see FilterProcessingAVX2.cpp.
  */
 
+#include <string.h>
+
 #ifdef SIMD_COMPILE_SSE2
 #include <xmmintrin.h>
 #endif
 
+#ifdef SIMD_COMPILE_AVX2
+#include <immintrin.h>
+#endif
+
 namespace mozilla {
 namespace gfx {
 
@@ -23,6 +31,19 @@ namespace simd {
 template<typename u8x16_t>
 u8x16_t Load8(const uint8_t* aSource);
 
+// Load only the first 16 bytes and zero the rest of the vector. This is the
+// same as Load8 for backends with 16 byte vectors.
+template<typename u8x16_t>
+u8x16_t Load8Lo(const uint8_t* aSource);
+
+// Load 16 bytes from an address that doesn't need to be aligned.
+template<typename u8x16_t>
+u8x16_t LoadUnaligned8(const uint8_t* aSource);
+
+// Load eight 16-bit values from a 16-byte aligned address.
+template<typename i16x8_t>
+i16x8_t Load16(const int16_t* aSource);
+
 template<typename u8x16_t>
 u8x16_t From8(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t h,
               uint8_t i, uint8_t j, uint8_t k, uint8_t l, uint8_t m, uint8_t n, uint8_t o, uint8_t p);
@@ -61,10 +82,19 @@ f32x4_t FromF32(float a);
 // Store 16 bytes to a 16-byte aligned address
 void Store8(uint8_t* aTarget, u8x16_t aM);
 
+// Store the first 16 bytes of the vector
+void Store8Lo(uint8_t* aTarget, u8x16_t aM);
+
+// Store eight 16-bit values to a 16-byte aligned address
+void Store16(int16_t* aTarget, i16x8_t aM);
+
 // Fixed shifts
 template<int32_t aNumberOfBits> i16x8_t ShiftRight16(i16x8_t aM);
 template<int32_t aNumberOfBits> i32x4_t ShiftRight32(i32x4_t aM);
 
+// Arithmetic shift by a number of bits that is only known at run time
+i32x4_t ShiftRight32(i32x4_t aM, int32_t aNumberOfBits);
+
 i16x8_t Add16(i16x8_t aM1, i16x8_t aM2);
 i32x4_t Add32(i32x4_t aM1, i32x4_t aM2);
 i16x8_t Sub16(i16x8_t aM1, i16x8_t aM2);
@@ -150,11 +180,44 @@ Load8<Scalaru8x16_t>(const uint8_t* aSource)
   return *(Scalaru8x16_t*)aSource;
 }
 
+template<>
+inline Scalaru8x16_t
+Load8Lo<Scalaru8x16_t>(const uint8_t* aSource)
+{
+  return Load8<Scalaru8x16_t>(aSource);
+}
+
 inline void Store8(uint8_t* aTarget, Scalaru8x16_t aM)
 {
   *(Scalaru8x16_t*)aTarget = aM;
 }
 
+inline void Store8Lo(uint8_t* aTarget, Scalaru8x16_t aM)
+{
+  Store8(aTarget, aM);
+}
+
+template<>
+inline Scalaru8x16_t
+LoadUnaligned8<Scalaru8x16_t>(const uint8_t* aSource)
+{
+  Scalaru8x16_t m;
+  memcpy(m.u8, aSource, 16);
+  return m;
+}
+
+template<>
+inline Scalari16x8_t
+Load16<Scalari16x8_t>(const int16_t* aSource)
+{
+  return *(Scalari16x8_t*)aSource;
+}
+
+inline void Store16(int16_t* aTarget, Scalari16x8_t aM)
+{
+  *(Scalari16x8_t*)aTarget = aM;
+}
+
 template<>
 inline Scalaru8x16_t From8<Scalaru8x16_t>(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t h,
                                           uint8_t i, uint8_t j, uint8_t k, uint8_t l, uint8_t m, uint8_t n, uint8_t o, uint8_t p)
@@ -277,6 +340,12 @@ inline Scalari32x4_t ShiftRight32(Scalari32x4_t aM)
                                aM.i32[2] >> aNumberOfBits, aM.i32[3] >> aNumberOfBits);
 }
 
+inline Scalari32x4_t ShiftRight32(Scalari32x4_t aM, int32_t aNumberOfBits)
+{
+  return From32<Scalari32x4_t>(aM.i32[0] >> aNumberOfBits, aM.i32[1] >> aNumberOfBits,
+                               aM.i32[2] >> aNumberOfBits, aM.i32[3] >> aNumberOfBits);
+}
+
 inline Scalaru16x8_t Add16(Scalaru16x8_t aM1, Scalaru16x8_t aM2)
 {
   return FromU16<Scalaru16x8_t>(aM1.u16[0] + aM2.u16[0], aM1.u16[1] + aM2.u16[1],
@@ -386,7 +455,7 @@ inline Scalari32x4_t MulAdd16x8x2To32x4(Scalari16x8_t aFactorsA,
 }
 
 template<int8_t aIndex>
-inline void AssertIndex()
+static inline void AssertIndex()
 {
   static_assert(aIndex == 0 || aIndex == 1 || aIndex == 2 || aIndex == 3,
                 "Invalid splat index");
@@ -795,6 +864,12 @@ inline Scalari32x4_t F32ToI32(Scalarf32x4_t m)
                                int32_t(floor(m.f32[3] + 0.5f)));
 }
 
+inline Scalarf32x4_t I32ToF32(Scalari32x4_t m)
+{
+  return FromF32<Scalarf32x4_t>(float(m.i32[0]), float(m.i32[1]),
+                                float(m.i32[2]), float(m.i32[3]));
+}
+
 #ifdef SIMD_COMPILE_SSE2
 
 // SSE2
@@ -806,11 +881,42 @@ Load8<__m128i>(const uint8_t* aSource)
   return _mm_load_si128((const __m128i*)aSource);
 }
 
+template<>
+inline __m128i
+Load8Lo<__m128i>(const uint8_t* aSource)
+{
+  return Load8<__m128i>(aSource);
+}
+
 inline void Store8(uint8_t* aTarget, __m128i aM)
 {
   _mm_store_si128((__m128i*)aTarget, aM);
 }
 
+inline void Store8Lo(uint8_t* aTarget, __m128i aM)
+{
+  Store8(aTarget, aM);
+}
+
+template<>
+inline __m128i
+LoadUnaligned8<__m128i>(const uint8_t* aSource)
+{
+  return _mm_loadu_si128((const __m128i*)aSource);
+}
+
+template<>
+inline __m128i
+Load16<__m128i>(const int16_t* aSource)
+{
+  return _mm_load_si128((const __m128i*)aSource);
+}
+
+inline void Store16(int16_t* aTarget, __m128i aM)
+{
+  _mm_store_si128((__m128i*)aTarget, aM);
+}
+
 template<>
 inline __m128i FromZero8<__m128i>()
 {
@@ -885,6 +991,11 @@ inline __m128i ShiftRight32(__m128i aM)
   return _mm_srai_epi32(aM, aNumberOfBits);
 }
 
+inline __m128i ShiftRight32(__m128i aM, int32_t aNumberOfBits)
+{
+  return _mm_sra_epi32(aM, _mm_cvtsi32_si128(aNumberOfBits));
+}
+
 inline __m128i Add16(__m128i aM1, __m128i aM2)
 {
   return _mm_add_epi16(aM1, aM2);
@@ -1170,8 +1281,431 @@ inline __m128i F32ToI32(__m128 m)
   return _mm_cvtps_epi32(m);
 }
 
+inline __m128 I32ToF32(__m128i m)
+{
+  return _mm_cvtepi32_ps(m);
+}
+
 #endif // SIMD_COMPILE_SSE2
 
+#ifdef SIMD_COMPILE_AVX2
+
+// AVX2
+//
+// The 256 bit types hold two independent 128 bit lanes. Every operation
+// works on both lanes in the same way the SSE2 version works on its single
+// register, so code written against the 128 bit interface processes twice
+// the amount of data per call. The From* functions replicate their arguments
+// into both lanes.
+
+template<>
+inline __m256i
+Load8<__m256i>(const uint8_t* aSource)
+{
+  return _mm256_loadu_si256((const __m256i*)aSource);
+}
+
+template<>
+inline __m256i
+Load8Lo<__m256i>(const uint8_t* aSource)
+{
+  return _mm256_inserti128_si256(_mm256_setzero_si256(),
+                                 _mm_loadu_si128((const __m128i*)aSource), 0);
+}
+
+inline void Store8(uint8_t* aTarget, __m256i aM)
+{
+  _mm256_storeu_si256((__m256i*)aTarget, aM);
+}
+
+inline void Store8Lo(uint8_t* aTarget, __m256i aM)
+{
+  _mm_storeu_si128((__m128i*)aTarget, _mm256_castsi256_si128(aM));
+}
+
+template<>
+inline __m256i
+LoadUnaligned8<__m256i>(const uint8_t* aSource)
+{
+  return Load8<__m256i>(aSource);
+}
+
+template<>
+inline __m256i
+Load16<__m256i>(const int16_t* aSource)
+{
+  return _mm256_loadu_si256((const __m256i*)aSource);
+}
+
+inline void Store16(int16_t* aTarget, __m256i aM)
+{
+  _mm256_storeu_si256((__m256i*)aTarget, aM);
+}
+
+template<>
+inline __m256i FromZero8<__m256i>()
+{
+  return _mm256_setzero_si256();
+}
+
+template<>
+inline __m256i From8<__m256i>(uint8_t a, uint8_t b, uint8_t c, uint8_t d, uint8_t e, uint8_t f, uint8_t g, uint8_t h,
+                              uint8_t i, uint8_t j, uint8_t k, uint8_t l, uint8_t m, uint8_t n, uint8_t o, uint8_t p)
+{
+  return _mm256_setr_epi8(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p,
+                          a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p);
+}
+
+template<>
+inline __m256i FromI16<__m256i>(int16_t a, int16_t b, int16_t c, int16_t d, int16_t e, int16_t f, int16_t g, int16_t h)
+{
+  return _mm256_setr_epi16(a, b, c, d, e, f, g, h, a, b, c, d, e, f, g, h);
+}
+
+template<>
+inline __m256i FromU16<__m256i>(uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t e, uint16_t f, uint16_t g, uint16_t h)
+{
+  return _mm256_setr_epi16(a, b, c, d, e, f, g, h, a, b, c, d, e, f, g, h);
+}
+
+template<>
+inline __m256i FromI16<__m256i>(int16_t a)
+{
+  return _mm256_set1_epi16(a);
+}
+
+template<>
+inline __m256i FromU16<__m256i>(uint16_t a)
+{
+  return _mm256_set1_epi16((int16_t)a);
+}
+
+template<>
+inline __m256i From32<__m256i>(int32_t a, int32_t b, int32_t c, int32_t d)
+{
+  return _mm256_setr_epi32(a, b, c, d, a, b, c, d);
+}
+
+template<>
+inline __m256i From32<__m256i>(int32_t a)
+{
+  return _mm256_set1_epi32(a);
+}
+
+template<>
+inline __m256 FromF32<__m256>(float a, float b, float c, float d)
+{
+  return _mm256_setr_ps(a, b, c, d, a, b, c, d);
+}
+
+template<>
+inline __m256 FromF32<__m256>(float a)
+{
+  return _mm256_set1_ps(a);
+}
+
+template<int32_t aNumberOfBits>
+inline __m256i ShiftRight16(__m256i aM)
+{
+  return _mm256_srli_epi16(aM, aNumberOfBits);
+}
+
+template<int32_t aNumberOfBits>
+inline __m256i ShiftRight32(__m256i aM)
+{
+  return _mm256_srai_epi32(aM, aNumberOfBits);
+}
+
+inline __m256i ShiftRight32(__m256i aM, int32_t aNumberOfBits)
+{
+  return _mm256_sra_epi32(aM, _mm_cvtsi32_si128(aNumberOfBits));
+}
+
+inline __m256i Add16(__m256i aM1, __m256i aM2)
+{
+  return _mm256_add_epi16(aM1, aM2);
+}
+
+inline __m256i Add32(__m256i aM1, __m256i aM2)
+{
+  return _mm256_add_epi32(aM1, aM2);
+}
+
+inline __m256i Sub16(__m256i aM1, __m256i aM2)
+{
+  return _mm256_sub_epi16(aM1, aM2);
+}
+
+inline __m256i Sub32(__m256i aM1, __m256i aM2)
+{
+  return _mm256_sub_epi32(aM1, aM2);
+}
+
+inline __m256i Min8(__m256i aM1, __m256i aM2)
+{
+  return _mm256_min_epu8(aM1, aM2);
+}
+
+inline __m256i Max8(__m256i aM1, __m256i aM2)
+{
+  return _mm256_max_epu8(aM1, aM2);
+}
+
+inline __m256i Min32(__m256i aM1, __m256i aM2)
+{
+  return _mm256_min_epi32(aM1, aM2);
+}
+
+inline __m256i Max32(__m256i aM1, __m256i aM2)
+{
+  return _mm256_max_epi32(aM1, aM2);
+}
+
+inline __m256i Mul16(__m256i aM1, __m256i aM2)
+{
+  return _mm256_mullo_epi16(aM1, aM2);
+}
+
+inline __m256i MulU16(__m256i aM1, __m256i aM2)
+{
+  return _mm256_mullo_epi16(aM1, aM2);
+}
+
+inline void Mul16x4x2x2To32x4x2(__m256i aFactorsA1B1,
+                                __m256i aFactorsA2B2,
+                                __m256i& aProductA,
+                                __m256i& aProductB)
+{
+  __m256i prodAB_lo = _mm256_mullo_epi16(aFactorsA1B1, aFactorsA2B2);
+  __m256i prodAB_hi = _mm256_mulhi_epi16(aFactorsA1B1, aFactorsA2B2);
+  aProductA = _mm256_unpacklo_epi16(prodAB_lo, prodAB_hi);
+  aProductB = _mm256_unpackhi_epi16(prodAB_lo, prodAB_hi);
+}
+
+inline __m256i MulAdd16x8x2To32x4(__m256i aFactorsA,
+                                  __m256i aFactorsB)
+{
+  return _mm256_madd_epi16(aFactorsA, aFactorsB);
+}
+
+template<int8_t i0, int8_t i1, int8_t i2, int8_t i3>
+inline __m256i Shuffle32(__m256i aM)
+{
+  AssertIndex<i0>();
+  AssertIndex<i1>();
+  AssertIndex<i2>();
+  AssertIndex<i3>();
+  return _mm256_shuffle_epi32(aM, _MM_SHUFFLE(i0, i1, i2, i3));
+}
+
+template<int8_t i0, int8_t i1, int8_t i2, int8_t i3>
+inline __m256i ShuffleLo16(__m256i aM)
+{
+  AssertIndex<i0>();
+  AssertIndex<i1>();
+  AssertIndex<i2>();
+  AssertIndex<i3>();
+  return _mm256_shufflelo_epi16(aM, _MM_SHUFFLE(i0, i1, i2, i3));
+}
+
+template<int8_t i0, int8_t i1, int8_t i2, int8_t i3>
+inline __m256i ShuffleHi16(__m256i aM)
+{
+  AssertIndex<i0>();
+  AssertIndex<i1>();
+  AssertIndex<i2>();
+  AssertIndex<i3>();
+  return _mm256_shufflehi_epi16(aM, _MM_SHUFFLE(i0, i1, i2, i3));
+}
+
+template<int8_t aIndex>
+inline __m256i Splat32(__m256i aM)
+{
+  return Shuffle32<aIndex,aIndex,aIndex,aIndex>(aM);
+}
+
+template<int8_t aIndex>
+inline __m256i Splat32On8(__m256i aM)
+{
+  return Shuffle32<aIndex,aIndex,aIndex,aIndex>(aM);
+}
+
+template<int8_t aIndexLo, int8_t aIndexHi>
+inline __m256i Splat16(__m256i aM)
+{
+  AssertIndex<aIndexLo>();
+  AssertIndex<aIndexHi>();
+  return ShuffleHi16<aIndexHi,aIndexHi,aIndexHi,aIndexHi>(
+           ShuffleLo16<aIndexLo,aIndexLo,aIndexLo,aIndexLo>(aM));
+}
+
+inline __m256i
+UnpackLo8x8ToI16x8(__m256i m)
+{
+  return _mm256_unpacklo_epi8(m, _mm256_setzero_si256());
+}
+
+inline __m256i
+UnpackHi8x8ToI16x8(__m256i m)
+{
+  return _mm256_unpackhi_epi8(m, _mm256_setzero_si256());
+}
+
+inline __m256i
+UnpackLo8x8ToU16x8(__m256i m)
+{
+  return _mm256_unpacklo_epi8(m, _mm256_setzero_si256());
+}
+
+inline __m256i
+UnpackHi8x8ToU16x8(__m256i m)
+{
+  return _mm256_unpackhi_epi8(m, _mm256_setzero_si256());
+}
+
+inline __m256i
+InterleaveLo8(__m256i m1, __m256i m2)
+{
+  return _mm256_unpacklo_epi8(m1, m2);
+}
+
+inline __m256i
+InterleaveHi8(__m256i m1, __m256i m2)
+{
+  return _mm256_unpackhi_epi8(m1, m2);
+}
+
+inline __m256i
+InterleaveLo16(__m256i m1, __m256i m2)
+{
+  return _mm256_unpacklo_epi16(m1, m2);
+}
+
+inline __m256i
+InterleaveHi16(__m256i m1, __m256i m2)
+{
+  return _mm256_unpackhi_epi16(m1, m2);
+}
+
+inline __m256i
+InterleaveLo32(__m256i m1, __m256i m2)
+{
+  return _mm256_unpacklo_epi32(m1, m2);
+}
+
+// Rotates within each lane, the lanes of a1234 and a5678 are paired up.
+template<uint8_t aNumBytes>
+inline __m256i
+Rotate8(__m256i a1234, __m256i a5678)
+{
+  return _mm256_alignr_epi8(a5678, a1234, aNumBytes);
+}
+
+inline __m256i
+PackAndSaturate32To16(__m256i m1, __m256i m2)
+{
+  return _mm256_packs_epi32(m1, m2);
+}
+
+inline __m256i
+PackAndSaturate32ToU16(__m256i m1, __m256i m2)
+{
+  return _mm256_packs_epi32(m1, m2);
+}
+
+inline __m256i
+PackAndSaturate32To8(__m256i m1, __m256i m2, __m256i m3, const __m256i& m4)
+{
+  // Pack into 16 16bit signed integers (saturating).
+  __m256i m12 = _mm256_packs_epi32(m1, m2);
+  __m256i m34 = _mm256_packs_epi32(m3, m4);
+
+  // Pack into 32 8bit unsigned integers (saturating).
+  return _mm256_packus_epi16(m12, m34);
+}
+
+inline __m256i
+PackAndSaturate16To8(__m256i m1, __m256i m2)
+{
+  // Pack into 32 8bit unsigned integers (saturating).
+  return _mm256_packus_epi16(m1, m2);
+}
+
+inline __m256i
+FastDivideBy255(__m256i m)
+{
+  // v = m << 8
+  __m256i v = _mm256_slli_epi32(m, 8);
+  // v = v + (m + (255,255,255,255,255,255,255,255))
+  v = _mm256_add_epi32(v, _mm256_add_epi32(m, _mm256_set1_epi32(255)));
+  // v = v >> 16
+  return _mm256_srai_epi32(v, 16);
+}
+
+inline __m256i
+FastDivideBy255_16(__m256i m)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i lo = _mm256_unpacklo_epi16(m, zero);
+  __m256i hi = _mm256_unpackhi_epi16(m, zero);
+  return _mm256_packs_epi32(FastDivideBy255(lo), FastDivideBy255(hi));
+}
+
+inline __m256i
+Pick(__m256i mask, __m256i a, __m256i b)
+{
+  return _mm256_blendv_epi8(a, b, mask);
+}
+
+inline __m256 MixF32(__m256 a, __m256 b, float t)
+{
+  return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), _mm256_set1_ps(t)));
+}
+
+inline __m256 WSumF32(__m256 a, __m256 b, float wa, float wb)
+{
+  return _mm256_add_ps(_mm256_mul_ps(a, _mm256_set1_ps(wa)), _mm256_mul_ps(b, _mm256_set1_ps(wb)));
+}
+
+inline __m256 AbsF32(__m256 a)
+{
+  return _mm256_max_ps(_mm256_sub_ps(_mm256_setzero_ps(), a), a);
+}
+
+inline __m256 AddF32(__m256 a, __m256 b)
+{
+  return _mm256_add_ps(a, b);
+}
+
+inline __m256 MulF32(__m256 a, __m256 b)
+{
+  return _mm256_mul_ps(a, b);
+}
+
+inline __m256 DivF32(__m256 a, __m256 b)
+{
+  return _mm256_div_ps(a, b);
+}
+
+template<uint8_t aIndex>
+inline __m256 SplatF32(__m256 m)
+{
+  AssertIndex<aIndex>();
+  return _mm256_shuffle_ps(m, m, _MM_SHUFFLE(aIndex, aIndex, aIndex, aIndex));
+}
+
+inline __m256i F32ToI32(__m256 m)
+{
+  return _mm256_cvtps_epi32(m);
+}
+
+inline __m256 I32ToF32(__m256i m)
+{
+  return _mm256_cvtepi32_ps(m);
+}
+
+#endif // SIMD_COMPILE_AVX2
+
 } // namespace simd
 
 } // namespace gfx
@@ -3,6 +3,11 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "Scale.h"
+#include "CacheHelpers.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+
+#include <limits>
 
 #ifdef USE_SKIA
 #include "HelpersSkia.h"
@@ -15,6 +20,71 @@
 namespace mozilla {
 namespace gfx {
 
+namespace {
+
+// Surfaces are identified by a serial number that is attached to them the
+// first time they're scaled. Invalidating a surface gives it a new one.
+SurfaceSerials sSurfaceSerials;
+
+struct ScaledKey
+{
+  uint64_t mSerial;
+  IntSize mSize;
+
+  bool operator<(const ScaledKey& aOther) const
+  {
+    if (mSerial != aOther.mSerial) {
+      return mSerial < aOther.mSerial;
+    }
+    if (mSize.width != aOther.mSize.width) {
+      return mSize.width < aOther.mSize.width;
+    }
+    return mSize.height < aOther.mSize.height;
+  }
+};
+
+class ScaledCache
+{
+public:
+  bool IsEnabled() const { return mCache.IsEnabled(); }
+  void SetMaxBytes(size_t aMaxBytes) { mCache.SetMaxBytes(aMaxBytes); }
+  CacheStats GetStats() const { return mCache.GetStats(); }
+
+  DataSourceSurface* Lookup(const ScaledKey& aKey)
+  {
+    RefPtr<DataSourceSurface>* surface = mCache.Lookup(aKey);
+    return surface ? surface->get() : nullptr;
+  }
+
+  void Insert(const ScaledKey& aKey, DataSourceSurface* aSurface)
+  {
+    size_t bytes = size_t(aSurface->Stride()) * aSurface->GetSize().height;
+    // Two requests for the same scale may have been in flight at once.
+    mCache.Remove(aKey);
+    mCache.Insert(aKey, aSurface, bytes);
+  }
+
+  // Drops the scaled copies of the surface that had aSerial.
+  void RemoveSerial(uint64_t aSerial)
+  {
+    const int32_t minimum = std::numeric_limits<int32_t>::min();
+    ScaledKey first = { aSerial, IntSize(minimum, minimum) };
+    mCache.RemoveRange(first, [aSerial](const ScaledKey& aKey) {
+      return aKey.mSerial == aSerial;
+    });
+  }
+
+private:
+  LRUCache<ScaledKey, RefPtr<DataSourceSurface> > mCache;
+};
+
+ScaledCache sScaledCache;
+
+ScaleFunction sSurfaceScaler = Scale;
+
+}
+
+
 bool Scale(uint8_t* srcData, int32_t srcWidth, int32_t srcHeight, int32_t srcStride,
            uint8_t* dstData, int32_t dstWidth, int32_t dstHeight, int32_t dstStride,
            SurfaceFormat format)
@@ -53,5 +123,164 @@ bool Scale(uint8_t* srcData, int32_t srcWidth, int32_t srcHeight, int32_t srcStr
 #endif
 }
 
+ScaleRequest::ScaleRequest()
+  : mSerial(0)
+  , mTasks(nullptr)
+  , mDone(false)
+  , mSucceeded(false)
+{
+}
+
+ScaleRequest::~ScaleRequest()
+{
+  Finish();
+}
+
+void
+ScaleRequest::Start(SourceSurface* aSource, const IntSize& aSize, WorkerPool* aPool)
+{
+  mSize = aSize;
+  if (sScaledCache.IsEnabled()) {
+    mSerial = sSurfaceSerials.Get(aSource);
+    ScaledKey key = { mSerial, aSize };
+    mResult = sScaledCache.Lookup(key);
+    if (mResult) {
+      mSerial = 0;
+      mSucceeded = true;
+      mDone = true;
+      return;
+    }
+  }
+
+  if (aSize.width <= 0 || aSize.height <= 0) {
+    mDone = true;
+    return;
+  }
+
+  mSource = aSource->GetDataSurface();
+  if (MOZ2D_WARN_IF(!mSource)) {
+    mDone = true;
+    return;
+  }
+
+  SurfaceFormat format = mSource->GetFormat() == SurfaceFormat::B8G8R8X8 ?
+    SurfaceFormat::B8G8R8X8 : SurfaceFormat::B8G8R8A8;
+  mResult = Factory::CreateDataSourceSurface(aSize, format);
+  if (MOZ2D_WARN_IF(!mResult)) {
+    mSource = nullptr;
+    mDone = true;
+    return;
+  }
+
+  if (!mSource->Map(DataSourceSurface::READ, &mSourceMap)) {
+    mSource = nullptr;
+    mResult = nullptr;
+    mDone = true;
+    return;
+  }
+  if (!mResult->Map(DataSourceSurface::WRITE, &mResultMap)) {
+    mSource->Unmap();
+    mSource = nullptr;
+    mResult = nullptr;
+    mDone = true;
+    return;
+  }
+
+  // The task only uses plain members, and Finish() waits for it before any of
+  // them go away.
+  ScaleRequest* request = this;
+  IntSize sourceSize = mSource->GetSize();
+  SurfaceFormat sourceFormat = mSource->GetFormat();
+  ScaleFunction scaler = sSurfaceScaler;
+  mTasks = new TaskGroup(aPool);
+  mTasks->Dispatch([=]() {
+    request->mSucceeded =
+      scaler(request->mSourceMap.mData, sourceSize.width, sourceSize.height,
+             request->mSourceMap.mStride, request->mResultMap.mData,
+             aSize.width, aSize.height, request->mResultMap.mStride,
+             sourceFormat);
+    request->mDone = true;
+  });
+}
+
+void
+ScaleRequest::Finish()
+{
+  if (!mTasks) {
+    return;
+  }
+
+  mTasks->Wait();
+  delete mTasks;
+  mTasks = nullptr;
+
+  mSource->Unmap();
+  mSource = nullptr;
+  mResult->Unmap();
+
+  if (!mSucceeded) {
+    mResult = nullptr;
+    return;
+  }
+  if (mSerial && sScaledCache.IsEnabled()) {
+    ScaledKey key = { mSerial, mSize };
+    sScaledCache.Insert(key, mResult);
+  }
+}
+
+TemporaryRef<DataSourceSurface>
+ScaleRequest::GetResult()
+{
+  Finish();
+  return mResult.get();
+}
+
+void
+SetSurfaceScaler(ScaleFunction aScaler)
+{
+  sSurfaceScaler = aScaler ? aScaler : Scale;
+}
+
+TemporaryRef<DataSourceSurface>
+ScaleSurface(SourceSurface* aSource, const IntSize& aSize)
+{
+  // Without a pool the scale runs right away, inside Start().
+  RefPtr<ScaleRequest> request = new ScaleRequest();
+  request->Start(aSource, aSize, nullptr);
+  return request->GetResult();
+}
+
+TemporaryRef<ScaleRequest>
+ScaleSurfaceAsync(SourceSurface* aSource, const IntSize& aSize)
+{
+  RefPtr<ScaleRequest> request = new ScaleRequest();
+  request->Start(aSource, aSize, WorkerPool::Get());
+  return request.forget();
+}
+
+void
+ScaledSurfaceCache::SetMaxBytes(size_t aMaxBytes)
+{
+  sScaledCache.SetMaxBytes(aMaxBytes);
+}
+
+CacheStats
+ScaledSurfaceCache::GetStats()
+{
+  return sScaledCache.GetStats();
+}
+
+void
+ScaledSurfaceCache::Invalidate(SourceSurface* aSurface)
+{
+  if (!sScaledCache.IsEnabled()) {
+    return;
+  }
+  uint64_t serial = sSurfaceSerials.Renew(aSurface);
+  if (serial) {
+    sScaledCache.RemoveSerial(serial);
+  }
+}
+
 }
 }
@@ -5,7 +5,9 @@
 #ifndef MOZILLA_GFX_SCALE_H_
 #define MOZILLA_GFX_SCALE_H_
 
-#include "Types.h"
+#include "2D.h"
+
+#include <atomic>
 
 namespace mozilla {
 namespace gfx {
@@ -30,7 +32,107 @@ GFX2D_API bool Scale(uint8_t* srcData, int32_t srcWidth, int32_t srcHeight, int3
                      uint8_t* dstData, int32_t dstWidth, int32_t dstHeight, int32_t dstStride,
                      SurfaceFormat format);
 
+/**
+ * A function with the signature of Scale(), see SetSurfaceScaler.
+ */
+typedef bool (*ScaleFunction)(uint8_t* srcData, int32_t srcWidth, int32_t srcHeight,
+                              int32_t srcStride, uint8_t* dstData, int32_t dstWidth,
+                              int32_t dstHeight, int32_t dstStride, SurfaceFormat format);
+
+/**
+ * Makes ScaleSurface and ScaleSurfaceAsync scale with aScaler instead of
+ * Scale(), or with Scale() again if aScaler is null. This lets builds without
+ * Skia, where Scale() always fails, use and test the cache of scaled
+ * surfaces. aScaler is called on worker threads. Scales that are already in
+ * flight keep the scaler they started with.
+ */
+GFX2D_API void SetSurfaceScaler(ScaleFunction aScaler);
+
+/**
+ * Returns aSource scaled to aSize with the same filter as Scale(), or the
+ * scaler set with SetSurfaceScaler, as a new surface. Sources in B8G8R8X8 format produce a B8G8R8X8 surface, all others
+ * a B8G8R8A8 one. Returns null if scaling isn't supported or failed.
+ *
+ * Results are kept in a cache keyed by aSource and aSize, see
+ * Factory::SetScaledSurfaceCacheSize, so drawing a large image at the same
+ * reduced size over and over only pays for the scale once. The returned
+ * surface may be shared with other callers and must not be modified.
+ */
+GFX2D_API TemporaryRef<DataSourceSurface>
+  ScaleSurface(SourceSurface* aSource, const IntSize& aSize);
+
+class ScaleRequest;
+class TaskGroup;
+class WorkerPool;
+
+/**
+ * Like ScaleSurface, but the scale runs on WorkerPool::Get() so the calling
+ * thread can get on with other work in the meantime. If the result is already
+ * cached the returned request is done right away. Never returns null; a
+ * request whose scale isn't supported or failed returns a null result.
+ */
+GFX2D_API TemporaryRef<ScaleRequest>
+  ScaleSurfaceAsync(SourceSurface* aSource, const IntSize& aSize);
+
+/**
+ * A scale started by ScaleSurfaceAsync. The request must be used and released
+ * on the thread that started it, only the scaling itself runs elsewhere.
+ */
+class GFX2D_API ScaleRequest : public RefCounted<ScaleRequest>
+{
+public:
+  MOZ_DECLARE_REFCOUNTED_TYPENAME(ScaleRequest)
+  ~ScaleRequest();
+
+  /**
+   * Whether the scaled image is ready, GetResult won't block once this
+   * returns true.
+   */
+  bool IsDone() const { return mDone; }
+
+  /**
+   * Waits for the scale to finish and returns its result, the same surface
+   * ScaleSurface would have returned. The result is added to the cache the
+   * first time this is called.
+   */
+  TemporaryRef<DataSourceSurface> GetResult();
+
+private:
+  friend TemporaryRef<DataSourceSurface>
+    ScaleSurface(SourceSurface* aSource, const IntSize& aSize);
+  friend TemporaryRef<ScaleRequest>
+    ScaleSurfaceAsync(SourceSurface* aSource, const IntSize& aSize);
+
+  ScaleRequest();
+  void Start(SourceSurface* aSource, const IntSize& aSize, WorkerPool* aPool);
+  void Finish();
+
+  // Both are mapped until the scale has finished, the task only touches the
+  // mapped data.
+  RefPtr<DataSourceSurface> mSource;
+  RefPtr<DataSourceSurface> mResult;
+  DataSourceSurface::MappedSurface mSourceMap;
+  DataSourceSurface::MappedSurface mResultMap;
+  // The cache key of the result, or 0 if it shouldn't be added to the cache.
+  uint64_t mSerial;
+  IntSize mSize;
+  TaskGroup* mTasks;
+  std::atomic<bool> mDone;
+  bool mSucceeded;
+};
+
+/**
+ * The cache behind ScaleSurface, see Factory::SetScaledSurfaceCacheSize.
+ */
+class ScaledSurfaceCache
+{
+public:
+  static void SetMaxBytes(size_t aMaxBytes);
+  static CacheStats GetStats();
+  static void Invalidate(SourceSurface* aSurface);
+};
+
 }
 }
 
-#endif /* MOZILLA_GFX_BLUR_H_ */
+#endif /* MOZILLA_GFX_SCALE_H_ */
@@ -0,0 +1,444 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "ShadowMaskCache.h"
+#include "Blur.h"
+#include "CacheHelpers.h"
+#include "Logging.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <string.h>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+namespace {
+
+void RemoveMasks(uint64_t aSerial);
+
+// Surfaces are identified by a serial number that is attached to them the
+// first time they're used. Invalidating a surface gives it a new one, so the
+// serial also serves as its generation.
+SurfaceSerials sSurfaceSerials(RemoveMasks);
+
+struct MaskKey
+{
+  uint64_t mSerial;
+  Float mSigma;
+  // The mask's bounds, relative to the surface. For box shadow templates,
+  // which have a serial of 0, the size of the box.
+  IntRect mExtents;
+  Size mCornerRadii[4];
+
+  bool operator<(const MaskKey& aOther) const
+  {
+    if (mSerial != aOther.mSerial) {
+      return mSerial < aOther.mSerial;
+    }
+    if (mSigma != aOther.mSigma) {
+      return mSigma < aOther.mSigma;
+    }
+    if (mExtents.x != aOther.mExtents.x) {
+      return mExtents.x < aOther.mExtents.x;
+    }
+    if (mExtents.y != aOther.mExtents.y) {
+      return mExtents.y < aOther.mExtents.y;
+    }
+    if (mExtents.width != aOther.mExtents.width) {
+      return mExtents.width < aOther.mExtents.width;
+    }
+    if (mExtents.height != aOther.mExtents.height) {
+      return mExtents.height < aOther.mExtents.height;
+    }
+    for (int i = 0; i < 4; i++) {
+      if (mCornerRadii[i].width != aOther.mCornerRadii[i].width) {
+        return mCornerRadii[i].width < aOther.mCornerRadii[i].width;
+      }
+      if (mCornerRadii[i].height != aOther.mCornerRadii[i].height) {
+        return mCornerRadii[i].height < aOther.mCornerRadii[i].height;
+      }
+    }
+    return false;
+  }
+};
+
+/**
+ * The masks are shared across all DrawTargets. Shadows drawn on worker
+ * threads, by DrawTargetTiled for example, bypass the cache.
+ */
+class MaskCache
+{
+public:
+  bool IsEnabled() const { return mCache.IsEnabled(); }
+  void SetMaxBytes(size_t aMaxBytes) { mCache.SetMaxBytes(aMaxBytes); }
+  size_t GetMaxBytes() const { return mCache.GetMaxBytes(); }
+  CacheStats GetStats() const { return mCache.GetStats(); }
+
+  DataSourceSurface* Lookup(const MaskKey& aKey)
+  {
+    RefPtr<DataSourceSurface>* mask = mCache.Lookup(aKey);
+    return mask ? mask->get() : nullptr;
+  }
+
+  void Insert(const MaskKey& aKey, DataSourceSurface* aMask)
+  {
+    size_t bytes = size_t(aMask->Stride()) * aMask->GetSize().height;
+    mCache.Insert(aKey, aMask, bytes);
+  }
+
+  // Drops the masks of the surface that had aSerial.
+  void RemoveSerial(uint64_t aSerial)
+  {
+    MaskKey first = { aSerial, -std::numeric_limits<Float>::max(), IntRect() };
+    mCache.RemoveRange(first, [aSerial](const MaskKey& aKey) {
+      return aKey.mSerial == aSerial;
+    });
+  }
+
+private:
+  LRUCache<MaskKey, RefPtr<DataSourceSurface> > mCache;
+};
+
+MaskCache sMaskCache;
+
+// The serials of surfaces that have gone away since the cache was last used.
+// Like the mipmap cache's, they're collected from whichever thread releases
+// the surface and only acted on from the cache's own thread.
+std::mutex sReleasedLock;
+std::vector<uint64_t> sReleasedSerials;
+
+void
+RemoveMasks(uint64_t aSerial)
+{
+  if (!sMaskCache.GetMaxBytes()) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(sReleasedLock);
+  sReleasedSerials.push_back(aSerial);
+}
+
+// Removes the masks of released surfaces, on the cache's thread.
+void
+RemoveReleasedMasks()
+{
+  std::vector<uint64_t> released;
+  {
+    std::lock_guard<std::mutex> lock(sReleasedLock);
+    released.swap(sReleasedSerials);
+  }
+  for (size_t i = 0; i < released.size(); i++) {
+    sMaskCache.RemoveSerial(released[i]);
+  }
+}
+
+// Copies the alpha channel of aSource into aMask at aOrigin.
+void
+CopyAlpha(DataSourceSurface* aSource, DataSourceSurface* aMask, const IntPoint& aOrigin)
+{
+  IntSize size = aSource->GetSize();
+  DataSourceSurface::MappedSurface map;
+  if (!aSource->Map(DataSourceSurface::READ, &map)) {
+    return;
+  }
+
+  for (int32_t y = 0; y < size.height; y++) {
+    const uint8_t* source = map.mData + y * map.mStride;
+    uint8_t* dest = aMask->GetData() + (aOrigin.y + y) * aMask->Stride() + aOrigin.x;
+    switch (aSource->GetFormat()) {
+      case SurfaceFormat::A8:
+        memcpy(dest, source, size.width);
+        break;
+      case SurfaceFormat::B8G8R8A8:
+      case SurfaceFormat::R8G8B8A8:
+        for (int32_t x = 0; x < size.width; x++) {
+          dest[x] = source[4 * x + 3];
+        }
+        break;
+      default:
+        memset(dest, 0xff, size.width);
+        break;
+    }
+  }
+
+  aSource->Unmap();
+}
+
+bool
+IsInsideRoundedRect(const Point& aPoint, const Size& aSize, const Size* aCornerRadii)
+{
+  // The centers of the corner ellipses and the quadrant each one bounds.
+  const Point centers[4] = {
+    Point(aCornerRadii[0].width, aCornerRadii[0].height),
+    Point(aSize.width - aCornerRadii[1].width, aCornerRadii[1].height),
+    Point(aSize.width - aCornerRadii[2].width, aSize.height - aCornerRadii[2].height),
+    Point(aCornerRadii[3].width, aSize.height - aCornerRadii[3].height)
+  };
+  const Float directions[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+  for (int i = 0; i < 4; i++) {
+    Float dx = (aPoint.x - centers[i].x) * directions[i][0];
+    Float dy = (aPoint.y - centers[i].y) * directions[i][1];
+    if (dx <= 0 || dy <= 0 || aCornerRadii[i].width <= 0 || aCornerRadii[i].height <= 0) {
+      continue;
+    }
+    dx /= aCornerRadii[i].width;
+    dy /= aCornerRadii[i].height;
+    if (dx * dx + dy * dy > 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Fills the rounded rectangle of aSize at aOrigin into the A8 surface aMask.
+// The shape is convex, so pixels with all their corners inside are covered,
+// the others are sampled 4x4 times.
+void
+FillRoundedRect(DataSourceSurface* aMask, const IntPoint& aOrigin,
+                const IntSize& aSize, const Size* aCornerRadii)
+{
+  Size size(aSize.width, aSize.height);
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint8_t* dest = aMask->GetData() + (aOrigin.y + y) * aMask->Stride() + aOrigin.x;
+    if (!aCornerRadii) {
+      memset(dest, 0xff, aSize.width);
+      continue;
+    }
+    for (int32_t x = 0; x < aSize.width; x++) {
+      if (IsInsideRoundedRect(Point(x, y), size, aCornerRadii) &&
+          IsInsideRoundedRect(Point(x + 1, y), size, aCornerRadii) &&
+          IsInsideRoundedRect(Point(x, y + 1), size, aCornerRadii) &&
+          IsInsideRoundedRect(Point(x + 1, y + 1), size, aCornerRadii)) {
+        dest[x] = 0xff;
+        continue;
+      }
+      int covered = 0;
+      for (int sy = 0; sy < 4; sy++) {
+        for (int sx = 0; sx < 4; sx++) {
+          Point sample(x + (sx + 0.5f) / 4, y + (sy + 0.5f) / 4);
+          covered += IsInsideRoundedRect(sample, size, aCornerRadii);
+        }
+      }
+      dest[x] = (covered * 0xff + 8) / 16;
+    }
+  }
+}
+
+struct BoxShadowSpan
+{
+  int32_t mStart;
+  int32_t mEnd;
+  Float mScale;
+  Float mOffset;
+};
+
+// Splits [aStart, aEnd) into the spans the template, aTemplateLength long
+// along this axis, is drawn in. If aMiddle isn't negative the template pixel
+// at aMiddle is stretched over everything between the two ends, otherwise the
+// template is exactly as long as the range.
+int
+SplitBoxShadowAxis(int32_t aStart, int32_t aEnd, int32_t aTemplateLength,
+                   int32_t aMiddle, BoxShadowSpan* aSpans)
+{
+  if (aMiddle < 0) {
+    MOZ_ASSERT(aEnd - aStart == aTemplateLength);
+    BoxShadowSpan span = { aStart, aEnd, 1.0f, Float(aStart) };
+    aSpans[0] = span;
+    return 1;
+  }
+
+  int32_t middleStart = aStart + aMiddle;
+  int32_t middleEnd = aEnd - (aTemplateLength - aMiddle - 1);
+  MOZ_ASSERT(middleEnd > middleStart);
+  Float scale = Float(middleEnd - middleStart);
+  BoxShadowSpan spans[3] = {
+    { aStart, middleStart, 1.0f, Float(aStart) },
+    { middleStart, middleEnd, scale, middleStart - aMiddle * scale },
+    { middleEnd, aEnd, 1.0f, Float(aEnd - aTemplateLength) }
+  };
+  std::copy(spans, spans + 3, aSpans);
+  return 3;
+}
+
+}
+
+/* static */ TemporaryRef<DataSourceSurface>
+ShadowMaskCache::GetMask(SourceSurface* aSurface, const AlphaSourceFunction& aGetAlphaSource,
+                         Float aSigma, bool aInflate, IntPoint* aOffset)
+{
+  IntSize radius = aInflate ? AlphaBoxBlur::CalculateBlurRadius(Point(aSigma, aSigma)) : IntSize();
+  IntRect extents(IntPoint(), aSurface->GetSize());
+  extents.Inflate(radius.width, radius.height);
+  *aOffset = extents.TopLeft();
+
+  bool useCache = sMaskCache.IsEnabled();
+  MaskKey key = { 0, aSigma, extents };
+  if (useCache) {
+    RemoveReleasedMasks();
+    key.mSerial = sSurfaceSerials.Get(aSurface);
+    RefPtr<DataSourceSurface> mask = sMaskCache.Lookup(key);
+    if (mask) {
+      return mask.forget();
+    }
+  }
+
+  RefPtr<DataSourceSurface> alphaSource = aGetAlphaSource();
+  if (!alphaSource) {
+    return nullptr;
+  }
+  MOZ_ASSERT(alphaSource->GetSize() == aSurface->GetSize());
+
+  RefPtr<DataSourceSurface> mask =
+    Factory::CreateDataSourceSurface(extents.Size(), SurfaceFormat::A8, true);
+  if (MOZ2D_WARN_IF(!mask)) {
+    return nullptr;
+  }
+  CopyAlpha(alphaSource, mask, -extents.TopLeft());
+
+  AlphaBoxBlur blur(Rect(0, 0, extents.width, extents.height), mask->Stride(), aSigma, aSigma);
+  blur.BlurDownscaled(mask->GetData(), WorkerPool::Get());
+
+  if (useCache) {
+    sMaskCache.Insert(key, mask);
+  }
+  return mask.forget();
+}
+
+/* static */ TemporaryRef<DataSourceSurface>
+ShadowMaskCache::GetMask(SourceSurface* aSurface, DataSourceSurface* aAlphaSource,
+                         Float aSigma, bool aInflate, IntPoint* aOffset)
+{
+  RefPtr<DataSourceSurface> alphaSource = aAlphaSource;
+  return GetMask(aSurface, [alphaSource]() -> TemporaryRef<DataSourceSurface> {
+                   return alphaSource.get();
+                 }, aSigma, aInflate, aOffset);
+}
+
+/* static */ TemporaryRef<DataSourceSurface>
+ShadowMaskCache::GetBoxShadow(const IntRect& aBox, const Size* aCornerRadii, Float aSigma,
+                              std::vector<BoxShadowPatch>* aPatches)
+{
+  aPatches->clear();
+  IntSize radius = AlphaBoxBlur::CalculateBlurRadius(Point(aSigma, aSigma));
+
+  // How far the corners reach into the box from each side.
+  int32_t left = 0, top = 0, right = 0, bottom = 0;
+  if (aCornerRadii) {
+    left = int32_t(ceil(std::max(aCornerRadii[0].width, aCornerRadii[3].width)));
+    top = int32_t(ceil(std::max(aCornerRadii[0].height, aCornerRadii[1].height)));
+    right = int32_t(ceil(std::max(aCornerRadii[1].width, aCornerRadii[2].width)));
+    bottom = int32_t(ceil(std::max(aCornerRadii[2].height, aCornerRadii[3].height)));
+  }
+
+  // The blur of the middle pixel of the template must not reach the corners
+  // on either side, so that it is the same as anywhere else along the middle
+  // of a larger box. The pixels next to it are kept the same as well, so
+  // filtering it while stretching doesn't pick up anything else. A blur at
+  // reduced resolution reaches up to about two reduced pixels further.
+  int32_t factor = AlphaBoxBlur::DownscaleFactor(aSigma);
+  int32_t reachX = radius.width + (factor > 1 ? 2 * factor : 0);
+  int32_t reachY = radius.height + (factor > 1 ? 2 * factor : 0);
+  IntSize minSize(left + right + 2 * reachX + 3, top + bottom + 2 * reachY + 3);
+  bool stretchX = aBox.width >= minSize.width;
+  bool stretchY = aBox.height >= minSize.height;
+  IntSize shapeSize(stretchX ? minSize.width : aBox.width,
+                    stretchY ? minSize.height : aBox.height);
+  IntSize templateSize(shapeSize.width + 2 * radius.width,
+                       shapeSize.height + 2 * radius.height);
+
+  bool useCache = sMaskCache.IsEnabled();
+  MaskKey key = { 0, aSigma, IntRect(IntPoint(), shapeSize) };
+  if (aCornerRadii) {
+    std::copy(aCornerRadii, aCornerRadii + 4, key.mCornerRadii);
+  }
+  RefPtr<DataSourceSurface> shadowTemplate;
+  if (useCache) {
+    shadowTemplate = sMaskCache.Lookup(key);
+  }
+
+  if (!shadowTemplate) {
+    shadowTemplate = Factory::CreateDataSourceSurface(templateSize, SurfaceFormat::A8, true);
+    if (MOZ2D_WARN_IF(!shadowTemplate)) {
+      return nullptr;
+    }
+    FillRoundedRect(shadowTemplate, IntPoint(radius.width, radius.height), shapeSize, aCornerRadii);
+
+    AlphaBoxBlur blur(Rect(0, 0, templateSize.width, templateSize.height),
+                      shadowTemplate->Stride(), aSigma, aSigma);
+    blur.BlurDownscaled(shadowTemplate->GetData(), WorkerPool::Get());
+
+    if (useCache) {
+      sMaskCache.Insert(key, shadowTemplate);
+    }
+  }
+
+  IntRect dest = aBox;
+  dest.Inflate(radius.width, radius.height);
+  BoxShadowSpan columns[3], rows[3];
+  int columnCount =
+    SplitBoxShadowAxis(dest.x, dest.XMost(), templateSize.width,
+                       stretchX ? radius.width + left + reachX + 1 : -1, columns);
+  int rowCount =
+    SplitBoxShadowAxis(dest.y, dest.YMost(), templateSize.height,
+                       stretchY ? radius.height + top + reachY + 1 : -1, rows);
+
+  for (int row = 0; row < rowCount; row++) {
+    for (int column = 0; column < columnCount; column++) {
+      const BoxShadowSpan& x = columns[column];
+      const BoxShadowSpan& y = rows[row];
+      BoxShadowPatch patch;
+      patch.mDest = IntRect(x.mStart, y.mStart, x.mEnd - x.mStart, y.mEnd - y.mStart);
+      patch.mTemplateTransform = Matrix(x.mScale, 0, 0, y.mScale, x.mOffset, y.mOffset);
+      aPatches->push_back(patch);
+    }
+  }
+
+  return shadowTemplate.forget();
+}
+
+/* static */ bool
+ShadowMaskCache::IsEnabled()
+{
+  return sMaskCache.IsEnabled();
+}
+
+/* static */ void
+ShadowMaskCache::SetMaxBytes(size_t aMaxBytes)
+{
+  {
+    std::lock_guard<std::mutex> lock(sReleasedLock);
+    sReleasedSerials.clear();
+  }
+  sMaskCache.SetMaxBytes(aMaxBytes);
+}
+
+/* static */ CacheStats
+ShadowMaskCache::GetStats()
+{
+  if (sMaskCache.IsEnabled()) {
+    RemoveReleasedMasks();
+  }
+  return sMaskCache.GetStats();
+}
+
+/* static */ void
+ShadowMaskCache::Invalidate(SourceSurface* aSurface)
+{
+  if (!sMaskCache.IsEnabled()) {
+    return;
+  }
+  uint64_t serial = sSurfaceSerials.Renew(aSurface);
+  if (serial) {
+    sMaskCache.RemoveSerial(serial);
+  }
+}
+
+}
+}
@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_SHADOWMASKCACHE_H_
+#define MOZILLA_GFX_SHADOWMASKCACHE_H_
+
+#include "2D.h"
+
+#include <functional>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+/**
+ * A piece of a box shadow, see ShadowMaskCache::GetBoxShadow.
+ */
+struct BoxShadowPatch
+{
+  // The area covered by the patch.
+  IntRect mDest;
+  // Maps the template onto mDest. Only patches along the middle of the box
+  // stretch it, by repeating the template's middle row or column.
+  Matrix mTemplateTransform;
+};
+
+/**
+ * Blurred alpha masks for DrawSurfaceWithShadow, shared by the software
+ * backends and kept across draws, see Factory::SetShadowMaskCacheSize.
+ *
+ * Masks are keyed by the identity of the source surface, the standard
+ * deviation and the extents of the mask. The shadow color isn't part of the
+ * key, it is only applied when the mask is drawn, so a surface drawn with
+ * shadows of different colors shares one mask.
+ *
+ * The templates of box shadows share the cache and its budget.
+ */
+class ShadowMaskCache
+{
+public:
+  typedef std::function<TemporaryRef<DataSourceSurface>()> AlphaSourceFunction;
+
+  /**
+   * Returns the alpha channel of aSurface blurred by aSigma with
+   * AlphaBoxBlur::BlurDownscaled, as an A8 surface. The alpha is read from the surface aGetAlphaSource
+   * returns, which must be the size of aSurface. aGetAlphaSource is only
+   * called when the mask isn't cached yet, so callers can put off reading
+   * back aSurface until then.
+   *
+   * If aInflate is true the mask is larger than aSurface by the blur radius on
+   * every side, so the shadow can spread out of it, otherwise the blur is
+   * confined to aSurface's bounds. *aOffset is set to the position of the
+   * mask relative to aSurface. Returns null if the mask couldn't be allocated
+   * or aGetAlphaSource returned null.
+   *
+   * Masks are created but not cached when the cache is disabled, or when this
+   * is called on a thread other than the one that configured it.
+   */
+  static TemporaryRef<DataSourceSurface>
+    GetMask(SourceSurface* aSurface, const AlphaSourceFunction& aGetAlphaSource,
+            Float aSigma, bool aInflate, IntPoint* aOffset);
+
+  /**
+   * GetMask for an alpha source that is already at hand.
+   */
+  static TemporaryRef<DataSourceSurface>
+    GetMask(SourceSurface* aSurface, DataSourceSurface* aAlphaSource,
+            Float aSigma, bool aInflate, IntPoint* aOffset);
+
+  /**
+   * Returns a blurred template for the shadow of aBox, rounded by aCornerRadii
+   * if not null, and fills aPatches with the pieces that together draw the
+   * shadow from it. The template contains the box's corners and the middle of
+   * its edges at a size that only depends on the radii and aSigma, so a box
+   * that is larger than that shares its template with all other such boxes.
+   * Smaller boxes are blurred in full along the axes they're too small in.
+   *
+   * The patches cover aBox inflated by the blur radius, without overlapping.
+   * aCornerRadii are in the order of AppendRoundedRectToPath. Returns null if
+   * the template couldn't be allocated.
+   */
+  static TemporaryRef<DataSourceSurface>
+    GetBoxShadow(const IntRect& aBox, const Size* aCornerRadii, Float aSigma,
+                 std::vector<BoxShadowPatch>* aPatches);
+
+  /**
+   * Whether GetMask caches the masks it returns on this thread.
+   */
+  static bool IsEnabled();
+
+  static void SetMaxBytes(size_t aMaxBytes);
+  static CacheStats GetStats();
+  static void Invalidate(SourceSurface* aSurface);
+};
+
+}
+}
+
+#endif /* MOZILLA_GFX_SHADOWMASKCACHE_H_ */
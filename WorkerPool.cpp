@@ -0,0 +1,205 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace mozilla {
+namespace gfx {
+
+WorkerPool::WorkerPool(uint32_t aThreadCount)
+  : mPendingTasks(0)
+  , mNextQueue(0)
+  , mShutdown(false)
+{
+  aThreadCount = std::max<uint32_t>(aThreadCount, 1);
+  for (uint32_t i = 0; i < aThreadCount; i++) {
+    mQueues.push_back(new WorkerQueue());
+  }
+  for (uint32_t i = 0; i < aThreadCount; i++) {
+    mThreads.push_back(std::thread(&WorkerPool::WorkerLoop, this, i));
+  }
+}
+
+WorkerPool::~WorkerPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mSleepLock);
+    mShutdown = true;
+  }
+  mWakeUp.notify_all();
+
+  for (size_t i = 0; i < mThreads.size(); i++) {
+    mThreads[i].join();
+  }
+  for (size_t i = 0; i < mQueues.size(); i++) {
+    delete mQueues[i];
+  }
+}
+
+WorkerPool*
+WorkerPool::Get()
+{
+  // Intentionally leaked, joining worker threads from a static destructor
+  // is asking for trouble.
+  static WorkerPool* sPool = new WorkerPool(std::thread::hardware_concurrency());
+  return sPool;
+}
+
+void
+WorkerPool::Submit(const Task& aTask, TaskGroup* aGroup)
+{
+  size_t index = mNextQueue++ % mQueues.size();
+  {
+    std::lock_guard<std::mutex> lock(mQueues[index]->mLock);
+    QueuedTask task = { aTask, aGroup };
+    mQueues[index]->mTasks.push_back(task);
+  }
+
+  mPendingTasks++;
+  // Take the sleep lock so a worker that just found nothing to do can't miss
+  // this notification between checking mPendingTasks and going to sleep.
+  std::lock_guard<std::mutex> lock(mSleepLock);
+  mWakeUp.notify_one();
+}
+
+bool
+WorkerPool::PopTask(size_t aPreferredQueue, QueuedTask* aTask)
+{
+  if (!mPendingTasks) {
+    return false;
+  }
+
+  {
+    WorkerQueue* own = mQueues[aPreferredQueue];
+    std::lock_guard<std::mutex> lock(own->mLock);
+    if (!own->mTasks.empty()) {
+      *aTask = own->mTasks.back();
+      own->mTasks.pop_back();
+      mPendingTasks--;
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < mQueues.size(); i++) {
+    WorkerQueue* victim = mQueues[(aPreferredQueue + i) % mQueues.size()];
+    std::lock_guard<std::mutex> lock(victim->mLock);
+    if (!victim->mTasks.empty()) {
+      *aTask = victim->mTasks.front();
+      victim->mTasks.pop_front();
+      mPendingTasks--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+WorkerPool::RunTask(QueuedTask& aTask)
+{
+  aTask.mTask();
+  // Release anything captured by the task before the group is signalled.
+  aTask.mTask = nullptr;
+  aTask.mGroup->TaskFinished();
+}
+
+bool
+WorkerPool::RunPendingTask()
+{
+  QueuedTask task;
+  if (!PopTask(mNextQueue % mQueues.size(), &task)) {
+    return false;
+  }
+  RunTask(task);
+  return true;
+}
+
+void
+WorkerPool::WorkerLoop(size_t aIndex)
+{
+  for (;;) {
+    QueuedTask task;
+    if (PopTask(aIndex, &task)) {
+      RunTask(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mSleepLock);
+    while (!mShutdown && !mPendingTasks) {
+      mWakeUp.wait(lock);
+    }
+    if (mShutdown) {
+      return;
+    }
+  }
+}
+
+void
+TaskGroup::Dispatch(const WorkerPool::Task& aTask)
+{
+  if (!mPool) {
+    aTask();
+    return;
+  }
+
+  mOutstanding++;
+  mPool->Submit(aTask, this);
+}
+
+void
+TaskGroup::TaskFinished()
+{
+  // Decrement under the lock, Wait() takes it before returning so the group
+  // can't be destroyed while we're still touching it.
+  std::lock_guard<std::mutex> lock(mLock);
+  if (--mOutstanding == 0) {
+    mDone.notify_all();
+  }
+}
+
+void
+TaskGroup::Wait()
+{
+  while (mOutstanding) {
+    if (mPool->RunPendingTask()) {
+      continue;
+    }
+
+    // Everything we're waiting for is already running on some other thread.
+    // Use a timeout since running tasks may queue new work we can help with.
+    std::unique_lock<std::mutex> lock(mLock);
+    if (mOutstanding) {
+      mDone.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mLock);
+}
+
+void
+ParallelFor(WorkerPool* aPool, int32_t aBegin, int32_t aEnd,
+            const std::function<void(int32_t)>& aFunc)
+{
+  if (!aPool || aEnd - aBegin <= 1) {
+    for (int32_t i = aBegin; i < aEnd; i++) {
+      aFunc(i);
+    }
+    return;
+  }
+
+  TaskGroup group(aPool);
+  // Keep the last index for the calling thread, it would otherwise just sit
+  // in Wait().
+  for (int32_t i = aBegin; i < aEnd - 1; i++) {
+    group.Dispatch([&aFunc, i] () { aFunc(i); });
+  }
+  aFunc(aEnd - 1);
+  group.Wait();
+}
+
+}
+}
@@ -0,0 +1,137 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#ifndef MOZILLA_GFX_WORKERPOOL_H_
+#define MOZILLA_GFX_WORKERPOOL_H_
+
+#include "Types.h"
+#include "mozilla/Attributes.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+class TaskGroup;
+
+/**
+ * A fixed size pool of worker threads used to spread CPU bound rendering work
+ * over several cores.
+ *
+ * Every worker owns a task queue. Submitted tasks are distributed over those
+ * queues in a round-robin fashion, a worker pops from the back of its own
+ * queue and, when that is empty, steals from the front of the queues of the
+ * other workers. Threads that wait for a TaskGroup to complete help by
+ * running queued tasks themselves, which makes it safe to wait for a group
+ * from inside another task.
+ *
+ * Tasks must not throw, and anything they touch must be safe to use from a
+ * thread other than the one that submitted them. In particular most objects
+ * in this library use non-atomic reference counting; tasks should work on
+ * raw pointers to objects whose lifetime is guaranteed by the submitter.
+ */
+class WorkerPool
+{
+public:
+  typedef std::function<void()> Task;
+
+  explicit WorkerPool(uint32_t aThreadCount);
+  ~WorkerPool();
+
+  /**
+   * Returns the process wide pool, which is created on first use with one
+   * thread per hardware thread. It is never destroyed.
+   */
+  static WorkerPool* Get();
+
+  uint32_t GetThreadCount() const { return mThreads.size(); }
+
+  /**
+   * Runs one queued task on the calling thread, if there is one. Returns
+   * false if all queues were empty.
+   */
+  bool RunPendingTask();
+
+private:
+  friend class TaskGroup;
+
+  struct QueuedTask {
+    Task mTask;
+    TaskGroup* mGroup;
+  };
+
+  struct WorkerQueue {
+    std::mutex mLock;
+    std::deque<QueuedTask> mTasks;
+  };
+
+  void Submit(const Task& aTask, TaskGroup* aGroup);
+  bool PopTask(size_t aPreferredQueue, QueuedTask* aTask);
+  void RunTask(QueuedTask& aTask);
+  void WorkerLoop(size_t aIndex);
+
+  std::vector<WorkerQueue*> mQueues;
+  std::vector<std::thread> mThreads;
+
+  std::mutex mSleepLock;
+  std::condition_variable mWakeUp;
+  std::atomic<uint32_t> mPendingTasks;
+  std::atomic<uint32_t> mNextQueue;
+  bool mShutdown;
+};
+
+/**
+ * A set of tasks that can be waited upon as a whole. Wait() is the join point;
+ * the destructor waits as well so a group can't go out of scope while its
+ * tasks are still running.
+ *
+ * A group created with a null pool runs every task synchronously inside
+ * Dispatch(). This makes it easy for callers to offer a single threaded mode.
+ */
+class TaskGroup
+{
+public:
+  explicit TaskGroup(WorkerPool* aPool)
+    : mPool(aPool)
+    , mOutstanding(0)
+  {}
+  ~TaskGroup() { Wait(); }
+
+  void Dispatch(const WorkerPool::Task& aTask);
+  void Wait();
+
+private:
+  friend class WorkerPool;
+
+  void TaskFinished();
+
+  TaskGroup(const TaskGroup&) MOZ_DELETE;
+  TaskGroup& operator=(const TaskGroup&) MOZ_DELETE;
+
+  WorkerPool* mPool;
+  std::atomic<uint32_t> mOutstanding;
+  std::mutex mLock;
+  std::condition_variable mDone;
+};
+
+/**
+ * Calls aFunc for every index in [aBegin, aEnd) on aPool and returns once all
+ * calls have finished. With a null pool, or a single index, everything runs
+ * on the calling thread. Callers are expected to pick a granularity where
+ * every index represents a reasonable amount of work.
+ */
+void ParallelFor(WorkerPool* aPool, int32_t aBegin, int32_t aEnd,
+                 const std::function<void(int32_t)>& aFunc);
+
+}
+}
+
+#endif /* MOZILLA_GFX_WORKERPOOL_H_ */
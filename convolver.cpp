@@ -28,17 +28,23 @@
 
 #include "2D.h"
 #include "convolver.h"
+#include "WorkerPool.h"
 
 #include <algorithm>
 
-#include "skia/SkTypes.h"
+#include "SkTypes.h"
 
 
 #if defined(USE_SSE2)
 #include "convolverSSE2.h"
 #endif
+#if defined(USE_AVX2)
+#include "convolverAVX2.h"
+#endif
 
 using mozilla::gfx::Factory;
+using mozilla::gfx::ParallelFor;
+using mozilla::gfx::WorkerPool;
 
 #if defined(SK_CPU_LENDIAN)
 #define R_OFFSET_IDX 0
@@ -338,22 +344,25 @@ void ConvolutionFilter1D::AddFilter(int filter_offset,
   max_filter_ = std::max(max_filter_, filter_length);
 }
 
-void BGRAConvolve2D(const unsigned char* source_data,
-                    int source_byte_row_stride,
-                    bool source_has_alpha,
-                    const ConvolutionFilter1D& filter_x,
-                    const ConvolutionFilter1D& filter_y,
-                    int output_byte_row_stride,
-                    unsigned char* output) {
-  bool use_sse2 = Factory::HasSSE2();
-
-#if !defined(USE_SSE2)
-  // Even we have runtime support for SSE2 instructions, since the binary
-  // was not built with SSE2 support, we had to fallback to C version.
-  use_sse2 = false;
-#endif
-
+namespace {
 
+// Bands are at least this many output rows high, so that the rows that
+// neighbouring bands both convolve horizontally stay a small part of the work.
+const int kMinBandRows = 32;
+
+// Runs the row buffer pipeline for the output rows [out_begin, out_end).
+// Every band has a row buffer of its own, filled with the horizontally
+// convolved source rows its vertical filters need, so the bands don't
+// depend on each other and can run concurrently.
+void ConvolveBand(const unsigned char* source_data,
+                  int source_byte_row_stride,
+                  bool source_has_alpha,
+                  const ConvolutionFilter1D& filter_x,
+                  const ConvolutionFilter1D& filter_y,
+                  int output_byte_row_stride,
+                  unsigned char* output,
+                  int out_begin, int out_end,
+                  bool use_sse2, bool use_avx2) {
   int max_y_filter_size = filter_y.max_filter();
 
   // The next row in the input that we will generate a horizontally
@@ -363,7 +372,7 @@ void BGRAConvolve2D(const unsigned char* source_data,
   // row for convolution as the first pixel for the first vertical filter.
   int filter_offset, filter_length;
   const ConvolutionFilter1D::Fixed* filter_values =
-      filter_y.FilterForValue(0, &filter_offset, &filter_length);
+      filter_y.FilterForValue(out_begin, &filter_offset, &filter_length);
   int next_x_row = filter_offset;
 
   // We loop over each row in the input doing a horizontal convolution. This
@@ -384,17 +393,17 @@ void BGRAConvolve2D(const unsigned char* source_data,
 
   // Loop over every possible output row, processing just enough horizontal
   // convolutions to run each subsequent vertical convolution.
-  SkASSERT(output_byte_row_stride >= filter_x.num_values() * 4);
   int num_output_rows = filter_y.num_values();
   int pixel_width = filter_x.num_values();
 
   // We need to check which is the last line to convolve before we advance 4
-  // lines in one iteration.
+  // lines in one iteration. This is the last line of the whole image, not of
+  // this band, as it is what bounds the reads from the source.
   int last_filter_offset, last_filter_length;
   filter_y.FilterForValue(num_output_rows - 1, &last_filter_offset,
                           &last_filter_length);
 
-  for (int out_y = 0; out_y < num_output_rows; out_y++) {
+  for (int out_y = out_begin; out_y < out_end; out_y++) {
     filter_values = filter_y.FilterForValue(out_y,
                                             &filter_offset, &filter_length);
 
@@ -411,7 +420,13 @@ void BGRAConvolve2D(const unsigned char* source_data,
             src[i] = &source_data[(next_x_row + i) * source_byte_row_stride];
             out_row[i] = row_buffer.AdvanceRow();
           }
-          ConvolveHorizontally4_SSE2(src, 0, pixel_width, filter_x, out_row);
+          if (use_avx2) {
+#if defined(USE_AVX2)
+            ConvolveHorizontally4_AVX2(src, 0, pixel_width, filter_x, out_row);
+#endif
+          } else {
+            ConvolveHorizontally4_SSE2(src, 0, pixel_width, filter_x, out_row);
+          }
           next_x_row += 4;
         } else {
           unsigned char* buffer = row_buffer.AdvanceRow();
@@ -472,9 +487,16 @@ void BGRAConvolve2D(const unsigned char* source_data,
 #if defined(USE_SSE2)
     int simd_width = pixel_width & ~3;
     if (use_sse2 && simd_width) {
+      if (use_avx2) {
+#if defined(USE_AVX2)
+        ConvolveVertically_AVX2(filter_values, filter_length, first_row_for_filter,
+                                0, simd_width, cur_output_row, source_has_alpha);
+#endif
+      } else {
         ConvolveVertically_SSE2(filter_values, filter_length, first_row_for_filter,
                                 0, simd_width, cur_output_row, source_has_alpha);
-        processed = simd_width;
+      }
+      processed = simd_width;
     }
 #endif
     if (source_has_alpha) {
@@ -489,4 +511,48 @@ void BGRAConvolve2D(const unsigned char* source_data,
   }
 }
 
+}  // namespace
+
+void BGRAConvolve2D(const unsigned char* source_data,
+                    int source_byte_row_stride,
+                    bool source_has_alpha,
+                    const ConvolutionFilter1D& filter_x,
+                    const ConvolutionFilter1D& filter_y,
+                    int output_byte_row_stride,
+                    unsigned char* output,
+                    WorkerPool* pool) {
+  bool use_sse2 = Factory::HasSSE2();
+
+#if !defined(USE_SSE2)
+  // Even we have runtime support for SSE2 instructions, since the binary
+  // was not built with SSE2 support, we had to fallback to C version.
+  use_sse2 = false;
+#endif
+
+  // The AVX2 loops are only used together with the SSE2 ones, which handle
+  // the rows and columns left over by them.
+  bool use_avx2 = use_sse2 && Factory::HasAVX2();
+#if !defined(USE_AVX2)
+  use_avx2 = false;
+#endif
+
+  SkASSERT(output_byte_row_stride >= filter_x.num_values() * 4);
+  int num_output_rows = filter_y.num_values();
+
+  int min_band_rows = std::max(kMinBandRows, filter_y.max_filter());
+  int bands = 1;
+  if (pool) {
+    bands = std::max(1, std::min(static_cast<int>(pool->GetThreadCount()),
+                                 num_output_rows / min_band_rows));
+  }
+
+  ParallelFor(bands > 1 ? pool : NULL, 0, bands, [&] (int32_t band) {
+    int out_begin = static_cast<int>(int64_t(num_output_rows) * band / bands);
+    int out_end = static_cast<int>(int64_t(num_output_rows) * (band + 1) / bands);
+    ConvolveBand(source_data, source_byte_row_stride, source_has_alpha,
+                 filter_x, filter_y, output_byte_row_stride, output,
+                 out_begin, out_end, use_sse2, use_avx2);
+  });
+}
+
 }  // namespace skia
@@ -40,6 +40,12 @@
 #undef FixedToFloat
 #endif
 
+namespace mozilla {
+namespace gfx {
+class WorkerPool;
+}
+}
+
 namespace skia {
 
 // Represents a filter in one dimension. Each output pixel has one entry in this
@@ -71,7 +77,7 @@ class ConvolutionFilter1D {
     // The cast relies on Fixed being a short, implying that on
     // the platforms we care about all (16) bits will fit into
     // the mantissa of a (32-bit) float.
-    COMPILE_ASSERT(sizeof(Fixed) == 2, fixed_type_should_fit_in_float_mantissa);
+    static_assert(sizeof(Fixed) == 2, "Fixed type should fit in float mantissa");
     float raw = static_cast<float>(x);
     return ldexpf(raw, -kShiftBits);
   }
@@ -174,13 +180,18 @@ class ConvolutionFilter1D {
 //
 // The layout in memory is assumed to be 4-bytes per pixel in B-G-R-A order
 // (this is ARGB when loaded into 32-bit words on a little-endian machine).
+//
+// If |pool| is not null, images with enough output rows are split into bands
+// of rows that are convolved on its threads. The result is the same either
+// way.
 void BGRAConvolve2D(const unsigned char* source_data,
                     int source_byte_row_stride,
                     bool source_has_alpha,
                     const ConvolutionFilter1D& xfilter,
                     const ConvolutionFilter1D& yfilter,
                     int output_byte_row_stride,
-                    unsigned char* output);
+                    unsigned char* output,
+                    mozilla::gfx::WorkerPool* pool = NULL);
 
 }  // namespace skia
 
@@ -0,0 +1,290 @@
+// Copyright (c) 2006-2011 The Chromium Authors. All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+//  * Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in
+//    the documentation and/or other materials provided with the
+//    distribution.
+//  * Neither the name of Google, Inc. nor the names of its contributors
+//    may be used to endorse or promote products derived from this
+//    software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+// OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+// AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+// OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+// OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+// SUCH DAMAGE.
+
+// This file is built with the same flags as the rest of Moz2D, only the code
+// below the target pragma gets AVX2 code generation. The headers above it
+// hold inline functions and templates that other files use as well, like
+// ConvolutionFilter1D::FilterForValue, and their copies emitted here must not
+// contain AVX2 instructions.
+
+#include "convolverAVX2.h"
+#include "convolverSSE2.h"
+
+#include <immintrin.h>
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+#ifndef USE_AVX2
+static_assert(false, "If this file is built, convolver.cpp should know about it!");
+#endif
+
+namespace skia {
+
+namespace {
+
+// Multiplies the two pixels in each half of |src16| with the coefficients
+// broadcast in |coeff16| and adds the products to |accum|, pixel by pixel.
+inline __m128i MultiplyAccumulate(__m128i accum, __m128i src16, __m128i coeff16) {
+  __m128i mul_hi = _mm_mulhi_epi16(src16, coeff16);
+  __m128i mul_lo = _mm_mullo_epi16(src16, coeff16);
+  accum = _mm_add_epi32(accum, _mm_unpacklo_epi16(mul_lo, mul_hi));
+  return _mm_add_epi32(accum, _mm_unpackhi_epi16(mul_lo, mul_hi));
+}
+
+inline __m256i MultiplyAccumulate(__m256i accum, __m256i src16, __m256i coeff16) {
+  __m256i mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+  __m256i mul_lo = _mm256_mullo_epi16(src16, coeff16);
+  accum = _mm256_add_epi32(accum, _mm256_unpacklo_epi16(mul_lo, mul_hi));
+  return _mm256_add_epi32(accum, _mm256_unpackhi_epi16(mul_lo, mul_hi));
+}
+
+// Applies four taps, whose coefficients are the low four of |coeff|, to the
+// four pixels at |src|.
+inline __m128i ConvolveFourTaps(__m128i accum, const unsigned char* src, __m128i coeff) {
+  __m128i zero = _mm_setzero_si128();
+  // [16] c1 c1 c1 c1 c0 c0 c0 c0
+  __m128i coeff16lo = _mm_shufflelo_epi16(coeff, _MM_SHUFFLE(1, 1, 0, 0));
+  coeff16lo = _mm_unpacklo_epi16(coeff16lo, coeff16lo);
+  // [16] c3 c3 c3 c3 c2 c2 c2 c2
+  __m128i coeff16hi = _mm_shufflelo_epi16(coeff, _MM_SHUFFLE(3, 3, 2, 2));
+  coeff16hi = _mm_unpacklo_epi16(coeff16hi, coeff16hi);
+
+  __m128i src8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  accum = MultiplyAccumulate(accum, _mm_unpacklo_epi8(src8, zero), coeff16lo);
+  return MultiplyAccumulate(accum, _mm_unpackhi_epi8(src8, zero), coeff16hi);
+}
+
+// Packs the 32 bit channels of the pixel in |accum| into 8 bits and stores it.
+inline void StorePixel(__m128i accum, unsigned char* out) {
+  __m128i zero = _mm_setzero_si128();
+  accum = _mm_srai_epi32(accum, ConvolutionFilter1D::kShiftBits);
+  accum = _mm_packs_epi32(accum, zero);
+  accum = _mm_packus_epi16(accum, zero);
+  *(reinterpret_cast<int*>(out)) = _mm_cvtsi128_si32(accum);
+}
+
+}  // namespace
+
+// Convolves horizontally along four rows. The row data is given in
+// |src_data| and continues for the [begin, end) of the filter.
+// The algorithm is the same as |ConvolveHorizontally4_SSE2|, except that eight
+// taps are applied per iteration: the low 128 bit lane of each register
+// handles the first four of them, the high lane the other four.
+void ConvolveHorizontally4_AVX2(const unsigned char* src_data[4],
+                                int begin, int end,
+                                const ConvolutionFilter1D& filter,
+                                unsigned char* out_row[4]) {
+  int filter_offset, filter_length;
+  __m256i zero = _mm256_setzero_si256();
+  __m128i mask[3];
+  // |mask| will be used to decimate all extra filter coefficients that are
+  // loaded by SIMD when |filter_length| is not divisible by 4.
+  mask[0] = _mm_set_epi16(0, 0, 0, 0, 0, 0, 0, -1);
+  mask[1] = _mm_set_epi16(0, 0, 0, 0, 0, 0, -1, -1);
+  mask[2] = _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+
+  // Output one pixel of each row per iteration.
+  for (int out_x = begin; out_x < end; out_x++) {
+    const ConvolutionFilter1D::Fixed* filter_values =
+        filter.FilterForValue(out_x, &filter_offset, &filter_length);
+
+    __m256i accum[4];
+    for (int i = 0; i < 4; i++) {
+      accum[i] = zero;
+    }
+    int start = filter_offset << 2;
+    for (int filter_x = 0; filter_x < (filter_length >> 3); filter_x++) {
+      // [16] c7 c6 c5 c4 c3 c2 c1 c0
+      __m128i coeff8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(filter_values));
+      // [16] xx xx xx xx c7 c6 c5 c4 | xx xx xx xx c3 c2 c1 c0
+      __m256i coeff = _mm256_inserti128_si256(_mm256_castsi128_si256(coeff8),
+                                              _mm_srli_si128(coeff8, 8), 1);
+      // [16] c5 c5 c5 c5 c4 c4 c4 c4 | c1 c1 c1 c1 c0 c0 c0 c0
+      __m256i coeff16lo = _mm256_shufflelo_epi16(coeff, _MM_SHUFFLE(1, 1, 0, 0));
+      coeff16lo = _mm256_unpacklo_epi16(coeff16lo, coeff16lo);
+      // [16] c7 c7 c7 c7 c6 c6 c6 c6 | c3 c3 c3 c3 c2 c2 c2 c2
+      __m256i coeff16hi = _mm256_shufflelo_epi16(coeff, _MM_SHUFFLE(3, 3, 2, 2));
+      coeff16hi = _mm256_unpacklo_epi16(coeff16hi, coeff16hi);
+
+      for (int i = 0; i < 4; i++) {
+        // [8] p7 p6 p5 p4 | p3 p2 p1 p0
+        __m256i src8 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(src_data[i] + start));
+        accum[i] = MultiplyAccumulate(accum[i], _mm256_unpacklo_epi8(src8, zero), coeff16lo);
+        accum[i] = MultiplyAccumulate(accum[i], _mm256_unpackhi_epi8(src8, zero), coeff16hi);
+      }
+
+      start += 32;
+      filter_values += 8;
+    }
+
+    // Add up the two lanes, then apply the remaining taps four at a time
+    // like the SSE2 version does.
+    __m128i accum128[4];
+    for (int i = 0; i < 4; i++) {
+      accum128[i] = _mm_add_epi32(_mm256_castsi256_si128(accum[i]),
+                                  _mm256_extracti128_si256(accum[i], 1));
+    }
+
+    int r = filter_length & 7;
+    if (r >= 4) {
+      __m128i coeff = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(filter_values));
+      for (int i = 0; i < 4; i++) {
+        accum128[i] = ConvolveFourTaps(accum128[i], src_data[i] + start, coeff);
+      }
+      start += 16;
+      filter_values += 4;
+      r -= 4;
+    }
+    if (r) {
+      // Note: filter_values must be padded to align_up(filter_offset, 8);
+      __m128i coeff = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(filter_values));
+      // Mask out extra filter taps.
+      coeff = _mm_and_si128(coeff, mask[r - 1]);
+      for (int i = 0; i < 4; i++) {
+        accum128[i] = ConvolveFourTaps(accum128[i], src_data[i] + start, coeff);
+      }
+    }
+
+    for (int i = 0; i < 4; i++) {
+      StorePixel(accum128[i], out_row[i]);
+      out_row[i] += 4;
+    }
+  }
+}
+
+// Does vertical convolution to produce one output row. Eight pixels are
+// computed per iteration, four in each 128 bit lane. The few pixels left over
+// at the end are passed on to the SSE2 version.
+template<bool has_alpha>
+void ConvolveVertically_AVX2_impl(const ConvolutionFilter1D::Fixed* filter_values,
+                                  int filter_length,
+                                  unsigned char* const* source_data_rows,
+                                  int begin, int end,
+                                  unsigned char* out_row) {
+  __m256i zero = _mm256_setzero_si256();
+  int out_x;
+  for (out_x = begin; out_x + 7 < end; out_x += 8) {
+    // Accumulated result for each pixel. 32 bits per RGBA channel, the
+    // low lane holds pixels 0 to 3, the high lane pixels 4 to 7.
+    __m256i accum0 = zero;
+    __m256i accum1 = zero;
+    __m256i accum2 = zero;
+    __m256i accum3 = zero;
+
+    // Convolve with one filter coefficient per iteration.
+    for (int filter_y = 0; filter_y < filter_length; filter_y++) {
+      __m256i coeff16 = _mm256_set1_epi16(filter_values[filter_y]);
+
+      // [8] p7 p6 p5 p4 | p3 p2 p1 p0
+      __m256i src8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+          &source_data_rows[filter_y][out_x << 2]));
+
+      // [16] p5 p4 | p1 p0
+      __m256i src16 = _mm256_unpacklo_epi8(src8, zero);
+      __m256i mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+      __m256i mul_lo = _mm256_mullo_epi16(src16, coeff16);
+      // [32] p4 | p0
+      accum0 = _mm256_add_epi32(accum0, _mm256_unpacklo_epi16(mul_lo, mul_hi));
+      // [32] p5 | p1
+      accum1 = _mm256_add_epi32(accum1, _mm256_unpackhi_epi16(mul_lo, mul_hi));
+
+      // [16] p7 p6 | p3 p2
+      src16 = _mm256_unpackhi_epi8(src8, zero);
+      mul_hi = _mm256_mulhi_epi16(src16, coeff16);
+      mul_lo = _mm256_mullo_epi16(src16, coeff16);
+      // [32] p6 | p2
+      accum2 = _mm256_add_epi32(accum2, _mm256_unpacklo_epi16(mul_lo, mul_hi));
+      // [32] p7 | p3
+      accum3 = _mm256_add_epi32(accum3, _mm256_unpackhi_epi16(mul_lo, mul_hi));
+    }
+
+    // Shift right for fixed point implementation.
+    accum0 = _mm256_srai_epi32(accum0, ConvolutionFilter1D::kShiftBits);
+    accum1 = _mm256_srai_epi32(accum1, ConvolutionFilter1D::kShiftBits);
+    accum2 = _mm256_srai_epi32(accum2, ConvolutionFilter1D::kShiftBits);
+    accum3 = _mm256_srai_epi32(accum3, ConvolutionFilter1D::kShiftBits);
+
+    // Packing works within lanes, so this puts the pixels back in order.
+    // [16] p5 p4 | p1 p0
+    accum0 = _mm256_packs_epi32(accum0, accum1);
+    // [16] p7 p6 | p3 p2
+    accum2 = _mm256_packs_epi32(accum2, accum3);
+    // [8] p7 p6 p5 p4 | p3 p2 p1 p0
+    accum0 = _mm256_packus_epi16(accum0, accum2);
+
+    if (has_alpha) {
+      // Make sure the value of alpha channel is always larger than maximum
+      // value of color channels.
+      __m256i a = _mm256_srli_epi32(accum0, 8);
+      __m256i b = _mm256_max_epu8(a, accum0);  // Max of r and g.
+      a = _mm256_srli_epi32(accum0, 16);
+      b = _mm256_max_epu8(a, b);  // Max of r and g and b.
+      b = _mm256_slli_epi32(b, 24);
+      accum0 = _mm256_max_epu8(b, accum0);
+    } else {
+      // Set value of alpha channels to 0xFF.
+      accum0 = _mm256_or_si256(accum0, _mm256_set1_epi32(0xff000000));
+    }
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out_row), accum0);
+    out_row += 32;
+  }
+
+  if (out_x < end) {
+    ConvolveVertically_SSE2(filter_values, filter_length, source_data_rows,
+                            out_x, end, out_row, has_alpha);
+  }
+}
+
+void ConvolveVertically_AVX2(const ConvolutionFilter1D::Fixed* filter_values,
+                             int filter_length,
+                             unsigned char* const* source_data_rows,
+                             int begin, int end,
+                             unsigned char* out_row, bool has_alpha) {
+  if (has_alpha) {
+    ConvolveVertically_AVX2_impl<true>(filter_values, filter_length,
+                                       source_data_rows, begin, end, out_row);
+  } else {
+    ConvolveVertically_AVX2_impl<false>(filter_values, filter_length,
+                                        source_data_rows, begin, end, out_row);
+  }
+}
+
+}  // namespace skia
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -33,7 +33,7 @@
 
 #include <algorithm>
 
-#include "skia/SkTypes.h"
+#include "SkTypes.h"
 
 namespace skia {
 
@@ -34,6 +34,7 @@
 #include "image_operations.h"
 
 #include "convolver.h"
+#include "WorkerPool.h"
 #include "SkColorPriv.h"
 #include "SkBitmap.h"
 #include "SkRect.h"
@@ -521,7 +522,8 @@ SkBitmap ImageOperations::ResizeBasic(const SkBitmap& source,
   BGRAConvolve2D(source_subset, static_cast<int>(source.rowBytes()),
                  !source.isOpaque(), filter.x_filter(), filter.y_filter(),
                  static_cast<int>(result.rowBytes()),
-                 static_cast<unsigned char*>(result.getPixels()));
+                 static_cast<unsigned char*>(result.getPixels()),
+                 mozilla::gfx::WorkerPool::Get());
 
   // Preserve the "opaque" flag for use as an optimization later.
   result.setAlphaType(source.alphaType());
@@ -4,11 +4,14 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
 
 #include "SanityChecks.h"
+#include "TestBlur.h"
+#include "TestFilterProcessing.h"
 #ifdef WIN32
 #include "TestDrawTargetD2D.h"
 #include "TestDrawTargetD2DWarp.h"
 #endif
 #ifdef USE_SKIA
+#include "TestConvolver.h"
 #include "TestDrawTargetSkiaSoftware.h"
 #endif
 #ifdef USE_CAIRO
@@ -34,11 +37,14 @@ main()
   TestObject tests[] = 
   {
     { new SanityChecks(), "Sanity Checks" },
+    { new TestBlur(), "Blur" },
+    { new TestFilterProcessing(), "Filter Processing" },
 #ifdef WIN32
     { new TestDrawTargetD2D(), "DrawTarget (D2D)" },
     { new TestDrawTargetD2DWarp(), "DrawTarget (D2D WARP)" },
 #endif
 #ifdef USE_SKIA
+    { new TestConvolver(), "Convolver" },
     { new TestDrawTargetSkiaSoftware(), "DrawTarget (Skia Software)" },
 #endif
 #ifdef USE_CAIRO
@@ -17,6 +17,7 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <chrono>
 #endif
 
 inline void SleepMS(int aMilliseconds)
@@ -35,7 +36,7 @@ public:
 #ifdef WIN32
     ::QueryPerformanceCounter(&mStart);
 #else
-    gettimeofday(&mStart, NULL);
+    mStart = std::chrono::steady_clock::now();
 #endif
   }
 
@@ -46,20 +47,16 @@ public:
     ::QueryPerformanceFrequency(&freq);
     return (double(end.QuadPart) - double(mStart.QuadPart)) / double(freq.QuadPart) * 1000.00;
 #else
-    struct timeval end;
-    gettimeofday(&end, NULL);
-
-    long seconds = end.tv_sec - mStart.tv_sec;
-    long useconds = end.tv_usec - mStart.tv_usec;
-    double mtime = ((seconds) * 1000 + useconds/1000.0) + 0.5;
-    return mtime;
+    std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - mStart;
+    return elapsed.count();
 #endif
   }
 private:
 #ifdef WIN32
   LARGE_INTEGER mStart;
 #else
-  struct timeval mStart;
+  std::chrono::steady_clock::time_point mStart;
 #endif
 };
 
@@ -0,0 +1,109 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestBlur.h"
+
+#include <string.h>
+
+using namespace mozilla::gfx;
+
+TestBlur::TestBlur()
+  : mBoxShadow(Rect(0, 0, 2000, 2000), IntSize(), IntSize(60, 60), nullptr, nullptr)
+  , mLargeBoxShadow(Rect(0, 0, 4500, 4000), IntSize(), IntSize(60, 60), nullptr, nullptr)
+  , mPool2(nullptr)
+  , mPool4(nullptr)
+  , mPool8(nullptr)
+{
+  REGISTER_TEST(TestBlur, BoxShadow1Thread);
+  REGISTER_TEST(TestBlur, BoxShadow2Threads);
+  REGISTER_TEST(TestBlur, BoxShadow4Threads);
+  REGISTER_TEST(TestBlur, BoxShadow8Threads);
+  REGISTER_TEST(TestBlur, LargeBoxShadow1Thread);
+  REGISTER_TEST(TestBlur, LargeBoxShadow2Threads);
+  REGISTER_TEST(TestBlur, LargeBoxShadow4Threads);
+  REGISTER_TEST(TestBlur, LargeBoxShadow8Threads);
+}
+
+void
+TestBlur::Initialize()
+{
+  mBoxShadowData.resize(mBoxShadow.GetSurfaceAllocationSize());
+  mLargeBoxShadowData.resize(mLargeBoxShadow.GetSurfaceAllocationSize());
+
+  mPool2 = new WorkerPool(2);
+  mPool4 = new WorkerPool(4);
+  mPool8 = new WorkerPool(8);
+}
+
+void
+TestBlur::Finalize()
+{
+  delete mPool2;
+  delete mPool4;
+  delete mPool8;
+}
+
+void
+TestBlur::BlurShadow(AlphaBoxBlur& aBlur, std::vector<uint8_t>& aData, WorkerPool* aPool)
+{
+  // Start every run from an opaque box in the middle of the surface, like a
+  // box-shadow would.
+  IntSize size = aBlur.GetSize();
+  int32_t stride = aBlur.GetStride();
+  memset(&aData.front(), 0, aData.size());
+  for (int32_t y = size.height / 4; y < size.height * 3 / 4; y++) {
+    memset(&aData[y * stride + size.width / 4], 0xff, size.width / 2);
+  }
+
+  aBlur.Blur(&aData.front(), aPool);
+}
+
+void
+TestBlur::BoxShadow1Thread()
+{
+  BlurShadow(mBoxShadow, mBoxShadowData, nullptr);
+}
+
+void
+TestBlur::BoxShadow2Threads()
+{
+  BlurShadow(mBoxShadow, mBoxShadowData, mPool2);
+}
+
+void
+TestBlur::BoxShadow4Threads()
+{
+  BlurShadow(mBoxShadow, mBoxShadowData, mPool4);
+}
+
+void
+TestBlur::BoxShadow8Threads()
+{
+  BlurShadow(mBoxShadow, mBoxShadowData, mPool8);
+}
+
+void
+TestBlur::LargeBoxShadow1Thread()
+{
+  BlurShadow(mLargeBoxShadow, mLargeBoxShadowData, nullptr);
+}
+
+void
+TestBlur::LargeBoxShadow2Threads()
+{
+  BlurShadow(mLargeBoxShadow, mLargeBoxShadowData, mPool2);
+}
+
+void
+TestBlur::LargeBoxShadow4Threads()
+{
+  BlurShadow(mLargeBoxShadow, mLargeBoxShadowData, mPool4);
+}
+
+void
+TestBlur::LargeBoxShadow8Threads()
+{
+  BlurShadow(mLargeBoxShadow, mLargeBoxShadowData, mPool8);
+}
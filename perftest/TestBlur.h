@@ -0,0 +1,46 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "TestBase.h"
+#include "Blur.h"
+#include "WorkerPool.h"
+
+#include <vector>
+
+/* Measures how AlphaBoxBlur scales with the number of threads. BoxShadow
+ * blurs a surface small enough for the integral image blur, LargeBoxShadow
+ * one that is big enough to use the separable blur.
+ */
+class TestBlur : public TestBase
+{
+public:
+  TestBlur();
+
+  void Initialize();
+  void Finalize();
+
+  void BoxShadow1Thread();
+  void BoxShadow2Threads();
+  void BoxShadow4Threads();
+  void BoxShadow8Threads();
+  void LargeBoxShadow1Thread();
+  void LargeBoxShadow2Threads();
+  void LargeBoxShadow4Threads();
+  void LargeBoxShadow8Threads();
+
+private:
+  void BlurShadow(mozilla::gfx::AlphaBoxBlur& aBlur, std::vector<uint8_t>& aData,
+                  mozilla::gfx::WorkerPool* aPool);
+
+  mozilla::gfx::AlphaBoxBlur mBoxShadow;
+  mozilla::gfx::AlphaBoxBlur mLargeBoxShadow;
+  std::vector<uint8_t> mBoxShadowData;
+  std::vector<uint8_t> mLargeBoxShadowData;
+  mozilla::gfx::WorkerPool* mPool2;
+  mozilla::gfx::WorkerPool* mPool4;
+  mozilla::gfx::WorkerPool* mPool8;
+};
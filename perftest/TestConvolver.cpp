@@ -0,0 +1,119 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestConvolver.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace mozilla::gfx;
+using namespace skia;
+
+static const int kSourceWidth = 4000;
+static const int kSourceHeight = 3000;
+static const int kDestWidth = 1000;
+static const int kDestHeight = 750;
+
+// A Lanczos3 filter resampling aSourceSize pixels to aDestSize.
+static void
+CreateLanczos3Filter(int aSourceSize, int aDestSize, ConvolutionFilter1D* aFilter)
+{
+  const float kPi = 3.14159265f;
+  float scale = float(aDestSize) / aSourceSize;
+  float radius = 3 / scale;
+  std::vector<float> values;
+  for (int x = 0; x < aDestSize; x++) {
+    float center = (x + 0.5f) / scale;
+    int begin = std::max(0, int(floor(center - radius)));
+    int end = std::min(aSourceSize, int(ceil(center + radius)));
+    values.clear();
+    float sum = 0;
+    for (int i = begin; i < end; i++) {
+      float t = (i + 0.5f - center) * scale;
+      float value = 1;
+      if (t != 0) {
+        value = 3 * sin(kPi * t) * sin(kPi * t / 3) / (kPi * kPi * t * t);
+      }
+      values.push_back(value);
+      sum += value;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] /= sum;
+    }
+    aFilter->AddFilter(begin, &values.front(), values.size());
+  }
+  aFilter->PaddingForSIMD(8);
+}
+
+TestConvolver::TestConvolver()
+  : mPool2(nullptr)
+  , mPool4(nullptr)
+  , mPool8(nullptr)
+{
+  REGISTER_TEST(TestConvolver, Downscale1Thread);
+  REGISTER_TEST(TestConvolver, Downscale2Threads);
+  REGISTER_TEST(TestConvolver, Downscale4Threads);
+  REGISTER_TEST(TestConvolver, Downscale8Threads);
+}
+
+void
+TestConvolver::Initialize()
+{
+  CreateLanczos3Filter(kSourceWidth, kDestWidth, &mFilterX);
+  CreateLanczos3Filter(kSourceHeight, kDestHeight, &mFilterY);
+
+  mSource.resize(kSourceWidth * kSourceHeight * 4);
+  for (size_t i = 0; i < mSource.size(); i += 4) {
+    mSource[i] = rand() % 256;
+    mSource[i + 1] = rand() % 256;
+    mSource[i + 2] = rand() % 256;
+    mSource[i + 3] = 0xff;
+  }
+  mOutput.resize(kDestWidth * kDestHeight * 4);
+
+  mPool2 = new WorkerPool(2);
+  mPool4 = new WorkerPool(4);
+  mPool8 = new WorkerPool(8);
+}
+
+void
+TestConvolver::Finalize()
+{
+  delete mPool2;
+  delete mPool4;
+  delete mPool8;
+}
+
+void
+TestConvolver::Downscale(WorkerPool* aPool)
+{
+  BGRAConvolve2D(&mSource.front(), kSourceWidth * 4, false, mFilterX, mFilterY,
+                 kDestWidth * 4, &mOutput.front(), aPool);
+}
+
+void
+TestConvolver::Downscale1Thread()
+{
+  Downscale(nullptr);
+}
+
+void
+TestConvolver::Downscale2Threads()
+{
+  Downscale(mPool2);
+}
+
+void
+TestConvolver::Downscale4Threads()
+{
+  Downscale(mPool4);
+}
+
+void
+TestConvolver::Downscale8Threads()
+{
+  Downscale(mPool8);
+}
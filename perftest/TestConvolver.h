@@ -0,0 +1,41 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "TestBase.h"
+#include "WorkerPool.h"
+#include "convolver.h"
+
+#include <vector>
+
+/* Measures how skia::BGRAConvolve2D scales with the number of threads when
+ * downscaling a 12 megapixel photo to a quarter of its width and height, with
+ * filters as wide as ImageOperations::Resize uses for Lanczos3.
+ */
+class TestConvolver : public TestBase
+{
+public:
+  TestConvolver();
+
+  void Initialize();
+  void Finalize();
+
+  void Downscale1Thread();
+  void Downscale2Threads();
+  void Downscale4Threads();
+  void Downscale8Threads();
+
+private:
+  void Downscale(mozilla::gfx::WorkerPool* aPool);
+
+  skia::ConvolutionFilter1D mFilterX;
+  skia::ConvolutionFilter1D mFilterY;
+  std::vector<unsigned char> mSource;
+  std::vector<unsigned char> mOutput;
+  mozilla::gfx::WorkerPool* mPool2;
+  mozilla::gfx::WorkerPool* mPool4;
+  mozilla::gfx::WorkerPool* mPool8;
+};
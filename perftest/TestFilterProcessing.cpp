@@ -0,0 +1,180 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestFilterProcessing.h"
+
+#include "FilterProcessing.h"
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+// Exposes the backend specific implementations so they can be timed
+// separately.
+class FilterProcessingBackends : public FilterProcessing
+{
+public:
+#ifdef USE_SSE2
+  using FilterProcessing::ApplyBlending_SSE2;
+  using FilterProcessing::ApplyColorMatrix_SSE2;
+  using FilterProcessing::ApplyComposition_SSE2;
+  using FilterProcessing::DoPremultiplicationCalculation_SSE2;
+  using FilterProcessing::DoUnpremultiplicationCalculation_SSE2;
+#endif
+#ifdef USE_AVX2
+  using FilterProcessing::ApplyBlending_AVX2;
+  using FilterProcessing::ApplyColorMatrix_AVX2;
+  using FilterProcessing::ApplyComposition_AVX2;
+  using FilterProcessing::DoPremultiplicationCalculation_AVX2;
+  using FilterProcessing::DoUnpremultiplicationCalculation_AVX2;
+#endif
+};
+
+static const IntSize kSize(1024, 1024);
+
+static Matrix5x4
+SepiaMatrix()
+{
+  Matrix5x4 matrix;
+  matrix._11 = 0.393f; matrix._12 = 0.349f; matrix._13 = 0.272f;
+  matrix._21 = 0.769f; matrix._22 = 0.686f; matrix._23 = 0.534f;
+  matrix._31 = 0.189f; matrix._32 = 0.168f; matrix._33 = 0.131f;
+  return matrix;
+}
+
+TestFilterProcessing::TestFilterProcessing()
+{
+  REGISTER_TEST(TestFilterProcessing, BlendingSSE2);
+  REGISTER_TEST(TestFilterProcessing, BlendingAVX2);
+  REGISTER_TEST(TestFilterProcessing, ColorMatrixSSE2);
+  REGISTER_TEST(TestFilterProcessing, ColorMatrixAVX2);
+  REGISTER_TEST(TestFilterProcessing, CompositionSSE2);
+  REGISTER_TEST(TestFilterProcessing, CompositionAVX2);
+  REGISTER_TEST(TestFilterProcessing, PremultiplySSE2);
+  REGISTER_TEST(TestFilterProcessing, PremultiplyAVX2);
+  REGISTER_TEST(TestFilterProcessing, UnpremultiplySSE2);
+  REGISTER_TEST(TestFilterProcessing, UnpremultiplyAVX2);
+}
+
+void
+TestFilterProcessing::Initialize()
+{
+  mSource = Factory::CreateDataSourceSurface(kSize, SurfaceFormat::B8G8R8A8);
+  mDest = Factory::CreateDataSourceSurface(kSize, SurfaceFormat::B8G8R8A8);
+
+  for (int32_t y = 0; y < kSize.height; y++) {
+    uint8_t* source = mSource->GetData() + y * mSource->Stride();
+    uint8_t* dest = mDest->GetData() + y * mDest->Stride();
+    for (int32_t x = 0; x < kSize.width; x++) {
+      uint8_t alpha = uint8_t(x ^ y);
+      for (int32_t i = 0; i < 3; i++) {
+        source[4 * x + i] = uint8_t((x * (i + 1)) % (alpha + 1));
+        dest[4 * x + i] = uint8_t((y * (i + 1)) % 256);
+      }
+      source[4 * x + 3] = alpha;
+      dest[4 * x + 3] = 255;
+    }
+  }
+}
+
+void
+TestFilterProcessing::Finalize()
+{
+  mSource = nullptr;
+  mDest = nullptr;
+}
+
+void
+TestFilterProcessing::BlendingSSE2()
+{
+#ifdef USE_SSE2
+  FilterProcessingBackends::ApplyBlending_SSE2(mDest, mSource, BLEND_MODE_MULTIPLY);
+#endif
+}
+
+void
+TestFilterProcessing::BlendingAVX2()
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    FilterProcessingBackends::ApplyBlending_AVX2(mDest, mSource, BLEND_MODE_MULTIPLY);
+  }
+#endif
+}
+
+void
+TestFilterProcessing::ColorMatrixSSE2()
+{
+#ifdef USE_SSE2
+  FilterProcessingBackends::ApplyColorMatrix_SSE2(mSource, SepiaMatrix());
+#endif
+}
+
+void
+TestFilterProcessing::ColorMatrixAVX2()
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    FilterProcessingBackends::ApplyColorMatrix_AVX2(mSource, SepiaMatrix());
+  }
+#endif
+}
+
+void
+TestFilterProcessing::CompositionSSE2()
+{
+#ifdef USE_SSE2
+  FilterProcessingBackends::ApplyComposition_SSE2(mSource, mDest, COMPOSITE_OPERATOR_ATOP);
+#endif
+}
+
+void
+TestFilterProcessing::CompositionAVX2()
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    FilterProcessingBackends::ApplyComposition_AVX2(mSource, mDest, COMPOSITE_OPERATOR_ATOP);
+  }
+#endif
+}
+
+void
+TestFilterProcessing::PremultiplySSE2()
+{
+#ifdef USE_SSE2
+  FilterProcessingBackends::DoPremultiplicationCalculation_SSE2(
+    kSize, mDest->GetData(), mDest->Stride(), mSource->GetData(), mSource->Stride());
+#endif
+}
+
+void
+TestFilterProcessing::PremultiplyAVX2()
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    FilterProcessingBackends::DoPremultiplicationCalculation_AVX2(
+      kSize, mDest->GetData(), mDest->Stride(), mSource->GetData(), mSource->Stride());
+  }
+#endif
+}
+
+void
+TestFilterProcessing::UnpremultiplySSE2()
+{
+#ifdef USE_SSE2
+  FilterProcessingBackends::DoUnpremultiplicationCalculation_SSE2(
+    kSize, mDest->GetData(), mDest->Stride(), mSource->GetData(), mSource->Stride());
+#endif
+}
+
+void
+TestFilterProcessing::UnpremultiplyAVX2()
+{
+#ifdef USE_AVX2
+  if (Factory::HasAVX2()) {
+    FilterProcessingBackends::DoUnpremultiplicationCalculation_AVX2(
+      kSize, mDest->GetData(), mDest->Stride(), mSource->GetData(), mSource->Stride());
+  }
+#endif
+}
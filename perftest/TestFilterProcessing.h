@@ -0,0 +1,36 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "TestBase.h"
+#include "2D.h"
+
+/* Compares the SSE2 and AVX2 versions of the FilterProcessing kernels on a
+ * 1024x1024 surface. The AVX2 tests do nothing on machines without AVX2.
+ */
+class TestFilterProcessing : public TestBase
+{
+public:
+  TestFilterProcessing();
+
+  void Initialize();
+  void Finalize();
+
+  void BlendingSSE2();
+  void BlendingAVX2();
+  void ColorMatrixSSE2();
+  void ColorMatrixAVX2();
+  void CompositionSSE2();
+  void CompositionAVX2();
+  void PremultiplySSE2();
+  void PremultiplyAVX2();
+  void UnpremultiplySSE2();
+  void UnpremultiplyAVX2();
+
+private:
+  mozilla::RefPtr<mozilla::gfx::DataSourceSurface> mSource;
+  mozilla::RefPtr<mozilla::gfx::DataSourceSurface> mDest;
+};
@@ -12,6 +12,7 @@
 
 #include "RecordedEvent.h"
 #include "PathRecording.h"
+#include "RecordingReader.h"
 
 #include "drawtargetwidget.h"
 #include "qmdisubwindow.h"
@@ -305,55 +306,30 @@ void MainWindow::on_actionOpen_Recording_triggered()
 
   QString fileName = QFileDialog::getOpenFileName(this, "Open File Recording", QString(), "*.aer");
 
-  ifstream inputFile;
-
   ui->comboBox->clear();
   ui->comboBox->addItem("All");
-  
-  inputFile.open(fileName.toStdString().c_str(), istream::in | istream::binary);
 
-  inputFile.seekg(0, ios::end);
-  int length = inputFile.tellg();
-  inputFile.seekg(0, ios::beg);
   int64_t i = 0;
   ui->treeWidget->setColumnWidth(0, 50);
   ui->treeWidget->setColumnWidth(2, 150);
 
   QList<ReferencePtr> objects;
 
-  uint32_t magicInt;
-  ReadElement(inputFile, magicInt);
-  if (magicInt != 0xc001feed) {
-    QMessageBox::critical(this, "Error", "File is not a valid recording");
-    return;
-  }
-
-  uint16_t majorRevision;
-  uint16_t minorRevision;
-  ReadElement(inputFile, majorRevision);
-  ReadElement(inputFile, minorRevision);
-
-  if (majorRevision != kMajorRevision) {
-    QMessageBox::critical(this, "Error", "Recording was made with a different major revision");
+  string error;
+  RecordingReader *reader = RecordingReader::Open(fileName.toStdString().c_str(), &error);
+  if (!reader) {
+    QMessageBox::critical(this, "Error", QString::fromStdString(error));
     return;
   }
 
-  if (minorRevision > kMinorRevision) {
-    QMessageBox::critical(this, "Error", "Recording was made with a later minor revision");
-    return;
+  vector<RecordedEvent*> events;
+  if (!reader->ReadAllEvents(mPBManager.mEventArena, events)) {
+    QMessageBox::critical(this, "Error", "Stream error: File could not be parsed");
   }
+  delete reader;
 
-  while (inputFile.tellg() < length) {
-
-    if (inputFile.tellg() < 0) {
-      QMessageBox::critical(this, "Error", "Stream error: File could not be parsed");
-      return;
-    }
-
-    int32_t type;
-    ReadElement(inputFile, type);
-
-    RecordedEvent *newEvent = RecordedEvent::LoadEventFromStream(inputFile, (RecordedEvent::EventType)type);
+  for (size_t e = 0; e < events.size(); e++) {
+    RecordedEvent *newEvent = events[e];
 
     QStringList list;
     list.push_back(QString::number(i));
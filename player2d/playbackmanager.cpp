@@ -91,6 +91,18 @@ PlaybackManager::LookupScaledFont(ReferencePtr aRefPtr)
   return NULL;
 }
 
+SourceSurface*
+PlaybackManager::LookupStoredSurfaceData(uint64_t aDataId)
+{
+  StoredSurfaceDataMap::iterator iter = mStoredSurfaceData.find(aDataId);
+
+  if (iter != mStoredSurfaceData.end()) {
+    return iter->second;
+  }
+
+  return NULL;
+}
+
 FontType
 PlaybackManager::GetDesiredFontType()
 {
@@ -229,6 +241,7 @@ PlaybackManager::PlayToEvent(uint32_t aID)
     mSourceSurfaces.clear();
     mPaths.clear();
     mGradientStops.clear();
+    mStoredSurfaceData.clear();
     mCurrentEvent = 0;
   }
   for (int i = mCurrentEvent; i < aID; i++) {
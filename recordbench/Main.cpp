@@ -1,7 +1,6 @@
 // recordbench.cpp : Defines the entry point for the console application.
 //
 
-#include <fstream>
 #ifdef WIN32
 #include <d3d10_1.h>
 #endif
@@ -9,13 +8,27 @@
 #include "nvpr/GL.h"
 #endif
 #include "2D.h"
+#include "DrawEventRecorder.h"
 #include "RecordedEvent.h"
+#include "RecordedEventGraph.h"
+#include "RecordingReader.h"
 #include "RawTranslator.h"
+#include "WorkerPool.h"
 #include "perftest/TestBase.h"
 
+#include <algorithm>
+#include <fstream>
 #include <map>
+#include <mutex>
 #include <string>
 
+#ifdef WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
 using namespace mozilla;
 using namespace mozilla::gfx;
 using namespace std;
@@ -53,6 +66,124 @@ GetBackendName(BackendType aType)
   }
 }
 
+// Peak resident set size of the process so far.
+double
+GetPeakMemoryMB()
+{
+#ifdef WIN32
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+}
+
+// Returns the value below which aPercentile percent of the sorted aValues lie.
+double
+Percentile(const vector<double>& aSortedValues, double aPercentile)
+{
+  if (aSortedValues.empty()) {
+    return 0;
+  }
+  size_t index = size_t(aPercentile / 100.0 * (aSortedValues.size() - 1) + 0.5);
+  return aSortedValues[std::min(index, aSortedValues.size() - 1)];
+}
+
+/* Collects the durations of all events of one type. Durations are kept in
+ * buckets that are a quarter of a power of two wide, so percentiles are
+ * accurate to about 20% without having to store every sample.
+ */
+class EventTimes
+{
+public:
+  static const int kSubBuckets = 4;
+  static const int kBuckets = 40 * kSubBuckets;
+
+  EventTimes()
+    : mCount(0)
+    , mTotalMS(0)
+    , mMaxMS(0)
+    , mBuckets(kBuckets)
+  {}
+
+  void Add(double aMS)
+  {
+    mCount++;
+    mTotalMS += aMS;
+    mMaxMS = std::max(mMaxMS, aMS);
+    mBuckets[BucketFor(aMS)]++;
+  }
+
+  uint64_t Count() const { return mCount; }
+  double TotalMS() const { return mTotalMS; }
+  double MaxMS() const { return mMaxMS; }
+
+  // Upper bound of the bucket containing the given percentile, in ms.
+  double Percentile(double aPercentile) const
+  {
+    uint64_t rank = uint64_t(aPercentile / 100.0 * (mCount - 1) + 0.5);
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; i++) {
+      seen += mBuckets[i];
+      if (seen > rank) {
+        return std::min(BucketEnd(i), mMaxMS);
+      }
+    }
+    return mMaxMS;
+  }
+
+  // Prints the number of events per power of two of microseconds.
+  void PrintHistogram() const
+  {
+    for (int group = 0; group * kSubBuckets < kBuckets - 1; group++) {
+      int first = group ? group * kSubBuckets + 1 : 0;
+      int last = std::min((group + 1) * kSubBuckets, kBuckets - 1);
+      uint64_t count = 0;
+      for (int i = first; i <= last; i++) {
+        count += mBuckets[i];
+      }
+      if (count) {
+        printf("    < %10g us: %llu\n", BucketEnd(last) * 1000.0,
+               (unsigned long long)count);
+      }
+    }
+  }
+
+private:
+  // Bucket 0 holds everything below 1/8 us, every further kSubBuckets cover
+  // the next power of two.
+  static int BucketFor(double aMS)
+  {
+    double units = aMS * 8000.0;
+    if (units < 1.0) {
+      return 0;
+    }
+    int bucket = int(log(units) / log(2.0) * kSubBuckets) + 1;
+    return std::min(bucket, kBuckets - 1);
+  }
+
+  static double BucketEnd(int aBucket)
+  {
+    return pow(2.0, double(aBucket) / kSubBuckets) / 8000.0;
+  }
+
+  uint64_t mCount;
+  double mTotalMS;
+  double mMaxMS;
+  vector<uint64_t> mBuckets;
+};
+
 void
 FinishDrawing(DrawTarget* aDT)
 {
@@ -94,17 +225,107 @@ static bool sRetainDrawTargets;
 static bool sRetainPaths;
 static bool sRetainSourceSurfaces;
 static bool sRetainGradientStops;
+static bool sEventTimes;
+static bool sPrintHistograms;
+static const char *sWriteFilename;
+static bool sCompress;
+static int sThreads;
+static vector<BackendType> sBackends;
+
+static void
+PrintUsage()
+{
+  printf("Usage: recordbench [options] <recording>\n"
+         "Replays a recording on every backend this build supports and reports\n"
+         "how long it took.\n\n"
+         "  --n=<count>               Number of timed iterations, default 10\n"
+         "  --backend=<name>          Only replay on this backend, may be repeated\n"
+         "  --event-times             Time every event in a separate pass after the\n"
+         "                            timed iterations and report them per event type\n"
+         "  --histograms              Print a timing histogram per event type, implies\n"
+         "                            --event-times\n"
+         "  --threads=<count>         Play independent draw targets concurrently on\n"
+         "                            this many worker threads\n"
+         "  --retain-draw-targets     Create draw targets once and reuse them\n"
+         "  --retain-paths            Create paths once and reuse them\n"
+         "  --retain-source-surfaces  Create source surfaces once and reuse them\n"
+         "  --retain-gradient-stops   Create gradient stops once and reuse them\n"
+         "  --write=<file>            Write the loaded events to a new recording\n"
+         "  --compress                Compress the recording written by --write\n"
+         "\nBackends:");
+  for (size_t i = 0; i < sizeof(sTestedBackends) / sizeof(BackendType); i++) {
+    printf(" %s", GetBackendName(sTestedBackends[i]).c_str());
+  }
+  printf("\n");
+}
+
+static bool
+ParseBackend(const char *aName)
+{
+  for (size_t i = 0; i < sizeof(sTestedBackends) / sizeof(BackendType); i++) {
+    string name = GetBackendName(sTestedBackends[i]);
+    if (name.size() == strlen(aName) &&
+        std::equal(name.begin(), name.end(), aName,
+                   [] (char a, char b) { return tolower(a) == tolower(b); })) {
+      sBackends.push_back(sTestedBackends[i]);
+      return true;
+    }
+  }
+  return false;
+}
 
 int
 main(int argc, char *argv[], char *envp[])
 {
   if (argc < 2) {
-    printf("No recording specified.");
+    PrintUsage();
     return 1;
   }
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--help")) {
+      PrintUsage();
+      return 1;
+    }
+  }
 
   for (int i = 1; i < argc - 1; i++) {
     if (sscanf(argv[i], "--n=%i", &sN)) {
+      if (sN < 1) {
+        printf("--n needs to be at least 1\n");
+        return 1;
+      }
+      continue;
+    }
+    if (sscanf(argv[i], "--threads=%i", &sThreads)) {
+      if (sThreads < 1) {
+        printf("--threads needs to be at least 1\n");
+        return 1;
+      }
+      continue;
+    }
+    if (!strncmp(argv[i], "--backend=", 10)) {
+      if (!ParseBackend(argv[i] + 10)) {
+        printf("Unknown or unsupported backend %s\n", argv[i] + 10);
+        PrintUsage();
+        return 1;
+      }
+      continue;
+    }
+    if (!strcmp(argv[i], "--event-times")) {
+      sEventTimes = true;
+      continue;
+    }
+    if (!strcmp(argv[i], "--histograms")) {
+      sEventTimes = true;
+      sPrintHistograms = true;
+      continue;
+    }
+    if (!strncmp(argv[i], "--write=", 8)) {
+      sWriteFilename = argv[i] + 8;
+      continue;
+    }
+    if (!strcmp(argv[i], "--compress")) {
+      sCompress = true;
       continue;
     }
     if (!strcmp(argv[i], "--retain-draw-targets")) {
@@ -123,6 +344,14 @@ main(int argc, char *argv[], char *envp[])
       sRetainGradientStops = true;
       continue;
     }
+    printf("Unknown option %s\n", argv[i]);
+    PrintUsage();
+    return 1;
+  }
+
+  if (sBackends.empty()) {
+    sBackends.assign(sTestedBackends,
+                     sTestedBackends + sizeof(sTestedBackends) / sizeof(BackendType));
   }
 
   struct EventWithID {
@@ -134,52 +363,63 @@ main(int argc, char *argv[], char *envp[])
   vector<EventWithID > retainedObjectCreations;
   map<ReferencePtr, vector<RetainedDrawTargetData> > retainedDrawTargets;
 
-  ifstream inputFile;
-
-  inputFile.open(argv[argc - 1], istream::in | istream::binary);
-
-  inputFile.seekg(0, ios::end);
-  int length = inputFile.tellg();
-  inputFile.seekg(0, ios::beg);
+  HighPrecisionMeasurement loadMeasurement;
+  loadMeasurement.Start();
 
-  uint32_t magicInt;
-  ReadElement(inputFile, magicInt);
-  if (magicInt != 0xc001feed) {
-    printf("File is not a valid recording");
+  string error;
+  RecordingReader *reader = RecordingReader::Open(argv[argc - 1], &error);
+  if (!reader) {
+    printf("%s", error.c_str());
     return 1;
   }
 
-  uint16_t majorRevision;
-  uint16_t minorRevision;
-  ReadElement(inputFile, majorRevision);
-  ReadElement(inputFile, minorRevision);
-
-  if (majorRevision != kMajorRevision) {
-    printf("Recording was made with a different major revision");
-    return 1;
+  RecordedEventArena eventArena;
+  vector<RecordedEvent*> events;
+  if (!reader->ReadAllEvents(eventArena, events)) {
+    printf("Recording is corrupt, only %u events could be read\n", uint32_t(events.size()));
   }
+  double fileMB = reader->GetLength() / (1024.0 * 1024.0);
+  double eventMB = reader->GetEventDataLength() / (1024.0 * 1024.0);
+  delete reader;
+
+  // Throughput is given in event data, so it's comparable between
+  // compressed and uncompressed recordings.
+  double loadTime = loadMeasurement.Measure();
+  printf("Loading time: %f ms (%u events, %.1f MB in a %.1f MB file, %.1f MB/s)\n",
+         loadTime, uint32_t(events.size()), eventMB, fileMB, eventMB / (loadTime / 1000));
+
+  if (sWriteFilename) {
+    HighPrecisionMeasurement writeMeasurement;
+    writeMeasurement.Start();
+    {
+      RefPtr<DrawEventRecorderFile> recorder =
+        new DrawEventRecorderFile(sWriteFilename, sCompress);
+      for (size_t i = 0; i < events.size(); i++) {
+        recorder->RecordEvent(*events[i]);
+      }
+    }
+    double writeTime = writeMeasurement.Measure();
 
-  if (minorRevision > kMinorRevision) {
-    printf("Recording was made with a later minor revision");
-    return 1;
+    ifstream written(sWriteFilename, ios::binary | ios::ate);
+    double writtenMB = double(written.tellg()) / (1024 * 1024);
+    printf("Writing time: %f ms (%.1f MB file, %.1f MB/s)\n", writeTime, writtenMB,
+           eventMB / (writeTime / 1000));
   }
 
-  uint32_t eventIndex = 0;
-  while (inputFile.tellg() < length) {
-    int32_t type;
-    ReadElement(inputFile, type);
-
+  for (uint32_t eventIndex = 0; eventIndex < events.size(); eventIndex++) {
     EventWithID newEvent;
-    newEvent.recordedEvent = RecordedEvent::LoadEventFromStream(inputFile, (RecordedEvent::EventType)type);
-    newEvent.eventID = eventIndex++;
+    newEvent.recordedEvent = events[eventIndex];
+    newEvent.eventID = eventIndex;
 
     RecordedEvent::EventType eventType = newEvent.recordedEvent->GetType();
 
     if ((sRetainDrawTargets && eventType == RecordedEvent::DRAWTARGETCREATION) ||
         (sRetainPaths && eventType == RecordedEvent::PATHCREATION) ||
-        (sRetainSourceSurfaces && eventType == RecordedEvent::SOURCESURFACECREATION) ||
+        (sRetainSourceSurfaces && (eventType == RecordedEvent::SOURCESURFACECREATION ||
+                                   eventType == RecordedEvent::SOURCESURFACEFROMSTOREDDATA)) ||
         (sRetainGradientStops && eventType == RecordedEvent::GRADIENTSTOPSCREATION) ||
-        (eventType == RecordedEvent::SCALEDFONTCREATION)) {
+        (eventType == RecordedEvent::SCALEDFONTCREATION) ||
+        (eventType == RecordedEvent::SURFACEDATASTORE)) {
 
       retainedObjectCreations.push_back(newEvent);
 
@@ -196,7 +436,8 @@ main(int argc, char *argv[], char *envp[])
         (sRetainPaths && eventType == RecordedEvent::PATHDESTRUCTION) ||
         (sRetainSourceSurfaces && eventType == RecordedEvent::SOURCESURFACEDESTRUCTION) ||
         (sRetainGradientStops && eventType == RecordedEvent::GRADIENTSTOPSDESTRUCTION) ||
-        (eventType == RecordedEvent::SCALEDFONTDESTRUCTION)) {
+        (eventType == RecordedEvent::SCALEDFONTDESTRUCTION) ||
+        (eventType == RecordedEvent::SURFACEDATARELEASE)) {
       // Retained objects never get destroyed.
       continue;
     }
@@ -219,6 +460,17 @@ main(int argc, char *argv[], char *envp[])
     drawingEvents.push_back(newEvent);
   }
 
+  vector<RecordedEvent*> drawingEventList;
+  for (size_t c = 0; c < drawingEvents.size(); c++) {
+    drawingEventList.push_back(drawingEvents[c].recordedEvent);
+  }
+  RecordedEventGraph graph(drawingEventList);
+  printf("Dependency graph: %u events, %u dependencies, %u draw targets\n",
+         graph.GetEventCount(), graph.GetDependencyCount(), graph.GetDrawTargetCount());
+
+  WorkerPool *pool = sThreads ? new WorkerPool(sThreads) : nullptr;
+  mutex translatorLock;
+
 #ifdef WIN32
   RefPtr<ID3D10Device1> device;
   ::D3D10CreateDevice1(nullptr,
@@ -233,8 +485,12 @@ main(int argc, char *argv[], char *envp[])
   Factory::SetDirect3D10Device(device);
 #endif
 
-  for (int i = 0; i < sizeof(sTestedBackends) / sizeof(BackendType); i++) {
-    RefPtr<DrawTarget> dt = Factory::CreateDrawTarget(sTestedBackends[i], IntSize(1, 1), SurfaceFormat::B8G8R8A8);
+  for (size_t i = 0; i < sBackends.size(); i++) {
+    RefPtr<DrawTarget> dt = Factory::CreateDrawTarget(sBackends[i], IntSize(1, 1), SurfaceFormat::B8G8R8A8);
+    if (!dt) {
+      printf("Failed to create a %s draw target\n", GetBackendName(sBackends[i]).c_str());
+      continue;
+    }
 
     RawTranslator* translator =
       RawTranslator::Create(dt, sRetainDrawTargets, sRetainPaths,
@@ -245,17 +501,27 @@ main(int argc, char *argv[], char *envp[])
       retainedObjectCreations[c].recordedEvent->PlayEvent(translator);
     }
 
-    vector<double> data(sN + 1);
-    double average = 0;
-
-    for (int k = 0; k < (sN + 1); k++) {
-      HighPrecisionMeasurement measurement;
-      measurement.Start();
-
-      for (int c = 0; c < drawingEvents.size(); c++) {
-        translator->SetEventNumber(drawingEvents[c].eventID);
-        drawingEvents[c].recordedEvent->PlayEvent(translator);
-      }
+    // Plays the drawing events once and resets the retained draw targets
+    // afterwards. If aDurations is non-null, it receives how long each event
+    // took.
+    auto playEvents = [&] (vector<double>* aDurations) {
+      graph.Play(pool, [&] (uint32_t c) {
+        RecordedEvent* event = drawingEvents[c].recordedEvent;
+        HighPrecisionMeasurement eventMeasurement;
+        if (aDurations) {
+          eventMeasurement.Start();
+        }
+        if (pool) {
+          RawEventTranslator eventTranslator(translator, &translatorLock, drawingEvents[c].eventID);
+          event->PlayEvent(&eventTranslator);
+        } else {
+          translator->SetEventNumber(drawingEvents[c].eventID);
+          event->PlayEvent(translator);
+        }
+        if (aDurations) {
+          (*aDurations)[c] = eventMeasurement.Measure();
+        }
+      });
 
       // Reset retained draw targets.
       for (const auto& drawTargetList : retainedDrawTargets) {
@@ -269,6 +535,16 @@ main(int argc, char *argv[], char *envp[])
           drawTarget->ClearRect(Rect(Point(), Size(drawTarget->GetSize())));
         }
       }
+    };
+
+    vector<double> data(sN + 1);
+    double average = 0;
+
+    for (int k = 0; k < (sN + 1); k++) {
+      HighPrecisionMeasurement measurement;
+      measurement.Start();
+
+      playEvents(nullptr);
 
       if (k == 0 || k == sN) {
         // TODO: This skews the sqDiffSum.
@@ -278,6 +554,7 @@ main(int argc, char *argv[], char *envp[])
       data[k] = measurement.Measure();
 
       if (k > 0) {
+        // The first iteration is a warm-up, it isn't part of the results.
         average += data[k];
       }
     }
@@ -290,10 +567,65 @@ main(int argc, char *argv[], char *envp[])
 
     sqDiffSum /= sN;
 
-    printf("Rendering time (%s): %f +/- %f ms\n", GetBackendName(sTestedBackends[i]).c_str(), average, sqrt(sqDiffSum));
+    string backendName = GetBackendName(sBackends[i]);
+    printf("Rendering time (%s): %f +/- %f ms\n", backendName.c_str(), average, sqrt(sqDiffSum));
+
+    vector<double> sorted(data.begin() + 1, data.end());
+    std::sort(sorted.begin(), sorted.end());
+    printf("  Iterations: min %f, p50 %f, p90 %f, p99 %f, max %f ms\n",
+           sorted.front(), Percentile(sorted, 50), Percentile(sorted, 90),
+           Percentile(sorted, 99), sorted.back());
+
+    if (sEventTimes) {
+      // Timing every event adds overhead of its own, so it's done in a pass
+      // of its own that doesn't count towards the rendering time above.
+      vector<EventTimes> eventTimes(RecordedEvent::kTotalEventTypes);
+      vector<double> durations(drawingEvents.size());
+      vector<double> totalDurations(drawingEvents.size());
+      for (int k = 0; k < sN; k++) {
+        playEvents(&durations);
+        for (size_t c = 0; c < drawingEvents.size(); c++) {
+          eventTimes[drawingEvents[c].recordedEvent->GetType()].Add(durations[c]);
+          totalDurations[c] += durations[c];
+        }
+      }
+      FinishDrawing(dt);
+
+      // How much faster the events could be played if every thread had a core
+      // to itself and there was no overhead.
+      double eventTime = 0;
+      for (size_t c = 0; c < totalDurations.size(); c++) {
+        totalDurations[c] /= sN;
+        eventTime += totalDurations[c];
+      }
+      double criticalPath = graph.GetCriticalPathLength(totalDurations);
+      printf("  Event time: %f ms, critical path %f ms (%.2fx parallelism)\n",
+             eventTime, criticalPath, criticalPath > 0 ? eventTime / criticalPath : 1.0);
+
+      printf("  %-28s %10s %12s %10s %10s %10s %10s\n", "Event", "Count/iter",
+             "ms/iter", "p50 us", "p90 us", "p99 us", "max us");
+      for (size_t t = 0; t < eventTimes.size(); t++) {
+        const EventTimes& times = eventTimes[t];
+        if (!times.Count()) {
+          continue;
+        }
+        printf("  %-28s %10llu %12.4f %10.1f %10.1f %10.1f %10.1f\n",
+               RecordedEvent::GetEventName(RecordedEvent::EventType(t)).c_str(),
+               (unsigned long long)(times.Count() / sN), times.TotalMS() / sN,
+               times.Percentile(50) * 1000.0, times.Percentile(90) * 1000.0,
+               times.Percentile(99) * 1000.0, times.MaxMS() * 1000.0);
+        if (sPrintHistograms) {
+          times.PrintHistogram();
+        }
+      }
+    }
 
     delete translator;
   }
 
+  delete pool;
+
+  printf("Peak memory: %.1f MB\n", GetPeakMemoryMB());
+
   return 0;
 }
@@ -114,6 +114,13 @@ private:
   virtual void RemoveFilterNode(ReferencePtr aRefPtr) { RemoveObject(mFilterNodes, aRefPtr); }
   virtual void RemoveGradientStops(ReferencePtr aRefPtr) { RemoveObject(mGradientStops, aRefPtr); }
   virtual void RemoveScaledFont(ReferencePtr aRefPtr) { RemoveObject(mScaledFonts, aRefPtr); }
+  virtual SourceSurface *LookupStoredSurfaceData(uint64_t aDataId)
+  {
+    map<uint64_t, RefPtr<SourceSurface> >::iterator iter = mStoredSurfaceData.find(aDataId);
+    return (iter != mStoredSurfaceData.end()) ? iter->second : NULL;
+  }
+  virtual void AddStoredSurfaceData(uint64_t aDataId, SourceSurface *aSurface) { mStoredSurfaceData[aDataId] = aSurface; }
+  virtual void RemoveStoredSurfaceData(uint64_t aDataId) { mStoredSurfaceData.erase(aDataId); }
 
 private:
   template<typename T, RetainBehavior> struct MapType {
@@ -128,6 +135,8 @@ private:
   typename MapType<FilterNode, RETAIN>::Type mFilterNodes;
   typename MapType<GradientStops, RetainGradientStops>::Type mGradientStops;
   typename MapType<ScaledFont, RETAIN>::Type mScaledFonts;
+  // Stored data is always retained, see Main.cpp.
+  map<uint64_t, RefPtr<SourceSurface> > mStoredSurfaceData;
 };
 
 RawTranslator
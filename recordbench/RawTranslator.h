@@ -1,6 +1,7 @@
 
 #include "2D.h"
 #include "RecordedEvent.h"
+#include "RecordedEventGraph.h"
 
 class RawTranslator : public mozilla::gfx::Translator
 {
@@ -20,3 +21,21 @@ protected:
   uint32_t mEventNumber;
   mozilla::RefPtr<mozilla::gfx::DrawTarget> mBaseDT;
 };
+
+// Used to play events from several threads, objects are looked up as they
+// were at the time of aEventNumber.
+class RawEventTranslator : public mozilla::gfx::SynchronizedTranslator
+{
+public:
+  RawEventTranslator(RawTranslator *aTranslator, std::mutex *aLock, uint32_t aEventNumber)
+    : SynchronizedTranslator(aTranslator, aLock)
+    , mRawTranslator(aTranslator)
+    , mEventNumber(aEventNumber)
+  {}
+
+protected:
+  virtual void WillForward() { mRawTranslator->SetEventNumber(mEventNumber); }
+
+  RawTranslator *mRawTranslator;
+  uint32_t mEventNumber;
+};
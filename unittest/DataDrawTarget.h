@@ -0,0 +1,429 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "2D.h"
+#include "Filters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#include <vector>
+
+namespace mozilla {
+namespace gfx {
+
+/**
+ * A minimal software DrawTarget that draws into a B8G8R8A8 DataSourceSurface,
+ * so tests can look at what is drawn without a real backend being built.
+ *
+ * It fills rectangles, masks and clears with color and surface patterns,
+ * under transforms without rotation, and supports rectangular clips and the
+ * OVER and SOURCE operators. Rectangles cover the pixels whose centers they
+ * contain, there is no antialiasing. Everything else is ignored and makes
+ * HasUnsupportedCalls return true.
+ *
+ * Surface patterns must be data surfaces.
+ */
+class DataDrawTarget : public DrawTarget
+{
+public:
+  MOZ_DECLARE_REFCOUNTED_VIRTUAL_TYPENAME(DataDrawTarget)
+
+  explicit DataDrawTarget(const IntSize& aSize)
+    : mSize(aSize)
+    , mUnsupported(false)
+  {
+    mFormat = SurfaceFormat::B8G8R8A8;
+    mData = Factory::CreateDataSourceSurface(aSize, mFormat, true);
+    mClips.push_back(IntRect(IntPoint(), aSize));
+  }
+
+  DataSourceSurface* GetData() { return mData; }
+  bool HasUnsupportedCalls() const { return mUnsupported; }
+
+  virtual DrawTargetType GetType() const { return DrawTargetType::SOFTWARE_RASTER; }
+  virtual BackendType GetBackendType() const { return BackendType::NONE; }
+
+  virtual TemporaryRef<SourceSurface> Snapshot()
+  {
+    return CopySurfaceData(mData);
+  }
+  virtual IntSize GetSize() { return mSize; }
+  virtual void Flush() {}
+
+  virtual void DrawSurface(SourceSurface *aSurface,
+                           const Rect &aDest,
+                           const Rect &aSource,
+                           const DrawSurfaceOptions &aSurfOptions,
+                           const DrawOptions &aOptions)
+  {
+    if (aSource.IsEmpty()) {
+      return;
+    }
+    Matrix sourceToDest = Matrix::Translation(-aSource.x, -aSource.y) *
+      Matrix::Scaling(aDest.width / aSource.width, aDest.height / aSource.height) *
+      Matrix::Translation(aDest.x, aDest.y);
+    FillRect(aDest, SurfacePattern(aSurface, ExtendMode::CLAMP, sourceToDest,
+                                   aSurfOptions.mFilter), aOptions);
+  }
+
+  virtual void DrawFilter(FilterNode *aNode, const Rect &aSourceRect,
+                          const Point &aDestPoint, const DrawOptions &aOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void DrawSurfaceWithShadow(SourceSurface *aSurface, const Point &aDest,
+                                     const Color &aColor, const Point &aOffset,
+                                     Float aSigma, CompositionOp aOperator)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void ClearRect(const Rect &aRect)
+  {
+    FillRect(aRect, ColorPattern(Color()), DrawOptions(1.0f, CompositionOp::OP_SOURCE));
+  }
+
+  virtual void CopySurface(SourceSurface *aSurface, const IntRect &aSourceRect,
+                           const IntPoint &aDestination)
+  {
+    DataSourceSurface* source = GetDataSurface(aSurface);
+    if (!source) {
+      return;
+    }
+    IntRect rect = aSourceRect.Intersect(IntRect(IntPoint(), source->GetSize()));
+    IntPoint dest = aDestination + rect.TopLeft() - aSourceRect.TopLeft();
+    IntRect destRect = IntRect(dest, rect.Size()).Intersect(IntRect(IntPoint(), mSize));
+    for (int32_t y = destRect.y; y < destRect.YMost(); y++) {
+      for (int32_t x = destRect.x; x < destRect.XMost(); x++) {
+        Float pixel[4];
+        ReadPixel(source, x - dest.x + rect.x, y - dest.y + rect.y, pixel);
+        WritePixel(x, y, pixel);
+      }
+    }
+  }
+
+  virtual void FillRect(const Rect &aRect, const Pattern &aPattern,
+                        const DrawOptions &aOptions = DrawOptions())
+  {
+    IntRect pixels;
+    if (!GetDevicePixels(aRect, &pixels)) {
+      return;
+    }
+    Composite(pixels, aPattern, nullptr, aOptions);
+  }
+
+  virtual void StrokeRect(const Rect &aRect, const Pattern &aPattern,
+                          const StrokeOptions &aStrokeOptions,
+                          const DrawOptions &aOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void StrokeLine(const Point &aStart, const Point &aEnd,
+                          const Pattern &aPattern,
+                          const StrokeOptions &aStrokeOptions,
+                          const DrawOptions &aOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void Stroke(const Path *aPath, const Pattern &aPattern,
+                      const StrokeOptions &aStrokeOptions,
+                      const DrawOptions &aOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void Fill(const Path *aPath, const Pattern &aPattern,
+                    const DrawOptions &aOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void FillGlyphs(ScaledFont *aFont, const GlyphBuffer &aBuffer,
+                          const Pattern &aPattern, const DrawOptions &aOptions,
+                          const GlyphRenderingOptions *aRenderingOptions)
+  {
+    mUnsupported = true;
+  }
+
+  virtual void Mask(const Pattern &aSource, const Pattern &aMask,
+                    const DrawOptions &aOptions = DrawOptions())
+  {
+    Composite(mClips.back(), aSource, &aMask, aOptions);
+  }
+
+  virtual void MaskSurface(const Pattern &aSource, SourceSurface *aMask,
+                           Point aOffset, const DrawOptions &aOptions = DrawOptions())
+  {
+    IntRect pixels;
+    if (!GetDevicePixels(Rect(aOffset, Size(aMask->GetSize())), &pixels)) {
+      return;
+    }
+    SurfacePattern mask(aMask, ExtendMode::CLAMP, Matrix::Translation(aOffset),
+                        Filter::POINT);
+    Composite(pixels, aSource, &mask, aOptions);
+  }
+
+  virtual void PushClip(const Path *aPath)
+  {
+    mUnsupported = true;
+    mClips.push_back(mClips.back());
+  }
+
+  virtual void PushClipRect(const Rect &aRect)
+  {
+    IntRect pixels;
+    if (!GetDevicePixels(aRect, &pixels)) {
+      pixels = IntRect();
+    }
+    mClips.push_back(pixels);
+  }
+
+  virtual void PopClip()
+  {
+    if (mClips.size() > 1) {
+      mClips.pop_back();
+    }
+  }
+
+  virtual TemporaryRef<SourceSurface>
+    CreateSourceSurfaceFromData(unsigned char *aData, const IntSize &aSize,
+                                int32_t aStride, SurfaceFormat aFormat) const
+  {
+    RefPtr<DataSourceSurface> surface = Factory::CreateDataSourceSurface(aSize, aFormat);
+    if (!surface) {
+      return nullptr;
+    }
+    for (int32_t y = 0; y < aSize.height; y++) {
+      memcpy(surface->GetData() + y * surface->Stride(), aData + y * aStride,
+             aSize.width * BytesPerPixel(aFormat));
+    }
+    return surface.forget();
+  }
+
+  virtual TemporaryRef<SourceSurface> OptimizeSourceSurface(SourceSurface *aSurface) const
+  {
+    return aSurface;
+  }
+
+  virtual TemporaryRef<SourceSurface>
+    CreateSourceSurfaceFromNativeSurface(const NativeSurface &aSurface) const
+  {
+    return nullptr;
+  }
+
+  virtual TemporaryRef<DrawTarget>
+    CreateSimilarDrawTarget(const IntSize &aSize, SurfaceFormat aFormat) const
+  {
+    if (aFormat != SurfaceFormat::B8G8R8A8) {
+      return nullptr;
+    }
+    return new DataDrawTarget(aSize);
+  }
+
+  virtual TemporaryRef<PathBuilder> CreatePathBuilder(FillRule aFillRule) const
+  {
+    return nullptr;
+  }
+
+  virtual TemporaryRef<GradientStops>
+    CreateGradientStops(GradientStop *aStops, uint32_t aNumStops,
+                        ExtendMode aExtendMode) const
+  {
+    return nullptr;
+  }
+
+  virtual TemporaryRef<FilterNode> CreateFilter(FilterType aType)
+  {
+    return nullptr;
+  }
+
+  static TemporaryRef<DataSourceSurface> CopySurfaceData(DataSourceSurface* aSurface)
+  {
+    IntSize size = aSurface->GetSize();
+    RefPtr<DataSourceSurface> copy =
+      Factory::CreateDataSourceSurface(size, aSurface->GetFormat());
+    if (!copy) {
+      return nullptr;
+    }
+    for (int32_t y = 0; y < size.height; y++) {
+      memcpy(copy->GetData() + y * copy->Stride(),
+             aSurface->GetData() + y * aSurface->Stride(),
+             size.width * BytesPerPixel(aSurface->GetFormat()));
+    }
+    return copy.forget();
+  }
+
+private:
+  // Data surfaces are the only ones we can read, without touching their
+  // reference count.
+  DataSourceSurface* GetDataSurface(SourceSurface* aSurface)
+  {
+    if (!aSurface || aSurface->GetType() != SurfaceType::DATA) {
+      mUnsupported = true;
+      return nullptr;
+    }
+    DataSourceSurface* data = static_cast<DataSourceSurface*>(aSurface);
+    if (data->GetFormat() != SurfaceFormat::B8G8R8A8 &&
+        data->GetFormat() != SurfaceFormat::A8) {
+      mUnsupported = true;
+      return nullptr;
+    }
+    return data;
+  }
+
+  // The pixels whose centers aRect contains, within the current clip.
+  bool GetDevicePixels(const Rect& aRect, IntRect* aPixels)
+  {
+    if (mTransform._12 != 0 || mTransform._21 != 0) {
+      mUnsupported = true;
+      return false;
+    }
+    Rect bounds = mTransform.TransformBounds(aRect);
+    int32_t x0 = int32_t(ceil(bounds.x - 0.5f));
+    int32_t y0 = int32_t(ceil(bounds.y - 0.5f));
+    int32_t x1 = int32_t(ceil(bounds.XMost() - 0.5f));
+    int32_t y1 = int32_t(ceil(bounds.YMost() - 0.5f));
+    *aPixels = IntRect(x0, y0, x1 - x0, y1 - y0).Intersect(mClips.back());
+    return !aPixels->IsEmpty();
+  }
+
+  // Reads a pixel as premultiplied B, G, R, A between 0 and 1.
+  static void ReadPixel(DataSourceSurface* aSurface, int32_t aX, int32_t aY, Float* aPixel)
+  {
+    const uint8_t* row = aSurface->GetData() + aY * aSurface->Stride();
+    if (aSurface->GetFormat() == SurfaceFormat::A8) {
+      aPixel[0] = aPixel[1] = aPixel[2] = 0;
+      aPixel[3] = row[aX] / 255.0f;
+      return;
+    }
+    for (int i = 0; i < 4; i++) {
+      aPixel[i] = row[aX * 4 + i] / 255.0f;
+    }
+  }
+
+  void WritePixel(int32_t aX, int32_t aY, const Float* aPixel)
+  {
+    uint8_t* row = mData->GetData() + aY * mData->Stride();
+    for (int i = 0; i < 4; i++) {
+      row[aX * 4 + i] = uint8_t(std::min(std::max(aPixel[i], 0.0f), 1.0f) * 255 + 0.5f);
+    }
+  }
+
+  static int32_t Extend(int32_t aValue, int32_t aSize, ExtendMode aExtendMode)
+  {
+    if (aExtendMode == ExtendMode::REPEAT) {
+      return ((aValue % aSize) + aSize) % aSize;
+    }
+    return std::min(std::max(aValue, 0), aSize - 1);
+  }
+
+  // Samples aPattern at the device pixel aX, aY.
+  bool Sample(const Pattern& aPattern, int32_t aX, int32_t aY, Float* aPixel)
+  {
+    if (aPattern.GetType() == PatternType::COLOR) {
+      const Color& color = static_cast<const ColorPattern&>(aPattern).mColor;
+      aPixel[0] = color.b * color.a;
+      aPixel[1] = color.g * color.a;
+      aPixel[2] = color.r * color.a;
+      aPixel[3] = color.a;
+      return true;
+    }
+    if (aPattern.GetType() != PatternType::SURFACE) {
+      mUnsupported = true;
+      return false;
+    }
+
+    const SurfacePattern& pattern = static_cast<const SurfacePattern&>(aPattern);
+    DataSourceSurface* surface = GetDataSurface(pattern.mSurface);
+    if (!surface) {
+      return false;
+    }
+    Matrix deviceToPattern = pattern.mMatrix * mTransform;
+    if (!deviceToPattern.Invert()) {
+      mUnsupported = true;
+      return false;
+    }
+    Point point = deviceToPattern * Point(aX + 0.5f, aY + 0.5f);
+    IntSize size = surface->GetSize();
+    if (pattern.mExtendMode != ExtendMode::CLAMP &&
+        pattern.mExtendMode != ExtendMode::REPEAT) {
+      mUnsupported = true;
+    }
+
+    if (pattern.mFilter == Filter::POINT) {
+      ReadPixel(surface, Extend(int32_t(floor(point.x)), size.width, pattern.mExtendMode),
+                Extend(int32_t(floor(point.y)), size.height, pattern.mExtendMode), aPixel);
+      return true;
+    }
+
+    Float x = point.x - 0.5f;
+    Float y = point.y - 0.5f;
+    int32_t left = int32_t(floor(x));
+    int32_t top = int32_t(floor(y));
+    Float fx = x - left;
+    Float fy = y - top;
+    Float corners[4][4];
+    for (int i = 0; i < 4; i++) {
+      ReadPixel(surface, Extend(left + i % 2, size.width, pattern.mExtendMode),
+                Extend(top + i / 2, size.height, pattern.mExtendMode), corners[i]);
+    }
+    for (int c = 0; c < 4; c++) {
+      Float upper = corners[0][c] * (1 - fx) + corners[1][c] * fx;
+      Float lower = corners[2][c] * (1 - fx) + corners[3][c] * fx;
+      aPixel[c] = upper * (1 - fy) + lower * fy;
+    }
+    return true;
+  }
+
+  void Composite(const IntRect& aPixels, const Pattern& aSource, const Pattern* aMask,
+                 const DrawOptions& aOptions)
+  {
+    CompositionOp op = aOptions.mCompositionOp;
+    if (op != CompositionOp::OP_OVER && op != CompositionOp::OP_SOURCE) {
+      mUnsupported = true;
+      return;
+    }
+    for (int32_t y = aPixels.y; y < aPixels.YMost(); y++) {
+      for (int32_t x = aPixels.x; x < aPixels.XMost(); x++) {
+        Float source[4];
+        if (!Sample(aSource, x, y, source)) {
+          return;
+        }
+        Float coverage = aOptions.mAlpha;
+        if (aMask) {
+          Float mask[4];
+          if (!Sample(*aMask, x, y, mask)) {
+            return;
+          }
+          coverage *= mask[3];
+        }
+        Float dest[4];
+        ReadPixel(mData, x, y, dest);
+        for (int i = 0; i < 4; i++) {
+          if (op == CompositionOp::OP_SOURCE) {
+            dest[i] = source[i] * coverage + dest[i] * (1 - coverage);
+          } else {
+            dest[i] = source[i] * coverage + dest[i] * (1 - source[3] * coverage);
+          }
+        }
+        WritePixel(x, y, dest);
+      }
+    }
+  }
+
+  RefPtr<DataSourceSurface> mData;
+  IntSize mSize;
+  std::vector<IntRect> mClips;
+  bool mUnsupported;
+};
+
+}
+}
@@ -9,6 +9,18 @@
 #include "TestMatrix.h"
 #include "TestScaling.h"
 #include "TestBugs.h"
+#include "TestRecording.h"
+#include "TestWorkerPool.h"
+#include "TestCaptureCommandList.h"
+#include "TestBlur.h"
+#include "TestShadowMaskCache.h"
+#include "TestMipmapCache.h"
+#include "TestFilterProcessing.h"
+#include "TestFilterNodeSoftware.h"
+#include "TestDrawTargetInstrumented.h"
+#ifdef USE_SKIA
+#include "TestConvolver.h"
+#endif
 #ifdef WIN32
 #include <d3d10_1.h>
 #ifdef USE_D2D1_1
@@ -85,12 +97,22 @@ main()
   #ifdef USE_SKIA
     { new TestDrawTargetSkiaSoftware(), "DrawTarget (Skia Software)" },
     { new TestPathSkia(), "Path (Skia)" },
+    { new TestConvolver(), "Convolver Tests" },
   #endif
     { new TestPoint(), "Point Tests" },
     { new TestRect(), "Rect Tests" },
     { new TestMatrix(), "Matrix Tests" },
     { new TestScaling(), "Scaling Tests" },
-    { new TestBugs(), "Bug Tests" }
+    { new TestBugs(), "Bug Tests" },
+    { new TestRecording(), "Recording Tests" },
+    { new TestWorkerPool(), "Worker Pool Tests" },
+    { new TestCaptureCommandList(), "Capture Command List Tests" },
+    { new TestBlur(), "Blur Tests" },
+    { new TestShadowMaskCache(), "Shadow Mask Cache Tests" },
+    { new TestMipmapCache(), "Mipmap Cache Tests" },
+    { new TestFilterProcessing(), "Filter Processing Tests" },
+    { new TestFilterNodeSoftware(), "Software Filter Tests" },
+    { new TestDrawTargetInstrumented(), "Instrumented DrawTarget Tests" }
   };
 
   int totalFailures = 0;
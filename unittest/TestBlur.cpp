@@ -0,0 +1,341 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestBlur.h"
+
+#include "Blur.h"
+#include "FilterProcessing.h"
+#include "WorkerPool.h"
+#include "mozilla/Util.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+using namespace std;
+
+TestBlur::TestBlur()
+{
+#define TEST_CLASS TestBlur
+  REGISTER_TEST(ParallelMatchesSerial);
+  REGISTER_TEST(ParallelMatchesSerialWithSkipRect);
+  REGISTER_TEST(ParallelMatchesSerialLargeSurface);
+  REGISTER_TEST(ColorBlurMatchesAlphaBoxBlur);
+  REGISTER_TEST(ColorBlurParallelMatchesSerial);
+  REGISTER_TEST(ExactGaussianMatchesReference);
+  REGISTER_TEST(DownscaledBlurMatchesBox);
+  REGISTER_TEST(DownscaledAlphaBlurMatchesBox);
+#undef TEST_CLASS
+}
+
+// Blurs the same pattern with and without a pool, returns whether the
+// results are identical. The padding at the end of each row is ignored.
+static bool
+CompareSerialAndParallel(const Rect& aRect, const IntSize& aSpread,
+                         const IntSize& aRadius, const Rect* aSkipRect)
+{
+  AlphaBoxBlur blur(aRect, aSpread, aRadius, nullptr, aSkipRect);
+  size_t size = blur.GetSurfaceAllocationSize();
+  if (!size) {
+    return false;
+  }
+
+  vector<uint8_t> serial(size);
+  for (size_t i = 0; i < size; i++) {
+    serial[i] = uint8_t((i * 7919) >> 5);
+  }
+  vector<uint8_t> parallel(serial);
+
+  WorkerPool pool(4);
+  blur.Blur(&serial.front());
+  blur.Blur(&parallel.front(), &pool);
+
+  IntSize blurSize = blur.GetSize();
+  for (int32_t y = 0; y < blurSize.height; y++) {
+    size_t offset = size_t(y) * blur.GetStride();
+    if (memcmp(&serial[offset], &parallel[offset], blurSize.width)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+TestBlur::ParallelMatchesSerial()
+{
+  VERIFY(CompareSerialAndParallel(Rect(0, 0, 900, 700), IntSize(0, 0), IntSize(15, 25), nullptr));
+  VERIFY(CompareSerialAndParallel(Rect(0, 0, 700, 500), IntSize(3, 2), IntSize(4, 0), nullptr));
+}
+
+void
+TestBlur::ParallelMatchesSerialWithSkipRect()
+{
+  Rect skipRect(100, 100, 500, 300);
+  VERIFY(CompareSerialAndParallel(Rect(0, 0, 700, 500), IntSize(0, 0), IntSize(12, 12), &skipRect));
+}
+
+void
+TestBlur::ParallelMatchesSerialLargeSurface()
+{
+  // Large enough to use the separable blur instead of an integral image.
+  Rect skipRect(500, 500, 3000, 2000);
+  VERIFY(CompareSerialAndParallel(Rect(0, 0, 4200, 4100), IntSize(0, 0), IntSize(9, 6), &skipRect));
+}
+
+// Fills a B8G8R8A8 surface with premultiplied pseudo random pixels, with
+// some fully transparent areas mixed in.
+static TemporaryRef<DataSourceSurface>
+CreateColorPattern(const IntSize& aSize)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8);
+  if (!surface) {
+    return nullptr;
+  }
+
+  uint32_t state = aSize.width * 31 + aSize.height;
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint8_t* row = surface->GetData() + y * surface->Stride();
+    for (int32_t x = 0; x < aSize.width; x++) {
+      state = state * 1103515245 + 12345;
+      uint8_t alpha = ((x / 7 + y / 5) % 3) ? uint8_t(state >> 16) : 0;
+      for (int32_t i = 0; i < 3; i++) {
+        state = state * 1103515245 + 12345;
+        row[4 * x + i] = uint8_t((state >> 16) % (alpha + 1));
+      }
+      row[4 * x + 3] = alpha;
+    }
+  }
+  return surface.forget();
+}
+
+static TemporaryRef<DataSourceSurface>
+CopyColorSurface(DataSourceSurface* aSource)
+{
+  IntSize size = aSource->GetSize();
+  RefPtr<DataSourceSurface> copy =
+    Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
+  if (!copy) {
+    return nullptr;
+  }
+  for (int32_t y = 0; y < size.height; y++) {
+    memcpy(copy->GetData() + y * copy->Stride(),
+           aSource->GetData() + y * aSource->Stride(), size.width * 4);
+  }
+  return copy.forget();
+}
+
+// Returns the largest difference between any two channels of the pixels in
+// aRect of aSurface1 and aSurface2.
+static int
+MaxChannelDifference(DataSourceSurface* aSurface1, DataSourceSurface* aSurface2,
+                     const IntRect& aRect)
+{
+  int maxDifference = 0;
+  for (int32_t y = aRect.y; y < aRect.YMost(); y++) {
+    uint8_t* row1 = aSurface1->GetData() + y * aSurface1->Stride();
+    uint8_t* row2 = aSurface2->GetData() + y * aSurface2->Stride();
+    for (int32_t x = aRect.x * 4; x < aRect.XMost() * 4; x++) {
+      maxDifference = max(maxDifference, abs(int(row1[x]) - int(row2[x])));
+    }
+  }
+  return maxDifference;
+}
+
+static int
+MaxChannelDifference(DataSourceSurface* aSurface1, DataSourceSurface* aSurface2)
+{
+  return MaxChannelDifference(aSurface1, aSurface2,
+                              IntRect(IntPoint(), aSurface1->GetSize()));
+}
+
+void
+TestBlur::ColorBlurMatchesAlphaBoxBlur()
+{
+  // The same box blurs as AlphaBoxBlur, only rounded after every pass
+  // instead of after every pair of passes.
+  IntSize sizes[] = { IntSize(3, 7), IntSize(61, 33), IntSize(300, 260) };
+  Size deviations[] = { Size(0.5f, 0.5f), Size(3.0f, 0), Size(7.0f, 3.0f), Size(40.0f, 40.0f) };
+  for (size_t i = 0; i < ArrayLength(sizes); i++) {
+    RefPtr<DataSourceSurface> input = CreateColorPattern(sizes[i]);
+    VERIFY(input);
+    for (size_t j = 0; j < ArrayLength(deviations); j++) {
+      RefPtr<DataSourceSurface> channels[4];
+      FilterProcessing::SeparateColorChannels(input, channels[0], channels[1],
+                                              channels[2], channels[3]);
+      AlphaBoxBlur blur(Rect(0, 0, sizes[i].width, sizes[i].height), channels[0]->Stride(),
+                        deviations[j].width, deviations[j].height);
+      for (int k = 0; k < 4; k++) {
+        blur.Blur(channels[k]->GetData());
+      }
+      RefPtr<DataSourceSurface> expected =
+        FilterProcessing::CombineColorChannels(channels[0], channels[1],
+                                               channels[2], channels[3]);
+
+      RefPtr<DataSourceSurface> result = CopyColorSurface(input);
+      VERIFY(FilterProcessing::ApplyGaussianBlur(result, deviations[j], GAUSSIAN_BLUR_BOX, nullptr));
+      VERIFY(MaxChannelDifference(expected, result) <= 3);
+    }
+  }
+}
+
+void
+TestBlur::ColorBlurParallelMatchesSerial()
+{
+  RefPtr<DataSourceSurface> input = CreateColorPattern(IntSize(700, 500));
+  VERIFY(input);
+
+  WorkerPool pool(4);
+  Size deviations[] = { Size(12.0f, 5.0f), Size(2.0f, 2.0f), Size(30.0f, 9.0f) };
+  GaussianBlurQuality qualities[] = { GAUSSIAN_BLUR_BOX, GAUSSIAN_BLUR_EXACT, GAUSSIAN_BLUR_DOWNSCALED };
+  for (size_t i = 0; i < ArrayLength(deviations); i++) {
+    for (size_t j = 0; j < ArrayLength(qualities); j++) {
+      RefPtr<DataSourceSurface> serial = CopyColorSurface(input);
+      RefPtr<DataSourceSurface> parallel = CopyColorSurface(input);
+      VERIFY(FilterProcessing::ApplyGaussianBlur(serial, deviations[i], qualities[j], nullptr));
+      VERIFY(FilterProcessing::ApplyGaussianBlur(parallel, deviations[i], qualities[j], &pool));
+      VERIFY(MaxChannelDifference(serial, parallel) == 0);
+    }
+  }
+}
+
+void
+TestBlur::ExactGaussianMatchesReference()
+{
+  IntSize size(41, 37);
+  RefPtr<DataSourceSurface> input = CreateColorPattern(size);
+  VERIFY(input);
+
+  Float deviations[] = { 0.7f, 1.5f, 2.5f };
+  for (size_t i = 0; i < ArrayLength(deviations); i++) {
+    Float sigma = deviations[i];
+    VERIFY(FilterProcessing::ExactGaussianBlurRadius(sigma) <=
+           FilterProcessing::kMaxExactGaussianBlurRadius);
+
+    RefPtr<DataSourceSurface> result = CopyColorSurface(input);
+    VERIFY(FilterProcessing::ApplyGaussianBlur(result, Size(sigma, sigma), GAUSSIAN_BLUR_EXACT, nullptr));
+
+    // Convolve in floating point, first horizontally, then vertically, with
+    // the edges repeated. Beyond six standard deviations the weights are too
+    // small to change any pixel, so this is the untruncated Gaussian.
+    int32_t radius = int32_t(ceil(6 * sigma));
+    vector<double> reference(size.width * size.height * 4);
+    for (int32_t y = 0; y < size.height; y++) {
+      for (int32_t x = 0; x < size.width * 4; x++) {
+        reference[y * size.width * 4 + x] = input->GetData()[y * input->Stride() + x];
+      }
+    }
+    for (int pass = 0; pass < 2; pass++) {
+      vector<double> blurred(reference.size());
+      for (int32_t y = 0; y < size.height; y++) {
+        for (int32_t x = 0; x < size.width; x++) {
+          for (int32_t c = 0; c < 4; c++) {
+            double sum = 0, weights = 0;
+            for (int32_t k = -radius; k <= radius; k++) {
+              int32_t sx = pass ? x : min(max(x + k, 0), size.width - 1);
+              int32_t sy = pass ? min(max(y + k, 0), size.height - 1) : y;
+              double weight = exp(-k * k / (2.0 * sigma * sigma));
+              sum += weight * reference[(sy * size.width + sx) * 4 + c];
+              weights += weight;
+            }
+            blurred[(y * size.width + x) * 4 + c] = sum / weights;
+          }
+        }
+      }
+      reference.swap(blurred);
+    }
+
+    double maxError = 0;
+    for (int32_t y = 0; y < size.height; y++) {
+      for (int32_t x = 0; x < size.width * 4; x++) {
+        double value = result->GetData()[y * result->Stride() + x];
+        maxError = max(maxError, fabs(value - reference[y * size.width * 4 + x]));
+      }
+    }
+    VERIFY(maxError <= 1.0);
+  }
+}
+
+void
+TestBlur::DownscaledBlurMatchesBox()
+{
+  IntSize sizes[] = { IntSize(157, 211), IntSize(400, 300) };
+  Size deviations[] = { Size(24.0f, 24.0f), Size(31.0f, 5.0f), Size(90.0f, 40.0f) };
+  for (size_t i = 0; i < ArrayLength(sizes); i++) {
+    // Noise, with a hard edged opaque rectangle on top, which is where the two
+    // differ the most.
+    RefPtr<DataSourceSurface> input = CreateColorPattern(sizes[i]);
+    VERIFY(input);
+    for (int32_t y = sizes[i].height / 3; y < sizes[i].height * 2 / 3; y++) {
+      uint8_t* row = input->GetData() + y * input->Stride();
+      for (int32_t x = sizes[i].width / 4 + 1; x < sizes[i].width * 3 / 4; x++) {
+        row[4 * x] = 255;
+        row[4 * x + 1] = 0;
+        row[4 * x + 2] = 128;
+        row[4 * x + 3] = 255;
+      }
+    }
+
+    for (size_t j = 0; j < ArrayLength(deviations); j++) {
+      RefPtr<DataSourceSurface> expected = CopyColorSurface(input);
+      RefPtr<DataSourceSurface> result = CopyColorSurface(input);
+      VERIFY(FilterProcessing::ApplyGaussianBlur(expected, deviations[j], GAUSSIAN_BLUR_BOX, nullptr));
+      VERIFY(FilterProcessing::ApplyGaussianBlur(result, deviations[j], GAUSSIAN_BLUR_DOWNSCALED, nullptr));
+
+      IntSize radius =
+        AlphaBoxBlur::CalculateBlurRadius(Point(deviations[j].width, deviations[j].height));
+      IntRect interior(IntPoint(), sizes[i]);
+      interior.Deflate(radius.width, radius.height);
+      if (interior.IsEmpty()) {
+        continue;
+      }
+      VERIFY(MaxChannelDifference(expected, result, interior) <=
+             FilterProcessing::kMaxDownscaledBlurError);
+    }
+  }
+}
+
+void
+TestBlur::DownscaledAlphaBlurMatchesBox()
+{
+  IntSize sizes[] = { IntSize(157, 211), IntSize(600, 500) };
+  Point deviations[] = { Point(24.0f, 24.0f), Point(31.0f, 5.0f), Point(90.0f, 40.0f) };
+  WorkerPool pool(4);
+  for (size_t i = 0; i < ArrayLength(sizes); i++) {
+    // Noise, with a hard edged opaque rectangle on top.
+    IntSize size = sizes[i];
+    int32_t stride = (size.width + 15) & ~15;
+    vector<uint8_t> input(stride * size.height + 3);
+    for (size_t j = 0; j < input.size(); j++) {
+      input[j] = uint8_t((j * 7919) >> 5);
+    }
+    for (int32_t y = size.height / 3; y < size.height * 2 / 3; y++) {
+      memset(&input[y * stride + size.width / 4 + 1], 0xff, size.width / 2 - 1);
+    }
+
+    for (size_t j = 0; j < ArrayLength(deviations); j++) {
+      AlphaBoxBlur blur(Rect(0, 0, size.width, size.height), stride,
+                        deviations[j].x, deviations[j].y);
+      vector<uint8_t> expected(input), result(input), parallel(input);
+      blur.Blur(&expected.front());
+      blur.BlurDownscaled(&result.front());
+      blur.BlurDownscaled(&parallel.front(), &pool);
+      VERIFY(result == parallel);
+
+      IntSize radius = AlphaBoxBlur::CalculateBlurRadius(deviations[j]);
+      int maxError = 0;
+      for (int32_t y = radius.height; y < size.height - radius.height; y++) {
+        for (int32_t x = radius.width; x < size.width - radius.width; x++) {
+          maxError = max(maxError, abs(expected[y * stride + x] - result[y * stride + x]));
+        }
+      }
+      VERIFY(maxError <= AlphaBoxBlur::kMaxDownscaledError);
+    }
+  }
+}
@@ -0,0 +1,23 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#pragma once
+
+#include "TestBase.h"
+
+class TestBlur : public TestBase
+{
+public:
+  TestBlur();
+
+  void ParallelMatchesSerial();
+  void ParallelMatchesSerialWithSkipRect();
+  void ParallelMatchesSerialLargeSurface();
+  void ColorBlurMatchesAlphaBoxBlur();
+  void ColorBlurParallelMatchesSerial();
+  void ExactGaussianMatchesReference();
+  void DownscaledBlurMatchesBox();
+  void DownscaledAlphaBlurMatchesBox();
+};
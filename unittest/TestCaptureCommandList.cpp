@@ -0,0 +1,412 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestCaptureCommandList.h"
+
+#include "CaptureCommandList.h"
+#include "DataDrawTarget.h"
+#include "DrawCommand.h"
+
+#include <string.h>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+namespace {
+
+// Records its index and counts live instances.
+class CountedCommand : public DrawingCommand
+{
+public:
+  CountedCommand(int aIndex, int *aLiveCount)
+    : DrawingCommand(CommandType::POPCLIP)
+    , mIndex(aIndex)
+    , mLiveCount(aLiveCount)
+  {
+    (*mLiveCount)++;
+  }
+  ~CountedCommand() { (*mLiveCount)--; }
+
+  virtual void ExecuteOnDT(DrawTarget* aDT, const Matrix& aTransform) {}
+
+  int mIndex;
+  int *mLiveCount;
+};
+
+template<size_t PayloadSize>
+class TestCommand : public CountedCommand
+{
+public:
+  TestCommand(int aIndex, int *aLiveCount)
+    : CountedCommand(aIndex, aLiveCount)
+  {}
+
+  uint8_t mPayload[PayloadSize];
+};
+
+int
+GetIndex(DrawingCommand *aCommand)
+{
+  return static_cast<CountedCommand*>(aCommand)->mIndex;
+}
+
+bool
+CompareSurfaces(SourceSurface *aSurfA, SourceSurface *aSurfB)
+{
+  RefPtr<DataSourceSurface> dataA = aSurfA->GetDataSurface();
+  RefPtr<DataSourceSurface> dataB = aSurfB->GetDataSurface();
+  for (int y = 0; y < dataA->GetSize().height; y++) {
+    if (memcmp(dataA->GetData() + y * dataA->Stride(),
+               dataB->GetData() + y * dataB->Stride(),
+               dataA->GetSize().width * 4)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+TestCaptureCommandList::TestCaptureCommandList()
+{
+#define TEST_CLASS TestCaptureCommandList
+  REGISTER_TEST(AlignedInOrder);
+  REGISTER_TEST(LargeCommands);
+  REGISTER_TEST(ClearAndReuse);
+  REGISTER_TEST(RemoveCommands);
+  REGISTER_TEST(OptimizeCulling);
+  REGISTER_TEST(OptimizeOcclusion);
+  REGISTER_TEST(ReplayToTiles);
+  REGISTER_TEST(TiledQueuesMatchImmediate);
+#undef TEST_CLASS
+}
+
+void
+TestCaptureCommandList::AlignedInOrder()
+{
+  int live = 0;
+  {
+    CaptureCommandList list;
+    VERIFY(list.IsEmpty());
+
+    // Enough commands of mixed sizes to need several chunks.
+    for (int i = 0; i < 3000; i++) {
+      void *command;
+      if (i % 2) {
+        command = new (list.Append<TestCommand<3> >()) TestCommand<3>(i, &live);
+      } else {
+        command = new (list.Append<TestCommand<40> >()) TestCommand<40>(i, &live);
+      }
+      VERIFY(uintptr_t(command) % CaptureCommandList::kCommandAlignment == 0);
+    }
+    VERIFY(!list.IsEmpty());
+    VERIFYVALUE(live, 3000);
+
+    int index = 0;
+    for (CaptureCommandList::Iterator iter(list); !iter.Done(); iter.Next()) {
+      VERIFYVALUE(GetIndex(iter.Get()), index);
+      index++;
+    }
+    VERIFYVALUE(index, 3000);
+  }
+  VERIFYVALUE(live, 0);
+}
+
+void
+TestCaptureCommandList::LargeCommands()
+{
+  int live = 0;
+  CaptureCommandList list;
+
+  // Commands larger than a chunk get a chunk of their own.
+  new (list.Append<TestCommand<8> >()) TestCommand<8>(0, &live);
+  new (list.Append<TestCommand<40000> >()) TestCommand<40000>(1, &live);
+  new (list.Append<TestCommand<8> >()) TestCommand<8>(2, &live);
+  new (list.Append<TestCommand<100000> >()) TestCommand<100000>(3, &live);
+
+  int index = 0;
+  for (CaptureCommandList::Iterator iter(list); !iter.Done(); iter.Next()) {
+    VERIFYVALUE(GetIndex(iter.Get()), index);
+    index++;
+  }
+  VERIFYVALUE(index, 4);
+
+  // After clearing, a large command first needs a new chunk in front of the
+  // existing ones, small commands then continue in order after it.
+  list.Clear();
+  VERIFYVALUE(live, 0);
+  VERIFY(list.IsEmpty());
+
+  new (list.Append<TestCommand<60000> >()) TestCommand<60000>(0, &live);
+  for (int i = 1; i < 1000; i++) {
+    new (list.Append<TestCommand<8> >()) TestCommand<8>(i, &live);
+  }
+
+  index = 0;
+  for (CaptureCommandList::Iterator iter(list); !iter.Done(); iter.Next()) {
+    VERIFYVALUE(GetIndex(iter.Get()), index);
+    index++;
+  }
+  VERIFYVALUE(index, 1000);
+
+  list.Clear();
+  VERIFYVALUE(live, 0);
+}
+
+void
+TestCaptureCommandList::ClearAndReuse()
+{
+  int live = 0;
+  CaptureCommandList list;
+
+  void *first = list.Append<TestCommand<16> >();
+  new (first) TestCommand<16>(0, &live);
+  for (int i = 1; i < 500; i++) {
+    new (list.Append<TestCommand<16> >()) TestCommand<16>(i, &live);
+  }
+
+  list.Clear();
+  VERIFYVALUE(live, 0);
+  VERIFY(list.IsEmpty());
+
+  // The storage is reused from the start.
+  void *reused = list.Append<TestCommand<16> >();
+  new (reused) TestCommand<16>(0, &live);
+  VERIFY(reused == first);
+}
+
+void
+TestCaptureCommandList::RemoveCommands()
+{
+  int live = 0;
+  CaptureCommandList list;
+
+  std::vector<DrawingCommand*> commands;
+  for (int i = 0; i < 2000; i++) {
+    commands.push_back(new (list.Append<TestCommand<24> >()) TestCommand<24>(i, &live));
+  }
+
+  // Remove every command that isn't a multiple of 3, across several chunks.
+  for (int i = 0; i < 2000; i++) {
+    if (i % 3) {
+      list.Remove(commands[i]);
+    }
+  }
+  VERIFYVALUE(live, 667);
+
+  int index = 0;
+  for (CaptureCommandList::Iterator iter(list); !iter.Done(); iter.Next()) {
+    VERIFYVALUE(GetIndex(iter.Get()), index);
+    index += 3;
+  }
+  VERIFYVALUE(index, 2001);
+
+  list.Remove(commands[0]);
+  list.Clear();
+  VERIFYVALUE(live, 0);
+  VERIFY(list.IsEmpty());
+}
+
+void
+TestCaptureCommandList::OptimizeCulling()
+{
+  RefPtr<DrawTarget> dt = new DataDrawTarget(IntSize(100, 100));
+  RefPtr<DrawTargetCapture> captures[2];
+  for (int i = 0; i < 2; i++) {
+    captures[i] = dt->CreateCaptureDT(IntSize(100, 100));
+    DrawTargetCapture *capture = captures[i];
+
+    // Nothing is known about the target's transform yet, this stays.
+    capture->FillRect(Rect(0, 0, 10, 10), ColorPattern(Color(1, 0, 0)));
+    // Replaced by the next transform before anything uses it.
+    capture->SetTransform(Matrix());
+    capture->SetTransform(Matrix::Translation(5, 5));
+    // Same as the current transform.
+    capture->SetTransform(Matrix::Translation(5, 5));
+    // Outside of the target.
+    capture->FillRect(Rect(200, 200, 10, 10), ColorPattern(Color(1, 0, 0)));
+    // Outside of the clip, which then has no draws in it.
+    capture->PushClipRect(Rect(0, 0, 10, 10));
+    capture->FillRect(Rect(50, 50, 10, 10), ColorPattern(Color(1, 0, 0)));
+    capture->PopClip();
+    capture->FillRect(Rect(20, 20, 10, 10), ColorPattern(Color(0, 1, 0)));
+  }
+
+  VERIFYVALUE(captures[1]->OptimizeCommands(), 6u);
+  // Running it again finds nothing new.
+  VERIFYVALUE(captures[1]->OptimizeCommands(), 0u);
+
+  RefPtr<SourceSurface> reference = captures[0]->Snapshot();
+  RefPtr<SourceSurface> optimized = captures[1]->Snapshot();
+  VERIFY(CompareSurfaces(reference, optimized));
+}
+
+void
+TestCaptureCommandList::OptimizeOcclusion()
+{
+  RefPtr<DrawTarget> dt = new DataDrawTarget(IntSize(100, 100));
+  RefPtr<DrawTargetCapture> captures[2];
+  for (int i = 0; i < 2; i++) {
+    captures[i] = dt->CreateCaptureDT(IntSize(100, 100));
+    DrawTargetCapture *capture = captures[i];
+
+    capture->SetTransform(Matrix());
+    // Covered by the opaque fill below.
+    capture->FillRect(Rect(10, 10, 20, 20), ColorPattern(Color(1, 0, 0)));
+    capture->FillRect(Rect(20, 20, 20, 20), ColorPattern(Color(0, 1, 0, 0.5f)));
+    // Sticks out of the opaque fill, which only covers whole pixels.
+    capture->FillRect(Rect(0, 0, 60.5f, 10), ColorPattern(Color(0, 0, 1)));
+    capture->FillRect(Rect(0, 0, 60.5f, 60.5f), ColorPattern(Color(1, 1, 0)));
+    // Translucent, this doesn't hide anything.
+    capture->FillRect(Rect(50, 50, 50, 50), ColorPattern(Color(0, 1, 1, 0.5f)));
+    // Only hides what's inside the clip.
+    capture->PushClipRect(Rect(0, 0, 100, 40));
+    capture->FillRect(Rect(50, 0, 50, 100), ColorPattern(Color(1, 0, 1)));
+    capture->PopClip();
+    capture->ClearRect(Rect(70, 70, 10, 10));
+  }
+
+  VERIFYVALUE(captures[1]->OptimizeCommands(), 2u);
+
+  RefPtr<SourceSurface> reference = captures[0]->Snapshot();
+  RefPtr<SourceSurface> optimized = captures[1]->Snapshot();
+  VERIFY(CompareSurfaces(reference, optimized));
+}
+
+// Records a scene that touches all four 50x50 quarters of a 100x100 target.
+static TemporaryRef<DrawTargetCapture>
+CaptureTileScene(DrawTarget* aRefDT)
+{
+  RefPtr<DrawTargetCapture> capture = aRefDT->CreateCaptureDT(IntSize(100, 100));
+
+  capture->FillRect(Rect(0, 0, 100, 100), ColorPattern(Color(1, 1, 1)));
+  capture->FillRect(Rect(10, 10, 20, 20), ColorPattern(Color(1, 0, 0)));
+  capture->SetTransform(Matrix::Translation(45, 45));
+  capture->PushClipRect(Rect(-20, -20, 40, 40));
+  capture->FillRect(Rect(-30, -30, 60, 60), ColorPattern(Color(0, 1, 0)));
+  capture->PopClip();
+  capture->FillRect(Rect(-45, 30, 95, 3), ColorPattern(Color(0, 0, 1, 0.5f)));
+  aRefDT->FillRect(Rect(0, 0, 10, 10), ColorPattern(Color(1, 0, 1)));
+  RefPtr<SourceSurface> source = aRefDT->Snapshot();
+  capture->CopySurface(source, IntRect(0, 0, 10, 10), IntPoint(60, 5));
+  return capture.forget();
+}
+
+// Replays aCapture onto 2x2 tiles and checks them against aReference.
+static bool
+ReplayMatches(DrawTargetCapture* aCapture, DataSourceSurface* aReference)
+{
+  RefPtr<DataDrawTarget> tileDTs[4];
+  Tile tiles[4];
+  Matrix tileTransform = Matrix::Translation(3, 4);
+  for (int i = 0; i < 4; i++) {
+    tileDTs[i] = new DataDrawTarget(IntSize(50, 50));
+    tileDTs[i]->SetTransform(tileTransform);
+    tiles[i].mDrawTarget = tileDTs[i];
+    tiles[i].mTileOrigin = IntPoint((i % 2) * 50, (i / 2) * 50);
+  }
+  TileSet tileSet;
+  tileSet.mTiles = tiles;
+  tileSet.mTileCount = 4;
+  aCapture->ReplayToTiles(tileSet);
+
+  for (int i = 0; i < 4; i++) {
+    if (tileDTs[i]->HasUnsupportedCalls() ||
+        tileDTs[i]->GetTransform() != tileTransform) {
+      return false;
+    }
+    DataSourceSurface* tileData = tileDTs[i]->GetData();
+    for (int y = 0; y < 50; y++) {
+      uint8_t *expected = aReference->GetData() +
+        (tiles[i].mTileOrigin.y + y) * aReference->Stride() +
+        tiles[i].mTileOrigin.x * 4;
+      if (memcmp(tileData->GetData() + y * tileData->Stride(), expected, 50 * 4)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void
+TestCaptureCommandList::ReplayToTiles()
+{
+  RefPtr<DrawTarget> dt = new DataDrawTarget(IntSize(100, 100));
+  RefPtr<DrawTargetCapture> capture = CaptureTileScene(dt);
+  RefPtr<SourceSurface> reference = capture->Snapshot();
+  RefPtr<DataSourceSurface> referenceData = reference->GetDataSurface();
+
+  VERIFY(ReplayMatches(capture, referenceData));
+}
+
+// Draws into 2x2 tiles of 50x50 pixels, queueing per tile if asked to, and
+// returns whether the tiles were only drawn to on flushing.
+static bool
+DrawTiles(RefPtr<DataDrawTarget>* aTiles, bool aQueuePerTile, SourceSurface* aImage)
+{
+  Tile tiles[4];
+  for (int i = 0; i < 4; i++) {
+    aTiles[i] = new DataDrawTarget(IntSize(50, 50));
+    tiles[i].mDrawTarget = aTiles[i];
+    tiles[i].mTileOrigin = IntPoint((i % 2) * 50, (i / 2) * 50);
+  }
+  TileSet tileSet;
+  tileSet.mTiles = tiles;
+  tileSet.mTileCount = 4;
+  RefPtr<DrawTarget> dt = Factory::CreateTiledDrawTarget(tileSet, aQueuePerTile);
+  if (!dt) {
+    return false;
+  }
+
+  dt->FillRect(Rect(0, 0, 100, 100), ColorPattern(Color(1, 1, 1)));
+  dt->FillRect(Rect(10, 10, 20, 20), ColorPattern(Color(1, 0, 0)));
+  dt->SetTransform(Matrix::Translation(45, 45));
+  dt->PushClipRect(Rect(-20, -20, 40, 40));
+  dt->FillRect(Rect(-30, -30, 60, 60), ColorPattern(Color(0, 1, 0, 0.5f)));
+  dt->PopClip();
+  dt->FillRect(Rect(-40, 10, 80, 30),
+               SurfacePattern(aImage, ExtendMode::REPEAT, Matrix::Scaling(3, 3)));
+  dt->SetTransform(Matrix());
+  dt->ClearRect(Rect(70, 70, 10, 10));
+
+  bool deferred = true;
+  for (int i = 0; i < 4; i++) {
+    deferred = deferred && !aTiles[i]->GetData()->GetData()[0];
+  }
+  dt->Flush();
+  return deferred;
+}
+
+void
+TestCaptureCommandList::TiledQueuesMatchImmediate()
+{
+  RefPtr<DataSourceSurface> image =
+    Factory::CreateDataSourceSurface(IntSize(4, 4), SurfaceFormat::B8G8R8A8);
+  VERIFY(image);
+  for (int32_t y = 0; y < 4; y++) {
+    for (int32_t x = 0; x < 4; x++) {
+      uint32_t* pixel = (uint32_t*)(image->GetData() + y * image->Stride()) + x;
+      *pixel = (x + y) % 2 ? 0xff204080 : 0x80800000;
+    }
+  }
+
+  RefPtr<DataDrawTarget> immediate[4];
+  VERIFY(!DrawTiles(immediate, false, image));
+  RefPtr<DataDrawTarget> queued[4];
+  VERIFY(DrawTiles(queued, true, image));
+  DataSourceSurface* first = immediate[0]->GetData();
+  VERIFY(*(uint32_t*)(first->GetData() + 15 * first->Stride() + 15 * 4) == 0xffff0000);
+
+  for (int i = 0; i < 4; i++) {
+    VERIFY(!immediate[i]->HasUnsupportedCalls());
+    VERIFY(!queued[i]->HasUnsupportedCalls());
+    DataSourceSurface* expected = immediate[i]->GetData();
+    DataSourceSurface* actual = queued[i]->GetData();
+    for (int32_t y = 0; y < 50; y++) {
+      VERIFY(!memcmp(expected->GetData() + y * expected->Stride(),
+                     actual->GetData() + y * actual->Stride(), 50 * 4));
+    }
+  }
+}
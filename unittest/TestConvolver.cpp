@@ -0,0 +1,171 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestConvolver.h"
+
+#include "2D.h"
+#include "WorkerPool.h"
+#include "convolver.h"
+#ifdef USE_SSE2
+#include "convolverSSE2.h"
+#endif
+#ifdef USE_AVX2
+#include "convolverAVX2.h"
+#endif
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace mozilla::gfx;
+using namespace skia;
+using namespace std;
+
+TestConvolver::TestConvolver()
+{
+#define TEST_CLASS TestConvolver
+  REGISTER_TEST(ParallelMatchesSerial);
+  REGISTER_TEST(AVX2MatchesSSE2);
+#undef TEST_CLASS
+}
+
+// Fills aFilter with a triangle filter that resamples aSourceSize pixels to
+// aDestSize, stretched by aSupport, like ImageOperations::Resize would.
+static void
+CreateResampleFilter(int aSourceSize, int aDestSize, float aSupport,
+                     ConvolutionFilter1D* aFilter)
+{
+  float scale = float(aDestSize) / aSourceSize;
+  float radius = aSupport * max(1.0f, 1 / scale);
+  vector<float> values;
+  for (int x = 0; x < aDestSize; x++) {
+    float center = (x + 0.5f) / scale;
+    int begin = max(0, int(floor(center - radius)));
+    int end = min(aSourceSize, int(ceil(center + radius)));
+    values.clear();
+    float sum = 0;
+    for (int i = begin; i < end; i++) {
+      float value = max(0.0f, 1 - fabs(i + 0.5f - center) / radius);
+      values.push_back(value);
+      sum += value;
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      values[i] /= sum;
+    }
+    aFilter->AddFilter(begin, &values.front(), values.size());
+  }
+  aFilter->PaddingForSIMD(8);
+}
+
+// A premultiplied BGRA image of random pixels.
+static vector<unsigned char>
+CreateImage(int aWidth, int aHeight, bool aHasAlpha)
+{
+  srand(aWidth * aHeight);
+  vector<unsigned char> image(aWidth * aHeight * 4);
+  for (size_t i = 0; i < image.size(); i += 4) {
+    unsigned char alpha = aHasAlpha ? rand() % 256 : 0xff;
+    for (int c = 0; c < 3; c++) {
+      image[i + c] = alpha ? rand() % (alpha + 1) : 0;
+    }
+    image[i + 3] = alpha;
+  }
+  return image;
+}
+
+void
+TestConvolver::ParallelMatchesSerial()
+{
+  const struct { int width, height, destWidth, destHeight; float support; } kCases[] = {
+    { 640, 480, 160, 120, 3.0f },
+    { 333, 517, 101, 250, 2.0f },
+    { 97, 1200, 97, 300, 1.0f },
+    { 50, 40, 300, 500, 2.0f },
+  };
+
+  WorkerPool pool(4);
+  for (size_t i = 0; i < sizeof(kCases) / sizeof(kCases[0]); i++) {
+    ConvolutionFilter1D filterX, filterY;
+    CreateResampleFilter(kCases[i].width, kCases[i].destWidth, kCases[i].support, &filterX);
+    CreateResampleFilter(kCases[i].height, kCases[i].destHeight, kCases[i].support, &filterY);
+
+    for (int hasAlpha = 0; hasAlpha < 2; hasAlpha++) {
+      vector<unsigned char> source = CreateImage(kCases[i].width, kCases[i].height, hasAlpha);
+      int outputStride = kCases[i].destWidth * 4;
+      vector<unsigned char> serial(outputStride * kCases[i].destHeight);
+      vector<unsigned char> parallel(serial.size());
+
+      BGRAConvolve2D(&source.front(), kCases[i].width * 4, hasAlpha, filterX, filterY,
+                     outputStride, &serial.front());
+      BGRAConvolve2D(&source.front(), kCases[i].width * 4, hasAlpha, filterX, filterY,
+                     outputStride, &parallel.front(), &pool);
+      VERIFY(serial == parallel);
+    }
+  }
+}
+
+void
+TestConvolver::AVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  // Filters of every length up to a few iterations of eight taps, so every
+  // remainder is covered, over rows that are padded for the SIMD loads.
+  const int kWidth = 61;
+  const int kRows = 24;
+  vector<unsigned char> source = CreateImage(kWidth + 40, kRows, true);
+  int stride = (kWidth + 40) * 4;
+
+  for (int length = 1; length <= 24; length++) {
+    ConvolutionFilter1D filter;
+    vector<float> values(length);
+    for (int x = 0; x < kWidth; x++) {
+      for (int i = 0; i < length; i++) {
+        values[i] = float((x * 7 + i * 13) % 11 + 1) / (11 * length);
+      }
+      filter.AddFilter(x % 5, &values.front(), length);
+    }
+    filter.PaddingForSIMD(8);
+
+    vector<unsigned char> sse2(kWidth * 4 * 4), avx2(sse2.size());
+    const unsigned char* src[4];
+    unsigned char* sse2Rows[4];
+    unsigned char* avx2Rows[4];
+    for (int i = 0; i < 4; i++) {
+      src[i] = &source[i * stride];
+      sse2Rows[i] = &sse2[i * kWidth * 4];
+      avx2Rows[i] = &avx2[i * kWidth * 4];
+    }
+    ConvolveHorizontally4_SSE2(src, 0, kWidth, filter, sse2Rows);
+    ConvolveHorizontally4_AVX2(src, 0, kWidth, filter, avx2Rows);
+    VERIFY(sse2 == avx2);
+
+    // The vertical pass uses the same coefficients, on as many rows.
+    int filterOffset, filterLength;
+    const ConvolutionFilter1D::Fixed* filterValues =
+      filter.FilterForValue(0, &filterOffset, &filterLength);
+    unsigned char* rows[kRows];
+    for (int i = 0; i < kRows; i++) {
+      rows[i] = &source[i * stride];
+    }
+    for (int hasAlpha = 0; hasAlpha < 2; hasAlpha++) {
+      for (int begin = 0; begin < 2; begin++) {
+        sse2.assign(kWidth * 4, 0);
+        avx2.assign(kWidth * 4, 0);
+        ConvolveVertically_SSE2(filterValues, filterLength, rows, begin, kWidth,
+                                &sse2.front(), hasAlpha);
+        ConvolveVertically_AVX2(filterValues, filterLength, rows, begin, kWidth,
+                                &avx2.front(), hasAlpha);
+        VERIFY(sse2 == avx2);
+      }
+    }
+  }
+#endif
+}
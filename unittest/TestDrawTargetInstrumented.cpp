@@ -0,0 +1,123 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestDrawTargetInstrumented.h"
+
+#include "DataDrawTarget.h"
+#include "ShadowMaskCache.h"
+
+#include <vector>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+using namespace std;
+
+TestDrawTargetInstrumented::TestDrawTargetInstrumented()
+{
+#define TEST_CLASS TestDrawTargetInstrumented
+  REGISTER_TEST(CountsCallsAndPixels);
+  REGISTER_TEST(BoxShadowMasksCountPatches);
+#undef TEST_CLASS
+}
+
+// Wraps 2x2 tiles of 32x32 pixels in an instrumented DrawTarget.
+static TemporaryRef<DrawTarget>
+CreateInstrumentedTiles(RefPtr<DataDrawTarget>* aTiles, DrawTargetStats* aStats)
+{
+  Tile tiles[4];
+  for (int i = 0; i < 4; i++) {
+    aTiles[i] = new DataDrawTarget(IntSize(32, 32));
+    tiles[i].mDrawTarget = aTiles[i];
+    tiles[i].mTileOrigin = IntPoint((i % 2) * 32, (i / 2) * 32);
+  }
+  TileSet tileSet;
+  tileSet.mTiles = tiles;
+  tileSet.mTileCount = 4;
+  RefPtr<DrawTarget> dt = Factory::CreateTiledDrawTarget(tileSet);
+  if (!dt) {
+    return nullptr;
+  }
+  return Factory::CreateInstrumentedDrawTarget(dt, aStats);
+}
+
+void
+TestDrawTargetInstrumented::CountsCallsAndPixels()
+{
+  RefPtr<DrawTargetStats> stats = new DrawTargetStats();
+  RefPtr<DataDrawTarget> tiles[4];
+  RefPtr<DrawTarget> dt = CreateInstrumentedTiles(tiles, stats);
+  VERIFY(dt);
+
+  ColorPattern red(Color(1, 0, 0));
+  // 10x10 pixels, moved by the transform, and 4x64 of which the rest is
+  // outside the DrawTarget.
+  dt->SetTransform(Matrix::Translation(5, 5));
+  dt->FillRect(Rect(0, 0, 10, 10), red);
+  dt->SetTransform(Matrix());
+  dt->FillRect(Rect(60, 0, 40, 64), red);
+
+  // Clipped to 10x10 and 20x20 pixels.
+  dt->PushClipRect(Rect(0, 0, 20, 20));
+  dt->FillRect(Rect(10, 10, 30, 30), red);
+  dt->Mask(red, ColorPattern(Color(0, 0, 0, 0.5f)));
+  dt->PopClip();
+
+  // The whole DrawTarget once the clip is gone.
+  dt->Mask(red, ColorPattern(Color(0, 0, 0, 0.5f)));
+
+  // CopySurface ignores the clip.
+  RefPtr<SourceSurface> snapshot = tiles[0]->Snapshot();
+  dt->PushClipRect(Rect(0, 0, 1, 1));
+  dt->CopySurface(snapshot, IntRect(0, 0, 8, 8), IntPoint(40, 40));
+  dt->PopClip();
+
+  const DrawTargetStats::Counters& fill = stats->Get(DrawTargetStats::FILL_RECT);
+  VERIFY(fill.mCalls == 3);
+  VERIFY(fill.mPixels == 100 + 4 * 64 + 100);
+  const DrawTargetStats::Counters& mask = stats->Get(DrawTargetStats::MASK);
+  VERIFY(mask.mCalls == 2);
+  VERIFY(mask.mPixels == 400 + 64 * 64);
+  const DrawTargetStats::Counters& copy = stats->Get(DrawTargetStats::COPY_SURFACE);
+  VERIFY(copy.mCalls == 1);
+  VERIFY(copy.mPixels == 64);
+  VERIFY(stats->Get(DrawTargetStats::PUSH_CLIP_RECT).mCalls == 2);
+  VERIFY(stats->Get(DrawTargetStats::POP_CLIP).mCalls == 2);
+
+  // The calls reached the tiles.
+  for (int i = 0; i < 4; i++) {
+    VERIFY(!tiles[i]->HasUnsupportedCalls());
+  }
+  VERIFY(tiles[1]->GetData()->GetData()[4 * 29 + 3] == 255);
+}
+
+void
+TestDrawTargetInstrumented::BoxShadowMasksCountPatches()
+{
+  RefPtr<DrawTargetStats> stats = new DrawTargetStats();
+  RefPtr<DataDrawTarget> tiles[4];
+  RefPtr<DrawTarget> dt = CreateInstrumentedTiles(tiles, stats);
+  VERIFY(dt);
+
+  IntRect box(16, 16, 32, 32);
+  Float sigma = 3.0f;
+  vector<BoxShadowPatch> patches;
+  RefPtr<DataSourceSurface> shadowTemplate =
+    ShadowMaskCache::GetBoxShadow(box, nullptr, sigma, &patches);
+  VERIFY(shadowTemplate);
+  uint64_t expectedPixels = 0;
+  for (size_t i = 0; i < patches.size(); i++) {
+    IntRect dest = patches[i].mDest.Intersect(IntRect(0, 0, 64, 64));
+    expectedPixels += uint64_t(dest.width) * dest.height;
+  }
+
+  dt->DrawBoxShadow(Rect(box), nullptr, Color(0, 0, 0), sigma);
+
+  // Each patch only counts the pixels within its clip, not the whole
+  // DrawTarget.
+  const DrawTargetStats::Counters& mask = stats->Get(DrawTargetStats::MASK);
+  VERIFY(mask.mCalls == patches.size());
+  VERIFY(mask.mPixels == expectedPixels);
+  VERIFY(mask.mPixels < uint64_t(patches.size()) * 64 * 64);
+}
@@ -0,0 +1,356 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestFilterNodeSoftware.h"
+
+#include "2D.h"
+#include "FilterNodeSoftware.h"
+#include "WorkerPool.h"
+#include "mozilla/Util.h"
+
+#include <string.h>
+#include <vector>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+TestFilterNodeSoftware::TestFilterNodeSoftware()
+{
+#define TEST_CLASS TestFilterNodeSoftware
+  REGISTER_TEST(TiledOutputMatchesUntiled);
+  REGISTER_TEST(ParallelTilesMatchSerial);
+  REGISTER_TEST(PointwiseChainMatchesSeparatePasses);
+  REGISTER_TEST(SharedCacheReusesOutput);
+#undef TEST_CLASS
+}
+
+static TemporaryRef<DataSourceSurface>
+CreateNoiseSurface(const IntSize& aSize)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8);
+  if (!surface) {
+    return nullptr;
+  }
+
+  uint32_t state = 1;
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint8_t* row = surface->GetData() + y * surface->Stride();
+    for (int32_t x = 0; x < aSize.width; x++) {
+      state = state * 1103515245 + 12345;
+      uint8_t alpha = uint8_t(state >> 16);
+      for (int32_t i = 0; i < 3; i++) {
+        state = state * 1103515245 + 12345;
+        row[4 * x + i] = uint8_t((state >> 16) % (alpha + 1));
+      }
+      row[4 * x + 3] = alpha;
+    }
+  }
+  return surface.forget();
+}
+
+// Builds a graph that uses filters with input margins, edge modes and a
+// filter that feeds two others, on top of a single input surface.
+static TemporaryRef<FilterNode>
+CreateFilterGraph(SourceSurface* aInput)
+{
+  RefPtr<FilterNode> blur = FilterNodeSoftware::Create(FilterType::GAUSSIAN_BLUR);
+  blur->SetInput(IN_GAUSSIAN_BLUR_IN, aInput);
+  blur->SetAttribute(ATT_GAUSSIAN_BLUR_STD_DEVIATION, 2.5f);
+
+  Matrix5x4 matrix;
+  matrix._11 = 0.393f; matrix._12 = 0.349f; matrix._13 = 0.272f;
+  matrix._21 = 0.769f; matrix._22 = 0.686f; matrix._23 = 0.534f;
+  matrix._31 = 0.189f; matrix._32 = 0.168f; matrix._33 = 0.131f;
+  RefPtr<FilterNode> colorMatrix = FilterNodeSoftware::Create(FilterType::COLOR_MATRIX);
+  colorMatrix->SetInput(IN_COLOR_MATRIX_IN, blur);
+  colorMatrix->SetAttribute(ATT_COLOR_MATRIX_MATRIX, matrix);
+
+  RefPtr<FilterNode> dilate = FilterNodeSoftware::Create(FilterType::MORPHOLOGY);
+  dilate->SetInput(IN_MORPHOLOGY_IN, aInput);
+  dilate->SetAttribute(ATT_MORPHOLOGY_RADII, IntSize(2, 1));
+  dilate->SetAttribute(ATT_MORPHOLOGY_OPERATOR, (uint32_t)MORPHOLOGY_OPERATOR_DILATE);
+
+  Float kernel[] = { 0, 1, 0, 1, -4, 1, 0, 1, 0 };
+  RefPtr<FilterNode> convolve = FilterNodeSoftware::Create(FilterType::CONVOLVE_MATRIX);
+  convolve->SetInput(IN_CONVOLVE_MATRIX_IN, aInput);
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_KERNEL_SIZE, IntSize(3, 3));
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_KERNEL_MATRIX, kernel, 9);
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_DIVISOR, 1.0f);
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_TARGET, IntPoint(1, 1));
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_SOURCE_RECT,
+                         IntRect(IntPoint(0, 0), aInput->GetSize()));
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_EDGE_MODE, (uint32_t)EDGE_MODE_WRAP);
+  convolve->SetAttribute(ATT_CONVOLVE_MATRIX_KERNEL_UNIT_LENGTH, Size(1, 1));
+
+  RefPtr<FilterNode> composite = FilterNodeSoftware::Create(FilterType::COMPOSITE);
+  composite->SetInput(IN_COMPOSITE_IN_START, dilate);
+  composite->SetInput(IN_COMPOSITE_IN_START + 1, convolve);
+  composite->SetInput(IN_COMPOSITE_IN_START + 2, colorMatrix);
+  composite->SetAttribute(ATT_COMPOSITE_OPERATOR, (uint32_t)COMPOSITE_OPERATOR_OVER);
+
+  RefPtr<FilterNode> lighting = FilterNodeSoftware::Create(FilterType::DISTANT_SPECULAR);
+  lighting->SetInput(IN_DISTANT_SPECULAR_IN, blur);
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_AZIMUTH, 45.0f);
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_ELEVATION, 30.0f);
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_COLOR, Color(1.0f, 0.8f, 0.5f, 1.0f));
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_SURFACE_SCALE, 2.0f);
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_KERNEL_UNIT_LENGTH, Size(1, 1));
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_SPECULAR_CONSTANT, 1.0f);
+  lighting->SetAttribute(ATT_DISTANT_SPECULAR_SPECULAR_EXPONENT, 8.0f);
+
+  Float coefficients[] = { 0, 0.5f, 0.5f, 0 };
+  RefPtr<FilterNode> combine = FilterNodeSoftware::Create(FilterType::ARITHMETIC_COMBINE);
+  combine->SetInput(IN_ARITHMETIC_COMBINE_IN, composite);
+  combine->SetInput(IN_ARITHMETIC_COMBINE_IN2, lighting);
+  combine->SetAttribute(ATT_ARITHMETIC_COMBINE_COEFFICIENTS, coefficients, 4);
+
+  return combine.forget();
+}
+
+// Connects aFilter to an extra consumer, which keeps it from being fused
+// into the filter that uses it.
+static void
+Observe(FilterNode* aFilter, std::vector<RefPtr<FilterNode> >* aObservers)
+{
+  if (!aObservers) {
+    return;
+  }
+  RefPtr<FilterNode> observer = FilterNodeSoftware::Create(FilterType::PREMULTIPLY);
+  observer->SetInput(IN_PREMULTIPLY_IN, aFilter);
+  aObservers->push_back(observer);
+}
+
+// Builds a chain of pointwise filters on top of aInput. Every filter in the
+// chain is rendered separately if aObservers is non-null.
+static TemporaryRef<FilterNode>
+CreatePointwiseChain(SourceSurface* aInput, SourceSurface* aInput2,
+                     std::vector<RefPtr<FilterNode> >* aObservers)
+{
+  RefPtr<FilterNode> unpremultiply = FilterNodeSoftware::Create(FilterType::UNPREMULTIPLY);
+  unpremultiply->SetInput(IN_UNPREMULTIPLY_IN, aInput);
+  Observe(unpremultiply, aObservers);
+
+  Matrix5x4 matrix;
+  matrix._11 = 0.8f; matrix._12 = 0.1f; matrix._21 = 0.3f; matrix._33 = 1.2f;
+  matrix._44 = 0.9f; matrix._51 = 0.05f; matrix._54 = 0.02f;
+  RefPtr<FilterNode> colorMatrix = FilterNodeSoftware::Create(FilterType::COLOR_MATRIX);
+  colorMatrix->SetInput(IN_COLOR_MATRIX_IN, unpremultiply);
+  colorMatrix->SetAttribute(ATT_COLOR_MATRIX_MATRIX, matrix);
+  colorMatrix->SetAttribute(ATT_COLOR_MATRIX_ALPHA_MODE, (uint32_t)ALPHA_MODE_PREMULTIPLIED);
+  Observe(colorMatrix, aObservers);
+
+  Float table[] = { 0.0f, 0.7f, 0.2f, 1.0f };
+  RefPtr<FilterNode> tableTransfer = FilterNodeSoftware::Create(FilterType::TABLE_TRANSFER);
+  tableTransfer->SetInput(IN_TABLE_TRANSFER_IN, colorMatrix);
+  tableTransfer->SetAttribute(ATT_TABLE_TRANSFER_DISABLE_G, false);
+  tableTransfer->SetAttribute(ATT_TABLE_TRANSFER_TABLE_G, table, ArrayLength(table));
+  Observe(tableTransfer, aObservers);
+
+  RefPtr<FilterNode> linearTransfer = FilterNodeSoftware::Create(FilterType::LINEAR_TRANSFER);
+  linearTransfer->SetInput(IN_LINEAR_TRANSFER_IN, tableTransfer);
+  linearTransfer->SetAttribute(ATT_LINEAR_TRANSFER_DISABLE_G, false);
+  linearTransfer->SetAttribute(ATT_LINEAR_TRANSFER_SLOPE_G, 1.5f);
+  linearTransfer->SetAttribute(ATT_LINEAR_TRANSFER_INTERCEPT_G, -0.1f);
+  linearTransfer->SetAttribute(ATT_LINEAR_TRANSFER_DISABLE_A, false);
+  linearTransfer->SetAttribute(ATT_LINEAR_TRANSFER_SLOPE_A, 0.8f);
+  Observe(linearTransfer, aObservers);
+
+  Float coefficients[] = { 0.5f, 0.6f, 0.3f, 0.0f };
+  RefPtr<FilterNode> combine = FilterNodeSoftware::Create(FilterType::ARITHMETIC_COMBINE);
+  combine->SetInput(IN_ARITHMETIC_COMBINE_IN, linearTransfer);
+  combine->SetInput(IN_ARITHMETIC_COMBINE_IN2, aInput2);
+  combine->SetAttribute(ATT_ARITHMETIC_COMBINE_COEFFICIENTS, coefficients, 4);
+  Observe(combine, aObservers);
+
+  RefPtr<FilterNode> premultiply = FilterNodeSoftware::Create(FilterType::PREMULTIPLY);
+  premultiply->SetInput(IN_PREMULTIPLY_IN, combine);
+
+  return premultiply.forget();
+}
+
+// A flood followed by pointwise filters.
+static TemporaryRef<FilterNode>
+CreateFloodChain(std::vector<RefPtr<FilterNode> >* aObservers)
+{
+  RefPtr<FilterNode> flood = FilterNodeSoftware::Create(FilterType::FLOOD);
+  flood->SetAttribute(ATT_FLOOD_COLOR, Color(0.2f, 0.6f, 0.9f, 0.7f));
+  Observe(flood, aObservers);
+
+  Matrix5x4 matrix;
+  matrix._12 = 0.5f; matrix._21 = 0.5f; matrix._22 = 0.5f;
+  RefPtr<FilterNode> colorMatrix = FilterNodeSoftware::Create(FilterType::COLOR_MATRIX);
+  colorMatrix->SetInput(IN_COLOR_MATRIX_IN, flood);
+  colorMatrix->SetAttribute(ATT_COLOR_MATRIX_MATRIX, matrix);
+  colorMatrix->SetAttribute(ATT_COLOR_MATRIX_ALPHA_MODE, (uint32_t)ALPHA_MODE_STRAIGHT);
+  Observe(colorMatrix, aObservers);
+
+  RefPtr<FilterNode> gammaTransfer = FilterNodeSoftware::Create(FilterType::GAMMA_TRANSFER);
+  gammaTransfer->SetInput(IN_GAMMA_TRANSFER_IN, colorMatrix);
+  gammaTransfer->SetAttribute(ATT_GAMMA_TRANSFER_DISABLE_R, false);
+  gammaTransfer->SetAttribute(ATT_GAMMA_TRANSFER_AMPLITUDE_R, 1.0f);
+  gammaTransfer->SetAttribute(ATT_GAMMA_TRANSFER_EXPONENT_R, 0.5f);
+
+  return gammaTransfer.forget();
+}
+
+// Assembles the tiles produced by RenderTiles into a single surface.
+static TemporaryRef<DataSourceSurface>
+RenderInTiles(FilterNode* aFilter, const IntRect& aRect, int32_t aTileSize,
+              WorkerPool* aPool)
+{
+  RefPtr<DataSourceSurface> result =
+    Factory::CreateDataSourceSurface(aRect.Size(), SurfaceFormat::B8G8R8A8, true);
+  if (!result) {
+    return nullptr;
+  }
+
+  bool ok = true;
+  static_cast<FilterNodeSoftware*>(aFilter)->RenderTiles(aRect, aTileSize, aPool,
+    [&] (const IntRect& aTileRect, DataSourceSurface* aTile) {
+    if (aTile->GetFormat() != SurfaceFormat::B8G8R8A8 ||
+        aTile->GetSize() != aTileRect.Size() || !aRect.Contains(aTileRect)) {
+      ok = false;
+      return;
+    }
+    IntPoint offset = aTileRect.TopLeft() - aRect.TopLeft();
+    for (int32_t y = 0; y < aTileRect.height; y++) {
+      memcpy(result->GetData() + (offset.y + y) * result->Stride() + offset.x * 4,
+             aTile->GetData() + y * aTile->Stride(), aTileRect.width * 4);
+    }
+  });
+  return ok ? result.forget() : nullptr;
+}
+
+// Compares the pixels of two surfaces, ignoring the padding after each row.
+static bool
+SurfacesEqual(DataSourceSurface* aA, DataSourceSurface* aB)
+{
+  if (!aA || !aB || aA->GetSize() != aB->GetSize()) {
+    return false;
+  }
+  IntSize size = aA->GetSize();
+  for (int32_t y = 0; y < size.height; y++) {
+    if (memcmp(aA->GetData() + y * aA->Stride(),
+               aB->GetData() + y * aB->Stride(), size.width * 4)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void
+TestFilterNodeSoftware::TiledOutputMatchesUntiled()
+{
+  RefPtr<DataSourceSurface> input = CreateNoiseSurface(IntSize(90, 70));
+  RefPtr<FilterNode> filter = CreateFilterGraph(input);
+  IntRect rect(-6, -4, 101, 79);
+
+  RefPtr<DataSourceSurface> whole = RenderInTiles(filter, rect, 1024, nullptr);
+  VERIFY(whole);
+
+  // Tile sizes that don't divide the rect, down to tiles smaller than the
+  // blur margin.
+  int32_t tileSizes[] = { 64, 17, 5 };
+  for (size_t i = 0; i < ArrayLength(tileSizes); i++) {
+    RefPtr<DataSourceSurface> tiled = RenderInTiles(filter, rect, tileSizes[i], nullptr);
+    VERIFY(SurfacesEqual(whole, tiled));
+  }
+}
+
+void
+TestFilterNodeSoftware::ParallelTilesMatchSerial()
+{
+  RefPtr<DataSourceSurface> input = CreateNoiseSurface(IntSize(90, 70));
+  RefPtr<FilterNode> filter = CreateFilterGraph(input);
+  IntRect rect(0, 0, 90, 70);
+
+  WorkerPool pool(3);
+  RefPtr<DataSourceSurface> serial = RenderInTiles(filter, rect, 16, nullptr);
+  RefPtr<DataSourceSurface> parallel = RenderInTiles(filter, rect, 16, &pool);
+  VERIFY(serial);
+  VERIFY(SurfacesEqual(serial, parallel));
+}
+
+void
+TestFilterNodeSoftware::PointwiseChainMatchesSeparatePasses()
+{
+  RefPtr<DataSourceSurface> input = CreateNoiseSurface(IntSize(90, 70));
+  RefPtr<DataSourceSurface> input2 = CreateNoiseSurface(IntSize(70, 90));
+  IntRect rect(-6, -4, 101, 79);
+
+  std::vector<RefPtr<FilterNode> > observers;
+  RefPtr<FilterNode> separate = CreatePointwiseChain(input, input2, &observers);
+  RefPtr<FilterNode> fused = CreatePointwiseChain(input, input2, nullptr);
+  RefPtr<DataSourceSurface> expected = RenderInTiles(separate, rect, 1024, nullptr);
+  RefPtr<DataSourceSurface> result = RenderInTiles(fused, rect, 1024, nullptr);
+  VERIFY(expected);
+  VERIFY(SurfacesEqual(expected, result));
+
+  separate = CreateFloodChain(&observers);
+  fused = CreateFloodChain(nullptr);
+  expected = RenderInTiles(separate, rect, 1024, nullptr);
+  result = RenderInTiles(fused, rect, 1024, nullptr);
+  VERIFY(expected);
+  VERIFY(SurfacesEqual(expected, result));
+}
+
+void
+TestFilterNodeSoftware::SharedCacheReusesOutput()
+{
+  RefPtr<DataSourceSurface> input = CreateNoiseSurface(IntSize(90, 70));
+  IntRect rect(-6, -4, 101, 79);
+
+  Factory::SetSoftwareFilterCacheSize(16 * 1024 * 1024);
+
+  RefPtr<FilterNode> filter = CreateFilterGraph(input);
+  RefPtr<DataSourceSurface> expected = RenderInTiles(filter, rect, 1024, nullptr);
+  CacheStats stats = Factory::GetSoftwareFilterCacheStats();
+  VERIFY(expected);
+  VERIFY(stats.mHits == 0 && stats.mMisses > 0 && stats.mEntries > 0);
+
+  // An identical graph finds the output of the first one.
+  RefPtr<FilterNode> copy = CreateFilterGraph(input);
+  RefPtr<DataSourceSurface> result = RenderInTiles(copy, rect, 1024, nullptr);
+  VERIFY(SurfacesEqual(expected, result));
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mHits == 1);
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mMisses == stats.mMisses);
+
+  // Changing an attribute only recomputes the filter it was set on, changing
+  // it back finds the earlier output again.
+  Float coefficients[] = { 0, 0.5f, 0.5f, 0 };
+  Float otherCoefficients[] = { 0, 0.25f, 0.75f, 0 };
+  stats = Factory::GetSoftwareFilterCacheStats();
+  copy->SetAttribute(ATT_ARITHMETIC_COMBINE_COEFFICIENTS, otherCoefficients, 4);
+  result = RenderInTiles(copy, rect, 1024, nullptr);
+  VERIFY(result && !SurfacesEqual(expected, result));
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mMisses == stats.mMisses + 1);
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mHits > stats.mHits);
+
+  stats = Factory::GetSoftwareFilterCacheStats();
+  copy->SetAttribute(ATT_ARITHMETIC_COMBINE_COEFFICIENTS, coefficients, 4);
+  result = RenderInTiles(copy, rect, 1024, nullptr);
+  VERIFY(SurfacesEqual(expected, result));
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mHits == stats.mHits + 1);
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mMisses == stats.mMisses);
+
+  // Inputs are identified by surface, not by content, so an equal copy of the
+  // input surface leads to the output being computed again.
+  stats = Factory::GetSoftwareFilterCacheStats();
+  RefPtr<DataSourceSurface> otherInput = CreateNoiseSurface(IntSize(90, 70));
+  copy = CreateFilterGraph(otherInput);
+  result = RenderInTiles(copy, rect, 1024, nullptr);
+  VERIFY(SurfacesEqual(expected, result));
+  VERIFY(Factory::GetSoftwareFilterCacheStats().mHits == stats.mHits);
+
+  // A budget below the size of the output evicts everything else.
+  size_t outputBytes = size_t(expected->Stride()) * rect.height;
+  Factory::SetSoftwareFilterCacheSize(outputBytes);
+  RenderInTiles(filter, rect, 1024, nullptr);
+  stats = Factory::GetSoftwareFilterCacheStats();
+  VERIFY(stats.mEvictions > 0 && stats.mEntries == 1 && stats.mBytes <= outputBytes);
+
+  Factory::SetSoftwareFilterCacheSize(0);
+}
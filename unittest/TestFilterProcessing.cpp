@@ -0,0 +1,472 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestFilterProcessing.h"
+
+#include "FilterProcessing.h"
+#include "mozilla/Util.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+TestFilterProcessing::TestFilterProcessing()
+{
+#define TEST_CLASS TestFilterProcessing
+  REGISTER_TEST(BlendingAVX2MatchesSSE2);
+  REGISTER_TEST(ColorMatrixAVX2MatchesSSE2);
+  REGISTER_TEST(CompositionAVX2MatchesSSE2);
+  REGISTER_TEST(PremultiplicationAVX2MatchesSSE2);
+  REGISTER_TEST(ArithmeticCombineAVX2MatchesSSE2);
+  REGISTER_TEST(MorphologyMatchesReference);
+  REGISTER_TEST(ConvolveMatrixMatchesReference);
+#undef TEST_CLASS
+}
+
+// Exposes the backend specific implementations so they can be compared.
+class FilterProcessingBackends : public FilterProcessing
+{
+public:
+  using FilterProcessing::ApplyMorphologyHorizontal_Scalar;
+  using FilterProcessing::ApplyMorphologyVertical_Scalar;
+  using FilterProcessing::ApplyConvolveMatrix_Scalar;
+#ifdef USE_AVX2
+  using FilterProcessing::ApplyBlending_SSE2;
+  using FilterProcessing::ApplyBlending_AVX2;
+  using FilterProcessing::ApplyColorMatrix_SSE2;
+  using FilterProcessing::ApplyColorMatrix_AVX2;
+  using FilterProcessing::ApplyComposition_SSE2;
+  using FilterProcessing::ApplyComposition_AVX2;
+  using FilterProcessing::DoPremultiplicationCalculation_SSE2;
+  using FilterProcessing::DoPremultiplicationCalculation_AVX2;
+  using FilterProcessing::DoUnpremultiplicationCalculation_SSE2;
+  using FilterProcessing::DoUnpremultiplicationCalculation_AVX2;
+  using FilterProcessing::ApplyArithmeticCombine_SSE2;
+  using FilterProcessing::ApplyArithmeticCombine_AVX2;
+#endif
+};
+
+// Widths around multiples of the vector sizes, so that every kind of row
+// tail gets exercised.
+static const int32_t sWidths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 12, 13, 16, 17, 61 };
+static const int32_t sHeight = 3;
+
+// Fills a surface with premultiplied pseudo random pixels, including the
+// fully transparent and fully opaque extremes.
+static TemporaryRef<DataSourceSurface>
+CreateNoiseSurface(const IntSize& aSize, uint32_t aSeed)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8);
+  if (!surface) {
+    return nullptr;
+  }
+
+  uint32_t state = aSeed;
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint8_t* row = surface->GetData() + y * surface->Stride();
+    for (int32_t x = 0; x < aSize.width; x++) {
+      state = state * 1103515245 + 12345;
+      uint8_t alpha = (state >> 24) % 3 ? uint8_t(state >> 16) : ((state >> 24) & 4 ? 255 : 0);
+      for (int32_t i = 0; i < 3; i++) {
+        state = state * 1103515245 + 12345;
+        row[4 * x + i] = uint8_t((state >> 16) % (alpha + 1));
+      }
+      row[4 * x + 3] = alpha;
+    }
+  }
+  return surface.forget();
+}
+
+#ifdef USE_AVX2
+
+static TemporaryRef<DataSourceSurface>
+CopySurface(DataSourceSurface* aSource)
+{
+  IntSize size = aSource->GetSize();
+  RefPtr<DataSourceSurface> copy =
+    Factory::CreateDataSourceSurface(size, SurfaceFormat::B8G8R8A8);
+  if (!copy) {
+    return nullptr;
+  }
+  for (int32_t y = 0; y < size.height; y++) {
+    memcpy(copy->GetData() + y * copy->Stride(),
+           aSource->GetData() + y * aSource->Stride(), size.width * 4);
+  }
+  return copy.forget();
+}
+
+// Compares the pixels of two surfaces, ignoring the padding after each row.
+static bool
+SurfacesEqual(DataSourceSurface* aA, DataSourceSurface* aB)
+{
+  if (!aA || !aB || aA->GetSize() != aB->GetSize()) {
+    return false;
+  }
+  IntSize size = aA->GetSize();
+  for (int32_t y = 0; y < size.height; y++) {
+    if (memcmp(aA->GetData() + y * aA->Stride(),
+               aB->GetData() + y * aB->Stride(), size.width * 4)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
+
+void
+TestFilterProcessing::BlendingAVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  BlendMode modes[] = { BLEND_MODE_MULTIPLY, BLEND_MODE_SCREEN,
+                        BLEND_MODE_DARKEN, BLEND_MODE_LIGHTEN };
+  for (size_t i = 0; i < ArrayLength(sWidths); i++) {
+    IntSize size(sWidths[i], sHeight);
+    RefPtr<DataSourceSurface> input1 = CreateNoiseSurface(size, 1);
+    RefPtr<DataSourceSurface> input2 = CreateNoiseSurface(size, 2);
+    for (size_t m = 0; m < ArrayLength(modes); m++) {
+      RefPtr<DataSourceSurface> sse2 =
+        FilterProcessingBackends::ApplyBlending_SSE2(input1, input2, modes[m]);
+      RefPtr<DataSourceSurface> avx2 =
+        FilterProcessingBackends::ApplyBlending_AVX2(input1, input2, modes[m]);
+      VERIFY(SurfacesEqual(sse2, avx2));
+    }
+  }
+#endif
+}
+
+void
+TestFilterProcessing::ColorMatrixAVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  // Sepia with some alpha mixing and an offset.
+  Matrix5x4 matrix;
+  matrix._11 = 0.393f; matrix._12 = 0.349f; matrix._13 = 0.272f; matrix._14 = 0.1f;
+  matrix._21 = 0.769f; matrix._22 = 0.686f; matrix._23 = 0.534f; matrix._24 = 0;
+  matrix._31 = 0.189f; matrix._32 = 0.168f; matrix._33 = 0.131f; matrix._34 = 0;
+  matrix._41 = 0;      matrix._42 = -0.5f;  matrix._43 = 0;      matrix._44 = 0.9f;
+  matrix._51 = 0.05f;  matrix._52 = 0;      matrix._53 = -0.1f;  matrix._54 = 0;
+
+  for (size_t i = 0; i < ArrayLength(sWidths); i++) {
+    RefPtr<DataSourceSurface> input = CreateNoiseSurface(IntSize(sWidths[i], sHeight), 3);
+    RefPtr<DataSourceSurface> sse2 =
+      FilterProcessingBackends::ApplyColorMatrix_SSE2(input, matrix);
+    RefPtr<DataSourceSurface> avx2 =
+      FilterProcessingBackends::ApplyColorMatrix_AVX2(input, matrix);
+    VERIFY(SurfacesEqual(sse2, avx2));
+  }
+#endif
+}
+
+void
+TestFilterProcessing::CompositionAVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  CompositeOperator operators[] = { COMPOSITE_OPERATOR_OVER, COMPOSITE_OPERATOR_IN,
+                                    COMPOSITE_OPERATOR_OUT, COMPOSITE_OPERATOR_ATOP,
+                                    COMPOSITE_OPERATOR_XOR };
+  for (size_t i = 0; i < ArrayLength(sWidths); i++) {
+    IntSize size(sWidths[i], sHeight);
+    RefPtr<DataSourceSurface> source = CreateNoiseSurface(size, 4);
+    RefPtr<DataSourceSurface> dest = CreateNoiseSurface(size, 5);
+    for (size_t o = 0; o < ArrayLength(operators); o++) {
+      RefPtr<DataSourceSurface> sse2 = CopySurface(dest);
+      RefPtr<DataSourceSurface> avx2 = CopySurface(dest);
+      FilterProcessingBackends::ApplyComposition_SSE2(source, sse2, operators[o]);
+      FilterProcessingBackends::ApplyComposition_AVX2(source, avx2, operators[o]);
+      VERIFY(SurfacesEqual(sse2, avx2));
+    }
+  }
+#endif
+}
+
+void
+TestFilterProcessing::PremultiplicationAVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  for (size_t i = 0; i < ArrayLength(sWidths); i++) {
+    IntSize size(sWidths[i], sHeight);
+    RefPtr<DataSourceSurface> input = CreateNoiseSurface(size, 6);
+    RefPtr<DataSourceSurface> sse2 = CopySurface(input);
+    RefPtr<DataSourceSurface> avx2 = CopySurface(input);
+
+    FilterProcessingBackends::DoUnpremultiplicationCalculation_SSE2(
+      size, sse2->GetData(), sse2->Stride(), input->GetData(), input->Stride());
+    FilterProcessingBackends::DoUnpremultiplicationCalculation_AVX2(
+      size, avx2->GetData(), avx2->Stride(), input->GetData(), input->Stride());
+    VERIFY(SurfacesEqual(sse2, avx2));
+
+    // Premultiply the unpremultiplied result again, in place.
+    FilterProcessingBackends::DoPremultiplicationCalculation_SSE2(
+      size, sse2->GetData(), sse2->Stride(), sse2->GetData(), sse2->Stride());
+    FilterProcessingBackends::DoPremultiplicationCalculation_AVX2(
+      size, avx2->GetData(), avx2->Stride(), avx2->GetData(), avx2->Stride());
+    VERIFY(SurfacesEqual(sse2, avx2));
+  }
+#endif
+}
+
+void
+TestFilterProcessing::ArithmeticCombineAVX2MatchesSSE2()
+{
+#ifdef USE_AVX2
+  if (!Factory::HasAVX2()) {
+    return;
+  }
+
+  for (size_t i = 0; i < ArrayLength(sWidths); i++) {
+    IntSize size(sWidths[i], sHeight);
+    RefPtr<DataSourceSurface> input1 = CreateNoiseSurface(size, 7);
+    RefPtr<DataSourceSurface> input2 = CreateNoiseSurface(size, 8);
+    RefPtr<DataSourceSurface> sse2 =
+      FilterProcessingBackends::ApplyArithmeticCombine_SSE2(input1, input2, 0.5f, 0.25f, 0.75f, -0.1f);
+    RefPtr<DataSourceSurface> avx2 =
+      FilterProcessingBackends::ApplyArithmeticCombine_AVX2(input1, input2, 0.5f, 0.25f, 0.75f, -0.1f);
+    VERIFY(SurfacesEqual(sse2, avx2));
+  }
+#endif
+}
+
+typedef void (*MorphologyFunction)(uint8_t* aSourceData, int32_t aSourceStride,
+                                   uint8_t* aDestData, int32_t aDestStride,
+                                   const IntRect& aDestRect, int32_t aRadius,
+                                   MorphologyOperator aOperator);
+
+// Applies aFunction to the middle aDestSize pixels of aInput, which has a
+// margin of aRadius pixels on the sides it works along, and compares the
+// result with the minimum or maximum of every window worked out one pixel at
+// a time.
+static bool
+MorphologyMatches(MorphologyFunction aFunction, bool aHorizontal,
+                  DataSourceSurface* aInput, const IntSize& aDestSize,
+                  int32_t aRadius, MorphologyOperator aOp)
+{
+  RefPtr<DataSourceSurface> dest =
+    Factory::CreateDataSourceSurface(aDestSize, SurfaceFormat::B8G8R8A8);
+  if (!dest) {
+    return false;
+  }
+
+  int32_t stride = aInput->Stride();
+  int32_t step = aHorizontal ? 4 : stride;
+  uint8_t* source = aInput->GetData() + aRadius * step;
+  aFunction(source, stride, dest->GetData(), dest->Stride(),
+            IntRect(IntPoint(), aDestSize), aRadius, aOp);
+
+  for (int32_t y = 0; y < aDestSize.height; y++) {
+    for (int32_t x = 0; x < aDestSize.width; x++) {
+      for (int32_t c = 0; c < 4; c++) {
+        const uint8_t* window = source + y * stride + 4 * x + c;
+        uint8_t expected = window[-aRadius * step];
+        for (int32_t i = -aRadius + 1; i <= aRadius; i++) {
+          expected = aOp == MORPHOLOGY_OPERATOR_ERODE ?
+            std::min(expected, window[i * step]) : std::max(expected, window[i * step]);
+        }
+        if (dest->GetData()[y * dest->Stride() + 4 * x + c] != expected) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void
+TestFilterProcessing::MorphologyMatchesReference()
+{
+  // Around both sides of kMinRunningMorphologyRadiusX and
+  // kMinRunningMorphologyRadiusY.
+  int32_t radii[] = { 1, 2, 3, 5, 6, 7, 12, 40 };
+  int32_t heights[] = { 1, 3, 4, 6 };
+  MorphologyOperator operators[] = { MORPHOLOGY_OPERATOR_ERODE, MORPHOLOGY_OPERATOR_DILATE };
+  MorphologyFunction horizontal[] = { FilterProcessing::ApplyMorphologyHorizontal,
+                                      FilterProcessingBackends::ApplyMorphologyHorizontal_Scalar };
+  MorphologyFunction vertical[] = { FilterProcessing::ApplyMorphologyVertical,
+                                    FilterProcessingBackends::ApplyMorphologyVertical_Scalar };
+
+  for (size_t w = 0; w < ArrayLength(sWidths); w++) {
+    for (size_t h = 0; h < ArrayLength(heights); h++) {
+      IntSize size(sWidths[w], heights[h]);
+      for (size_t r = 0; r < ArrayLength(radii); r++) {
+        int32_t radius = radii[r];
+        RefPtr<DataSourceSurface> wide =
+          CreateNoiseSurface(IntSize(size.width + 2 * radius, size.height), 9);
+        RefPtr<DataSourceSurface> tall =
+          CreateNoiseSurface(IntSize(size.width, size.height + 2 * radius), 10);
+        VERIFY(wide && tall);
+        if (!wide || !tall) {
+          return;
+        }
+        for (size_t o = 0; o < ArrayLength(operators); o++) {
+          for (size_t f = 0; f < ArrayLength(horizontal); f++) {
+            VERIFY(MorphologyMatches(horizontal[f], true, wide, size,
+                                     radius, operators[o]));
+            VERIFY(MorphologyMatches(vertical[f], false, tall, size,
+                                     radius, operators[o]));
+          }
+        }
+      }
+    }
+  }
+}
+
+typedef bool (*ConvolveMatrixFunction)(const uint8_t* aSourceData, int32_t aSourceStride,
+                                       uint8_t* aTargetData, int32_t aTargetStride,
+                                       const IntSize& aSize, const Float* aKernel,
+                                       const IntSize& aKernelSize,
+                                       const IntSize& aKernelUnitLength, Float aBias);
+
+// Convolves aInput, which has room for the kernel around aTargetSize pixels,
+// with aFunction and compares the result with the sum of every kernel window
+// worked out in floating point. The weights are rounded to fixed point, so
+// the results may be one off.
+static bool
+ConvolveMatrixMatches(ConvolveMatrixFunction aFunction, DataSourceSurface* aInput,
+                      const IntSize& aTargetSize, const Float* aKernel,
+                      const IntSize& aKernelSize, const IntSize& aUnit, Float aBias)
+{
+  RefPtr<DataSourceSurface> target =
+    Factory::CreateDataSourceSurface(aTargetSize, SurfaceFormat::B8G8R8A8);
+  if (!target ||
+      !aFunction(aInput->GetData(), aInput->Stride(), target->GetData(), target->Stride(),
+                 aTargetSize, aKernel, aKernelSize, aUnit, aBias)) {
+    return false;
+  }
+
+  for (int32_t y = 0; y < aTargetSize.height; y++) {
+    for (int32_t x = 0; x < aTargetSize.width; x++) {
+      for (int32_t c = 0; c < 4; c++) {
+        Float sum = aBias * 255;
+        for (int32_t ky = 0; ky < aKernelSize.height; ky++) {
+          for (int32_t kx = 0; kx < aKernelSize.width; kx++) {
+            sum += aKernel[ky * aKernelSize.width + kx] *
+              aInput->GetData()[(y + ky * aUnit.height) * aInput->Stride() +
+                                4 * (x + kx * aUnit.width) + c];
+          }
+        }
+        int32_t expected = std::min(std::max(int32_t(floorf(sum + 0.5f)), 0), 255);
+        int32_t actual = target->GetData()[y * target->Stride() + 4 * x + c];
+        if (abs(actual - expected) > 1) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void
+TestFilterProcessing::ConvolveMatrixMatchesReference()
+{
+  // Separable kernels first, then ones that have to be applied in one pass.
+  const Float blur[] = { 1.f/256, 4.f/256, 6.f/256, 4.f/256, 1.f/256,
+                         4.f/256, 16.f/256, 24.f/256, 16.f/256, 4.f/256,
+                         6.f/256, 24.f/256, 36.f/256, 24.f/256, 6.f/256,
+                         4.f/256, 16.f/256, 24.f/256, 16.f/256, 4.f/256,
+                         1.f/256, 4.f/256, 6.f/256, 4.f/256, 1.f/256 };
+  const Float sobel[] = { -1, 0, 1, -2, 0, 2, -1, 0, 1 };
+  const Float row[] = { 0.25f, 0.5f, 0.25f };
+  const Float sharpen[] = { 0, -1, 0, -1, 5, -1, 0, -1, 0 };
+  const Float emboss[] = { -2, -1, 0, -1, 1, 1, 0, 1, 2 };
+  const Float laplacian[] = { 1.f/4, 1.f/2, 1.f/4, 1.f/2, -3, 1.f/2, 1.f/4, 1.f/2, 1.f/4 };
+  struct {
+    const Float* mKernel;
+    IntSize mSize;
+    Float mBias;
+  } kernels[] = {
+    { blur, IntSize(5, 5), 0 },
+    { sobel, IntSize(3, 3), 0.5f },
+    { row, IntSize(3, 1), 0 },
+    { row, IntSize(1, 3), 0.1f },
+    { sharpen, IntSize(3, 3), 0 },
+    { emboss, IntSize(3, 3), -0.25f },
+    { laplacian, IntSize(3, 3), 0.5f },
+  };
+  ConvolveMatrixFunction functions[] = { FilterProcessing::ApplyConvolveMatrix,
+                                         FilterProcessingBackends::ApplyConvolveMatrix_Scalar };
+
+  for (size_t w = 0; w < ArrayLength(sWidths); w++) {
+    for (size_t k = 0; k < ArrayLength(kernels); k++) {
+      for (int32_t unit = 1; unit <= 2; unit++) {
+        IntSize size(sWidths[w], sHeight + 2);
+        IntSize kernelSize = kernels[k].mSize;
+        RefPtr<DataSourceSurface> input =
+          CreateNoiseSurface(IntSize(size.width + (kernelSize.width - 1) * unit,
+                                     size.height + (kernelSize.height - 1) * unit), 11);
+        VERIFY(input);
+        if (!input) {
+          return;
+        }
+        for (size_t f = 0; f < ArrayLength(functions); f++) {
+          VERIFY(ConvolveMatrixMatches(functions[f], input, size, kernels[k].mKernel,
+                                       kernelSize, IntSize(unit, unit), kernels[k].mBias));
+        }
+      }
+    }
+  }
+
+  // Weights that don't fit in 16 bits are left to the caller.
+  const Float huge[] = { 0, 40000, 0 };
+  uint8_t pixels[16 * 3] = { 0 };
+  VERIFY(!FilterProcessing::ApplyConvolveMatrix(pixels, 16 * 3, pixels, 16 * 3, IntSize(1, 1),
+                                                huge, IntSize(3, 1), IntSize(1, 1), 0));
+
+  // Small weights next to large ones. The large ones cancel out on an input
+  // whose rows are uniform, so the small ones decide the result. Those of
+  // the first kernel are exact in fixed point, but at the precision the
+  // large weights leave, those of the second would all round to zero. They
+  // have to be left to the caller rather than be applied inaccurately.
+  const Float mixedExact[] = { 200, -200, 0.25f, 0, 0.125f, 0, 0.5f, 0, 0.0625f };
+  const Float mixedInexact[] = { 200, -200, 0.003f, 0.003f, 0.003f, 0.003f, 0.003f, 0.003f, 0.5f };
+  IntSize mixedSize(17, sHeight);
+  RefPtr<DataSourceSurface> uniformRows =
+    Factory::CreateDataSourceSurface(IntSize(mixedSize.width + 2, mixedSize.height + 2),
+                                     SurfaceFormat::B8G8R8A8);
+  VERIFY(uniformRows);
+  if (!uniformRows) {
+    return;
+  }
+  for (int32_t y = 0; y < mixedSize.height + 2; y++) {
+    uint8_t* rowData = uniformRows->GetData() + y * uniformRows->Stride();
+    for (int32_t x = 0; x < mixedSize.width + 2; x++) {
+      memset(rowData + 4 * x, 255 - 10 * y, 4);
+    }
+  }
+  for (size_t f = 0; f < ArrayLength(functions); f++) {
+    VERIFY(ConvolveMatrixMatches(functions[f], uniformRows, mixedSize, mixedExact,
+                                 IntSize(3, 3), IntSize(1, 1), 0));
+    RefPtr<DataSourceSurface> target =
+      Factory::CreateDataSourceSurface(mixedSize, SurfaceFormat::B8G8R8A8);
+    VERIFY(target);
+    if (target &&
+        functions[f](uniformRows->GetData(), uniformRows->Stride(),
+                     target->GetData(), target->Stride(), mixedSize,
+                     mixedInexact, IntSize(3, 3), IntSize(1, 1), 0)) {
+      VERIFY(ConvolveMatrixMatches(functions[f], uniformRows, mixedSize, mixedInexact,
+                                   IntSize(3, 3), IntSize(1, 1), 0));
+    }
+  }
+}
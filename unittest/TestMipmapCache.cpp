@@ -0,0 +1,286 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestMipmapCache.h"
+
+#include "ImageScaling.h"
+#include "MipmapCache.h"
+
+#include <string.h>
+#include <thread>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+TestMipmapCache::TestMipmapCache()
+{
+#define TEST_CLASS TestMipmapCache
+  REGISTER_TEST(LevelMatchesHalfScaler);
+  REGISTER_TEST(OnlyMinifiedSurfacesUseLevels);
+  REGISTER_TEST(LevelsAreReused);
+  REGISTER_TEST(EvictsLeastRecentlyDrawn);
+  REGISTER_TEST(ReleaseOnOtherThread);
+  REGISTER_TEST(InvalidateDropsLevels);
+  REGISTER_TEST(RepeatingPatternsNeedExactLevels);
+  REGISTER_TEST(DrawSurfaceSourceRect);
+#undef TEST_CLASS
+}
+
+// A B8G8R8A8 surface with a different color in every pixel.
+static TemporaryRef<DataSourceSurface>
+CreatePattern(const IntSize& aSize)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8);
+  if (!surface) {
+    return nullptr;
+  }
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint32_t* row = (uint32_t*)(surface->GetData() + y * surface->Stride());
+    for (int32_t x = 0; x < aSize.width; x++) {
+      row[x] = 0xff000000 | ((x * 7 & 0xff) << 16) | ((y * 3 & 0xff) << 8) | ((x ^ y) & 0xff);
+    }
+  }
+  return surface.forget();
+}
+
+// Whether aSurface drawn with aTransform is drawn from a level.
+static bool
+HasLevel(SourceSurface* aSurface, const Matrix& aTransform, bool aExactSize, int32_t* aScale)
+{
+  RefPtr<DataSourceSurface> level =
+    MipmapCache::GetLevel(aSurface, aTransform, aExactSize, aScale);
+  return level;
+}
+
+void
+TestMipmapCache::LevelMatchesHalfScaler()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(257, 130));
+  VERIFY(surface);
+  int32_t scale = 0;
+  RefPtr<DataSourceSurface> level =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.2f, 0.25f), false, &scale);
+  VERIFY(level && scale == 4);
+  if (level) {
+    VERIFY(level->GetSize() == IntSize(64, 32));
+    VERIFY(level->GetFormat() == SurfaceFormat::B8G8R8A8);
+
+    ImageHalfScaler scaler(surface->GetData(), surface->Stride(), surface->GetSize());
+    scaler.ScaleForSize(IntSize(63, 31));
+    VERIFY(scaler.GetSize() == IntSize(64, 32));
+    for (int32_t y = 0; y < 32; y++) {
+      VERIFY(!memcmp(level->GetData() + y * level->Stride(),
+                     scaler.GetScaledData() + y * scaler.GetStride(), 64 * 4));
+    }
+  }
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::OnlyMinifiedSurfacesUseLevels()
+{
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(128, 128));
+  VERIFY(surface);
+  int32_t scale;
+
+  // Disabled by default.
+  VERIFY(!HasLevel(surface, Matrix::Scaling(0.25f, 0.25f), false, &scale));
+
+  Factory::SetMipmapCacheSize(1024 * 1024);
+  VERIFY(!HasLevel(surface, Matrix::Scaling(0.6f, 0.6f), false, &scale));
+  VERIFY(!HasLevel(surface, Matrix::Scaling(0.25f, 1.0f), false, &scale));
+  VERIFY(!HasLevel(surface, Matrix::Scaling(2.0f, 2.0f), false, &scale));
+  VERIFY(HasLevel(surface, Matrix::Scaling(0.5f, 0.5f), false, &scale));
+  VERIFY(scale == 2);
+
+  // A rotation doesn't change how much the surface is minified.
+  Matrix rotated = Matrix::Scaling(0.25f, 0.25f) * Matrix::Rotation(0.5f);
+  VERIFY(HasLevel(surface, rotated, false, &scale));
+  VERIFY(scale == 4);
+
+  SurfacePattern pattern(surface, ExtendMode::CLAMP, Matrix::Scaling(0.25f, 0.25f));
+  MipmappedPattern mipmapped(pattern, Matrix::Translation(10, 10));
+  const SurfacePattern& level = static_cast<const SurfacePattern&>(mipmapped.Get());
+  VERIFY(&level != &pattern);
+  VERIFY(level.mSurface && level.mSurface->GetSize() == IntSize(32, 32));
+  VERIFY(level.mMatrix == Matrix());
+
+  SurfacePattern point(surface, ExtendMode::CLAMP, Matrix::Scaling(0.25f, 0.25f), Filter::POINT);
+  VERIFY(&MipmappedPattern(point, Matrix()).Get() == &point);
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::LevelsAreReused()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(128, 128));
+  VERIFY(surface);
+  int32_t scale;
+  RefPtr<DataSourceSurface> first =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.3f, 0.3f), false, &scale);
+  RefPtr<DataSourceSurface> second =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.4f, 0.4f), false, &scale);
+  VERIFY(first && first == second);
+
+  // Deeper levels are built from the ones that are already there.
+  RefPtr<DataSourceSurface> deeper =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.1f, 0.1f), false, &scale);
+  VERIFY(deeper && scale == 8 && deeper->GetSize() == IntSize(16, 16));
+  second = MipmapCache::GetLevel(surface, Matrix::Scaling(0.3f, 0.3f), false, &scale);
+  VERIFY(second == first);
+
+  CacheStats stats = Factory::GetMipmapCacheStats();
+  VERIFY(stats.mHits == 2);
+  VERIFY(stats.mMisses == 2);
+  VERIFY(stats.mEntries == 1);
+  VERIFY(stats.mBytes == size_t(64 * 64 * 4 + 32 * 32 * 4 + 16 * 16 * 4));
+
+  // The levels go away with the surface.
+  surface = nullptr;
+  first = second = deeper = nullptr;
+  VERIFY(Factory::GetMipmapCacheStats().mEntries == 0);
+  VERIFY(Factory::GetMipmapCacheStats().mBytes == 0);
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::EvictsLeastRecentlyDrawn()
+{
+  // Room for level 1 of two 64x64 surfaces.
+  Factory::SetMipmapCacheSize(2 * 32 * 32 * 4);
+
+  RefPtr<DataSourceSurface> surfaces[3];
+  for (int i = 0; i < 3; i++) {
+    surfaces[i] = CreatePattern(IntSize(64, 64));
+    VERIFY(surfaces[i]);
+  }
+  int32_t scale;
+  Matrix half = Matrix::Scaling(0.5f, 0.5f);
+  MipmapCache::GetLevel(surfaces[0], half, false, &scale);
+  MipmapCache::GetLevel(surfaces[1], half, false, &scale);
+  MipmapCache::GetLevel(surfaces[0], half, false, &scale);
+  MipmapCache::GetLevel(surfaces[2], half, false, &scale);
+
+  CacheStats stats = Factory::GetMipmapCacheStats();
+  VERIFY(stats.mEvictions == 1);
+  VERIFY(stats.mEntries == 2);
+
+  // surfaces[1] was drawn least recently, so it lost its level.
+  MipmapCache::GetLevel(surfaces[0], half, false, &scale);
+  MipmapCache::GetLevel(surfaces[2], half, false, &scale);
+  VERIFY(Factory::GetMipmapCacheStats().mHits == 3);
+  MipmapCache::GetLevel(surfaces[1], half, false, &scale);
+  VERIFY(Factory::GetMipmapCacheStats().mMisses == 4);
+
+  // Levels that don't fit at all are returned without being kept.
+  Factory::SetMipmapCacheSize(16);
+  VERIFY(HasLevel(surfaces[0], half, false, &scale));
+  VERIFY(Factory::GetMipmapCacheStats().mEntries == 0);
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::ReleaseOnOtherThread()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(64, 64));
+  VERIFY(surface);
+  int32_t scale;
+  VERIFY(HasLevel(surface, Matrix::Scaling(0.5f, 0.5f), false, &scale));
+  VERIFY(Factory::GetMipmapCacheStats().mEntries == 1);
+
+  // The last reference goes away on a worker, as it can after a tiled or
+  // captured draw. The levels are dropped back on this thread.
+  std::thread worker([&surface]() { surface = nullptr; });
+  worker.join();
+  VERIFY(Factory::GetMipmapCacheStats().mEntries == 0);
+  VERIFY(Factory::GetMipmapCacheStats().mBytes == 0);
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::InvalidateDropsLevels()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(64, 64));
+  VERIFY(surface);
+  int32_t scale;
+  RefPtr<DataSourceSurface> first =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.5f, 0.5f), false, &scale);
+  VERIFY(first);
+
+  memset(surface->GetData(), 0, surface->Stride() * 64);
+  Factory::InvalidateMipmaps(surface);
+  VERIFY(Factory::GetMipmapCacheStats().mEntries == 0);
+
+  RefPtr<DataSourceSurface> second =
+    MipmapCache::GetLevel(surface, Matrix::Scaling(0.5f, 0.5f), false, &scale);
+  VERIFY(second && second != first);
+  VERIFY(second && ((uint32_t*)second->GetData())[0] == 0);
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::RepeatingPatternsNeedExactLevels()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  // 100 can be halved twice without dropping a column.
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(100, 100));
+  VERIFY(surface);
+  int32_t scale;
+  VERIFY(HasLevel(surface, Matrix::Scaling(0.1f, 0.1f), false, &scale));
+  VERIFY(scale == 8);
+  VERIFY(HasLevel(surface, Matrix::Scaling(0.1f, 0.1f), true, &scale));
+  VERIFY(scale == 4);
+
+  SurfacePattern pattern(surface, ExtendMode::REPEAT, Matrix::Scaling(0.1f, 0.1f));
+  MipmappedPattern mipmapped(pattern, Matrix());
+  const SurfacePattern& level = static_cast<const SurfacePattern&>(mipmapped.Get());
+  VERIFY(level.mSurface && level.mSurface->GetSize() == IntSize(25, 25));
+  VERIFY(level.mExtendMode == ExtendMode::REPEAT);
+  VERIFY(level.mMatrix == Matrix::Scaling(0.4f, 0.4f));
+
+  RefPtr<DataSourceSurface> odd = CreatePattern(IntSize(99, 100));
+  VERIFY(odd);
+  VERIFY(!HasLevel(odd, Matrix::Scaling(0.1f, 0.1f), true, &scale));
+
+  Factory::SetMipmapCacheSize(0);
+}
+
+void
+TestMipmapCache::DrawSurfaceSourceRect()
+{
+  Factory::SetMipmapCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreatePattern(IntSize(200, 200));
+  VERIFY(surface);
+  Rect levelSource;
+  RefPtr<DataSourceSurface> level =
+    MipmapCache::GetLevelForDrawSurface(surface, Rect(0, 0, 30, 20), Rect(20, 40, 120, 80),
+                                        Matrix::Scaling(0.5f, 0.5f), &levelSource);
+  VERIFY(level && level->GetSize() == IntSize(25, 25));
+  VERIFY(levelSource.IsEqualEdges(Rect(2.5f, 5, 15, 10)));
+
+  // Drawn at its own size once the transform is taken into account.
+  level = MipmapCache::GetLevelForDrawSurface(surface, Rect(0, 0, 30, 20), Rect(20, 40, 120, 80),
+                                              Matrix::Scaling(4, 4), &levelSource);
+  VERIFY(!level);
+
+  Factory::SetMipmapCacheSize(0);
+}
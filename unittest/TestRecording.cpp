@@ -0,0 +1,557 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestRecording.h"
+
+#include "DataDrawTarget.h"
+#include "DrawEventRecorder.h"
+#include "RecordedEventGraph.h"
+#include "RecordingCompression.h"
+#include "RecordingReader.h"
+#include "RecordingTypes.h"
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+using namespace std;
+
+static const char *kRecordingFile = "moz2d-unittest.aer";
+
+// Enough events to span several chunks.
+static const uint32_t kEventCount = 20000;
+
+static void
+RecordTestEvents(DrawEventRecorderPrivate *aRecorder)
+{
+  DrawTarget *dt = reinterpret_cast<DrawTarget*>(0x1000);
+
+  for (uint32_t i = 0; i < kEventCount; i++) {
+    aRecorder->RecordEvent(RecordedFillRect(dt, Rect(Float(i), 0, 10, 10),
+                                            ColorPattern(Color(1, 0, 0, 1)),
+                                            DrawOptions()));
+  }
+}
+
+static void
+WriteTestRecording(bool aCompress = false)
+{
+  RefPtr<DrawEventRecorderFile> recorder = new DrawEventRecorderFile(kRecordingFile, aCompress);
+  RecordTestEvents(recorder);
+}
+
+static size_t
+GetFileLength(const char *aFilename)
+{
+  ifstream file(aFilename, ios::binary | ios::ate);
+  return size_t(file.tellg());
+}
+
+static void
+DeleteEvents(vector<RecordedEvent*> &aEvents)
+{
+  for (size_t i = 0; i < aEvents.size(); i++) {
+    delete aEvents[i];
+  }
+  aEvents.clear();
+}
+
+TestRecording::TestRecording()
+{
+#define TEST_CLASS TestRecording
+  REGISTER_TEST(ChunkedRoundTrip);
+  REGISTER_TEST(UnfinishedRecording);
+  REGISTER_TEST(CorruptIndex);
+  REGISTER_TEST(MemoryRecorderStreaming);
+  REGISTER_TEST(MemoryRecorderFlightMode);
+  REGISTER_TEST(SurfaceDataDeduplication);
+  REGISTER_TEST(CompressionRoundTrip);
+  REGISTER_TEST(CompressedRecording);
+  REGISTER_TEST(EventGraph);
+  REGISTER_TEST(BoxShadowReplays);
+#undef TEST_CLASS
+}
+
+void
+TestRecording::ChunkedRoundTrip()
+{
+  WriteTestRecording();
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  VERIFY(reader->HasIndex());
+  VERIFY(reader->GetChunkCount() > 1);
+
+  uint32_t indexedEvents = 0;
+  for (size_t i = 0; i < reader->GetChunkCount(); i++) {
+    indexedEvents += reader->GetEventCount(i);
+  }
+  VERIFYVALUE(indexedEvents, kEventCount);
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFYVALUE(uint32_t(events.size()), kEventCount);
+  for (size_t i = 0; i < events.size(); i++) {
+    VERIFY(events[i]->GetType() == RecordedEvent::FILLRECT);
+  }
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::UnfinishedRecording()
+{
+  WriteTestRecording();
+
+  // Chop off the index and part of the last chunk, as if the recording
+  // process had crashed.
+  string contents;
+  {
+    ifstream file(kRecordingFile, ios::binary);
+    contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  }
+  {
+    ofstream file(kRecordingFile, ios::binary | ios::trunc);
+    file.write(contents.data(), contents.size() - 4096);
+  }
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  VERIFY(!reader->HasIndex());
+  VERIFY(reader->GetChunkCount() > 0);
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFY(events.size() > 0 && events.size() < kEventCount);
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::CorruptIndex()
+{
+  WriteTestRecording();
+
+  string contents;
+  {
+    ifstream file(kRecordingFile, ios::binary);
+    contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  }
+
+  // Point the first index entry so close to the end of the address space
+  // that adding the chunk header size to it wraps around.
+  RecordingTrailer trailer;
+  memcpy(&trailer, &contents[contents.size() - sizeof(trailer)], sizeof(trailer));
+  uint64_t offset = UINT64_MAX - sizeof(RecordingChunkHeader) / 2;
+  memcpy(&contents[size_t(trailer.mIndexOffset)], &offset, sizeof(offset));
+  {
+    ofstream file(kRecordingFile, ios::binary | ios::trunc);
+    file.write(contents.data(), contents.size());
+  }
+
+  // The index is ignored, the chunks are still found by walking them.
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  VERIFY(!reader->HasIndex());
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFY(events.size() == kEventCount);
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::MemoryRecorderStreaming()
+{
+  {
+    // Small enough that the drain thread has to keep up.
+    RefPtr<DrawEventRecorderMemory> recorder =
+      new DrawEventRecorderMemory(16 * 1024, kRecordingFile);
+    RecordTestEvents(recorder);
+
+    // This needs to be split up to pass through the ring buffer.
+    vector<uint8_t> pixels(100 * 100 * 4, 0x80);
+    recorder->RecordEvent(RecordedSourceSurfaceCreation(pixels.data(), pixels.data(), 400,
+                                                        IntSize(100, 100),
+                                                        SurfaceFormat::B8G8R8A8));
+  }
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFYVALUE(uint32_t(events.size()), kEventCount + 1);
+  VERIFY(events.back()->GetType() == RecordedEvent::SOURCESURFACECREATION);
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::MemoryRecorderFlightMode()
+{
+  RefPtr<DrawEventRecorderMemory> recorder = new DrawEventRecorderMemory(64 * 1024);
+  RecordTestEvents(recorder);
+  // Stored surface data could be overwritten while surfaces still refer to
+  // it, so both of these have to be recorded in full.
+  vector<uint8_t> pixels(64 * 64 * 4, 0x40);
+  for (int i = 0; i < 2; i++) {
+    recorder->RecordSourceSurfaceCreation(&pixels[0], &pixels[0], 64 * 4,
+                                          IntSize(64, 64), SurfaceFormat::B8G8R8A8);
+  }
+  VERIFY(recorder->DumpToFile(kRecordingFile));
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  // Only the most recent events are retained.
+  VERIFY(events.size() > 2 && events.size() < kEventCount);
+  for (size_t i = events.size() - 2; i < events.size(); i++) {
+    VERIFY(events[i]->GetType() == RecordedEvent::SOURCESURFACECREATION);
+  }
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::SurfaceDataDeduplication()
+{
+  const IntSize size(64, 64);
+  vector<uint8_t> pixels(size.width * size.height * 4, 0x40);
+  vector<uint8_t> otherPixels(size.width * size.height * 4, 0x80);
+  // Same contents as pixels, but with padding at the end of every row.
+  const int32_t paddedStride = size.width * 4 + 44;
+  vector<uint8_t> paddedPixels(paddedStride * size.height, 0xff);
+  for (int32_t y = 0; y < size.height; y++) {
+    memcpy(&paddedPixels[y * paddedStride], &pixels[y * size.width * 4], size.width * 4);
+  }
+  vector<uint8_t> smallPixels(8 * 8 * 4, 0x40);
+
+  {
+    RefPtr<DrawEventRecorderFile> recorder = new DrawEventRecorderFile(kRecordingFile);
+    recorder->RecordSourceSurfaceCreation(&pixels[0], &pixels[0], size.width * 4,
+                                          size, SurfaceFormat::B8G8R8A8);
+    recorder->RecordSourceSurfaceCreation(&paddedPixels[0], &paddedPixels[0], paddedStride,
+                                          size, SurfaceFormat::B8G8R8A8);
+    recorder->RecordSourceSurfaceCreation(&otherPixels[0], &otherPixels[0], size.width * 4,
+                                          size, SurfaceFormat::B8G8R8A8);
+    recorder->RecordSourceSurfaceCreation(&smallPixels[0], &smallPixels[0], 8 * 4,
+                                          IntSize(8, 8), SurfaceFormat::B8G8R8A8);
+
+    // Only room for one of the two stored surfaces, so the least recently
+    // used one goes, and storing the other one again evicts the rest.
+    recorder->SetSurfaceDataStoreLimit(pixels.size() + 1024);
+    recorder->RecordSourceSurfaceCreation(&pixels[0], &pixels[0], size.width * 4,
+                                          size, SurfaceFormat::B8G8R8A8);
+  }
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  const RecordedEvent::EventType expected[] = {
+    RecordedEvent::SURFACEDATASTORE,
+    RecordedEvent::SOURCESURFACEFROMSTOREDDATA,
+    RecordedEvent::SOURCESURFACEFROMSTOREDDATA,
+    RecordedEvent::SURFACEDATASTORE,
+    RecordedEvent::SOURCESURFACEFROMSTOREDDATA,
+    RecordedEvent::SOURCESURFACECREATION,
+    RecordedEvent::SURFACEDATARELEASE,
+    RecordedEvent::SURFACEDATARELEASE,
+    RecordedEvent::SURFACEDATASTORE,
+    RecordedEvent::SOURCESURFACEFROMSTOREDDATA
+  };
+  const uint32_t expectedCount = sizeof(expected) / sizeof(expected[0]);
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFYVALUE(uint32_t(events.size()), expectedCount);
+  for (size_t i = 0; i < events.size() && i < expectedCount; i++) {
+    VERIFY(events[i]->GetType() == expected[i]);
+  }
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::CompressionRoundTrip()
+{
+  vector<vector<char> > inputs;
+  inputs.push_back(vector<char>());
+  inputs.push_back(vector<char>(1, 'x'));
+  inputs.push_back(vector<char>(12, 'x'));
+  // Long runs, as found in solid pixel data.
+  inputs.push_back(vector<char>(100000, 'x'));
+
+  uint32_t state = 1;
+  vector<char> random(70000);
+  for (size_t i = 0; i < random.size(); i++) {
+    state = state * 1103515245 + 12345;
+    random[i] = char(state >> 16);
+  }
+  inputs.push_back(random);
+
+  // Repeats that are further apart than a match can reach.
+  vector<char> repeated(random.begin(), random.end());
+  repeated.insert(repeated.end(), random.begin(), random.begin() + 1000);
+  repeated.insert(repeated.end(), random.begin() + 500, random.begin() + 3000);
+  inputs.push_back(repeated);
+
+  for (size_t i = 0; i < inputs.size(); i++) {
+    const vector<char> &input = inputs[i];
+    vector<char> compressed(RecordingCompression::MaxCompressedLength(input.size()));
+    size_t length = RecordingCompression::Compress(input.empty() ? nullptr : &input.front(),
+                                                   input.size(), &compressed.front());
+    VERIFY(length <= compressed.size());
+
+    vector<char> output(input.size() + 1);
+    VERIFY(RecordingCompression::Decompress(&compressed.front(), length,
+                                            &output.front(), input.size()));
+    VERIFY(std::equal(input.begin(), input.end(), output.begin()));
+
+    // Truncated input or a wrong length must be rejected.
+    if (length > 1) {
+      VERIFY(!RecordingCompression::Decompress(&compressed.front(), length - 1,
+                                               &output.front(), input.size()));
+    }
+    VERIFY(!RecordingCompression::Decompress(&compressed.front(), length,
+                                             &output.front(), input.size() + 1));
+  }
+
+  vector<char> compressed(RecordingCompression::MaxCompressedLength(100000));
+  VERIFY(RecordingCompression::Compress(&inputs[3].front(), 100000, &compressed.front()) < 1000);
+}
+
+void
+TestRecording::CompressedRecording()
+{
+  WriteTestRecording();
+  size_t uncompressedLength = GetFileLength(kRecordingFile);
+  WriteTestRecording(true);
+  VERIFY(GetFileLength(kRecordingFile) < uncompressedLength / 4);
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+
+  VERIFY(reader->HasIndex());
+  VERIFY(reader->GetChunkCount() > 1);
+
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  VERIFYVALUE(uint32_t(events.size()), kEventCount);
+
+  stringstream expected, decoded;
+  RecordedFillRect(reinterpret_cast<DrawTarget*>(0x1000), Rect(Float(kEventCount - 1), 0, 10, 10),
+                   ColorPattern(Color(1, 0, 0, 1)), DrawOptions()).OutputSimpleEventInfo(expected);
+  events.back()->OutputSimpleEventInfo(decoded);
+  VERIFY(expected.str() == decoded.str());
+
+  delete reader;
+  remove(kRecordingFile);
+}
+
+void
+TestRecording::EventGraph()
+{
+  DrawTarget *dtA = reinterpret_cast<DrawTarget*>(0x1000);
+  DrawTarget *dtB = reinterpret_cast<DrawTarget*>(0x2000);
+  ReferencePtr snapshot = reinterpret_cast<void*>(0x3000);
+  Rect rect(0, 0, 10, 10);
+
+  vector<RecordedEvent*> events;
+  events.push_back(new RecordedDrawTargetCreation(dtA, BackendType::NONE, IntSize(10, 10),
+                                                  SurfaceFormat::B8G8R8A8));
+  events.push_back(new RecordedDrawTargetCreation(dtB, BackendType::NONE, IntSize(10, 10),
+                                                  SurfaceFormat::B8G8R8A8));
+  events.push_back(new RecordedFillRect(dtA, rect, ColorPattern(Color()), DrawOptions()));
+  events.push_back(new RecordedFillRect(dtB, rect, ColorPattern(Color()), DrawOptions()));
+  events.push_back(new RecordedFillRect(dtA, rect, ColorPattern(Color()), DrawOptions()));
+  events.push_back(new RecordedFillRect(dtB, rect, ColorPattern(Color()), DrawOptions()));
+  events.push_back(new RecordedSnapshot(snapshot, dtA));
+  events.push_back(new RecordedDrawSurface(dtB, snapshot, rect, rect, DrawSurfaceOptions(),
+                                           DrawOptions()));
+  // The snapshot shares its data with A, so this has to wait for B to be
+  // done with it.
+  events.push_back(new RecordedFillRect(dtA, rect, ColorPattern(Color()), DrawOptions()));
+
+  // Events that have to be played before each event.
+  const int32_t dependencies[][2] = {
+    { -1, -1 }, { 0, -1 }, { 0, -1 }, { 1, -1 }, { 2, -1 }, { 3, -1 },
+    { 4, -1 }, { 5, 6 }, { 7, -1 }
+  };
+
+  RecordedEventGraph graph(events);
+  VERIFYVALUE(graph.GetEventCount(), uint32_t(events.size()));
+  VERIFYVALUE(graph.GetDependencyCount(), 9u);
+  VERIFYVALUE(graph.GetDrawTargetCount(), 2u);
+
+  vector<double> durations(events.size(), 1.0);
+  VERIFY(graph.GetCriticalPathLength(durations) == 6.0);
+
+  WorkerPool pool(4);
+  for (int i = 0; i < 100; i++) {
+    vector<atomic<bool> > played(events.size());
+    for (size_t j = 0; j < events.size(); j++) {
+      played[j] = false;
+    }
+    atomic<uint32_t> misordered(0);
+    graph.Play(&pool, [&] (uint32_t aEvent) {
+      for (int j = 0; j < 2; j++) {
+        int32_t dependency = dependencies[aEvent][j];
+        if (dependency >= 0 && !played[dependency]) {
+          misordered++;
+        }
+      }
+      if (played[aEvent].exchange(true)) {
+        misordered++;
+      }
+    });
+
+    VERIFYVALUE(misordered.load(), 0u);
+    for (size_t j = 0; j < events.size(); j++) {
+      VERIFY(played[j]);
+    }
+  }
+
+  DeleteEvents(events);
+}
+
+// Plays events into DataDrawTargets.
+class DataTranslator : public Translator
+{
+public:
+  DataTranslator() : mReferenceDT(new DataDrawTarget(IntSize(1, 1))) {}
+
+  virtual DrawTarget *LookupDrawTarget(ReferencePtr aRefPtr) { return mDrawTargets[aRefPtr]; }
+  virtual Path *LookupPath(ReferencePtr aRefPtr) { return mPaths[aRefPtr]; }
+  virtual SourceSurface *LookupSourceSurface(ReferencePtr aRefPtr) { return mSurfaces[aRefPtr]; }
+  virtual FilterNode *LookupFilterNode(ReferencePtr aRefPtr) { return mFilterNodes[aRefPtr]; }
+  virtual GradientStops *LookupGradientStops(ReferencePtr aRefPtr) { return mStops[aRefPtr]; }
+  virtual ScaledFont *LookupScaledFont(ReferencePtr aRefPtr) { return mFonts[aRefPtr]; }
+  virtual void AddDrawTarget(ReferencePtr aRefPtr, DrawTarget *aDT) { mDrawTargets[aRefPtr] = aDT; }
+  virtual void RemoveDrawTarget(ReferencePtr aRefPtr) { mDrawTargets.erase(aRefPtr); }
+  virtual void AddPath(ReferencePtr aRefPtr, Path *aPath) { mPaths[aRefPtr] = aPath; }
+  virtual void RemovePath(ReferencePtr aRefPtr) { mPaths.erase(aRefPtr); }
+  virtual void AddSourceSurface(ReferencePtr aRefPtr, SourceSurface *aSurface) { mSurfaces[aRefPtr] = aSurface; }
+  virtual void RemoveSourceSurface(ReferencePtr aRefPtr) { mSurfaces.erase(aRefPtr); }
+  virtual void AddFilterNode(ReferencePtr aRefPtr, FilterNode *aNode) { mFilterNodes[aRefPtr] = aNode; }
+  virtual void RemoveFilterNode(ReferencePtr aRefPtr) { mFilterNodes.erase(aRefPtr); }
+  virtual void AddGradientStops(ReferencePtr aRefPtr, GradientStops *aStops) { mStops[aRefPtr] = aStops; }
+  virtual void RemoveGradientStops(ReferencePtr aRefPtr) { mStops.erase(aRefPtr); }
+  virtual void AddScaledFont(ReferencePtr aRefPtr, ScaledFont *aFont) { mFonts[aRefPtr] = aFont; }
+  virtual void RemoveScaledFont(ReferencePtr aRefPtr) { mFonts.erase(aRefPtr); }
+  virtual SourceSurface *LookupStoredSurfaceData(uint64_t aDataId) { return mStoredData[aDataId]; }
+  virtual void AddStoredSurfaceData(uint64_t aDataId, SourceSurface *aSurface) { mStoredData[aDataId] = aSurface; }
+  virtual void RemoveStoredSurfaceData(uint64_t aDataId) { mStoredData.erase(aDataId); }
+  virtual DrawTarget *GetReferenceDrawTarget() { return mReferenceDT; }
+  virtual FontType GetDesiredFontType() { return FontType::SKIA; }
+
+private:
+  RefPtr<DrawTarget> mReferenceDT;
+  map<void*, RefPtr<DrawTarget> > mDrawTargets;
+  map<void*, RefPtr<Path> > mPaths;
+  map<void*, RefPtr<SourceSurface> > mSurfaces;
+  map<void*, RefPtr<FilterNode> > mFilterNodes;
+  map<void*, RefPtr<GradientStops> > mStops;
+  map<void*, RefPtr<ScaledFont> > mFonts;
+  map<uint64_t, RefPtr<SourceSurface> > mStoredData;
+};
+
+void
+TestRecording::BoxShadowReplays()
+{
+  // DrawBoxShadow masks with a template that the recording has to carry
+  // along, or the shadow can't be played back.
+  RefPtr<DataDrawTarget> live = new DataDrawTarget(IntSize(120, 100));
+  {
+    RefPtr<DrawEventRecorderFile> recorder = new DrawEventRecorderFile(kRecordingFile);
+    RefPtr<DrawTarget> dt = Factory::CreateRecordingDrawTarget(recorder, live);
+    VERIFY(dt);
+    if (!dt) {
+      return;
+    }
+    dt->DrawBoxShadow(Rect(20, 20, 70, 50), nullptr, Color(0, 0, 0, 1), 4.0f);
+  }
+  VERIFY(!live->HasUnsupportedCalls());
+
+  RecordingReader *reader = RecordingReader::Open(kRecordingFile);
+  VERIFY(reader);
+  if (!reader) {
+    return;
+  }
+  RecordedEventArena arena;
+  vector<RecordedEvent*> events;
+  VERIFY(reader->ReadAllEvents(arena, events));
+  delete reader;
+  remove(kRecordingFile);
+
+  DataTranslator translator;
+  RefPtr<DataDrawTarget> replayed;
+  for (size_t i = 0; i < events.size(); i++) {
+    events[i]->PlayEvent(&translator);
+    if (events[i]->GetType() == RecordedEvent::DRAWTARGETCREATION) {
+      replayed = static_cast<DataDrawTarget*>(
+        translator.LookupDrawTarget(events[i]->GetObjectRef()));
+    }
+  }
+
+  VERIFY(replayed);
+  if (!replayed) {
+    return;
+  }
+  VERIFY(!replayed->HasUnsupportedCalls());
+  DataSourceSurface* expected = live->GetData();
+  DataSourceSurface* actual = replayed->GetData();
+  bool drawn = false;
+  for (int32_t y = 0; y < 100; y++) {
+    VERIFY(!memcmp(expected->GetData() + y * expected->Stride(),
+                   actual->GetData() + y * actual->Stride(), 120 * 4));
+    drawn |= expected->GetData()[y * expected->Stride() + 4 * 50 + 3] != 0;
+  }
+  VERIFY(drawn);
+}
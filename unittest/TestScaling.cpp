@@ -6,7 +6,11 @@
 #include "TestScaling.h"
 
 #include "ImageScaling.h"
+#include "Scale.h"
 
+#include <string.h>
+
+using namespace mozilla;
 using namespace mozilla::gfx;
 
 TestScaling::TestScaling()
@@ -19,6 +23,10 @@ TestScaling::TestScaling()
   REGISTER_TEST(VerticalHalfScale);
   REGISTER_TEST(HorizontalHalfScale);
   REGISTER_TEST(MixedHalfScale);
+  REGISTER_TEST(ScaleSurfaceIsCached);
+  REGISTER_TEST(AsyncMatchesSync);
+  REGISTER_TEST(AsyncHitsCache);
+  REGISTER_TEST(InvalidateDropsScaledCopies);
 #undef TEST_CLASS
 }
 
@@ -249,3 +257,167 @@ TestScaling::MixedHalfScale()
   VERIFY(scaler.GetSize().width == 250);
   VERIFY(scaler.GetSize().height == 125);
 }
+
+// An opaque B8G8R8A8 surface with a different color in every column.
+static TemporaryRef<DataSourceSurface>
+CreateGradient(const IntSize& aSize)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8);
+  if (!surface) {
+    return nullptr;
+  }
+  for (int32_t y = 0; y < aSize.height; y++) {
+    uint32_t* row = (uint32_t*)(surface->GetData() + y * surface->Stride());
+    for (int32_t x = 0; x < aSize.width; x++) {
+      row[x] = 0xff000000 | ((x & 0xff) << 8) | (y & 0xff);
+    }
+  }
+  return surface.forget();
+}
+
+// Copies the source pixel under the middle of every target pixel. The cache
+// tests scale with this, Scale() only works in builds with Skia.
+static bool
+PointScale(uint8_t* aSrcData, int32_t aSrcWidth, int32_t aSrcHeight, int32_t aSrcStride,
+           uint8_t* aDstData, int32_t aDstWidth, int32_t aDstHeight, int32_t aDstStride,
+           SurfaceFormat aFormat)
+{
+  for (int32_t y = 0; y < aDstHeight; y++) {
+    int32_t srcY = (2 * y + 1) * aSrcHeight / (2 * aDstHeight);
+    for (int32_t x = 0; x < aDstWidth; x++) {
+      int32_t srcX = (2 * x + 1) * aSrcWidth / (2 * aDstWidth);
+      memcpy(aDstData + y * aDstStride + 4 * x, aSrcData + srcY * aSrcStride + 4 * srcX, 4);
+    }
+  }
+  return true;
+}
+
+// Whether aScaled is aSource scaled by PointScale.
+static bool
+IsPointScaled(DataSourceSurface* aScaled, DataSourceSurface* aSource)
+{
+  IntSize size = aScaled->GetSize();
+  IntSize sourceSize = aSource->GetSize();
+  for (int32_t y = 0; y < size.height; y++) {
+    int32_t sourceY = (2 * y + 1) * sourceSize.height / (2 * size.height);
+    for (int32_t x = 0; x < size.width; x++) {
+      int32_t sourceX = (2 * x + 1) * sourceSize.width / (2 * size.width);
+      if (memcmp(aScaled->GetData() + y * aScaled->Stride() + 4 * x,
+                 aSource->GetData() + sourceY * aSource->Stride() + 4 * sourceX, 4)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void
+TestScaling::ScaleSurfaceIsCached()
+{
+  SetSurfaceScaler(PointScale);
+  Factory::SetScaledSurfaceCacheSize(4 * 1024 * 1024);
+
+  RefPtr<DataSourceSurface> source = CreateGradient(IntSize(400, 300));
+  VERIFY(source);
+  RefPtr<DataSourceSurface> first = ScaleSurface(source, IntSize(100, 75));
+  RefPtr<DataSourceSurface> second = ScaleSurface(source, IntSize(100, 75));
+  RefPtr<DataSourceSurface> other = ScaleSurface(source, IntSize(50, 75));
+  VERIFY(first && other);
+  if (first && other) {
+    VERIFY(first->GetSize() == IntSize(100, 75));
+    VERIFY(IsPointScaled(first, source));
+    VERIFY(second == first);
+    VERIFY(other != first);
+    VERIFY(IsPointScaled(other, source));
+
+    CacheStats stats = Factory::GetScaledSurfaceCacheStats();
+    VERIFY(stats.mHits == 1);
+    VERIFY(stats.mMisses == 2);
+    VERIFY(stats.mEntries == 2);
+    VERIFY(stats.mBytes == size_t(first->Stride() * 75 + other->Stride() * 75));
+  }
+
+  Factory::SetScaledSurfaceCacheSize(0);
+  SetSurfaceScaler(nullptr);
+}
+
+void
+TestScaling::AsyncMatchesSync()
+{
+  SetSurfaceScaler(PointScale);
+
+  RefPtr<DataSourceSurface> source = CreateGradient(IntSize(400, 300));
+  VERIFY(source);
+  RefPtr<DataSourceSurface> expected = ScaleSurface(source, IntSize(130, 90));
+  RefPtr<ScaleRequest> request = ScaleSurfaceAsync(source, IntSize(130, 90));
+  VERIFY(request);
+  RefPtr<DataSourceSurface> result = request->GetResult();
+  VERIFY(request->IsDone());
+  VERIFY(expected && result);
+  if (expected && result) {
+    // Without the cache every scale makes a new surface.
+    VERIFY(result != expected);
+    VERIFY(result->GetSize() == expected->GetSize());
+    for (int32_t y = 0; y < 90; y++) {
+      VERIFY(!memcmp(result->GetData() + y * result->Stride(),
+                     expected->GetData() + y * expected->Stride(), 130 * 4));
+    }
+    VERIFY(IsPointScaled(result, source));
+  }
+
+  SetSurfaceScaler(nullptr);
+}
+
+void
+TestScaling::AsyncHitsCache()
+{
+  SetSurfaceScaler(PointScale);
+  Factory::SetScaledSurfaceCacheSize(4 * 1024 * 1024);
+
+  RefPtr<DataSourceSurface> source = CreateGradient(IntSize(400, 300));
+  VERIFY(source);
+  RefPtr<ScaleRequest> request = ScaleSurfaceAsync(source, IntSize(100, 75));
+  // Not in the cache until the result has been asked for.
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mEntries == 0);
+  RefPtr<DataSourceSurface> first = request->GetResult();
+  VERIFY(first);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mEntries == 1);
+
+  request = ScaleSurfaceAsync(source, IntSize(100, 75));
+  VERIFY(request->IsDone());
+  RefPtr<DataSourceSurface> second = request->GetResult();
+  VERIFY(second == first);
+  second = ScaleSurface(source, IntSize(100, 75));
+  VERIFY(second == first);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mHits == 2);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mMisses == 1);
+
+  Factory::SetScaledSurfaceCacheSize(0);
+  SetSurfaceScaler(nullptr);
+}
+
+void
+TestScaling::InvalidateDropsScaledCopies()
+{
+  SetSurfaceScaler(PointScale);
+  Factory::SetScaledSurfaceCacheSize(4 * 1024 * 1024);
+
+  RefPtr<DataSourceSurface> source = CreateGradient(IntSize(400, 300));
+  VERIFY(source);
+  RefPtr<DataSourceSurface> first = ScaleSurface(source, IntSize(100, 75));
+  VERIFY(first);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mEntries == 1);
+
+  memset(source->GetData(), 0, source->Stride() * 300);
+  Factory::InvalidateScaledSurfaces(source);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mEntries == 0);
+
+  RefPtr<DataSourceSurface> second = ScaleSurface(source, IntSize(100, 75));
+  VERIFY(second && second != first);
+  VERIFY(second && ((uint32_t*)second->GetData())[0] == 0);
+  VERIFY(Factory::GetScaledSurfaceCacheStats().mEntries == 1);
+
+  Factory::SetScaledSurfaceCacheSize(0);
+  SetSurfaceScaler(nullptr);
+}
@@ -19,4 +19,8 @@ public:
   void VerticalHalfScale();
   void HorizontalHalfScale();
   void MixedHalfScale();
+  void ScaleSurfaceIsCached();
+  void AsyncMatchesSync();
+  void AsyncHitsCache();
+  void InvalidateDropsScaledCopies();
 };
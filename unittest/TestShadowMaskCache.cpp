@@ -0,0 +1,403 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestShadowMaskCache.h"
+
+#include "Blur.h"
+#include "DataDrawTarget.h"
+#include "ShadowMaskCache.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+TestShadowMaskCache::TestShadowMaskCache()
+{
+#define TEST_CLASS TestShadowMaskCache
+  REGISTER_TEST(MaskMatchesAlphaBoxBlur);
+  REGISTER_TEST(RepeatedDrawsHitCache);
+  REGISTER_TEST(InvalidateDropsMasks);
+  REGISTER_TEST(ReleaseOnOtherThread);
+  REGISTER_TEST(EvictsLeastRecentlyUsed);
+  REGISTER_TEST(BoxShadowMatchesFullBlur);
+  REGISTER_TEST(DrawBoxShadowMatchesFullBlur);
+  REGISTER_TEST(BoxShadowTemplatesAreShared);
+#undef TEST_CLASS
+}
+
+// A B8G8R8A8 surface with an opaque rectangle in the middle, whose alpha
+// value is aAlpha.
+static TemporaryRef<DataSourceSurface>
+CreateShape(const IntSize& aSize, uint8_t aAlpha)
+{
+  RefPtr<DataSourceSurface> surface =
+    Factory::CreateDataSourceSurface(aSize, SurfaceFormat::B8G8R8A8, true);
+  if (!surface) {
+    return nullptr;
+  }
+  for (int32_t y = aSize.height / 4; y < aSize.height * 3 / 4; y++) {
+    memset(surface->GetData() + y * surface->Stride() + aSize.width, aAlpha, aSize.width * 2);
+  }
+  return surface.forget();
+}
+
+void
+TestShadowMaskCache::MaskMatchesAlphaBoxBlur()
+{
+  IntSize size(40, 30);
+  RefPtr<DataSourceSurface> surface = CreateShape(size, 0xff);
+  VERIFY(surface);
+
+  for (int inflate = 0; inflate < 2; inflate++) {
+    IntPoint offset;
+    RefPtr<DataSourceSurface> mask =
+      ShadowMaskCache::GetMask(surface, surface, 3.0f, inflate, &offset);
+    VERIFY(mask && mask->GetFormat() == SurfaceFormat::A8);
+
+    // Blur the same alpha channel directly.
+    IntSize radius = inflate ? AlphaBoxBlur::CalculateBlurRadius(Point(3.0f, 3.0f)) : IntSize();
+    VERIFY(offset == IntPoint(-radius.width, -radius.height));
+    IntSize maskSize(size.width + 2 * radius.width, size.height + 2 * radius.height);
+    VERIFY(mask->GetSize() == maskSize);
+    int32_t stride = maskSize.width;
+    uint8_t* expected = new uint8_t[stride * maskSize.height];
+    memset(expected, 0, stride * maskSize.height);
+    for (int32_t y = 0; y < size.height; y++) {
+      for (int32_t x = 0; x < size.width; x++) {
+        expected[(y + radius.height) * stride + x + radius.width] =
+          surface->GetData()[y * surface->Stride() + 4 * x + 3];
+      }
+    }
+    AlphaBoxBlur blur(Rect(0, 0, maskSize.width, maskSize.height), stride, 3.0f, 3.0f);
+    blur.Blur(expected);
+
+    for (int32_t y = 0; y < maskSize.height; y++) {
+      VERIFY(!memcmp(mask->GetData() + y * mask->Stride(), expected + y * stride, maskSize.width));
+    }
+    delete [] expected;
+  }
+}
+
+void
+TestShadowMaskCache::RepeatedDrawsHitCache()
+{
+  RefPtr<DataSourceSurface> surface = CreateShape(IntSize(40, 30), 0xff);
+  VERIFY(surface);
+
+  // Nothing is kept while the cache is disabled.
+  Factory::SetShadowMaskCacheSize(0);
+  IntPoint offset;
+  RefPtr<DataSourceSurface> first = ShadowMaskCache::GetMask(surface, surface, 3.0f, true, &offset);
+  RefPtr<DataSourceSurface> second = ShadowMaskCache::GetMask(surface, surface, 3.0f, true, &offset);
+  VERIFY(first && second && first != second);
+  VERIFY(Factory::GetShadowMaskCacheStats().mEntries == 0);
+
+  Factory::SetShadowMaskCacheSize(1024 * 1024);
+  first = ShadowMaskCache::GetMask(surface, surface, 3.0f, true, &offset);
+  second = ShadowMaskCache::GetMask(surface, surface, 3.0f, true, &offset);
+  VERIFY(first && first == second);
+
+  // Different deviations and extents need masks of their own.
+  RefPtr<DataSourceSurface> other = ShadowMaskCache::GetMask(surface, surface, 4.0f, true, &offset);
+  VERIFY(other && other != first);
+  other = ShadowMaskCache::GetMask(surface, surface, 3.0f, false, &offset);
+  VERIFY(other && other != first);
+
+  CacheStats stats = Factory::GetShadowMaskCacheStats();
+  VERIFY(stats.mHits == 1);
+  VERIFY(stats.mMisses == 3);
+  VERIFY(stats.mEntries == 3);
+  VERIFY(stats.mBytes >= size_t(first->Stride()) * first->GetSize().height);
+
+  // The alpha source is only asked for when a mask has to be built.
+  int reads = 0;
+  ShadowMaskCache::AlphaSourceFunction getAlphaSource =
+    [&reads, &surface]() -> TemporaryRef<DataSourceSurface> {
+      reads++;
+      return surface.get();
+    };
+  other = ShadowMaskCache::GetMask(surface, getAlphaSource, 3.0f, true, &offset);
+  VERIFY(other == first && reads == 0);
+  other = ShadowMaskCache::GetMask(surface, getAlphaSource, 5.0f, true, &offset);
+  VERIFY(other && other != first && reads == 1);
+
+  Factory::SetShadowMaskCacheSize(0);
+}
+
+void
+TestShadowMaskCache::InvalidateDropsMasks()
+{
+  RefPtr<DataSourceSurface> surface = CreateShape(IntSize(40, 30), 0x80);
+  VERIFY(surface);
+
+  Factory::SetShadowMaskCacheSize(1024 * 1024);
+  IntPoint offset;
+  RefPtr<DataSourceSurface> first = ShadowMaskCache::GetMask(surface, surface, 2.0f, false, &offset);
+  VERIFY(first);
+  uint8_t center = first->GetData()[15 * first->Stride() + 20];
+  VERIFY(center > 0x70 && center <= 0x80);
+
+  // Change the surface, the cache only notices after it's told.
+  for (int32_t y = 0; y < 30; y++) {
+    memset(surface->GetData() + y * surface->Stride(), 0xff, 40 * 4);
+  }
+  Factory::InvalidateShadowMasks(surface);
+  VERIFY(Factory::GetShadowMaskCacheStats().mEntries == 0);
+  VERIFY(Factory::GetShadowMaskCacheStats().mBytes == 0);
+
+  RefPtr<DataSourceSurface> second = ShadowMaskCache::GetMask(surface, surface, 2.0f, false, &offset);
+  VERIFY(second && second != first);
+  VERIFY(second->GetData()[15 * second->Stride() + 20] > 0xf0);
+  Factory::SetShadowMaskCacheSize(0);
+}
+
+void
+TestShadowMaskCache::ReleaseOnOtherThread()
+{
+  Factory::SetShadowMaskCacheSize(1024 * 1024);
+
+  RefPtr<DataSourceSurface> surface = CreateShape(IntSize(40, 30), 0xff);
+  VERIFY(surface);
+  IntPoint offset;
+  RefPtr<DataSourceSurface> mask = ShadowMaskCache::GetMask(surface, surface, 3.0f, true, &offset);
+  VERIFY(mask);
+  mask = nullptr;
+  VERIFY(Factory::GetShadowMaskCacheStats().mEntries == 1);
+
+  // The last reference to the surface goes away on a worker. Its mask is
+  // dropped back on this thread.
+  std::thread worker([&surface]() { surface = nullptr; });
+  worker.join();
+  VERIFY(Factory::GetShadowMaskCacheStats().mEntries == 0);
+  VERIFY(Factory::GetShadowMaskCacheStats().mBytes == 0);
+
+  Factory::SetShadowMaskCacheSize(0);
+}
+
+void
+TestShadowMaskCache::EvictsLeastRecentlyUsed()
+{
+  RefPtr<DataSourceSurface> surfaces[3];
+  for (int i = 0; i < 3; i++) {
+    surfaces[i] = CreateShape(IntSize(64, 64), 0xff);
+    VERIFY(surfaces[i]);
+  }
+
+  // Room for two 64x64 A8 masks.
+  Factory::SetShadowMaskCacheSize(2 * 64 * 64);
+  IntPoint offset;
+  RefPtr<DataSourceSurface> masks[3];
+  for (int i = 0; i < 2; i++) {
+    masks[i] = ShadowMaskCache::GetMask(surfaces[i], surfaces[i], 2.0f, false, &offset);
+  }
+  // Use the first one again, so the second one is evicted for the third.
+  RefPtr<DataSourceSurface> mask = ShadowMaskCache::GetMask(surfaces[0], surfaces[0], 2.0f, false, &offset);
+  VERIFY(mask == masks[0]);
+  masks[2] = ShadowMaskCache::GetMask(surfaces[2], surfaces[2], 2.0f, false, &offset);
+
+  CacheStats stats = Factory::GetShadowMaskCacheStats();
+  VERIFY(stats.mEvictions == 1);
+  VERIFY(stats.mEntries == 2);
+  VERIFY(stats.mBytes <= 2 * 64 * 64);
+  mask = ShadowMaskCache::GetMask(surfaces[0], surfaces[0], 2.0f, false, &offset);
+  VERIFY(mask == masks[0]);
+  mask = ShadowMaskCache::GetMask(surfaces[1], surfaces[1], 2.0f, false, &offset);
+  VERIFY(mask != masks[1]);
+  Factory::SetShadowMaskCacheSize(0);
+}
+
+// The coverage of a pixel by a rounded rectangle at the origin, sampled 4x4
+// times.
+static uint8_t
+RoundedRectCoverage(int32_t aX, int32_t aY, const IntSize& aSize, const Size* aCornerRadii)
+{
+  const Point centers[4] = {
+    Point(aCornerRadii[0].width, aCornerRadii[0].height),
+    Point(aSize.width - aCornerRadii[1].width, aCornerRadii[1].height),
+    Point(aSize.width - aCornerRadii[2].width, aSize.height - aCornerRadii[2].height),
+    Point(aCornerRadii[3].width, aSize.height - aCornerRadii[3].height)
+  };
+  int covered = 0;
+  for (int sy = 0; sy < 4; sy++) {
+    for (int sx = 0; sx < 4; sx++) {
+      Point sample(aX + (sx + 0.5f) / 4, aY + (sy + 0.5f) / 4);
+      bool inside = true;
+      for (int i = 0; i < 4; i++) {
+        Float dx = (sample.x - centers[i].x) / aCornerRadii[i].width;
+        Float dy = (sample.y - centers[i].y) / aCornerRadii[i].height;
+        bool inQuadrant = (i == 0 || i == 3 ? dx < 0 : dx > 0) &&
+                          (i < 2 ? dy < 0 : dy > 0);
+        if (inQuadrant && dx * dx + dy * dy > 1) {
+          inside = false;
+        }
+      }
+      covered += inside;
+    }
+  }
+  return (covered * 0xff + 8) / 16;
+}
+
+// Blurs the whole of aBox, rounded by aCornerRadii if not null, the slow way.
+// aDest is set to the area the blur covers, the result has a row of aStride
+// bytes for every row of it.
+static std::vector<uint8_t>
+BlurWholeBox(const IntRect& aBox, const Size* aCornerRadii, Float aSigma,
+             IntRect* aDest, int32_t* aStride)
+{
+  IntSize radius = AlphaBoxBlur::CalculateBlurRadius(Point(aSigma, aSigma));
+  IntRect dest = aBox;
+  dest.Inflate(radius.width, radius.height);
+  // The SSE2 blur reads whole 16 byte groups of each row.
+  int32_t stride = (dest.width + 15) & ~15;
+  std::vector<uint8_t> blurred(stride * dest.height);
+  for (int32_t y = 0; y < aBox.height; y++) {
+    for (int32_t x = 0; x < aBox.width; x++) {
+      blurred[(y + radius.height) * stride + x + radius.width] =
+        aCornerRadii ? RoundedRectCoverage(x, y, aBox.Size(), aCornerRadii) : 0xff;
+    }
+  }
+  AlphaBoxBlur blur(Rect(0, 0, dest.width, dest.height), stride, aSigma, aSigma);
+  blur.Blur(&blurred.front());
+  *aDest = dest;
+  *aStride = stride;
+  return blurred;
+}
+
+void
+TestShadowMaskCache::BoxShadowMatchesFullBlur()
+{
+  const Size radii[4] = { Size(6, 6), Size(10.5f, 4), Size(0, 0), Size(3, 12) };
+  const IntSize sizes[] = { IntSize(200, 150), IntSize(12, 150), IntSize(200, 9), IntSize(7, 5) };
+  // Templates for the largest deviation are blurred at reduced resolution.
+  const Float sigmas[] = { 1.5f, 6.0f, 30.0f };
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t g = 0; g < sizeof(sigmas) / sizeof(sigmas[0]); g++) {
+      for (int rounded = 0; rounded < 2; rounded++) {
+        IntRect box(IntPoint(17, 5), sizes[s]);
+        const Size* cornerRadii = rounded ? radii : nullptr;
+        std::vector<BoxShadowPatch> patches;
+        RefPtr<DataSourceSurface> shadowTemplate =
+          ShadowMaskCache::GetBoxShadow(box, cornerRadii, sigmas[g], &patches);
+        VERIFY(shadowTemplate);
+
+        IntRect dest;
+        int32_t stride;
+        std::vector<uint8_t> expected =
+          BlurWholeBox(box, cornerRadii, sigmas[g], &dest, &stride);
+
+        // Stitch the patches together, sampling the template at the center of
+        // each pixel.
+        std::vector<uint8_t> actual(stride * dest.height);
+        std::vector<int> coverage(stride * dest.height);
+        for (size_t i = 0; i < patches.size(); i++) {
+          const BoxShadowPatch& patch = patches[i];
+          VERIFY(dest.Contains(patch.mDest));
+          Matrix inverse = patch.mTemplateTransform;
+          VERIFY(inverse.Invert());
+          for (int32_t y = patch.mDest.y; y < patch.mDest.YMost(); y++) {
+            for (int32_t x = patch.mDest.x; x < patch.mDest.XMost(); x++) {
+              size_t index = (y - dest.y) * stride + x - dest.x;
+              coverage[index]++;
+              Point source = inverse * Point(x + 0.5f, y + 0.5f);
+              int32_t sx = int32_t(floor(source.x));
+              int32_t sy = int32_t(floor(source.y));
+              VERIFY(sx >= 0 && sx < shadowTemplate->GetSize().width);
+              VERIFY(sy >= 0 && sy < shadowTemplate->GetSize().height);
+              actual[index] = shadowTemplate->GetData()[sy * shadowTemplate->Stride() + sx];
+            }
+          }
+        }
+
+        int maxDifference = 0;
+        for (int32_t y = 0; y < dest.height; y++) {
+          for (int32_t x = 0; x < dest.width; x++) {
+            VERIFY(coverage[y * stride + x] == 1);
+            maxDifference = std::max(maxDifference,
+                                     abs(actual[y * stride + x] - expected[y * stride + x]));
+          }
+        }
+        VERIFY(maxDifference <= (sigmas[g] < AlphaBoxBlur::kMinDownscaledStdDeviation ?
+                                 0 : AlphaBoxBlur::kMaxDownscaledError));
+      }
+    }
+  }
+}
+
+void
+TestShadowMaskCache::DrawBoxShadowMatchesFullBlur()
+{
+  const Size radii[4] = { Size(6, 6), Size(10.5f, 4), Size(0, 0), Size(3, 12) };
+  const IntSize sizes[] = { IntSize(200, 150), IntSize(12, 150), IntSize(7, 5) };
+  const Float sigmas[] = { 1.5f, 6.0f };
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t g = 0; g < sizeof(sigmas) / sizeof(sigmas[0]); g++) {
+      for (int rounded = 0; rounded < 2; rounded++) {
+        IntRect box(IntPoint(30, 25), sizes[s]);
+        const Size* cornerRadii = rounded ? radii : nullptr;
+        IntRect dest;
+        int32_t stride;
+        std::vector<uint8_t> expected =
+          BlurWholeBox(box, cornerRadii, sigmas[g], &dest, &stride);
+
+        // Draw through the real path, clipping to each patch and masking
+        // with a bilinearly filtered pattern of the template.
+        IntSize size(250, 200);
+        RefPtr<DataDrawTarget> dt = new DataDrawTarget(size);
+        dt->DrawBoxShadow(Rect(box), cornerRadii, Color(0, 0, 0, 1), sigmas[g]);
+        VERIFY(!dt->HasUnsupportedCalls());
+
+        DataSourceSurface* result = dt->GetData();
+        int maxDifference = 0;
+        for (int32_t y = 0; y < size.height; y++) {
+          for (int32_t x = 0; x < size.width; x++) {
+            int actual = result->GetData()[y * result->Stride() + 4 * x + 3];
+            int wanted = dest.Contains(IntPoint(x, y)) ?
+              expected[(y - dest.y) * stride + x - dest.x] : 0;
+            maxDifference = std::max(maxDifference, abs(actual - wanted));
+          }
+        }
+        VERIFY(maxDifference <= 1);
+      }
+    }
+  }
+}
+
+void
+TestShadowMaskCache::BoxShadowTemplatesAreShared()
+{
+  const Size radii[4] = { Size(8, 8), Size(8, 8), Size(8, 8), Size(8, 8) };
+  Factory::SetShadowMaskCacheSize(1024 * 1024);
+
+  // Boxes of any size share a template as long as they're large enough.
+  std::vector<BoxShadowPatch> patches;
+  RefPtr<DataSourceSurface> first =
+    ShadowMaskCache::GetBoxShadow(IntRect(0, 0, 300, 200), radii, 4.0f, &patches);
+  VERIFY(first && patches.size() == 9);
+  RefPtr<DataSourceSurface> second =
+    ShadowMaskCache::GetBoxShadow(IntRect(40, 30, 2000, 90), radii, 4.0f, &patches);
+  VERIFY(second && second == first);
+  VERIFY(first->GetSize().width < 90 && first->GetSize().height < 90);
+
+  // Other radii or deviations need templates of their own.
+  RefPtr<DataSourceSurface> other =
+    ShadowMaskCache::GetBoxShadow(IntRect(0, 0, 300, 200), nullptr, 4.0f, &patches);
+  VERIFY(other && other != first);
+  other = ShadowMaskCache::GetBoxShadow(IntRect(0, 0, 300, 200), radii, 5.0f, &patches);
+  VERIFY(other && other != first);
+
+  CacheStats stats = Factory::GetShadowMaskCacheStats();
+  VERIFY(stats.mHits == 1);
+  VERIFY(stats.mMisses == 3);
+  VERIFY(stats.mEntries == 3);
+  Factory::SetShadowMaskCacheSize(0);
+}
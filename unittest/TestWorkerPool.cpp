@@ -0,0 +1,70 @@
+/* -*- Mode: C++; tab-width: 20; indent-tabs-mode: nil; c-basic-offset: 2 -*-
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/. */
+
+#include "TestWorkerPool.h"
+
+#include "WorkerPool.h"
+
+using namespace mozilla;
+using namespace mozilla::gfx;
+
+TestWorkerPool::TestWorkerPool()
+{
+#define TEST_CLASS TestWorkerPool
+  REGISTER_TEST(ParallelForAllIndices);
+  REGISTER_TEST(SerialTaskGroup);
+  REGISTER_TEST(NestedTaskGroups);
+#undef TEST_CLASS
+}
+
+void
+TestWorkerPool::ParallelForAllIndices()
+{
+  WorkerPool pool(4);
+  std::vector<int> hits(1000, 0);
+
+  ParallelFor(&pool, 0, hits.size(), [&] (int32_t aIndex) {
+    hits[aIndex]++;
+  });
+
+  for (size_t i = 0; i < hits.size(); i++) {
+    VERIFY(hits[i] == 1);
+  }
+}
+
+void
+TestWorkerPool::SerialTaskGroup()
+{
+  std::vector<int> order;
+  {
+    TaskGroup group(nullptr);
+    for (int i = 0; i < 10; i++) {
+      group.Dispatch([&order, i] () { order.push_back(i); });
+    }
+  }
+
+  VERIFY(order.size() == 10);
+  for (size_t i = 0; i < order.size(); i++) {
+    VERIFY(order[i] == int(i));
+  }
+}
+
+void
+TestWorkerPool::NestedTaskGroups()
+{
+  // Waiting inside a task must not deadlock, even with a single worker.
+  WorkerPool pool(1);
+  std::atomic<uint32_t> count(0);
+
+  ParallelFor(&pool, 0, 8, [&] (int32_t) {
+    TaskGroup inner(&pool);
+    for (int i = 0; i < 8; i++) {
+      inner.Dispatch([&count] () { count++; });
+    }
+    inner.Wait();
+  });
+
+  VERIFY(count == 64);
+}